@@ -0,0 +1,21 @@
+#version 450 core
+
+// Path nodes in float32, relative to the path origin
+layout (location = 0) in vec2 aPos;
+
+// Stroke width factor, only used by the stroke shader. Without an array bound
+// to it this is the current attribute value.
+layout (location = 1) in float aWidth;
+out float vWidth;
+
+// Path to screen transform, composed per path in double on the CPU. `offset`
+// is the screen position of the path origin, so it stays small while the path
+// is on screen.
+uniform vec4 linear;
+uniform vec2 offset;
+
+void main() {
+    vec2 p = mat2(linear.xy, linear.zw) * aPos + offset;
+    gl_Position = vec4(p, 0.0, 1.0);
+    vWidth = aWidth;
+}
@@ -0,0 +1,70 @@
+#version 450 core
+
+// Coverage of a pixel by the stroke of one bezier segment, from the distance
+// of the pixel center to the curve. The nearest curve parameter is found on a
+// coarse polyline first and refined with Newton iterations.
+
+in vec2 pos;
+flat in vec2 p0, p1, p2, p3;
+flat in int isLast;
+
+out vec4 FragColor;
+
+uniform vec4 color = vec4(1.0, 0.5, 0.2, 1.0);
+uniform float strokeWidth = 2.0;
+
+const int SEARCH_STEPS = 8;
+const int NEWTON_STEPS = 4;
+
+vec2 bezier(float u) {
+    float v = 1.0 - u;
+    return v*v*v*p0 + 3.0*u*v*v*p1 + 3.0*u*u*v*p2 + u*u*u*p3;
+}
+
+vec2 bezierD1(float u) {
+    float v = 1.0 - u;
+    return 3.0*(v*v*(p1 - p0) + 2.0*u*v*(p2 - p1) + u*u*(p3 - p2));
+}
+
+vec2 bezierD2(float u) {
+    return 6.0*((1.0 - u)*(p2 - 2.0*p1 + p0) + u*(p3 - 2.0*p2 + p1));
+}
+
+void main() {
+    // Nearest point on the polyline through SEARCH_STEPS + 1 curve points
+    float t = 0.0;
+    float best = 1e30;
+    vec2 a = p0;
+    for (int i = 1; i <= SEARCH_STEPS; i++) {
+        vec2 b = bezier(float(i) / SEARCH_STEPS);
+        vec2 ab = b - a;
+        float h = clamp(dot(pos - a, ab) / max(dot(ab, ab), 1e-12), 0.0, 1.0);
+        vec2 d = pos - (a + h*ab);
+        if (dot(d, d) < best) {
+            best = dot(d, d);
+            t = (float(i - 1) + h) / SEARCH_STEPS;
+        }
+        a = b;
+    }
+
+    // Minimize |B(t) - pos|^2, root of f(t) = (B - pos) . B'
+    for (int i = 0; i < NEWTON_STEPS; i++) {
+        vec2 r = bezier(t) - pos;
+        vec2 d1 = bezierD1(t);
+        float f = dot(r, d1);
+        float df = dot(d1, d1) + dot(r, bezierD2(t));
+        if (df > 0.0)
+            t = clamp(t - f / df, 0.0, 1.0);
+    }
+
+    // Pixels beyond the end of the segment belong to the next segment, which
+    // draws them with its start. Only the last segment draws the end cap.
+    if (t >= 1.0 && isLast == 0)
+        discard;
+
+    float dist = length(bezier(t) - pos);
+    float coverage = clamp(0.5 * strokeWidth + 0.5 - dist, 0.0, 1.0);
+    if (coverage <= 0.0)
+        discard;
+    FragColor = vec4(color.rgb, color.a * coverage);
+}
@@ -0,0 +1,42 @@
+#version 450 core
+
+// One instance per bezier segment, the control points are read straight from
+// the geometry buffer: instance k gets nodes 3k..3k+3 of the path. Each
+// instance draws a quad covering the control polygon plus the stroke width, the
+// fragment shader computes the distance to the curve.
+
+layout (location = 0) in vec2 aP0;
+layout (location = 1) in vec2 aP1;
+layout (location = 2) in vec2 aP2;
+layout (location = 3) in vec2 aP3;
+
+out vec2 pos;               // Screen position, in pixels
+flat out vec2 p0, p1, p2, p3;
+flat out int isLast;
+
+uniform vec2 viewSize;
+uniform vec4 linear;
+uniform vec2 offset;
+uniform float strokeWidth = 2.0;
+uniform int segmentCount;
+
+const float FRINGE = 1.0;   // Extra pixels for the anti-aliased edge
+
+void main() {
+    mat2 m = mat2(linear.xy, linear.zw);
+    p0 = m * aP0 + offset;
+    p1 = m * aP1 + offset;
+    p2 = m * aP2 + offset;
+    p3 = m * aP3 + offset;
+    isLast = gl_InstanceID == segmentCount - 1 ? 1 : 0;
+
+    // The curve lies within the convex hull of its control points
+    float r = 0.5 * strokeWidth + FRINGE;
+    vec2 lo = min(min(p0, p1), min(p2, p3)) - r;
+    vec2 hi = max(max(p0, p1), max(p2, p3)) + r;
+
+    // Triangle strip corners from the vertex id
+    pos = vec2((gl_VertexID & 1) != 0 ? hi.x : lo.x,
+               (gl_VertexID & 2) != 0 ? hi.y : lo.y);
+    gl_Position = vec4(pos.x*(2/viewSize.x) - 1, -pos.y*(2/viewSize.y) + 1, 0.0, 1.0);
+}
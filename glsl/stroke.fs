@@ -0,0 +1,14 @@
+#version 450 core
+
+in float dist;
+flat in float halfWidth;
+
+out vec4 FragColor;
+
+uniform vec4 color = vec4(1.0, 0.5, 0.2, 1.0);
+
+void main() {
+    // Coverage of the pixel by the stroke, 1px wide falloff at the edges
+    float coverage = clamp(halfWidth + 0.5 - abs(dist), 0.0, 1.0);
+    FragColor = vec4(color.rgb, color.a * coverage);
+}
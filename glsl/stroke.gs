@@ -1,42 +1,51 @@
 #version 450 core
 
-//layout(triangles) in;
+// Expands a flattened path into a stroke. The input is a line strip with
+// adjacency in screen pixels, the first and last point are repeated, which
+// marks the start and end of the stroke. Each invocation draws the segment
+// p1-p2, the join at p1 and the caps.
+
 layout(lines_adjacency) in;
-//layout(lines) in;
-layout(triangle_strip, max_vertices = 16) out;
+layout(triangle_strip, max_vertices = 31) out;
 
-uniform float strokeWidth2;
+in float vWidth[];
 
-const float PI = 3.1415926535897932384626433832795;
-const float PI_2 = 1.57079632679489661923;
+out float dist;         // Signed distance to the center line, in pixels
+flat out float halfWidth;
 
-const mat2 T = mat2(0, -1, 1, 0);
+uniform vec2 viewSize;
+uniform float strokeWidth = 2.0;
+uniform float miterLimit = 10.0;
 
-void HandleStroke(vec2 p0, vec2 p1, float a, float b) {
-    vec2 r = p1 - p0;
-    vec2 n = T * r;
-    vec2 nScaled = strokeWidth2 * normalize(n);
+const float PI = 3.1415926535897932384626433832795;
+const int CAP_STEPS = 4;
+const float FRINGE = 1.0;   // Extra pixels for the anti-aliased edge
 
-    vec2 rn = normalize(r);
+// Outputs are undefined after EmitVertex, so emit() writes them every time
+float hw;
 
-    gl_Position = vec4(p0 + nScaled + rn*a, 0.0, 1.0);
-    EmitVertex();
-    gl_Position = vec4(p0 - nScaled - rn*a, 0.0, 1.0);
-    EmitVertex();
-    gl_Position = vec4(p1 + nScaled - rn*b, 0.0, 1.0);
-    EmitVertex();
+vec2 normal(vec2 d) {
+    return vec2(-d.y, d.x);
+}
 
-    gl_Position = vec4(p1 - nScaled + rn*b, 0.0, 1.0);
+void emit(vec2 p, float d) {
+    gl_Position = vec4(p.x*(2/viewSize.x) - 1, -p.y*(2/viewSize.y) + 1, 0.0, 1.0);
+    dist = d;
+    halfWidth = hw;
     EmitVertex();
-
-    EndPrimitive();
 }
 
-float FindMiterPiece(vec2 r0, vec2 r1) {
-    float psi = PI_2 - acos(dot(r0, r1) / (length(r0) * length(r1)))/2;
-    float a = strokeWidth2 / tan(psi);
-
-    return a;
+// Half disc around `p`, on the side facing away from direction `d`
+void roundCap(vec2 p, vec2 d, float w) {
+    vec2 n = normal(d);
+    for (int i = 0; i < CAP_STEPS; i++) {
+        float a0 = PI * float(i) / CAP_STEPS;
+        float a1 = PI * float(i + 1) / CAP_STEPS;
+        emit(p, 0);
+        emit(p + w*(n*cos(a0) - d*sin(a0)), w);
+        emit(p + w*(n*cos(a1) - d*sin(a1)), w);
+        EndPrimitive();
+    }
 }
 
 void main() {
@@ -45,28 +54,63 @@ void main() {
     vec2 p2 = gl_in[2].gl_Position.xy;
     vec2 p3 = gl_in[3].gl_Position.xy;
 
-    vec2 r0 = p1 - p0;
-    vec2 r1 = p2 - p1;
-    vec2 r2 = p3 - p2;
-
-    // Miter join
-    float a = 0;
-    if (p1 != p2) {
-        a = FindMiterPiece(r0, r1);
+    if (p1 == p2)
+        return;
+
+    float w1 = 0.5 * strokeWidth * vWidth[1];
+    float w2 = 0.5 * strokeWidth * vWidth[2];
+    hw = 0.5 * (w1 + w2);
+    w1 += FRINGE;
+    w2 += FRINGE;
+
+    vec2 d = normalize(p2 - p1);
+    vec2 n = normal(d);
+
+    // The segment ends are offset along the miter direction, so neighbouring
+    // segments meet. Sharp joins fall back to a bevel.
+    vec2 m1 = n;
+    float l1 = w1;
+    bool bevel = false;
+    if (p0 != p1) {
+        vec2 n0 = normal(normalize(p1 - p0));
+        vec2 m = normalize(n0 + n);
+        float c = dot(m, n);
+        if (c > 1.0 / miterLimit) {
+            m1 = m;
+            l1 = w1 / c;
+        } else {
+            bevel = true;
+        }
+
+        if (bevel) {
+            // Fill the gap on the outer side of the turn
+            float side = sign(dot(p2 - p1, n0));
+            emit(p1, 0);
+            emit(p1 - side*w1*n0, w1);
+            emit(p1 - side*w1*n, w1);
+            EndPrimitive();
+        }
+    } else {
+        roundCap(p1, d, w1);
     }
 
-    float b = 0;
+    vec2 m2 = n;
+    float l2 = w2;
     if (p2 != p3) {
-        b = FindMiterPiece(r1, r2);
+        vec2 n2 = normal(normalize(p3 - p2));
+        vec2 m = normalize(n + n2);
+        float c = dot(m, n);
+        if (c > 1.0 / miterLimit) {
+            m2 = m;
+            l2 = w2 / c;
+        }
+    } else {
+        roundCap(p2, -d, w2);
     }
 
-    HandleStroke(p1, p2, a, b);
-
-
-    //for (int i = 0; i < 3; i++) {
-    //    gl_Position = gl_in[i].gl_Position;
-    //    EmitVertex();
-    //}
-
-    //EndPrimitive();
+    emit(p1 + l1*m1, w1);
+    emit(p1 - l1*m1, -w1);
+    emit(p2 + l2*m2, w2);
+    emit(p2 - l2*m2, -w2);
+    EndPrimitive();
 }
@@ -0,0 +1,20 @@
+#version 450 core
+
+// Text from the signed distance field atlas. The outline is at 0.5, the edge
+// is anti-aliased over one screen pixel at any scale.
+
+in vec2 vUV;
+
+out vec4 FragColor;
+
+uniform sampler2D atlas;
+uniform vec4 color = vec4(0.0, 0.0, 0.0, 1.0);
+
+void main() {
+    float d = texture(atlas, vUV / vec2(textureSize(atlas, 0))).r;
+    float w = max(fwidth(d), 1e-4);
+    float coverage = clamp((d - 0.5) / w + 0.5, 0.0, 1.0);
+    if (coverage <= 0.0)
+        discard;
+    FragColor = vec4(color.rgb, color.a * coverage);
+}
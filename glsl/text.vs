@@ -0,0 +1,18 @@
+#version 450 core
+
+// Glyph quads of a text note, in atlas pixels relative to the note origin
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aUV;     // In atlas pixels
+
+out vec2 vUV;
+
+uniform vec2 viewSize;
+// Note to screen transform, composed per note in double on the CPU
+uniform vec4 linear;
+uniform vec2 offset;
+
+void main() {
+    vec2 p = mat2(linear.xy, linear.zw) * aPos + offset;
+    gl_Position = vec4(p.x*(2/viewSize.x) - 1, -p.y*(2/viewSize.y) + 1, 0.0, 1.0);
+    vUV = aUV;
+}
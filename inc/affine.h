@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "vec.h"
+
+// 2D affine transform. Maps a point p to
+//   x' = a*x + c*y + e
+//   y' = b*x + d*y + f
+// (same layout as the nanovg transforms)
+typedef struct affine {
+    double a, b, c, d;
+    double e, f;
+} Affine;
+
+Affine affine_identity(void);
+Affine affine_translate(Vec2 t);
+Affine affine_scale(double s);
+Affine affine_scaleAround(Vec2 center, double s);
+Affine affine_mult(Affine m0, Affine m1);
+Affine affine_inverse(Affine m);
+Vec2 affine_apply(Affine m, Vec2 p);
+Vec2 affine_applyLinear(Affine m, Vec2 v);
+double affine_scaleFactor(Affine m);
+bool affine_isIdentity(Affine m);
+bool affine_isTranslation(Affine m);
@@ -0,0 +1,5 @@
+#pragma once
+
+int bench_flattenMain(int argc, char *argv[]);
+int bench_pickMain(int argc, char *argv[]);
+int bench_geomMain(int argc, char *argv[]);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "path.h"
+
+// Document compaction. Strokes that continue each other (the end of one is
+// near the start of the next, in about the same direction) are merged into
+// one path, so the page has fewer paths and nodes but looks the same. A run
+// of strokes is refitted from its curves with fitCurve at `epsilon` if that
+// takes fewer nodes, else the strokes are joined as they are, the joints moved
+// to the middle of the gaps.
+// A merge is kept only if the result stays within `max_dev` of the strokes.
+// Degenerate segments of the other paths are dropped.
+//
+// Merged paths keep the raw samples of their strokes if all of them had any,
+// so they can still be refitted.
+//
+// `vectornotes compact DIR` compacts all pages of a notebook, the 'C' key the
+// page on screen.
+
+typedef struct compact_options {
+    // Pixels at `scale`, the view scale the result has to look the same at
+    double max_gap;         // Between the end of a stroke and the next
+    double epsilon;         // Fit error of the merged curve
+    double max_dev;         // Max distance of a merged path to its strokes
+    double max_angle;       // Degrees between the directions at a join
+    double scale;
+} CompactOptions;
+
+typedef struct compact_stats {
+    unsigned paths_before;  // Also the draws of the page
+    unsigned paths_after;
+    unsigned long nodes_before;
+    unsigned long nodes_after;
+    size_t bytes_before;    // See notebook_pathBytes
+    size_t bytes_after;
+    unsigned merged;        // Runs of strokes joined into one path
+    unsigned refitted;      // Merged runs that were refitted
+    unsigned rejected;      // Runs kept apart, merging changed their shape
+    unsigned long dropped;  // Degenerate segments removed
+    double max_dev;         // Largest distance of a merged path to its strokes, in pixels
+} CompactStats;
+
+CompactOptions compact_defaultOptions(void);
+unsigned compact_paths(Path **paths, unsigned count, const CompactOptions *opts, CompactStats *stats);
+void compact_addStats(CompactStats *total, const CompactStats *stats);
+void compact_printStats(const CompactStats *stats);
+int compact_main(int argc, char *argv[]);
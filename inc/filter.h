@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "vec.h"
+
+// Streaming input filter chain between the raw input samples and the path.
+// Every sample is pushed through the stages in order, each stage passes on
+// zero or more samples to the next, the last stage feeds the sink. All state
+// is stored inline, pushing samples never allocates.
+//
+// Positions are in screen pixels and times in seconds, so the thresholds do
+// not depend on the zoom level. The first and last sample of a stroke always
+// pass, so a stroke keeps its end points.
+//
+// By default the pencil only decimates, as it always did, so its strokes stay
+// the same. Smoothing and simplification are opt-in, e.g. --filter
+// euro,rdp,decimate.
+
+#define FILTER_MAX_STAGES 4
+#define FILTER_RDP_WINDOW 64    // Max samples between two RDP output samples
+#define FILTER_DEFAULT_SPEC "decimate"
+
+typedef enum filter_type {
+    FILTER_one_euro,    // 1€ filter, speed adaptive low-pass smoothing
+    FILTER_rdp,         // Streaming Ramer-Douglas-Peucker simplification
+    FILTER_decimate,    // Drops samples based on distance and direction
+    FILTER_count,
+} FilterType;
+
+typedef void (*FilterSinkFn)(void *ctx, Vec2 pos);
+
+typedef struct one_euro_filter {
+    double min_cutoff;  // In Hz, smoothing at low speeds
+    double beta;        // Cutoff increase per px/s, less lag at high speeds
+    double d_cutoff;    // In Hz, smoothing of the speed estimate
+
+    Vec2 x;             // Filtered position and speed
+    Vec2 dx;
+    Vec2 raw;           // Last unfiltered sample, placed at the end of the stroke
+    double time;
+} OneEuroFilter;
+
+typedef struct rdp_filter {
+    double epsilon;     // Max distance of a dropped sample to the output, px
+
+    Vec2 anchor;        // Last output sample
+    Vec2 window[FILTER_RDP_WINDOW];
+    unsigned window_cnt;
+} RdpFilter;
+
+typedef struct decimate_filter {
+    double first_len;   // Distance of the second sample, there is no direction yet
+    double min_len;     // Min distance between samples, in px
+    double max_len;     // Extra distance allowed when moving straight on
+    double exponent;    // How fast the distance drops when changing direction
+    double backtrack;   // Moving back this far places a sample
+
+    Vec2 prev;          // Last two output samples, for the direction
+    Vec2 last;
+    double max_dist;    // Max distance to `last` since it was placed
+    Vec2 pending;       // Last dropped sample, placed at the end of the stroke
+    bool has_pending;
+} DecimateFilter;
+
+typedef struct filter_stage {
+    FilterType type;
+    bool started;       // A sample passed this stroke
+    unsigned out_cnt;   // Samples passed on this stroke
+    double time;        // Time of the last sample pushed to this stage
+    union {
+        OneEuroFilter one_euro;
+        RdpFilter rdp;
+        DecimateFilter decimate;
+    };
+} FilterStage;
+
+typedef struct filter_chain {
+    FilterStage stages[FILTER_MAX_STAGES];
+    unsigned stage_cnt;
+
+    FilterSinkFn sink;
+    void *sink_ctx;
+
+    unsigned long in_cnt;   // Samples pushed and passed to the sink, over
+    unsigned long out_cnt;  // all strokes
+} FilterChain;
+
+void filter_init(FilterChain *chain, FilterSinkFn sink, void *sink_ctx);
+FilterStage *filter_add(FilterChain *chain, FilterType type);
+bool filter_parse(FilterChain *chain, const char *spec);
+void filter_begin(FilterChain *chain);
+void filter_push(FilterChain *chain, Vec2 pos, double time);
+void filter_end(FilterChain *chain);
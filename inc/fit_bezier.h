@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "vec.h"
@@ -16,14 +17,40 @@ typedef struct bezier_coeffs {
     double B3;
 } BezierCoeffs;
 
+// Fit parameters. The distances are in screen pixels, they are divided by the
+// view scale when applied (see fit_setParams), so a stroke is fitted with the
+// same accuracy at any zoom level.
+typedef struct fit_params {
+    double corner_thresh;   // Min angle we define as a corner (in rad)
+    double tangent_range;   // Range for point averaging for tangent calcs
+    double epsilon;         // Max allowed error
+    double psi;             // Threshold at which to split the curve
+    unsigned max_iter;      // Max depth for Newton-Raphson iteration
+} FitParams;
+
+// A span of points still to be fitted, see fitBezier
+typedef struct fit_span {
+    Vec2 t1;
+    Vec2 t2;
+    size_t i_start;
+    size_t i_end;
+} FitSpan;
+
+// A context can be reused for any number of strokes with fit_reset. The
+// scratch arrays only grow, so once they fit the longest stroke, fitting does
+// not allocate anymore. The output is the exception, fit_takeOutput hands it
+// off, so the next fit allocates a new one.
 typedef struct bezier_fit_ctx {
     size_t  count;
+    size_t  capacity;       // Of the scratch arrays
 
     Vec2    *points;        // Not malloc'd
     double  *timestamps;    // Not malloc'd
     double  *params;
 
     BezierCoeffs *coeffs;
+    FitSpan *stack;         // Spans still to be fitted
+    size_t  stack_cnt;
 
     double corner_thresh;   // Min angle we define as a corner (in rad)
     double tangent_range;   // Range for point averaging for tangent calcs
@@ -31,12 +58,23 @@ typedef struct bezier_fit_ctx {
     double psi;             // Threshold at which to split curive into multiple
     unsigned max_iter;      // Max depth for Newton-Raphson iteration
 
+    bool debug;             // Record fit errors in the global `dbg` path.
+                            // Not thread safe, so off by default.
+
     Vec2   *new;
     double *new_ts;
     size_t new_cnt;
     size_t new_capacity;
+    size_t new_ts_capacity; // Separate, only `new` is handed off
 } BezierFitCtx;
 
 BezierFitCtx *fit_init(Vec2 points[], size_t count);
+void fit_reset(BezierFitCtx *fit, Vec2 points[], size_t count);
 void fit_deinit(BezierFitCtx *fit);
 void fitCurve(BezierFitCtx *fit);
+Vec2 *fit_takeOutput(BezierFitCtx *fit, size_t *count);
+
+FitParams fit_defaultParams(void);
+void fit_setParams(BezierFitCtx *fit, const FitParams *params, double scale);
+bool fit_loadParams(const char *filename, FitParams *params);
+bool fit_saveParams(const char *filename, const FitParams *params);
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec.h"
+
+// Signed distance field glyph atlas and text notes.
+//
+// Every glyph is rasterized once, as a distance field at FONT_SDF_SIZE pixels
+// per line, into a single atlas. Text is drawn from that atlas at any size
+// and zoom level by thresholding the distance in the fragment shader, so
+// zooming never rasterizes glyphs again. Note layouts are in atlas pixels,
+// the note transform scales them to the note size.
+//
+// Glyphs are packed on shelves. Once the atlas reached its max size, the
+// least recently used shelf that no visible note needs this frame is
+// evicted and reused. Notes remember the shelves (and their generation) they
+// were laid out with, and are laid out again when one of them was evicted.
+
+#define FONT_SDF_SIZE 48.0      // Glyph rasterization size, pixels per line
+#define FONT_SDF_PADDING 6      // Distance field range around a glyph, pixels
+#define FONT_ATLAS_WIDTH 1024
+#define FONT_ATLAS_MAX_HEIGHT 4096
+
+struct stbtt_fontinfo;
+
+typedef struct glyph {
+    int codepoint;          // -1 for an empty hash slot
+    int shelf;              // -1 for empty glyphs, which are never evicted
+    uint16_t x, y, w, h;    // Position in the atlas, w = 0 for empty glyphs
+    float xoff, yoff;       // Top-left of the bitmap relative to the pen
+    float advance;
+} Glyph;
+
+typedef struct font_shelf {
+    unsigned y, h;
+    unsigned x;             // Used width
+    unsigned long last_used;    // Frame the shelf was last needed in
+    unsigned generation;    // Incremented when the shelf is evicted
+} FontShelf;
+
+typedef struct shelf_ref {
+    unsigned shelf;
+    unsigned generation;
+} ShelfRef;
+
+typedef struct font_atlas {
+    struct stbtt_fontinfo *font;
+    uint8_t *font_data;
+    float scale;            // Font units to atlas pixels
+    float ascent;           // In atlas pixels, descent is negative
+    float descent;
+    float line_height;
+
+    // Single channel distance field, grows in height up to `max_height` and
+    // then evicts shelves
+    uint8_t *pixels;
+    unsigned width, height;
+    unsigned max_height;
+    FontShelf *shelves;
+    unsigned shelf_cnt;
+    unsigned shelf_capacity;
+    unsigned long frame;
+    bool full;                  // No space was left in `full_frame`, shelves
+    unsigned long full_frame;   // only free up in a later frame
+
+    // Rows changed since the last upload, and whether the size changed
+    unsigned dirty_y0, dirty_y1;
+    bool resized;
+
+    // Open addressing hash table of all rasterized glyphs
+    Glyph *glyphs;
+    unsigned glyph_cnt;
+    unsigned glyph_capacity;
+
+    // Statistics since init
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long rasterized;
+    unsigned long evictions;    // Shelves
+} FontAtlas;
+
+// Text note, UTF-8 text laid out in atlas pixels. `pos` is the top-left in
+// canvas coordinates, `size` the line height in canvas units.
+typedef struct text_note {
+    char *text;
+    size_t len;
+    size_t capacity;
+
+    Vec2 pos;
+    double size;
+
+    // Layout, 6 vertices (x, y, u, v) per glyph quad, u/v in atlas pixels.
+    // Clear `layout_valid` after changing the text.
+    float *verts;
+    unsigned vert_cnt;
+    unsigned vert_capacity;
+    bool layout_valid;
+    Vec2 bbox_min;          // Bounds of the layout, in atlas pixels
+    Vec2 bbox_max;
+    Vec2 caret;             // Pen position after the last glyph, on the baseline
+
+    // Atlas shelves the layout uses
+    ShelfRef *shelf_refs;
+    unsigned shelf_ref_cnt;
+    unsigned shelf_ref_capacity;
+    bool missing_glyphs;    // The atlas was full, laid out again next frame
+
+    // Location of `verts` in the text buffer, see vn_drawNotes
+    unsigned gpu_offset;
+    bool gpu_valid;
+} TextNote;
+
+bool font_init(FontAtlas *atlas, const char *filename);
+void font_deinit(FontAtlas *atlas);
+const Glyph *font_glyph(FontAtlas *atlas, int codepoint);
+void font_layout(FontAtlas *atlas, TextNote *note);
+void font_beginFrame(FontAtlas *atlas);
+bool font_useNote(FontAtlas *atlas, TextNote *note);
+void font_printStats(const FontAtlas *atlas);
+
+TextNote *font_noteInit(Vec2 pos, double size);
+void font_noteDeinit(TextNote *note);
+void font_noteAppend(TextNote *note, int codepoint);
+bool font_noteBackspace(TextNote *note);
@@ -10,4 +10,16 @@ typedef struct shader {
     GLuint      id;
 } Shader;
 
+// Shader sources embedded at build time, generated from glsl/ by the Makefile.
+// Terminated by an entry with name NULL.
+typedef struct embedded_shader {
+    const char  *name;      // Path relative to the repo root, e.g. "glsl/path.vs"
+    const char  *source;
+} EmbeddedShader;
+
+extern const EmbeddedShader gl_embedded_shaders[];
+
 GLuint gl_createProgram(Shader shaders[]);
+const char *gl_embeddedSource(const char *name);
+GLuint gl_loadProgramBinary(const char *sources[], int count);
+void gl_storeProgramBinary(const char *sources[], int count, GLuint program);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vec.h"
+
+// Reference images on the canvas.
+//
+// Images are decoded by a background loader thread, which also builds a mip
+// pyramid of the image (each level half the size of the previous one, down to
+// a single tile). Every level is cut into square tiles, which the renderer
+// uploads a few at a time, so no frame waits for the decode or for a large
+// upload. The pixels are freed once all tiles are uploaded.
+
+#define IMAGE_TILE_SIZE 256     // Tile size in level pixels, without border
+#define IMAGE_TILE_BORDER 1     // Pixels shared with the neighbour tiles
+#define IMAGE_TILE_TEXELS (IMAGE_TILE_SIZE + 2*IMAGE_TILE_BORDER)
+#define IMAGE_MAX_LEVELS 16
+
+enum image_state {
+    IMAGE_queued,
+    IMAGE_decoding,
+    IMAGE_ready,        // Levels and tiles are valid
+    IMAGE_failed,
+};
+
+typedef struct image_tile {
+    unsigned texture;   // GL texture, 0 until uploaded
+    int vg_image;       // nanovg handle of `texture`
+} ImageTile;
+
+typedef struct image_level {
+    unsigned width, height;
+    unsigned tiles_x, tiles_y;
+    uint8_t *pixels;    // RGBA, NULL once all tiles are uploaded
+    ImageTile *tiles;   // Row major
+} ImageLevel;
+
+typedef struct image {
+    char *filename;
+    Vec2 pos;           // Top-left corner in canvas coordinates
+    double scale;       // Canvas units per image pixel
+    unsigned width, height;
+
+    _Atomic int state;
+    atomic_bool cancelled;  // Freed by the loader when done decoding
+    struct image *next;     // Loader queue
+
+    // Valid once the state is IMAGE_ready
+    ImageLevel levels[IMAGE_MAX_LEVELS];
+    unsigned level_cnt;
+    unsigned tiles_pending; // Tiles not uploaded yet
+} Image;
+
+bool image_isSupported(const char *filename);
+Image *image_load(const char *filename, Vec2 pos, double scale);
+void image_deinit(Image *image);
+void image_copyTile(const Image *image, unsigned level, unsigned tx, unsigned ty, uint8_t *dest);
+void image_tileUploaded(Image *image);
+void image_loaderDeinit(void);
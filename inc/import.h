@@ -0,0 +1,6 @@
+#pragma once
+
+#include "path.h"
+
+Path **import_file(const char *filename, double scale, unsigned *count);
+Path **import_readPolylines(const char *filename, unsigned *count);
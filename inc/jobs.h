@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+// Minimal worker pool for data parallel loops. The pool is created on first
+// use with one thread per core (or $VN_THREADS), the calling thread takes part
+// in the work as well.
+
+typedef void (*JobFn)(void *ctx, size_t begin, size_t end);
+
+void jobs_parallelFor(size_t count, size_t batch, JobFn fn, void *ctx);
+unsigned jobs_threadCount(void);
+void jobs_deinit(void);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+
+// Memory accounting per subsystem. The allocations of a subsystem go through
+// mem_malloc and friends with its tag, which keep the live and peak bytes of
+// every tag. Each block starts with a small header that remembers its size and
+// tag, so blocks must be freed with mem_free, never with free.
+//
+// Memory allocated by others, like GL buffers and textures, is reported with
+// mem_track whenever its size changes.
+//
+// The counters are printed every second while debug mode (D) is on, and on
+// exit.
+
+typedef enum mem_tag {
+    MEM_path,               // Path structs and nodes
+    MEM_fit,                // Fit contexts and their scratch arrays
+    MEM_nvg_commands,       // nanovg contexts and command buffers
+    MEM_nvg_cache,          // nanovg points, paths and vertices, incl. workers
+    MEM_nvg_gl,             // nanovg GL backend calls, paths, vertices, uniforms
+    MEM_gl,                 // GL buffers and textures of the canvas (mem_track)
+    MEM_count,
+} MemTag;
+
+typedef struct mem_stats {
+    size_t live;
+    size_t peak;
+    size_t blocks;          // Live allocations, 0 for tracked memory
+} MemStats;
+
+void *mem_malloc(MemTag tag, size_t size);
+void *mem_calloc(MemTag tag, size_t count, size_t size);
+void *mem_realloc(MemTag tag, void *ptr, size_t size);
+void mem_free(void *ptr);
+void mem_retag(void *ptr, MemTag tag);
+void mem_track(MemTag tag, ptrdiff_t bytes);
+MemStats mem_getStats(MemTag tag);
+size_t mem_totalLive(void);
+void mem_printStats(void);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "path.h"
+
+// Notebook of pages, a directory with one file per page (page-0000.vnp, ...).
+//
+// Pages are loaded on demand. The active page and its neighbours are kept
+// resident, other pages stay resident until the notebook exceeds its memory
+// budget, then the least recently used ones are saved and freed. Opening a
+// notebook or flipping a page never reads more than the pages needed.
+
+#define NOTEBOOK_DEFAULT_BUDGET (256 * 1024 * 1024)
+
+typedef struct page {
+    Path **paths;
+    unsigned path_cnt;
+    unsigned path_capacity;
+
+    bool resident;
+    bool dirty;             // Changed since loaded, saved when evicted
+    size_t bytes;           // Memory of the paths, while resident
+    size_t file_size;       // 0 if the page was never saved
+    unsigned long last_used;
+} Page;
+
+typedef struct notebook {
+    char *dir;
+    Page *pages;
+    unsigned page_cnt;
+    unsigned page_capacity;
+    unsigned active;
+
+    size_t budget;          // Bytes of resident pages
+    size_t resident_bytes;
+    unsigned long clock;
+
+    // Statistics since open
+    unsigned long loads;
+    unsigned long evictions;
+} Notebook;
+
+Notebook *notebook_open(const char *dir, size_t budget);
+bool notebook_close(Notebook *nb);
+Page *notebook_activate(Notebook *nb, unsigned index);
+Page *notebook_load(Notebook *nb, unsigned index);
+void notebook_storeActive(Notebook *nb, Path **paths, unsigned path_cnt, unsigned path_capacity);
+void notebook_markDirty(Notebook *nb);
+void notebook_prefetch(Notebook *nb);
+void notebook_evict(Notebook *nb);
+bool notebook_savePage(Notebook *nb, unsigned index);
+size_t notebook_pathBytes(const Path *path);
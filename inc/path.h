@@ -1,7 +1,11 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdlib.h>
 
+#include "affine.h"
+#include "fit_bezier.h"
+#include "stroke.h"
 #include "vec.h"
 
 
@@ -11,16 +15,84 @@ typedef enum path_type {
 } PathType;
 
 #define PATH_DEFAULT_CAPACITY 512
+#define PATH_G1_ANGLE 15.0      // Max angle in degrees smoothed by path_concat
+
+// Nodes shared by instances of the same geometry (path_instance), e.g. pasted
+// copies. Every instance points `nodes` at the same array and only has its
+// own transform. The last instance frees the array.
+typedef struct path_shared {
+    _Atomic unsigned refs;
+
+    // Upload of the nodes to the GPU geometry buffer, made for the first
+    // instance drawn and reused by the others. Only valid while the buffer
+    // generation is still `gpu_generation`, 0 for none.
+    unsigned gpu_offset;
+    unsigned gpu_generation;
+} PathShared;
+
 typedef struct path {
     PathType    type;
     Vec2        *nodes;
     unsigned    node_cnt;
     unsigned    capacity;
+
+    // Non-NULL if `nodes` is shared with other instances. Call path_unshare
+    // before writing to the nodes directly, the path_* functions do.
+    PathShared  *shared;
+
+    // Bounding box of `nodes` (untransformed). Since a bezier lies within the
+    // convex hull of its control points this also bounds the curve.
+    Vec2        bbox_min;
+    Vec2        bbox_max;
+
+    // Applied at render time, maps `nodes` to canvas coordinates. Moving or
+    // scaling a path only touches this, never the nodes themselves.
+    Affine      transform;
+
+    // Location of the float32 copy of `nodes` in the GPU geometry buffer.
+    // Clear `gpu_valid` after changing the nodes to have them re-uploaded.
+    unsigned    gpu_offset;
+    bool        gpu_valid;
+
+    // Flattened copy in the stroke buffer (RENDERER_stroke), a line strip with
+    // adjacency. `flat_scale` is the path to screen scale it was flattened at,
+    // a `flat_cnt` of 0 means it has to be flattened (again), unless
+    // `flat_empty` is set: it flattened to a single point at that scale.
+    unsigned    flat_offset;
+    unsigned    flat_cnt;
+    double      flat_scale;
+    bool        flat_empty;
+
+    // Raw input samples the path was fitted from, NULL if there are none
+    // (e.g. imported paths and instances). Owned by the path.
+    Stroke      *stroke;
 } Path;
 
 Path* path_init(unsigned count);
+Path* path_adopt(Vec2 *nodes, unsigned count);
 void path_deinit(Path *path);
+Path* path_instance(Path *path);
+void path_unshare(Path *path);
+unsigned path_shareIdentical(Path **paths, unsigned count);
 void path_resize(Path *path, unsigned new_capacity);
 void path_addNode(Path *path, Vec2 node);
+void path_clear(Path *path);
+void path_updateBBox(Path *path);
+void path_getBounds(Path *path, Vec2 *min, Vec2 *max);
+void path_localize(Path *path);
 Vec2* path_getNode(Path *path, int index);
+unsigned path_segmentCount(const Path *path);
+Vec2 path_pointAt(const Path *path, double u);
+void path_subdivide(Path *path, double u);
+void path_trim(Path *path, double u0, double u1);
+Path* path_split(Path *path, double u);
+double path_length(const Path *path, double u);
+double path_positionAt(const Path *path, double length);
+bool path_concat(Path *path, const Path *other, double max_gap);
+void path_setFitParams(const FitParams *params);
+FitParams path_getFitParams(void);
 Path* path_fitBezier(Path *path, double scale);
+void path_freeFitCtx(void);
+Path** path_fitBezierN(Path **paths, unsigned count, double scale);
+bool path_refit(Path *path, double scale);
+unsigned path_refitN(Path **paths, unsigned count, double scale);
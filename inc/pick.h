@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "affine.h"
+#include "path.h"
+#include "vec.h"
+
+// Nearest path queries for hover and tap selection.
+//
+// A bounding volume hierarchy over the curve segments of all paths, in canvas
+// coordinates, finds the candidate segments. The distance to a cubic is where
+// (B(t) - p) . B'(t) changes sign: the roots of this quintic are isolated by
+// subdividing its Bernstein form until the coefficients change sign at most
+// once, then refined with Newton steps like reparameterize in the fitter.
+//
+// The index keeps the transform and nodes of every path it was built from.
+// pick_update rebuilds it when paths were added or refitted, and only refits
+// the bounds when paths were just moved or scaled.
+
+#define PICK_LEAF_SIZE 4
+#define PICK_MAX_DEPTH 64
+
+typedef struct pick_hit {
+    unsigned path;          // Index into the paths of the query
+    unsigned segment;       // Starts at node 3*segment (bezier) or segment (line)
+    double t;               // Curve parameter of the nearest point
+    double dist;            // In canvas units
+    Vec2 point;
+} PickHit;
+
+typedef struct pick_item {
+    Vec2 min, max;          // Bounds of the transformed control points
+    unsigned path;
+    unsigned segment;
+} PickItem;
+
+typedef struct pick_node {
+    Vec2 min, max;
+    unsigned start;         // Leaves: first item, inner nodes: right child
+    unsigned count;         // Items of a leaf, 0 for inner nodes
+} PickNode;
+
+// What the index was built from, per path
+typedef struct pick_key {
+    const Path *path;
+    const Vec2 *nodes;
+    unsigned node_cnt;
+    Affine transform;
+} PickKey;
+
+typedef struct pick_index {
+    PickItem *items;
+    unsigned item_cnt;
+    unsigned item_capacity;
+
+    PickNode *nodes;        // Depth first, the left child follows its parent
+    unsigned node_cnt;
+    unsigned node_capacity;
+
+    PickKey *keys;
+    unsigned key_cnt;
+    unsigned key_capacity;
+
+    // Statistics since init
+    unsigned long builds;
+    unsigned long refits;
+} PickIndex;
+
+PickIndex *pick_init(void);
+void pick_deinit(PickIndex *index);
+void pick_build(PickIndex *index, Path **paths, unsigned count);
+void pick_update(PickIndex *index, Path **paths, unsigned count);
+bool pick_nearest(const PickIndex *index, Path **paths, Vec2 p, double max_dist, PickHit *hit);
+double pick_cubicDistance(const Vec2 c[4], Vec2 p, double *t);
+double pick_lineDistance(Vec2 a, Vec2 b, Vec2 p, double *t);
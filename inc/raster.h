@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "affine.h"
+#include "path.h"
+
+// CPU rasterizer for headless rendering (tests, thumbnails, benchmarks).
+//
+// Paths are stroked like the nanovg setup in vn_update: round caps, miter
+// joins with the nanovg miter limit, flattened to the nanovg tolerance. The
+// stroke outlines are rasterized with exact area coverage in 64x64 tiles, the
+// rows of tiles are rendered in parallel on the worker pool. The result does
+// not depend on the number of threads.
+
+#define RASTER_TILE_SIZE 64
+
+typedef struct raster {
+    uint8_t *pixels;        // RGBA, straight alpha, rows top to bottom
+    unsigned width, height;
+} Raster;
+
+typedef struct raster_style {
+    double stroke_width;    // In pixels
+    double miter_limit;
+    uint8_t color[4];       // RGBA
+} RasterStyle;
+
+Raster *raster_init(unsigned width, unsigned height);
+void raster_deinit(Raster *raster);
+void raster_clear(Raster *raster, const uint8_t color[4]);
+RasterStyle raster_defaultStyle(void);
+void raster_strokePaths(Raster *raster, Path **paths, unsigned count, Affine view,
+        const RasterStyle *style);
+bool raster_writePpm(const Raster *raster, const char *filename);
+int raster_main(int argc, char *argv[]);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "writer.h"
+
+// Input session recording. The GLFW input callbacks of the canvas are logged
+// with their event time to a compact binary file, together with a marker per
+// frame. `vectornotes replay` feeds a recording back without a window, at the
+// recorded pace or as fast as possible, renders every frame with the CPU
+// rasterizer and reports the frame times.
+//
+// Event times are whole microseconds, the canvas uses the same quantized
+// time (vn_eventTime) live and in replay, so a replay takes the exact same
+// steps as the recorded session.
+
+enum record_event_type {
+    RECORD_frame,
+    RECORD_key,
+    RECORD_char,
+    RECORD_cursor,
+    RECORD_button,
+    RECORD_scroll,
+    RECORD_resize,
+    RECORD_drop,
+    RECORD_count,
+};
+
+typedef struct record_event {
+    int type;
+    uint64_t time_us;
+    int key;                // Key, or mouse button
+    int scancode;
+    int action;
+    int mods;
+    unsigned codepoint;
+    double x, y;            // Cursor position, scroll offset or framebuffer size
+    int path_cnt;           // Dropped files, owned by the reader
+    const char **paths;
+} RecordEvent;
+
+typedef struct recorder {
+    FILE *fp;
+    Writer w;
+    uint64_t prev_us;
+    unsigned long events;
+    unsigned long frames;
+} Recorder;
+
+Recorder *record_open(const char *filename, unsigned width, unsigned height, uint64_t start_us);
+bool record_close(Recorder *rec);
+void record_event(Recorder *rec, const RecordEvent *ev);
+int record_replayMain(int argc, char *argv[]);
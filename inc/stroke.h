@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec.h"
+
+typedef struct path Path;
+
+// Compressed archive of the raw input samples of a stroke, kept next to the
+// fitted curve so the stroke can be refitted later (at another scale or with
+// another fit profile).
+//
+// Pencil samples are screen positions mapped to the canvas with the view at
+// capture time, so they lie on the grid `origin + q/scale` with small integer
+// steps q. Samples are stored as zigzag varint deltas of q, which takes 2-3
+// bytes per sample instead of 16. A sample that does not map back exactly
+// (e.g. the view was panned mid-stroke) is stored as raw doubles instead, so
+// decoding always returns the exact original samples.
+typedef struct stroke {
+    uint8_t     *data;
+    size_t      size;           // Bytes in `data`
+    unsigned    sample_cnt;
+    Vec2        view_origin;    // View at capture time
+    double      view_scale;
+} Stroke;
+
+Stroke *stroke_encode(const Vec2 *samples, unsigned count, Vec2 view_origin, double view_scale);
+void stroke_deinit(Stroke *stroke);
+Path *stroke_decode(const Stroke *stroke);
+bool stroke_check(const Stroke *stroke);
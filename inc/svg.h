@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "path.h"
+
+#define SVG_DEFAULT_PRECISION 3
+
+typedef struct svg_options {
+    unsigned    precision;      // Max number of decimals for coordinates
+    double      stroke_width;   // In canvas units
+    const char  *stroke_color;  // Any SVG color, e.g. "#e6140f"
+} SvgOptions;
+
+SvgOptions svg_defaultOptions(void);
+bool svg_export(const char *filename, Path **paths, unsigned path_cnt, const SvgOptions *opts);
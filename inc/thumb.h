@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "notebook.h"
+#include "path.h"
+
+// Page thumbnails for the page grid, a small mip pyramid per page.
+//
+// Thumbnails show the page frame, the canvas area of the initial view, and
+// are rendered offscreen with the CPU rasterizer. Level 0 is split into tiles:
+// adding paths only marks the tiles under them, and only those tiles (and the
+// pixels above them in the smaller levels) are rendered again.
+//
+// The thumbnails of a notebook are kept in DIR/thumbs.vnc, with the content
+// hash of the paths each one shows, so the grid opens without loading pages.
+// Thumbnails of resident pages are checked against the hash of their paths,
+// those of other pages are matched by the size of the page file until the
+// page is loaded.
+
+#define THUMB_PAGE_WIDTH 800.0      // Page frame, in canvas units
+#define THUMB_PAGE_HEIGHT 600.0
+#define THUMB_WIDTH 160             // Level 0, in pixels
+#define THUMB_HEIGHT 120
+#define THUMB_LEVELS 3
+#define THUMB_TILE_SIZE 40          // Level 0 tiles, a multiple of 1 << (THUMB_LEVELS-1)
+#define THUMB_TILES_X (THUMB_WIDTH / THUMB_TILE_SIZE)
+#define THUMB_TILES_Y (THUMB_HEIGHT / THUMB_TILE_SIZE)
+#define THUMB_ALL_TILES ((1u << (THUMB_TILES_X * THUMB_TILES_Y)) - 1)
+#define THUMB_STROKE_WIDTH 1.0      // In level 0 pixels
+#define THUMB_HASH_SEED 0xcbf29ce484222325ull
+
+typedef struct thumb {
+    uint8_t *pixels;        // RGBA, all levels after each other, NULL if none
+    uint64_t hash;          // Of the paths shown, once all dirty tiles are rendered
+    uint64_t file_size;     // Of the page file the cached thumbnail was saved with
+    bool verified;          // `hash` was checked against the paths of the page
+    uint32_t dirty;         // Level 0 tiles to render again, a bit per tile
+    uint32_t stale;         // Tiles rendered since the texture upload
+
+    // Owned by the canvas
+    unsigned texture;
+    int vg_image;
+} Thumb;
+
+typedef struct thumb_cache {
+    char *filename;
+    Thumb *thumbs;          // By page index
+    unsigned thumb_cnt;
+    unsigned thumb_capacity;
+
+    // Statistics since open
+    unsigned long loaded;
+    unsigned long tiles_rendered;
+} ThumbCache;
+
+ThumbCache *thumb_open(const Notebook *nb);
+bool thumb_save(const ThumbCache *cache, const Notebook *nb);
+void thumb_close(ThumbCache *cache);
+Thumb *thumb_get(ThumbCache *cache, unsigned page);
+uint8_t *thumb_level(const Thumb *thumb, unsigned level);
+uint64_t thumb_hashPaths(uint64_t hash, Path **paths, unsigned count);
+void thumb_check(ThumbCache *cache, unsigned page, Path **paths, unsigned count);
+void thumb_addPaths(ThumbCache *cache, unsigned page, Path **paths, unsigned count);
+bool thumb_render(ThumbCache *cache, unsigned page, Path **paths, unsigned count);
@@ -2,6 +2,8 @@
 
 #include <stdbool.h>
 
+#include "nanovg/nanovg.h"
+
 #include "vec.h"
 #include "path.h"
 
@@ -10,10 +12,13 @@
 // toolbar. (maybe)
 typedef enum tools {
     TOOLS_pencil,
+    TOOLS_select,
+    TOOLS_text,
     TOOLS_count,
 } Tools;
 
 typedef struct tool_ctx Tool;
+typedef struct vn_ctx VnCtx;
 
 // TODO: Add ToolType type to differentiate between selection, deletion and
 // creation tools (and more)
@@ -21,10 +26,23 @@ struct tool_ctx {
     void (*mousePosCb)(Tool *tool, Vec2 *mouse_pos, int mouse_states[]);
     void (*mouseBtnCb)(Tool *tool, Vec2 *mouse_pos, int button, int action);
     Path *(*update)(Tool *tool, double scale);
+    void (*draw)(Tool *tool, NVGcontext *vg);     // Optional overlay
+
+    // Optional keyboard input. keyCb returns true if it used the key, which
+    // then does not trigger the global shortcuts.
+    bool (*keyCb)(Tool *tool, int key, int action, int mods);
+    void (*charCb)(Tool *tool, unsigned codepoint);
 
     Path *tmp_path;
     bool tmp_path_ready;
 };
 
-Tool *pencil_init();
+Tool *pencil_init(const char *filter_spec);
 void pencil_deinit(Tool *tool);
+
+Tool *select_init(VnCtx *vn);
+void select_deinit(Tool *tool);
+void select_clear(Tool *tool);
+
+Tool *text_init(VnCtx *vn);
+void text_deinit(Tool *tool);
@@ -0,0 +1,4 @@
+#pragma once
+
+int tune_main(int argc, char *argv[]);
+int tune_benchMain(int argc, char *argv[]);
@@ -7,7 +7,13 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include "affine.h"
+#include "font.h"
+#include "image.h"
+#include "notebook.h"
 #include "path.h"
+#include "record.h"
+#include "thumb.h"
 #include "tool.h"
 #include "vec.h"
 
@@ -20,12 +26,19 @@ typedef struct rgb {
 enum vbo_type {
     VBO_spline,
     VBO_debug,
+    VBO_geometry,
+    VBO_stroke,
+    VBO_text,
     VBO_count,
 };
 
 enum vao_type {
     VAO_spline,
     VAO_debug,
+    VAO_geometry,
+    VAO_stroke,
+    VAO_text,
+    VAO_sdf,        // Instanced segments from VBO_geometry
     VAO_count,
 };
 
@@ -33,10 +46,25 @@ enum shader_type {
     SHADER_simple,
     SHADER_stipple,
     SHADER_debug,
+    SHADER_path,
+    SHADER_stroke,
+    SHADER_sdf,
+    SHADER_text,
     SHADER_count,
 };
 
+enum renderer_type {
+    RENDERER_nanovg,    // Tessellated by nanovg on the CPU every frame
+    RENDERER_gpu,       // Resident float32 geometry, tessellation shaders
+    RENDERER_stroke,    // Flattened once on the CPU, stroked by a geometry shader
+    RENDERER_sdf,       // Quad per segment, distance to the curve per pixel
+    RENDERER_count,
+};
+
 #define NUM_MOUSE_STATES 8
+#define VN_MAX_VG_WORKERS 16
+#define VN_IMAGE_PBO_COUNT 8
+#define VN_MEM_PRINT_INTERVAL 1.0   // Seconds between memory stats in debug mode
 #define DEFAULT_PATH_CAPACITY 8
 typedef struct vn_ctx {
     GLFWwindow *window;
@@ -46,6 +74,51 @@ typedef struct vn_ctx {
     GLuint shaders[SHADER_count];
 
     NVGcontext *vg;
+    int renderer;
+
+    // nanovg worker contexts (RENDERER_nanovg), each tessellates a contiguous
+    // range of the visible paths on its own thread
+    NVGcontext *vg_workers[VN_MAX_VG_WORKERS];
+    unsigned vg_worker_cnt;
+    Path **visible;
+    unsigned visible_capacity;
+
+    // GPU geometry buffer (VBO_geometry), holds the float32 nodes of all
+    // paths. Paths are uploaded once, instances of shared nodes only once for
+    // all of them. The buffer is compacted when it grows.
+    GLuint geom_ebo;            // Shared patch indices, 4 per segment
+    unsigned geom_capacity;     // In vertices
+    unsigned geom_used;
+    unsigned geom_generation;   // Counts the times the content was dropped
+    unsigned geom_segments;     // Segments covered by geom_ebo
+    float *geom_scratch;
+    unsigned geom_scratch_capacity;
+
+    // Stroke buffer (VBO_stroke), flattened paths for the geometry shader
+    // strokes. Managed like the geometry buffer.
+    unsigned flat_capacity;     // In vertices
+    unsigned flat_used;
+
+    // Text notes, drawn from the glyph atlas. The glyph quads of all notes are
+    // kept in the text buffer (VBO_text), managed like the geometry buffer.
+    FontAtlas font;
+    bool font_ready;
+    GLuint font_texture;
+    size_t font_texture_bytes;  // Accounted in MEM_gl
+    TextNote **notes;
+    unsigned note_cnt;
+    unsigned note_capacity;
+    unsigned text_capacity;     // In vertices
+    unsigned text_used;
+
+    // Reference images, drawn below the paths. Tiles are uploaded through a
+    // ring of pixel buffers, a buffer is reused once its fence is signaled.
+    Image **images;
+    unsigned image_cnt;
+    unsigned image_capacity;
+    GLuint image_pbos[VN_IMAGE_PBO_COUNT];
+    GLsync image_fences[VN_IMAGE_PBO_COUNT];
+    unsigned image_pbo_next;
 
     unsigned view_width, view_height;
     Vec2 view_origin;
@@ -55,21 +128,65 @@ typedef struct vn_ctx {
     Vec2 mouse_pos_rc;  // Mouse pos on right-click
     int mouse_states[NUM_MOUSE_STATES];
 
+    // Paths of the canvas. With a notebook open these are the paths of the
+    // active page, handed back to the notebook when flipping pages.
+    // `page_edited` is set by vn_pageEdited until the notebook got the change.
     Path **paths;
     unsigned path_cnt;
     unsigned path_capacity;
+    Notebook *notebook;
+    bool page_edited;
+
+    // Page grid (G), shows the thumbnails of all notebook pages instead of
+    // the canvas
+    ThumbCache *thumbs;
+    bool page_grid;
+    unsigned grid_columns;
+    double grid_scroll;         // In pixels
 
     Tool *tools[TOOLS_count];
     size_t tool_cnt;
     size_t active_tool;
 
+    // Time of the input event being handled, in whole microseconds so it is
+    // the same in a replay of the session. Input is logged to `recorder`
+    // while recording.
+    uint64_t event_us;
+    Recorder *recorder;
+
     bool debug;
+    double mem_print_time;      // Last memory stats printed in debug mode
 } VnCtx;
 
 VnCtx *vn_init(unsigned width, unsigned height);
+VnCtx *vn_initHeadless(unsigned width, unsigned height);
 void vn_deinit(VnCtx *vn);
+void vn_addTools(VnCtx *vn, const char *filter_spec);
+void vn_step(VnCtx *vn);
 void vn_update(VnCtx *vn);
+void vn_handleEvent(VnCtx *vn, const RecordEvent *ev);
+double vn_eventTime(void);
+Path *vn_instancePath(VnCtx *vn, Path *path);
+void vn_addPaths(VnCtx *vn, Path **paths, unsigned count);
+void vn_compact(VnCtx *vn);
+void vn_pageEdited(VnCtx *vn);
+unsigned vn_importFile(VnCtx *vn, const char *filename);
+bool vn_openNotebook(VnCtx *vn, const char *dir, size_t budget);
+bool vn_setPage(VnCtx *vn, unsigned index);
+void vn_drawPageGrid(VnCtx *vn);
+bool vn_loadFont(VnCtx *vn, const char *filename);
+void vn_addNote(VnCtx *vn, TextNote *note);
+void vn_removeNote(VnCtx *vn, TextNote *note);
+Image *vn_addImage(VnCtx *vn, const char *filename, Vec2 pos);
+Affine vn_pathToScreen(VnCtx *vn, Path *path);
+Affine vn_noteToScreen(VnCtx *vn, TextNote *note);
 void vn_drawPath(VnCtx *vn, Path *path);
+void vn_drawPathsNanovg(VnCtx *vn);
+void vn_drawPathsGpu(VnCtx *vn);
+void vn_drawPathsStroke(VnCtx *vn);
+void vn_drawPathsSdf(VnCtx *vn);
+void vn_drawNotes(VnCtx *vn);
+void vn_drawImages(VnCtx *vn);
 void vn_drawLines(VnCtx *vn, Path *path);
 void vn_drawCtrlPoints(VnCtx *vn, Path *path);
 void vn_drawDbgLines(VnCtx *vn, Vec2 *points, size_t count, Rgb color, float linewidth);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Buffered streaming writer. All output goes through a fixed size buffer that
+// is flushed to `fp` whenever it fills up, so memory use does not depend on
+// the amount of data written.
+
+#define WRITER_DEFAULT_CAPACITY (64 * 1024)
+#define WRITER_MAX_PRECISION 15
+
+typedef struct writer {
+    FILE    *fp;
+    char    *buf;
+    size_t  len;
+    size_t  capacity;
+    bool    owns_buf;
+    bool    error;
+    size_t  total;      // Total number of bytes written
+} Writer;
+
+void writer_init(Writer *w, FILE *fp, char *buf, size_t capacity);
+bool writer_deinit(Writer *w);
+bool writer_flush(Writer *w);
+void writer_write(Writer *w, const void *data, size_t len);
+void writer_puts(Writer *w, const char *str);
+void writer_putc(Writer *w, char c);
+void writer_putUint(Writer *w, uint64_t v);
+void writer_putDouble(Writer *w, double v, unsigned precision);
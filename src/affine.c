@@ -0,0 +1,104 @@
+#include <math.h>
+
+#include "affine.h"
+#include "vec.h"
+
+Affine affine_identity(void) {
+    Affine m = {
+        .a = 1.0, .b = 0.0,
+        .c = 0.0, .d = 1.0,
+        .e = 0.0, .f = 0.0,
+    };
+    return m;
+}
+
+Affine affine_translate(Vec2 t) {
+    Affine m = affine_identity();
+    m.e = t.x;
+    m.f = t.y;
+    return m;
+}
+
+Affine affine_scale(double s) {
+    Affine m = affine_identity();
+    m.a = s;
+    m.d = s;
+    return m;
+}
+
+/**
+ * Uniform scale by `s` which keeps `center` in place.
+ */
+Affine affine_scaleAround(Vec2 center, double s) {
+    Affine m = affine_scale(s);
+    m.e = center.x - s*center.x;
+    m.f = center.y - s*center.y;
+    return m;
+}
+
+/**
+ * Returns m0 * m1, i.e. the transform that first applies m1 and then m0.
+ */
+Affine affine_mult(Affine m0, Affine m1) {
+    Affine m = {
+        .a = m0.a*m1.a + m0.c*m1.b,
+        .b = m0.b*m1.a + m0.d*m1.b,
+        .c = m0.a*m1.c + m0.c*m1.d,
+        .d = m0.b*m1.c + m0.d*m1.d,
+        .e = m0.a*m1.e + m0.c*m1.f + m0.e,
+        .f = m0.b*m1.e + m0.d*m1.f + m0.f,
+    };
+    return m;
+}
+
+Affine affine_inverse(Affine m) {
+    double det = m.a*m.d - m.b*m.c;
+    if (det == 0.0)
+        return affine_identity();
+
+    double inv = 1.0 / det;
+    Affine out = {
+        .a =  m.d * inv,
+        .b = -m.b * inv,
+        .c = -m.c * inv,
+        .d =  m.a * inv,
+    };
+    out.e = -(out.a*m.e + out.c*m.f);
+    out.f = -(out.b*m.e + out.d*m.f);
+    return out;
+}
+
+Vec2 affine_apply(Affine m, Vec2 p) {
+    Vec2 out = {
+        .x = m.a*p.x + m.c*p.y + m.e,
+        .y = m.b*p.x + m.d*p.y + m.f,
+    };
+    return out;
+}
+
+/**
+ * Applies only the linear part (no translation), for direction vectors.
+ */
+Vec2 affine_applyLinear(Affine m, Vec2 v) {
+    Vec2 out = {
+        .x = m.a*v.x + m.c*v.y,
+        .y = m.b*v.x + m.d*v.y,
+    };
+    return out;
+}
+
+/**
+ * Average scale factor of the transform (sqrt of the determinant).
+ */
+double affine_scaleFactor(Affine m) {
+    return sqrt(fabs(m.a*m.d - m.b*m.c));
+}
+
+bool affine_isIdentity(Affine m) {
+    return m.a == 1.0 && m.b == 0.0 && m.c == 0.0 && m.d == 1.0
+        && m.e == 0.0 && m.f == 0.0;
+}
+
+bool affine_isTranslation(Affine m) {
+    return m.a == 1.0 && m.b == 0.0 && m.c == 0.0 && m.d == 1.0;
+}
@@ -0,0 +1,709 @@
+// Rendering benchmarks, run from the command line:
+//
+//   vectornotes flattenbench CORPUS [--repeat N]
+//   vectornotes pickbench CORPUS [--segments N] [--queries N]
+//   vectornotes geombench CORPUS [--repeat N]
+//
+// CORPUS is a polyline file (as printed by the 'P' key). The strokes are
+// fitted once, then `flattenbench` flattens the curves with both nanovg curve
+// tessellation modes (see nvgCurveTessellation) at several zoom levels. It
+// reports the points generated, the CPU time and the max and mean distance of
+// the true curve to the polyline, in screen pixels.
+//
+// `pickbench` tiles copies of the corpus until the document has N curve
+// segments, then times building and refitting the pick index and nearest path
+// queries at random points. A sample of the queries is checked against a
+// search over all segments.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "nanovg/nanovg.h"
+
+#include "affine.h"
+#include "bench.h"
+#include "import.h"
+#include "mem.h"
+#include "path.h"
+#include "pick.h"
+#include "vec.h"
+
+#define BENCH_CURVE_STEPS 64    // Samples per curve segment for the deviation
+
+#define BENCH_PICK_CHECKS 200    // Queries checked against all segments
+#define BENCH_PICK_RADIUS 8.0    // Hover radius, in corpus units
+
+static const double BENCH_SCALES[] = { 1, 4, 16 };
+#define BENCH_SCALE_CNT (sizeof(BENCH_SCALES) / sizeof(BENCH_SCALES[0]))
+
+static const char *BENCH_TESS_NAMES[] = {
+    [NVG_TESS_SUBDIVIDE] = "subdivide",
+    [NVG_TESS_FORWARD] = "forward",
+};
+
+typedef struct flatten_stats {
+    unsigned long points;
+    double max_dev;     // In pixels
+    double mean_dev;
+    double time;        // CPU time of all repetitions, in seconds
+} FlattenStats;
+
+// Polyline of the last nvgFill, collected by the null back-end
+typedef struct null_renderer {
+    bool collect;
+    Vec2 *verts;
+    unsigned vert_cnt;
+    unsigned vert_capacity;
+    unsigned long points;
+} NullRenderer;
+
+static double cpuTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int nullCreate(void *uptr) { return 1; }
+static int nullCreateTexture(void *uptr, int type, int w, int h, int flags,
+        const unsigned char *data) { return 1; }
+static int nullDeleteTexture(void *uptr, int image) { return 1; }
+static void nullViewport(void *uptr, float w, float h, float ratio) {}
+static void nullCancel(void *uptr) {}
+static void nullFlush(void *uptr) {}
+static void nullDelete(void *uptr) {}
+
+static void nullFill(void *uptr, NVGpaint *paint, NVGcompositeOperationState op,
+        NVGscissor *scissor, float fringe, const float *bounds,
+        const NVGpath *paths, int npaths) {
+    NullRenderer *r = uptr;
+    r->vert_cnt = 0;
+
+    for (int i = 0; i < npaths; i++) {
+        r->points += paths[i].nfill;
+        if (!r->collect)
+            continue;
+
+        if (r->vert_cnt + paths[i].nfill > r->vert_capacity) {
+            r->vert_capacity = (r->vert_cnt + paths[i].nfill) * 2;
+            r->verts = realloc(r->verts, r->vert_capacity * sizeof(Vec2));
+            assert(r->verts != NULL);
+        }
+        for (int j = 0; j < paths[i].nfill; j++) {
+            r->verts[r->vert_cnt++] = (Vec2){ paths[i].fill[j].x, paths[i].fill[j].y };
+        }
+    }
+}
+
+/**
+ * A nanovg context that renders nothing. Without anti-aliasing the fill
+ * vertices of a path are exactly its flattened points.
+ */
+static NVGcontext *createNullContext(NullRenderer *r) {
+    NVGparams params = {
+        .userPtr = r,
+        .edgeAntiAlias = 0,
+        .renderCreate = nullCreate,
+        .renderCreateTexture = nullCreateTexture,
+        .renderDeleteTexture = nullDeleteTexture,
+        .renderViewport = nullViewport,
+        .renderCancel = nullCancel,
+        .renderFlush = nullFlush,
+        .renderFill = nullFill,
+        .renderDelete = nullDelete,
+    };
+    return nvgCreateInternal(&params);
+}
+
+static void screenCurve(Path *path, double scale, Vec2 *out) {
+    Affine m = affine_mult(affine_scale(scale), path->transform);
+    for (unsigned i = 0; i < path->node_cnt; i++)
+        out[i] = affine_apply(m, path->nodes[i]);
+}
+
+/**
+ * Same commands as vn_drawPath, but filled so the polyline can be read back.
+ */
+static void fillCurve(NVGcontext *vg, Vec2 *curve, unsigned count) {
+    nvgBeginPath(vg);
+    nvgMoveTo(vg, curve[0].x, curve[0].y);
+    for (unsigned j = 1; j + 2 < count; j += 3) {
+        nvgBezierTo(vg,
+                curve[j].x, curve[j].y,
+                curve[j+1].x, curve[j+1].y,
+                curve[j+2].x, curve[j+2].y);
+    }
+    nvgFill(vg);
+}
+
+static double segmentDistSqr(Vec2 p, Vec2 a, Vec2 b) {
+    Vec2 ab = vec2_sub(b, a);
+    double len_sqr = vec2_dot(ab, ab);
+    double t = len_sqr > 0 ? vec2_dot(vec2_sub(p, a), ab) / len_sqr : 0;
+    t = fmin(fmax(t, 0.0), 1.0);
+    return vec2_distSqr(p, vec2_add(a, vec2_scalarMult(ab, t)));
+}
+
+static Vec2 bezier(Vec2 *v, double u) {
+    double omu = 1 - u;
+    Vec2 p = vec2_scalarMult(v[0], omu*omu*omu);
+    p = vec2_add(p, vec2_scalarMult(v[1], 3*u*omu*omu));
+    p = vec2_add(p, vec2_scalarMult(v[2], 3*u*u*omu));
+    return vec2_add(p, vec2_scalarMult(v[3], u*u*u));
+}
+
+/**
+ * Distance of the densely sampled curve to the polyline, over all its
+ * segments. A segment is skipped if its bounds are farther than the best so
+ * far, which starts at the segment nearest to the previous sample.
+ */
+static void curveDeviation(Vec2 *curve, unsigned count, Vec2 *poly, unsigned poly_cnt,
+        double *max_sqr, double *sum, unsigned long *samples) {
+    if (poly_cnt < 2)
+        return;
+
+    size_t hint = 0;
+    for (unsigned j = 0; j + 3 < count; j += 3) {
+        for (int k = 0; k < BENCH_CURVE_STEPS; k++) {
+            Vec2 p = bezier(&curve[j], (double)k / BENCH_CURVE_STEPS);
+
+            double best = segmentDistSqr(p, poly[hint], poly[hint+1]);
+            for (size_t s = 0; s + 1 < poly_cnt; s++) {
+                Vec2 a = poly[s], b = poly[s+1];
+                double dx = fmax(fmin(a.x, b.x) - p.x, p.x - fmax(a.x, b.x));
+                double dy = fmax(fmin(a.y, b.y) - p.y, p.y - fmax(a.y, b.y));
+                if ((dx > 0 && dx*dx >= best) || (dy > 0 && dy*dy >= best) || s == hint)
+                    continue;
+
+                double d = segmentDistSqr(p, a, b);
+                if (d < best) {
+                    best = d;
+                    hint = s;
+                }
+            }
+
+            *max_sqr = fmax(*max_sqr, best);
+            *sum += sqrt(best);
+            (*samples)++;
+        }
+    }
+}
+
+static void flattenCorpus(NVGcontext *vg, NullRenderer *r, Path **paths, unsigned count,
+        double scale, unsigned repeat, FlattenStats *stats) {
+    unsigned max_nodes = 0;
+    for (unsigned i = 0; i < count; i++)
+        if (paths[i]->node_cnt > max_nodes)
+            max_nodes = paths[i]->node_cnt;
+
+    Vec2 *curve = malloc((max_nodes > 0 ? max_nodes : 1) * sizeof(Vec2));
+    assert(curve != NULL);
+
+    // Timed run, the curves are transformed up front like vn_drawPath does
+    // before the nanovg calls
+    r->collect = false;
+    r->points = 0;
+    double start = cpuTime();
+    for (unsigned n = 0; n < repeat; n++) {
+        nvgBeginFrame(vg, 1, 1, 1);
+        for (unsigned i = 0; i < count; i++) {
+            screenCurve(paths[i], scale, curve);
+            fillCurve(vg, curve, paths[i]->node_cnt);
+        }
+        nvgEndFrame(vg);
+    }
+    stats->time = cpuTime() - start;
+    stats->points = r->points / repeat;
+
+    // Untimed run for the deviation
+    double max_sqr = 0, sum = 0;
+    unsigned long samples = 0;
+    r->collect = true;
+    nvgBeginFrame(vg, 1, 1, 1);
+    for (unsigned i = 0; i < count; i++) {
+        screenCurve(paths[i], scale, curve);
+        fillCurve(vg, curve, paths[i]->node_cnt);
+        curveDeviation(curve, paths[i]->node_cnt, r->verts, r->vert_cnt,
+                &max_sqr, &sum, &samples);
+    }
+    nvgEndFrame(vg);
+
+    stats->max_dev = sqrt(max_sqr);
+    stats->mean_dev = samples ? sum / samples : 0;
+
+    free(curve);
+}
+
+/**
+ * Reads and fits the strokes of a polyline corpus.
+ */
+static Path **loadCorpus(const char *corpus, unsigned *count, unsigned long *segments) {
+    unsigned stroke_cnt;
+    Path **strokes = import_readPolylines(corpus, &stroke_cnt);
+    if (!strokes)
+        return NULL;
+
+    // Fitting needs at least two samples
+    unsigned n = 0;
+    for (unsigned i = 0; i < stroke_cnt; i++) {
+        if (strokes[i]->node_cnt > 1)
+            strokes[n++] = strokes[i];
+        else
+            path_deinit(strokes[i]);
+    }
+
+    Path **paths = path_fitBezierN(strokes, n, 1.0);
+    *segments = 0;
+    for (unsigned i = 0; i < n; i++) {
+        *segments += paths[i]->node_cnt / 3;
+        path_deinit(strokes[i]);
+    }
+    free(strokes);
+    *count = n;
+    return paths;
+}
+
+int bench_flattenMain(int argc, char *argv[]) {
+    const char *corpus = NULL;
+    unsigned repeat = 20;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i+1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            corpus = argv[i];
+        }
+    }
+    if (!corpus || repeat == 0) {
+        printf("Usage: vectornotes flattenbench CORPUS [--repeat N]\n");
+        return 1;
+    }
+
+    unsigned count;
+    unsigned long segments;
+    Path **paths = loadCorpus(corpus, &count, &segments);
+    if (!paths)
+        return 1;
+    printf("Corpus: %u paths, %lu curve segments, %u repetitions\n", count, segments, repeat);
+
+    NullRenderer r = {0};
+    NVGcontext *vg = createNullContext(&r);
+    if (!vg) {
+        printf("Error(Bench): Could not create the nanovg context\n");
+        return 1;
+    }
+
+    printf("%-10s %6s %10s %10s %10s %10s\n",
+            "mode", "scale", "points", "max px", "mean px", "time ms");
+    for (unsigned s = 0; s < BENCH_SCALE_CNT; s++) {
+        FlattenStats base = {0};
+        for (int mode = NVG_TESS_SUBDIVIDE; mode <= NVG_TESS_FORWARD; mode++) {
+            FlattenStats stats = {0};
+            nvgCurveTessellation(vg, mode);
+            flattenCorpus(vg, &r, paths, count, BENCH_SCALES[s], repeat, &stats);
+
+            printf("%-10s %6.0f %10lu %10.3f %10.3f %10.2f",
+                    BENCH_TESS_NAMES[mode], BENCH_SCALES[s], stats.points,
+                    stats.max_dev, stats.mean_dev, stats.time * 1000 / repeat);
+            if (mode == NVG_TESS_SUBDIVIDE) {
+                base = stats;
+                printf("\n");
+            } else {
+                printf("   points %+.1f%%, time %+.1f%%\n",
+                        base.points ? 100.0 * ((double)stats.points / base.points - 1) : 0,
+                        base.time > 0 ? 100.0 * (stats.time / base.time - 1) : 0);
+            }
+        }
+    }
+
+    nvgDeleteInternal(vg);
+    free(r.verts);
+    for (unsigned i = 0; i < count; i++)
+        path_deinit(paths[i]);
+    free(paths);
+    return 0;
+}
+
+static double randomUnit(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Nearest segment by testing all of them, and the distance to it by sampling
+ * the curve densely, to check the index and the curve solver.
+ */
+static double nearestBruteForce(Path **paths, unsigned count, Vec2 p,
+        PickHit *hit, double *sampled) {
+    double best = INFINITY;
+    for (unsigned i = 0; i < count; i++) {
+        const Path *path = paths[i];
+        for (unsigned s = 0; 3*s + 3 < path->node_cnt; s++) {
+            Vec2 c[4];
+            for (int k = 0; k < 4; k++)
+                c[k] = affine_apply(path->transform, path->nodes[3*s + k]);
+
+            double t;
+            double d = pick_cubicDistance(c, p, &t);
+            if (d < best) {
+                best = d;
+                hit->path = i;
+                hit->segment = s;
+                hit->t = t;
+
+                *sampled = INFINITY;
+                for (int k = 0; k <= 4 * BENCH_CURVE_STEPS; k++)
+                    *sampled = fmin(*sampled,
+                            vec2_dist(bezier(c, (double)k / (4 * BENCH_CURVE_STEPS)), p));
+            }
+        }
+    }
+    hit->dist = best;
+    return best;
+}
+
+int bench_pickMain(int argc, char *argv[]) {
+    const char *corpus = NULL;
+    unsigned long target = 100000;
+    unsigned queries = 100000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--segments") == 0 && i+1 < argc) {
+            target = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--queries") == 0 && i+1 < argc) {
+            queries = atoi(argv[++i]);
+        } else {
+            corpus = argv[i];
+        }
+    }
+    if (!corpus || queries == 0) {
+        printf("Usage: vectornotes pickbench CORPUS [--segments N] [--queries N]\n");
+        return 1;
+    }
+
+    unsigned corpus_cnt;
+    unsigned long corpus_segments;
+    Path **corpus_paths = loadCorpus(corpus, &corpus_cnt, &corpus_segments);
+    if (!corpus_paths)
+        return 1;
+    if (corpus_segments == 0) {
+        printf("Error(Bench): No curves in %s\n", corpus);
+        return 1;
+    }
+
+    Vec2 cmin = { DBL_MAX, DBL_MAX };
+    Vec2 cmax = { -DBL_MAX, -DBL_MAX };
+    for (unsigned i = 0; i < corpus_cnt; i++) {
+        Vec2 min, max;
+        path_getBounds(corpus_paths[i], &min, &max);
+        cmin = (Vec2){ fmin(cmin.x, min.x), fmin(cmin.y, min.y) };
+        cmax = (Vec2){ fmax(cmax.x, max.x), fmax(cmax.y, max.y) };
+    }
+    Vec2 size = vec2_sub(cmax, cmin);
+
+    // Copies of the corpus on a square grid
+    unsigned copies = (target + corpus_segments - 1) / corpus_segments;
+    unsigned columns = (unsigned)ceil(sqrt(copies));
+    unsigned count = copies * corpus_cnt;
+    Path **paths = malloc(count * sizeof(Path *));
+    assert(paths != NULL);
+    unsigned long segments = 0;
+    for (unsigned n = 0; n < copies; n++) {
+        Vec2 offset = { (n % columns) * size.x, (n / columns) * size.y };
+        for (unsigned i = 0; i < corpus_cnt; i++) {
+            const Path *src = corpus_paths[i];
+            Vec2 *nodes = mem_malloc(MEM_path, src->node_cnt * sizeof(Vec2));
+            assert(nodes != NULL);
+            memcpy(nodes, src->nodes, src->node_cnt * sizeof(Vec2));
+
+            Path *path = path_adopt(nodes, src->node_cnt);
+            path->type = src->type;
+            path->transform = affine_mult(affine_translate(offset), src->transform);
+            paths[n * corpus_cnt + i] = path;
+            segments += src->node_cnt / 3;
+        }
+    }
+    Vec2 doc_min = cmin;
+    Vec2 doc_max = vec2_add(cmin, (Vec2){ columns * size.x, ((copies + columns - 1) / columns) * size.y });
+    printf("Document: %u paths, %lu curve segments (%u copies of the corpus)\n",
+            count, segments, copies);
+
+    PickIndex *index = pick_init();
+    double start = cpuTime();
+    pick_build(index, paths, count);
+    double build_time = cpuTime() - start;
+    printf("Build: %.2f ms, %u nodes\n", build_time * 1000, index->node_cnt);
+
+    // Move every tenth path, like dragging a selection
+    for (unsigned i = 0; i < count; i += 10)
+        paths[i]->transform = affine_mult(affine_translate((Vec2){ 1, 1 }), paths[i]->transform);
+    start = cpuTime();
+    pick_update(index, paths, count);
+    double refit_time = cpuTime() - start;
+    printf("Refit: %.2f ms (%lu refits, %lu builds)\n",
+            refit_time * 1000, index->refits, index->builds);
+
+    // Hover queries within a radius, and unbounded ones which always hit
+    static const double RADII[] = { BENCH_PICK_RADIUS, INFINITY };
+    for (unsigned r = 0; r < sizeof(RADII) / sizeof(RADII[0]); r++) {
+        uint64_t state = 0x9e3779b97f4a7c15ull;
+        unsigned hits = 0;
+        double sum = 0;
+        start = cpuTime();
+        for (unsigned q = 0; q < queries; q++) {
+            Vec2 p = {
+                doc_min.x + randomUnit(&state) * (doc_max.x - doc_min.x),
+                doc_min.y + randomUnit(&state) * (doc_max.y - doc_min.y),
+            };
+            PickHit hit;
+            if (pick_nearest(index, paths, p, RADII[r], &hit)) {
+                hits++;
+                sum += hit.dist;
+            }
+        }
+        double time = cpuTime() - start;
+        printf("Radius %-8.0f %8.3f us/query, %u of %u hit, mean distance %.3f\n",
+                RADII[r], time * 1e6 / queries, hits, queries, hits ? sum / hits : 0);
+    }
+
+    // Check a sample against all segments
+    uint64_t state = 0x2545f4914f6cdd1dull;
+    unsigned mismatches = 0;
+    double max_error = 0;
+    for (unsigned q = 0; q < BENCH_PICK_CHECKS; q++) {
+        Vec2 p = {
+            doc_min.x + randomUnit(&state) * (doc_max.x - doc_min.x),
+            doc_min.y + randomUnit(&state) * (doc_max.y - doc_min.y),
+        };
+        PickHit hit, ref;
+        double sampled = 0;
+        nearestBruteForce(paths, count, p, &ref, &sampled);
+        if (!pick_nearest(index, paths, p, INFINITY, &hit) || fabs(hit.dist - ref.dist) > 1e-9)
+            mismatches++;
+        // Sampling can only find a point farther away than the true nearest
+        max_error = fmax(max_error, ref.dist - sampled);
+    }
+    printf("Checked %u queries: %u mismatches, solver %.2e above sampled distance\n",
+            BENCH_PICK_CHECKS, mismatches, max_error);
+
+    pick_deinit(index);
+    for (unsigned i = 0; i < count; i++)
+        path_deinit(paths[i]);
+    free(paths);
+    for (unsigned i = 0; i < corpus_cnt; i++)
+        path_deinit(corpus_paths[i]);
+    free(corpus_paths);
+    return mismatches == 0 ? 0 : 1;
+}
+
+typedef struct geom_bench {
+    Path **paths;
+    unsigned count;
+    Path *work;
+    unsigned repeat;
+    double max_error;
+    double sink;        // Keeps the results of pure ops alive
+} GeomBench;
+
+typedef void (*GeomOp)(GeomBench *bench, const Path *src);
+
+static void copyPath(Path *dst, const Path *src) {
+    memcpy(dst->nodes, src->nodes, src->node_cnt * sizeof(Vec2));
+    dst->node_cnt = src->node_cnt;
+    dst->type = src->type;
+    dst->transform = src->transform;
+}
+
+static double relError(double value, double expected) {
+    return fabs(value - expected) / fmax(fabs(expected), 1.0);
+}
+
+// Every op works on a copy of `src` at a position inside its middle segment
+static double midPosition(const Path *src) {
+    return path_segmentCount(src) / 2 + 0.37;
+}
+
+static void opCopy(GeomBench *b, const Path *src) {
+    copyPath(b->work, src);
+}
+
+static void opSubdivide(GeomBench *b, const Path *src) {
+    copyPath(b->work, src);
+    path_subdivide(b->work, midPosition(src));
+}
+
+static void checkSubdivide(GeomBench *b, const Path *src) {
+    double u = midPosition(src);
+    opSubdivide(b, src);
+    unsigned stride = src->type == PATHTYPE_bezier ? 3 : 1;
+    Vec2 node = b->work->nodes[stride * ((unsigned)u + 1)];
+    b->max_error = fmax(b->max_error, vec2_dist(node, path_pointAt(src, u)));
+    b->max_error = fmax(b->max_error, relError(path_length(b->work, INFINITY),
+            path_length(src, INFINITY)));
+}
+
+static void opTrim(GeomBench *b, const Path *src) {
+    copyPath(b->work, src);
+    path_trim(b->work, 0.25 * path_segmentCount(src), midPosition(src));
+}
+
+static void checkTrim(GeomBench *b, const Path *src) {
+    double u0 = 0.25 * path_segmentCount(src);
+    double u1 = midPosition(src);
+    opTrim(b, src);
+    b->max_error = fmax(b->max_error, vec2_dist(b->work->nodes[0], path_pointAt(src, u0)));
+    b->max_error = fmax(b->max_error, vec2_dist(*path_getNode(b->work, -1), path_pointAt(src, u1)));
+    b->max_error = fmax(b->max_error, relError(path_length(b->work, INFINITY),
+            path_length(src, u1) - path_length(src, u0)));
+}
+
+static void opSplit(GeomBench *b, const Path *src) {
+    copyPath(b->work, src);
+    path_deinit(path_split(b->work, midPosition(src)));
+}
+
+/**
+ * Splits and joins the halves again, which must give the same curve.
+ */
+static void checkSplit(GeomBench *b, const Path *src) {
+    copyPath(b->work, src);
+    Path *tail = path_split(b->work, midPosition(src));
+    double total = path_length(src, INFINITY);
+    b->max_error = fmax(b->max_error, relError(path_length(b->work, INFINITY)
+            + path_length(tail, INFINITY), total));
+
+    path_concat(b->work, tail, 0.0);
+    b->max_error = fmax(b->max_error, relError(path_length(b->work, INFINITY), total));
+    path_deinit(tail);
+}
+
+static void opConcat(GeomBench *b, const Path *src) {
+    copyPath(b->work, src);
+    path_concat(b->work, src, 1.0);
+}
+
+static void checkConcat(GeomBench *b, const Path *src) {
+    opConcat(b, src);
+    // The copy starts where the path started, so a bridge was added
+    double bridge = vec2_dist(*path_getNode((Path *)src, -1), src->nodes[0]);
+    b->max_error = fmax(b->max_error, relError(path_length(b->work, INFINITY),
+            2 * path_length(src, INFINITY) + bridge));
+}
+
+static void opLength(GeomBench *b, const Path *src) {
+    b->sink += path_length(src, INFINITY);
+}
+
+static void opPosition(GeomBench *b, const Path *src) {
+    b->sink += path_positionAt(src, 0.5 * path_length(src, INFINITY));
+}
+
+static void checkPosition(GeomBench *b, const Path *src) {
+    double u = midPosition(src);
+    double len = path_length(src, u);
+    b->max_error = fmax(b->max_error, fabs(path_positionAt(src, len) - u));
+}
+
+/**
+ * CPU time of `op` on all paths, per path and repetition.
+ */
+static double timeOp(GeomBench *b, GeomOp op) {
+    double start = cpuTime();
+    for (unsigned n = 0; n < b->repeat; n++)
+        for (unsigned i = 0; i < b->count; i++)
+            op(b, b->paths[i]);
+    return (cpuTime() - start) / ((double)b->repeat * b->count);
+}
+
+int bench_geomMain(int argc, char *argv[]) {
+    const char *corpus = NULL;
+    unsigned repeat = 200;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i+1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else {
+            corpus = argv[i];
+        }
+    }
+    if (!corpus || repeat == 0) {
+        printf("Usage: vectornotes geombench CORPUS [--repeat N]\n");
+        return 1;
+    }
+
+    unsigned count;
+    unsigned long segments;
+    Path **paths = loadCorpus(corpus, &count, &segments);
+    if (!paths)
+        return 1;
+
+    // Paths with a middle segment to work on
+    unsigned max_nodes = 0;
+    unsigned n = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (path_segmentCount(paths[i]) < 2) {
+            path_deinit(paths[i]);
+            continue;
+        }
+        if (paths[i]->node_cnt > max_nodes)
+            max_nodes = paths[i]->node_cnt;
+        paths[n++] = paths[i];
+    }
+    printf("Corpus: %u paths, %lu curve segments, %u repetitions\n", n, segments, repeat);
+
+    GeomBench b = {
+        .paths = paths,
+        .count = n,
+        .work = path_init(2 * max_nodes + 8),
+        .repeat = repeat,
+    };
+
+    static const struct {
+        const char *name;
+        GeomOp op;
+        GeomOp check;
+        const char *error;
+    } OPS[] = {
+        { "subdivide", opSubdivide, checkSubdivide, "node/length" },
+        { "trim", opTrim, checkTrim, "ends/length" },
+        { "split", opSplit, checkSplit, "rel length" },
+        { "concat", opConcat, checkConcat, "rel length" },
+        { "length", opLength, NULL, NULL },
+        { "position", opPosition, checkPosition, "position" },
+    };
+
+    double copy = timeOp(&b, opCopy);
+    printf("%-10s %10s %12s %s\n", "op", "ns/path", "max error", "");
+    for (unsigned i = 0; i < sizeof(OPS) / sizeof(OPS[0]); i++) {
+        double time = timeOp(&b, OPS[i].op);
+        if (OPS[i].op != opLength && OPS[i].op != opPosition)
+            time -= copy;
+
+        b.max_error = 0;
+        if (OPS[i].check)
+            for (unsigned j = 0; j < n; j++)
+                OPS[i].check(&b, paths[j]);
+
+        printf("%-10s %10.1f", OPS[i].name, time * 1e9);
+        if (OPS[i].check)
+            printf(" %12.2e %s\n", b.max_error, OPS[i].error);
+        else
+            printf("\n");
+    }
+
+    path_deinit(b.work);
+    for (unsigned i = 0; i < n; i++)
+        path_deinit(paths[i]);
+    free(paths);
+    return 0;
+}
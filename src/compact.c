@@ -0,0 +1,663 @@
+// Document compaction, see compact.h. Joining has three steps:
+// - Link every stroke to the stroke starting nearest to its end, if that is
+//   within `max_gap` and the directions agree. Starts are looked up in a
+//   sorted grid of cell size `max_gap`.
+// - Flatten each run of linked strokes and fit it again with fitCurve, or
+//   join the strokes as they are, in parallel on the worker pool.
+// - Compare the new curve with the strokes both ways: every point of either
+//   must lie within `max_dev` of the other (half the gap at the joins).
+//
+// Command line:
+//
+//   vectornotes compact DIR [--scale S] [--epsilon PX] [--gap PX] [--dev PX]
+//                           [--angle DEG] [--dry-run]
+
+#include <assert.h>
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affine.h"
+#include "compact.h"
+#include "fit_bezier.h"
+#include "jobs.h"
+#include "notebook.h"
+#include "path.h"
+#include "pick.h"
+#include "stroke.h"
+#include "vec.h"
+
+#define COMPACT_NONE UINT_MAX
+#define COMPACT_SAMPLE_STEP 2.0     // Flattening step of the strokes, in pixels
+#define COMPACT_MAX_SAMPLES 256     // Per curve segment
+#define COMPACT_DEGENERATE 0.01     // Segments shorter than this are dropped, in pixels
+
+extern const double PI;
+
+typedef struct start_cell {
+    int64_t x, y;
+    unsigned path;
+} StartCell;
+
+// Growing arrays of points, cubics are 4 consecutive control points
+typedef struct point_buf {
+    Vec2 *points;
+    unsigned cnt;
+    unsigned capacity;
+} PointBuf;
+
+// Scratch buffers of a fit batch
+typedef struct compact_scratch {
+    PointBuf strokes;           // Cubics of the run
+    PointBuf samples;           // Flattened run, the fit input
+    PointBuf fitted;            // Cubics of the merged path
+    PointBuf fitted_samples;
+} CompactScratch;
+
+typedef struct compact_job {
+    Path **paths;
+    const CompactOptions *opts;
+    const unsigned *order;          // Paths of all runs, in run order
+    const unsigned *run_start;      // Run k is order[run_start[k] .. run_start[k+1])
+    Path **merged;                  // Per run, NULL if rejected
+    double *dev;                    // Per run, in canvas units
+    bool *refitted;                 // Per run, false if joined as they are
+} CompactJob;
+
+CompactOptions compact_defaultOptions(void) {
+    return (CompactOptions){
+        .max_gap = 2.0,
+        .epsilon = 0.5,
+        .max_dev = 1.0,
+        .max_angle = 30.0,
+        .scale = 1.0,
+    };
+}
+
+static bool mergeable(const Path *path) {
+    return path->type == PATHTYPE_bezier && path->node_cnt >= 4;
+}
+
+/**
+ * Direction the path leaves its start or enters its end, in canvas
+ * coordinates. Zero if all nodes coincide.
+ */
+static Vec2 endDirection(const Path *path, bool at_start) {
+    Vec2 d = { 0, 0 };
+    unsigned last = path->node_cnt - 1;
+    for (unsigned i = 1; i <= last && d.x == 0 && d.y == 0; i++) {
+        d = at_start ? vec2_sub(path->nodes[i], path->nodes[0])
+                     : vec2_sub(path->nodes[last], path->nodes[last - i]);
+    }
+    return affine_applyLinear(path->transform, d);
+}
+
+static int compareCells(const void *a, const void *b) {
+    const StartCell *c0 = a;
+    const StartCell *c1 = b;
+    if (c0->x != c1->x)
+        return c0->x < c1->x ? -1 : 1;
+    if (c0->y != c1->y)
+        return c0->y < c1->y ? -1 : 1;
+    return c0->path < c1->path ? -1 : c0->path > c1->path;
+}
+
+static unsigned lowerBound(const StartCell *cells, unsigned cnt, int64_t x, int64_t y) {
+    unsigned lo = 0, hi = cnt;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (cells[mid].x < x || (cells[mid].x == x && cells[mid].y < y))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Links the end of every stroke to the nearest start of another one that
+ * continues it. A link that would close a loop is skipped.
+ */
+static void linkStrokes(Path **paths, unsigned count, const CompactOptions *opts,
+        unsigned *next, unsigned *prev) {
+    for (unsigned i = 0; i < count; i++)
+        next[i] = prev[i] = COMPACT_NONE;
+
+    double gap = opts->max_gap / opts->scale;
+    if (!(gap > 0))
+        return;
+    double min_cos = cos(opts->max_angle * PI / 180);
+
+    StartCell *cells = malloc((count > 0 ? count : 1) * sizeof(StartCell));
+    assert(cells != NULL);
+    unsigned cell_cnt = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (!mergeable(paths[i]))
+            continue;
+        Vec2 p = affine_apply(paths[i]->transform, paths[i]->nodes[0]);
+        cells[cell_cnt++] = (StartCell){ (int64_t)floor(p.x / gap), (int64_t)floor(p.y / gap), i };
+    }
+    qsort(cells, cell_cnt, sizeof(StartCell), compareCells);
+
+    for (unsigned i = 0; i < count; i++) {
+        Path *path = paths[i];
+        if (!mergeable(path))
+            continue;
+
+        Vec2 end = affine_apply(path->transform, path->nodes[path->node_cnt - 1]);
+        Vec2 dir = endDirection(path, false);
+        int64_t cx = (int64_t)floor(end.x / gap);
+        int64_t cy = (int64_t)floor(end.y / gap);
+
+        unsigned best = COMPACT_NONE;
+        double best_dist = gap;
+        for (int64_t x = cx - 1; x <= cx + 1; x++) {
+            for (int64_t y = cy - 1; y <= cy + 1; y++) {
+                for (unsigned c = lowerBound(cells, cell_cnt, x, y);
+                        c < cell_cnt && cells[c].x == x && cells[c].y == y; c++) {
+                    unsigned j = cells[c].path;
+                    if (j == i || prev[j] != COMPACT_NONE)
+                        continue;
+
+                    Vec2 start = affine_apply(paths[j]->transform, paths[j]->nodes[0]);
+                    double d = vec2_dist(end, start);
+                    if (d > best_dist)
+                        continue;
+
+                    Vec2 dir_j = endDirection(paths[j], true);
+                    double len = vec2_len(dir) * vec2_len(dir_j);
+                    if (!(len > 0) || vec2_dot(dir, dir_j) < min_cos * len)
+                        continue;
+
+                    best = j;
+                    best_dist = d;
+                }
+            }
+        }
+        if (best == COMPACT_NONE)
+            continue;
+
+        unsigned k = best;
+        while (k != COMPACT_NONE && k != i)
+            k = next[k];
+        if (k == i)
+            continue;
+
+        next[i] = best;
+        prev[best] = i;
+    }
+
+    free(cells);
+}
+
+static void pushPoint(PointBuf *buf, Vec2 p) {
+    if (buf->cnt >= buf->capacity) {
+        buf->capacity = buf->capacity ? 2 * buf->capacity : 1024;
+        buf->points = realloc(buf->points, buf->capacity * sizeof(Vec2));
+        assert(buf->points != NULL);
+    }
+    buf->points[buf->cnt++] = p;
+}
+
+/**
+ * Appends the segments of a bezier path as separate cubics.
+ */
+static void pushCubics(PointBuf *buf, const Path *path, Affine m) {
+    for (unsigned j = 0; j + 3 < path->node_cnt; j += 3)
+        for (int n = 0; n < 4; n++)
+            pushPoint(buf, affine_apply(m, path->nodes[j + n]));
+}
+
+static Vec2 cubicPoint(const Vec2 *c, double t) {
+    double mt = 1 - t;
+    Vec2 p = vec2_scalarMult(c[0], mt*mt*mt);
+    p = vec2_add(p, vec2_scalarMult(c[1], 3*mt*mt*t));
+    p = vec2_add(p, vec2_scalarMult(c[2], 3*mt*t*t));
+    return vec2_add(p, vec2_scalarMult(c[3], t*t*t));
+}
+
+/**
+ * Samples the cubics about `step` apart, by the length of their control
+ * polygons. Samples closer than a quarter step to the previous one are
+ * skipped, the fitter needs distinct points.
+ */
+static void flattenCubics(const PointBuf *cubics, double step, PointBuf *samples) {
+    samples->cnt = 0;
+    for (unsigned i = 0; i < cubics->cnt; i += 4) {
+        const Vec2 *c = &cubics->points[i];
+        double len = vec2_dist(c[0], c[1]) + vec2_dist(c[1], c[2]) + vec2_dist(c[2], c[3]);
+        unsigned n = (unsigned)fmin(ceil(len / step), COMPACT_MAX_SAMPLES);
+        if (n == 0)
+            n = 1;
+        for (unsigned k = 0; k <= n; k++) {
+            // The end of the last cubic, the others are the next start
+            if (k == n && i + 4 < cubics->cnt)
+                break;
+            Vec2 p = cubicPoint(c, (double)k / n);
+            if (samples->cnt == 0 || vec2_dist(samples->points[samples->cnt - 1], p) >= step / 4)
+                pushPoint(samples, p);
+        }
+    }
+}
+
+/**
+ * Largest distance of the points to the nearest of the cubics. The nearest
+ * cubic of the previous point is tried first, which gives a tight bound for
+ * rejecting the others by their control point bounds.
+ */
+static double maxDistance(const PointBuf *samples, const PointBuf *cubic_buf) {
+    const Vec2 *cubics = cubic_buf->points;
+    unsigned cnt = cubic_buf->cnt;
+    double max_dist = 0;
+    unsigned hint = 0;
+    for (unsigned i = 0; i < samples->cnt; i++) {
+        Vec2 p = samples->points[i];
+        double t;
+        double best = pick_cubicDistance(&cubics[hint], p, &t);
+        for (unsigned k = 0; k < cnt; k += 4) {
+            const Vec2 *c = &cubics[k];
+            double dx = fmax(fmin(fmin(c[0].x, c[1].x), fmin(c[2].x, c[3].x)) - p.x,
+                    p.x - fmax(fmax(c[0].x, c[1].x), fmax(c[2].x, c[3].x)));
+            double dy = fmax(fmin(fmin(c[0].y, c[1].y), fmin(c[2].y, c[3].y)) - p.y,
+                    p.y - fmax(fmax(c[0].y, c[1].y), fmax(c[2].y, c[3].y)));
+            if (dx >= best || dy >= best || k == hint)
+                continue;
+
+            double d = pick_cubicDistance(c, p, &t);
+            if (d < best) {
+                best = d;
+                hint = k;
+            }
+        }
+        max_dist = fmax(max_dist, best);
+    }
+    return max_dist;
+}
+
+/**
+ * Raw samples of all strokes of a run in canvas coordinates, NULL if one of
+ * them has none. Mapped like path_refit does.
+ */
+static Stroke *mergeStrokes(Path **paths, const unsigned *run, unsigned len) {
+    unsigned total = 0;
+    for (unsigned i = 0; i < len; i++) {
+        if (!paths[run[i]]->stroke)
+            return NULL;
+        total += paths[run[i]]->stroke->sample_cnt;
+    }
+
+    Vec2 *samples = malloc(total * sizeof(Vec2));
+    assert(samples != NULL);
+    unsigned cnt = 0;
+    for (unsigned i = 0; i < len; i++) {
+        const Path *path = paths[run[i]];
+        Path *raw = stroke_decode(path->stroke);
+        Affine m = affine_mult(path->transform,
+                affine_translate(vec2_scalarMult(raw->nodes[0], -1)));
+        for (unsigned j = 0; j < raw->node_cnt; j++)
+            samples[cnt++] = affine_apply(m, raw->nodes[j]);
+        path_deinit(raw);
+    }
+
+    const Stroke *first = paths[run[0]]->stroke;
+    Stroke *stroke = stroke_encode(samples, cnt, first->view_origin, first->view_scale);
+    free(samples);
+    return stroke;
+}
+
+/**
+ * Distance between the run (flattened in `s->samples`) and the merged path,
+ * the larger of both directions. NAN if it exceeds the options.
+ */
+static double runDeviation(const CompactOptions *opts, CompactScratch *s, const Path *merged) {
+    s->fitted.cnt = 0;
+    pushCubics(&s->fitted, merged, merged->transform);
+    flattenCubics(&s->fitted, COMPACT_SAMPLE_STEP / opts->scale, &s->fitted_samples);
+
+    // At the joins the merged path bridges the gap
+    double fwd = maxDistance(&s->samples, &s->fitted);
+    double rev = maxDistance(&s->fitted_samples, &s->strokes);
+    double max_dev = opts->max_dev / opts->scale;
+    if (fwd > max_dev || rev > fmax(max_dev, 0.5 * opts->max_gap / opts->scale))
+        return NAN;
+    return fmax(fwd, rev);
+}
+
+/**
+ * The strokes of the run joined as they are. Each join moves to the middle of
+ * the gap, with the handles next to it, so the curves move by at most half the
+ * gap. Unlike path_concat the handles are not aligned, which would bend the
+ * curves.
+ */
+static Path *joinRun(Path **paths, const unsigned *run, unsigned len) {
+    unsigned cnt = 0;
+    for (unsigned i = 0; i < len; i++)
+        cnt += paths[run[i]]->node_cnt;
+
+    const Path *first = paths[run[0]];
+    Path *joined = path_init(cnt);
+    memcpy(joined->nodes, first->nodes, first->node_cnt * sizeof(Vec2));
+    joined->node_cnt = first->node_cnt;
+    joined->type = PATHTYPE_bezier;
+    joined->transform = first->transform;
+
+    Affine to_joined = affine_inverse(joined->transform);
+    for (unsigned i = 1; i < len; i++) {
+        const Path *path = paths[run[i]];
+        Affine m = affine_mult(to_joined, path->transform);
+        Vec2 *end = &joined->nodes[joined->node_cnt - 1];
+        Vec2 start = affine_apply(m, path->nodes[0]);
+
+        Vec2 shift = vec2_scalarMult(vec2_sub(start, *end), 0.5);
+        end[-1] = vec2_add(end[-1], shift);
+        end[0] = vec2_add(end[0], shift);
+        for (unsigned j = 1; j < path->node_cnt; j++) {
+            Vec2 p = affine_apply(m, path->nodes[j]);
+            joined->nodes[joined->node_cnt++] = j == 1 ? vec2_sub(p, shift) : p;
+        }
+    }
+    path_updateBBox(joined);
+    return joined;
+}
+
+/**
+ * Merges a run into one path: the strokes refitted at `epsilon` if that
+ * takes fewer nodes than joining them as they are. Either has to stay within
+ * `max_dev`. Returns NULL if neither does.
+ */
+static Path *mergeRun(CompactJob *job, BezierFitCtx *fit, CompactScratch *s, size_t k,
+        double *dev, bool *refitted) {
+    const CompactOptions *opts = job->opts;
+    const unsigned *run = &job->order[job->run_start[k]];
+    unsigned len = job->run_start[k + 1] - job->run_start[k];
+
+    s->strokes.cnt = 0;
+    for (unsigned i = 0; i < len; i++)
+        pushCubics(&s->strokes, job->paths[run[i]], job->paths[run[i]]->transform);
+    flattenCubics(&s->strokes, COMPACT_SAMPLE_STEP / opts->scale, &s->samples);
+    if (s->samples.cnt < 2)
+        return NULL;
+
+    Path *merged = joinRun(job->paths, run, len);
+    *dev = runDeviation(opts, s, merged);
+    *refitted = false;
+
+    fit_reset(fit, s->samples.points, s->samples.cnt);
+    fitCurve(fit);
+    size_t cnt;
+    Vec2 *nodes = fit_takeOutput(fit, &cnt);
+    Path *fitted = path_adopt(nodes, cnt);
+    fitted->type = PATHTYPE_bezier;
+
+    double fitted_dev;
+    if (mergeable(fitted) && fitted->node_cnt < merged->node_cnt
+            && !isnan(fitted_dev = runDeviation(opts, s, fitted))) {
+        path_deinit(merged);
+        merged = fitted;
+        *dev = fitted_dev;
+        *refitted = true;
+        path_localize(merged);
+    } else {
+        path_deinit(fitted);
+    }
+
+    if (isnan(*dev)) {
+        path_deinit(merged);
+        return NULL;
+    }
+
+    merged->stroke = mergeStrokes(job->paths, run, len);
+    return merged;
+}
+
+static void fitRunsJob(void *ctx, size_t begin, size_t end) {
+    CompactJob *job = ctx;
+
+    FitParams params = path_getFitParams();
+    params.epsilon = job->opts->epsilon;
+    BezierFitCtx *fit = fit_init(NULL, 0);
+    fit_setParams(fit, &params, job->opts->scale);
+
+    CompactScratch s = {0};
+    for (size_t k = begin; k < end; k++)
+        job->merged[k] = mergeRun(job, fit, &s, k, &job->dev[k], &job->refitted[k]);
+
+    fit_deinit(fit);
+    free(s.strokes.points);
+    free(s.samples.points);
+    free(s.fitted.points);
+    free(s.fitted_samples.points);
+}
+
+/**
+ * Removes segments whose nodes all lie within `tolerance` of their start,
+ * keeping at least one. Returns the number removed.
+ */
+static unsigned dropDegenerate(Path *path, double tolerance) {
+    unsigned stride = path->type == PATHTYPE_bezier ? 3 : 1;
+    // Instances keep their shared nodes, a copy would cost more than it saves
+    if (path->node_cnt < 1 + 2 * stride || path->shared)
+        return 0;
+
+    Vec2 *nodes = path->nodes;
+    unsigned out = 1;
+    unsigned dropped = 0;
+    for (unsigned i = 0; i + stride < path->node_cnt; i += stride) {
+        bool degenerate = true;
+        for (unsigned n = 1; n <= stride; n++)
+            degenerate &= vec2_dist(nodes[i + n], nodes[out - 1]) <= tolerance;
+
+        bool last = i + 2 * stride >= path->node_cnt;
+        if (degenerate && (out > 1 || !last)) {
+            // The segment collapses onto its start, a last one onto its end
+            if (last)
+                nodes[out - 1] = nodes[i + stride];
+            dropped++;
+            continue;
+        }
+        for (unsigned n = 1; n <= stride; n++)
+            nodes[out++] = nodes[i + n];
+    }
+
+    if (dropped > 0) {
+        path->node_cnt = out;
+        path_updateBBox(path);
+        path->gpu_valid = false;
+        path->flat_cnt = 0;
+        path->flat_empty = false;
+    }
+    return dropped;
+}
+
+static void countPaths(Path **paths, unsigned count, unsigned long *nodes, size_t *bytes) {
+    *nodes = 0;
+    *bytes = count * sizeof(Path *);
+    for (unsigned i = 0; i < count; i++) {
+        *nodes += paths[i]->node_cnt;
+        *bytes += notebook_pathBytes(paths[i]);
+    }
+}
+
+/**
+ * Compacts the paths in place, see compact.h. Replaced paths are freed, the
+ * others keep their order. Returns the new path count.
+ */
+unsigned compact_paths(Path **paths, unsigned count, const CompactOptions *opts, CompactStats *stats) {
+    *stats = (CompactStats){0};
+    stats->paths_before = count;
+    countPaths(paths, count, &stats->nodes_before, &stats->bytes_before);
+
+    unsigned *next = malloc(2 * (count > 0 ? count : 1) * sizeof(unsigned));
+    assert(next != NULL);
+    unsigned *prev = next + count;
+    linkStrokes(paths, count, opts, next, prev);
+
+    // Runs in order of their first stroke
+    unsigned *order = malloc((count + 1) * sizeof(unsigned));
+    unsigned *run_start = malloc((count + 1) * sizeof(unsigned));
+    assert(order != NULL && run_start != NULL);
+    unsigned order_cnt = 0;
+    unsigned run_cnt = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (prev[i] != COMPACT_NONE || next[i] == COMPACT_NONE)
+            continue;
+        run_start[run_cnt++] = order_cnt;
+        for (unsigned j = i; j != COMPACT_NONE; j = next[j])
+            order[order_cnt++] = j;
+    }
+    run_start[run_cnt] = order_cnt;
+
+    Path **merged = calloc(run_cnt + 1, sizeof(Path *));
+    double *dev = calloc(run_cnt + 1, sizeof(double));
+    bool *refitted = calloc(run_cnt + 1, sizeof(bool));
+    assert(merged != NULL && dev != NULL && refitted != NULL);
+    CompactJob job = {
+        .paths = paths,
+        .opts = opts,
+        .order = order,
+        .run_start = run_start,
+        .merged = merged,
+        .dev = dev,
+        .refitted = refitted,
+    };
+    jobs_parallelFor(run_cnt, 1, fitRunsJob, &job);
+
+    // The merged path takes the place of the first stroke of its run
+    for (unsigned k = 0; k < run_cnt; k++) {
+        if (!merged[k]) {
+            stats->rejected += 1;
+            continue;
+        }
+        stats->merged += 1;
+        stats->refitted += refitted[k];
+        stats->max_dev = fmax(stats->max_dev, dev[k] * opts->scale);
+        for (unsigned i = run_start[k]; i < run_start[k + 1]; i++) {
+            path_deinit(paths[order[i]]);
+            paths[order[i]] = NULL;
+        }
+        paths[order[run_start[k]]] = merged[k];
+    }
+
+    // Strokes of rejected runs stay as they are, like unlinked paths
+    for (unsigned k = 0; k < run_cnt; k++)
+        for (unsigned i = run_start[k]; i < run_start[k + 1] && !merged[k]; i++)
+            stats->dropped += dropDegenerate(paths[order[i]], COMPACT_DEGENERATE / opts->scale);
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (!paths[i])
+            continue;
+        if (prev[i] == COMPACT_NONE && next[i] == COMPACT_NONE)
+            stats->dropped += dropDegenerate(paths[i], COMPACT_DEGENERATE / opts->scale);
+        paths[n++] = paths[i];
+    }
+
+    stats->paths_after = n;
+    countPaths(paths, n, &stats->nodes_after, &stats->bytes_after);
+
+    free(next);
+    free(order);
+    free(run_start);
+    free(merged);
+    free(dev);
+    free(refitted);
+    return n;
+}
+
+void compact_addStats(CompactStats *total, const CompactStats *stats) {
+    total->paths_before += stats->paths_before;
+    total->paths_after += stats->paths_after;
+    total->nodes_before += stats->nodes_before;
+    total->nodes_after += stats->nodes_after;
+    total->bytes_before += stats->bytes_before;
+    total->bytes_after += stats->bytes_after;
+    total->merged += stats->merged;
+    total->refitted += stats->refitted;
+    total->rejected += stats->rejected;
+    total->dropped += stats->dropped;
+    total->max_dev = fmax(total->max_dev, stats->max_dev);
+}
+
+static double change(double before, double after) {
+    return before > 0 ? 100.0 * (after / before - 1.0) : 0.0;
+}
+
+void compact_printStats(const CompactStats *stats) {
+    printf("  paths (draws) %u -> %u (%+.1f%%), nodes %lu -> %lu (%+.1f%%), "
+            "%.1f -> %.1f KiB (%+.1f%%)\n",
+            stats->paths_before, stats->paths_after,
+            change(stats->paths_before, stats->paths_after),
+            stats->nodes_before, stats->nodes_after,
+            change(stats->nodes_before, stats->nodes_after),
+            stats->bytes_before / 1024.0, stats->bytes_after / 1024.0,
+            change(stats->bytes_before, stats->bytes_after));
+    printf("  %u runs merged (%u refitted), %u rejected, %lu degenerate segments dropped, "
+            "max deviation %.3f px\n",
+            stats->merged, stats->refitted, stats->rejected, stats->dropped, stats->max_dev);
+}
+
+int compact_main(int argc, char *argv[]) {
+    const char *dir = NULL;
+    CompactOptions opts = compact_defaultOptions();
+    bool dry_run = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scale") == 0 && i+1 < argc) {
+            opts.scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--epsilon") == 0 && i+1 < argc) {
+            opts.epsilon = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--gap") == 0 && i+1 < argc) {
+            opts.max_gap = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--dev") == 0 && i+1 < argc) {
+            opts.max_dev = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--angle") == 0 && i+1 < argc) {
+            opts.max_angle = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            dry_run = true;
+        } else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || !(opts.scale > 0) || !(opts.epsilon > 0)) {
+        printf("Usage: vectornotes compact DIR [--scale S] [--epsilon PX] [--gap PX] "
+                "[--dev PX] [--angle DEG] [--dry-run]\n");
+        return 1;
+    }
+
+    Notebook *nb = notebook_open(dir, 0);
+    if (!nb)
+        return 1;
+
+    CompactStats total = {0};
+    bool ok = true;
+    for (unsigned i = 0; i < nb->page_cnt; i++) {
+        Page *page = notebook_load(nb, i);
+        if (!page) {
+            ok = false;
+            continue;
+        }
+
+        CompactStats stats;
+        page->path_cnt = compact_paths(page->paths, page->path_cnt, &opts, &stats);
+        printf("Page %u:\n", i);
+        compact_printStats(&stats);
+        compact_addStats(&total, &stats);
+
+        // Only the pages that changed are written
+        if (!dry_run && (stats.merged > 0 || stats.dropped > 0)) {
+            page->dirty = true;
+            ok &= notebook_savePage(nb, i);
+        }
+        page->dirty = false;
+        notebook_evict(nb);
+    }
+
+    printf("Notebook %s, %u pages:\n", dir, nb->page_cnt);
+    compact_printStats(&total);
+    ok &= notebook_close(nb);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "filter.h"
+#include "vec.h"
+
+extern const double PI;
+
+// Used when two samples have the same timestamp
+#define FILTER_MIN_DT (1.0 / 1000)
+
+static const char *FILTER_NAMES[FILTER_count] = {
+    [FILTER_one_euro] = "euro",
+    [FILTER_rdp] = "rdp",
+    [FILTER_decimate] = "decimate",
+};
+
+static void pushStage(FilterChain *chain, unsigned index, Vec2 pos, double time);
+
+/**
+ * Passes a sample on to the stage after `index`, or to the sink.
+ */
+static void emit(FilterChain *chain, unsigned index, Vec2 pos, double time) {
+    chain->stages[index].out_cnt++;
+
+    if (index + 1 < chain->stage_cnt) {
+        pushStage(chain, index + 1, pos, time);
+    } else {
+        chain->out_cnt++;
+        chain->sink(chain->sink_ctx, pos);
+    }
+}
+
+static double smoothingFactor(double cutoff, double dt) {
+    double tau = 1.0 / (2*PI * cutoff);
+    return 1.0 / (1.0 + tau/dt);
+}
+
+static Vec2 lerp(Vec2 a, Vec2 b, double t) {
+    return vec2_add(a, vec2_scalarMult(vec2_sub(b, a), t));
+}
+
+/**
+ * 1€ filter (Casiez et al. 2012). A low-pass filter whose cutoff grows with
+ * the speed: slow movements are smoothed a lot, fast ones barely lag.
+ */
+static void pushOneEuro(FilterChain *chain, unsigned index, Vec2 pos, double time) {
+    FilterStage *stage = &chain->stages[index];
+    OneEuroFilter *f = &stage->one_euro;
+
+    f->raw = pos;
+    if (!stage->started) {
+        f->x = pos;
+        f->dx = (Vec2){ 0, 0 };
+        f->time = time;
+        emit(chain, index, pos, time);
+        return;
+    }
+
+    double dt = fmax(time - f->time, FILTER_MIN_DT);
+    f->time = time;
+
+    Vec2 dx = vec2_scalarMult(vec2_sub(pos, f->x), 1/dt);
+    f->dx = lerp(f->dx, dx, smoothingFactor(f->d_cutoff, dt));
+
+    double cutoff = f->min_cutoff + f->beta * vec2_len(f->dx);
+    f->x = lerp(f->x, pos, smoothingFactor(cutoff, dt));
+
+    emit(chain, index, f->x, time);
+}
+
+static double segmentDist(Vec2 p, Vec2 a, Vec2 b) {
+    Vec2 ab = vec2_sub(b, a);
+    double len_sqr = vec2_dot(ab, ab);
+    double t = len_sqr > 0 ? vec2_dot(vec2_sub(p, a), ab) / len_sqr : 0;
+    t = fmin(fmax(t, 0.0), 1.0);
+    return vec2_dist(p, vec2_add(a, vec2_scalarMult(ab, t)));
+}
+
+/**
+ * Streaming Ramer-Douglas-Peucker. Samples are collected as long as they all
+ * stay within epsilon of the line from the last output sample to the newest
+ * one. Once that fails, the sample before the newest becomes the next output.
+ * The window bounds the work per sample.
+ */
+static void pushRdp(FilterChain *chain, unsigned index, Vec2 pos, double time) {
+    FilterStage *stage = &chain->stages[index];
+    RdpFilter *f = &stage->rdp;
+
+    if (!stage->started) {
+        f->anchor = pos;
+        f->window_cnt = 0;
+        emit(chain, index, pos, time);
+        return;
+    }
+
+    bool fits = f->window_cnt < FILTER_RDP_WINDOW;
+    for (unsigned i = 0; fits && i < f->window_cnt; i++) {
+        fits = segmentDist(f->window[i], f->anchor, pos) <= f->epsilon;
+    }
+
+    if (!fits) {
+        // All samples up to the previous one fit the previous line
+        f->anchor = f->window[f->window_cnt - 1];
+        f->window_cnt = 0;
+        emit(chain, index, f->anchor, time);
+    }
+
+    f->window[f->window_cnt++] = pos;
+}
+
+/**
+ * Places samples further apart while the stroke goes straight on, and close
+ * together when it changes direction or moves back.
+ */
+static void pushDecimate(FilterChain *chain, unsigned index, Vec2 pos, double time) {
+    FilterStage *stage = &chain->stages[index];
+    DecimateFilter *f = &stage->decimate;
+
+    if (!stage->started) {
+        f->last = pos;
+        f->max_dist = 0;
+        f->has_pending = false;
+        emit(chain, index, pos, time);
+        return;
+    }
+
+    Vec2 r = vec2_sub(pos, f->last);
+    double dist = vec2_len(r);
+    if (dist == 0)
+        return;
+
+    double cmp = f->first_len;
+    if (stage->out_cnt > 1) {
+        // Cosine of the angle between the last direction and the cursor. Not
+        // clamped: with an even exponent moving straight back counts like
+        // moving straight on, the backtrack test places those samples.
+        Vec2 tg = vec2_norm(vec2_sub(f->last, f->prev));
+        double alpha = vec2_dot(r, tg) / dist;
+        cmp = f->max_len*pow(alpha, f->exponent) + f->min_len;
+
+        f->max_dist = fmax(f->max_dist, dist);
+    }
+
+    if (dist < f->max_dist - f->backtrack || dist > cmp) {
+        f->prev = f->last;
+        f->last = pos;
+        f->max_dist = 0;
+        f->has_pending = false;
+        emit(chain, index, pos, time);
+    } else {
+        f->pending = pos;
+        f->has_pending = true;
+    }
+}
+
+static void pushStage(FilterChain *chain, unsigned index, Vec2 pos, double time) {
+    FilterStage *stage = &chain->stages[index];
+
+    switch (stage->type) {
+    case FILTER_one_euro: pushOneEuro(chain, index, pos, time); break;
+    case FILTER_rdp: pushRdp(chain, index, pos, time); break;
+    case FILTER_decimate: pushDecimate(chain, index, pos, time); break;
+    default: break;
+    }
+
+    stage->started = true;
+    stage->time = time;
+}
+
+void filter_init(FilterChain *chain, FilterSinkFn sink, void *sink_ctx) {
+    memset(chain, 0, sizeof(FilterChain));
+    chain->sink = sink;
+    chain->sink_ctx = sink_ctx;
+}
+
+/**
+ * Appends a stage with default parameters, which can be changed through the
+ * returned stage. Returns NULL if the chain is full.
+ */
+FilterStage *filter_add(FilterChain *chain, FilterType type) {
+    if (chain->stage_cnt >= FILTER_MAX_STAGES) {
+        printf("Error(Filter): More than %d stages\n", FILTER_MAX_STAGES);
+        return NULL;
+    }
+
+    FilterStage *stage = &chain->stages[chain->stage_cnt++];
+    memset(stage, 0, sizeof(FilterStage));
+    stage->type = type;
+
+    switch (type) {
+    case FILTER_one_euro:
+        stage->one_euro.min_cutoff = 1.0;
+        stage->one_euro.beta = 0.007;
+        stage->one_euro.d_cutoff = 1.0;
+        break;
+    case FILTER_rdp:
+        stage->rdp.epsilon = 1.0;
+        break;
+    case FILTER_decimate:
+        // The heuristic the pencil has always used
+        stage->decimate.first_len = 5.0;
+        stage->decimate.min_len = 7.0;
+        stage->decimate.max_len = 128.0;
+        stage->decimate.exponent = 512.0;
+        stage->decimate.backtrack = 5.0;
+        break;
+    default: break;
+    }
+
+    return stage;
+}
+
+/**
+ * Builds the chain from a comma separated list of stage names, e.g.
+ * "euro,rdp". An empty spec gives a chain that passes everything on.
+ */
+bool filter_parse(FilterChain *chain, const char *spec) {
+    chain->stage_cnt = 0;
+
+    while (*spec) {
+        size_t len = strcspn(spec, ",");
+
+        int type = 0;
+        while (type < FILTER_count && (strlen(FILTER_NAMES[type]) != len
+                    || strncmp(spec, FILTER_NAMES[type], len) != 0))
+            type++;
+
+        if (type == FILTER_count) {
+            printf("Error(Filter): Unknown stage '%.*s'\n", (int)len, spec);
+            return false;
+        }
+        if (!filter_add(chain, type))
+            return false;
+
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+
+    return true;
+}
+
+/**
+ * Resets all stages for a new stroke.
+ */
+void filter_begin(FilterChain *chain) {
+    for (unsigned i = 0; i < chain->stage_cnt; i++) {
+        chain->stages[i].started = false;
+        chain->stages[i].out_cnt = 0;
+    }
+}
+
+void filter_push(FilterChain *chain, Vec2 pos, double time) {
+    chain->in_cnt++;
+
+    if (chain->stage_cnt == 0) {
+        chain->out_cnt++;
+        chain->sink(chain->sink_ctx, pos);
+        return;
+    }
+    pushStage(chain, 0, pos, time);
+}
+
+/**
+ * Ends the stroke, samples held back by a stage are passed on so the stroke
+ * ends where the input ended.
+ */
+void filter_end(FilterChain *chain) {
+    for (unsigned i = 0; i < chain->stage_cnt; i++) {
+        FilterStage *stage = &chain->stages[i];
+
+        switch (stage->type) {
+        case FILTER_one_euro:
+            // The filtered position lags behind, the stroke ends at the pen
+            if (stage->started && (stage->one_euro.raw.x != stage->one_euro.x.x
+                        || stage->one_euro.raw.y != stage->one_euro.x.y))
+                emit(chain, i, stage->one_euro.raw, stage->time);
+            break;
+        case FILTER_rdp:
+            if (stage->rdp.window_cnt > 0) {
+                Vec2 last = stage->rdp.window[stage->rdp.window_cnt - 1];
+                stage->rdp.window_cnt = 0;
+                emit(chain, i, last, stage->time);
+            }
+            break;
+        case FILTER_decimate:
+            if (stage->decimate.has_pending) {
+                stage->decimate.has_pending = false;
+                emit(chain, i, stage->decimate.pending, stage->time);
+            }
+            break;
+        default: break;
+        }
+    }
+}
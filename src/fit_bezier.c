@@ -6,8 +6,10 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "fit_bezier.h"
+#include "mem.h"
 #include "vec.h"
 
 // Temp for debugging
@@ -16,41 +18,137 @@ void path_addNode(Path *path, Vec2 node);
 extern Path *dbg;
 
 BezierFitCtx *fit_init(Vec2 points[], size_t count) {
-    BezierFitCtx *fit = malloc(sizeof(BezierFitCtx));
+    BezierFitCtx *fit = mem_calloc(MEM_fit, 1, sizeof(BezierFitCtx));
     assert(fit != NULL);
 
+    FitParams params = fit_defaultParams();
+    fit_setParams(fit, &params, 1.0);
+    fit->debug = false;
+
+    fit_reset(fit, points, count);
+
+    return fit;
+}
+
+/**
+ * Prepares the context for fitting a new set of points, keeping the params.
+ * The scratch arrays are only reallocated when `count` exceeds all previous
+ * strokes.
+ */
+void fit_reset(BezierFitCtx *fit, Vec2 points[], size_t count) {
     fit->count = count;
     fit->points = points;
     fit->timestamps = NULL;
-    fit->params = malloc(sizeof(double) * count);
-    fit->coeffs = malloc(sizeof(BezierCoeffs) * count);
-
-    // Sane defaults
-    fit->corner_thresh = 0.873;  // ~50 degrees
-    fit->tangent_range = 30.0;
-    fit->epsilon = 8.0;
-    fit->psi = 30.0;
-    fit->max_iter = 3;
-
-    fit->new = malloc(sizeof(Vec2) * count);
-    fit->new_ts = malloc(sizeof(double) * count);
+
+    if (count > fit->capacity) {
+        fit->capacity = count;
+        fit->params = mem_realloc(MEM_fit, fit->params, sizeof(double) * count);
+        fit->coeffs = mem_realloc(MEM_fit, fit->coeffs, sizeof(BezierCoeffs) * count);
+        fit->stack = mem_realloc(MEM_fit, fit->stack, sizeof(FitSpan) * count);
+
+        assert(fit->params != NULL);
+        assert(fit->coeffs != NULL);
+        assert(fit->stack != NULL);
+    }
+    fit->stack_cnt = 0;
+
+    // The output may have been handed off, it then starts out at the input
+    // size again (the common case needs far less)
+    if (!fit->new || fit->new_capacity < count) {
+        fit->new_capacity = count > 0 ? count : 1;
+        fit->new = mem_realloc(MEM_fit, fit->new, sizeof(Vec2) * fit->new_capacity);
+        assert(fit->new != NULL);
+    }
+    if (!fit->new_ts || fit->new_ts_capacity < count) {
+        fit->new_ts_capacity = count > 0 ? count : 1;
+        fit->new_ts = mem_realloc(MEM_fit, fit->new_ts, sizeof(double) * fit->new_ts_capacity);
+        assert(fit->new_ts != NULL);
+    }
     fit->new_cnt = 0;
-    fit->new_capacity = count;
+}
 
-    assert(fit->params != NULL);
-    assert(fit->coeffs != NULL);
-    assert(fit->new != NULL);
-    assert(fit->new_ts != NULL);
+/**
+ * The default profile, tuned for handwriting with a mouse.
+ */
+FitParams fit_defaultParams(void) {
+    FitParams params = {
+        .corner_thresh = 0.52359877559829887,   // 30 degrees
+        .tangent_range = 20.0,
+        .epsilon = 10.0,
+        .psi = 80.0,
+        .max_iter = 4,
+    };
+    return params;
+}
 
-    return fit;
+void fit_setParams(BezierFitCtx *fit, const FitParams *params, double scale) {
+    fit->corner_thresh = params->corner_thresh;
+    fit->tangent_range = params->tangent_range / scale;
+    fit->epsilon = params->epsilon / scale;
+    fit->psi = params->psi / scale;
+    fit->max_iter = params->max_iter;
+}
+
+/**
+ * Loads a profile written by `fit_saveParams` (or the tune command). Keys that
+ * are missing keep their current value in `params`.
+ */
+bool fit_loadParams(const char *filename, FitParams *params) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        printf("Error(fit): Could not open profile '%s'\n", filename);
+        return false;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        char key[64];
+        double value;
+        if (line[0] == '#' || sscanf(line, " %63[a-z_] = %lf", key, &value) != 2)
+            continue;
+
+        if (strcmp(key, "corner_thresh") == 0)
+            params->corner_thresh = value;
+        else if (strcmp(key, "tangent_range") == 0)
+            params->tangent_range = value;
+        else if (strcmp(key, "epsilon") == 0)
+            params->epsilon = value;
+        else if (strcmp(key, "psi") == 0)
+            params->psi = value;
+        else if (strcmp(key, "max_iter") == 0)
+            params->max_iter = value;
+        else
+            printf("Warning(fit): Unknown key '%s' in profile\n", key);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+bool fit_saveParams(const char *filename, const FitParams *params) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        printf("Error(fit): Could not open profile '%s'\n", filename);
+        return false;
+    }
+
+    fprintf(fp, "# VectorNotes fit profile, distances in screen pixels\n");
+    fprintf(fp, "corner_thresh = %.17g\n", params->corner_thresh);
+    fprintf(fp, "tangent_range = %.17g\n", params->tangent_range);
+    fprintf(fp, "epsilon = %.17g\n", params->epsilon);
+    fprintf(fp, "psi = %.17g\n", params->psi);
+    fprintf(fp, "max_iter = %u\n", params->max_iter);
+
+    return fclose(fp) == 0;
 }
 
 void fit_deinit(BezierFitCtx *fit) {
-    free(fit->params);
-    free(fit->coeffs);
-    free(fit->new);
-    free(fit->new_ts);
-    free(fit);
+    mem_free(fit->params);
+    mem_free(fit->coeffs);
+    mem_free(fit->stack);
+    mem_free(fit->new);
+    mem_free(fit->new_ts);
+    mem_free(fit);
 }
 
 void addToNewPath(BezierFitCtx *fit, Vec2 point, int ts_index) {
@@ -58,11 +156,13 @@ void addToNewPath(BezierFitCtx *fit, Vec2 point, int ts_index) {
     // points. The list is initialized with the same size as the input points
     // list.
     if (fit->new_cnt >= fit->new_capacity) {
-        fit->new = realloc(fit->new, sizeof(Vec2) * fit->new_capacity * 2);
-        fit->new_ts = realloc(fit->new_ts, sizeof(double) * fit->new_capacity * 2);
         fit->new_capacity *= 2;
-
+        fit->new = mem_realloc(MEM_fit, fit->new, sizeof(Vec2) * fit->new_capacity);
         assert(fit->new != NULL);
+    }
+    if (fit->new_cnt >= fit->new_ts_capacity) {
+        fit->new_ts_capacity *= 2;
+        fit->new_ts = mem_realloc(MEM_fit, fit->new_ts, sizeof(double) * fit->new_ts_capacity);
         assert(fit->new_ts != NULL);
     }
 
@@ -78,6 +178,22 @@ void addToNewPath(BezierFitCtx *fit, Vec2 point, int ts_index) {
     fit->new_cnt++;
 }
 
+/**
+ * Hands the fitted nodes to the caller, who has to free them with mem_free.
+ * The buffer is shrunk to `count` nodes, it is sized for the input points.
+ */
+Vec2 *fit_takeOutput(BezierFitCtx *fit, size_t *count) {
+    Vec2 *out = mem_realloc(MEM_fit, fit->new, sizeof(Vec2) * (fit->new_cnt > 0 ? fit->new_cnt : 1));
+    assert(out != NULL);
+
+    *count = fit->new_cnt;
+    fit->new = NULL;
+    fit->new_cnt = 0;
+    fit->new_capacity = 0;
+
+    return out;
+}
+
 Vec2 calcBezier(BezierFitCtx *fit, unsigned index, Vec2 v0, Vec2 v1, Vec2 v2, Vec2 v3) {
     Vec2 p = vec2_scalarMult(v0, fit->coeffs[index].B0);
     p = vec2_add(p, vec2_scalarMult(v1, fit->coeffs[index].B1));
@@ -187,152 +303,159 @@ void reparameterize(BezierFitCtx *fit, Vec2 v0, Vec2 v1, Vec2 v2, Vec2 v3, size_
     assert(fit->params[i_end] == 1.0f);
 }
 
+static void pushSpan(BezierFitCtx *fit, Vec2 t1, Vec2 t2, size_t i_start, size_t i_end) {
+    // The spans on the stack are disjoint, so there are less than `count`
+    assert(fit->stack_cnt < fit->capacity);
+    fit->stack[fit->stack_cnt++] = (FitSpan){ t1, t2, i_start, i_end };
+}
+
 /**
- * Main function. It fits a bezier onto the points in `fit->points` in the given
- * range and calculates an error for each point to the fit curve.
+ * Main function. It fits a bezier onto the points of each span on the stack
+ * and calculates an error for each point to the fit curve.
  *
- * - If the error is large (> `fit->psi`), it will split the curve into two at
+ * - If the error is large (> `fit->psi`), it will split the span into two at
  *   the point of greatest error.
  * - If the error is smaller (> `fit->epsilon`), it will use Newton-Raphson
  *   iteration up to `fit->max_iter` times. If max_iter is reached, and the
- *   error is still too large, the cruve is split at the point of greatest
+ *   error is still too large, the span is split at the point of greatest
  *   error.
  * - If the error is smaller than `fit->epsilon` the curve stored in `fit->new`.
+ *
+ * Splits push both halves, the left one on top so the curves are still added
+ * in order. This replaces the recursion, the depth of which grew with the
+ * number of splits.
  */
-void fitBezier(BezierFitCtx *fit, Vec2 t1, Vec2 t2, unsigned level, size_t i_start, size_t i_end) {
-    //printf("fitBezier called; i_start=%ld, i_end=%ld\n", i_start, i_end);
+void fitBezier(BezierFitCtx *fit) {
+    while (fit->stack_cnt > 0) {
+        FitSpan span = fit->stack[--fit->stack_cnt];
+        Vec2 t1 = span.t1;
+        Vec2 t2 = span.t2;
+        size_t i_start = span.i_start;
+        size_t i_end = span.i_end;
+
+        assert(i_end < fit->count);
+        Vec2 v0 = fit->points[i_start];
+        Vec2 v3 = fit->points[i_end];
+
+        if (i_end - i_start == 1) {
+            // Only two points
+
+            double dist = vec2_dist(v0, v3) / 3.0;
+            addToNewPath(fit, vec2_add(v0, vec2_scalarMult(t1, dist)), -1);
+            addToNewPath(fit, vec2_add(v3, vec2_scalarMult(t2, dist)), -1);
+            addToNewPath(fit, v3, i_end);
+            continue;
+        }
 
-    assert(i_end < fit->count);
-    Vec2 v0 = fit->points[i_start];
-    Vec2 v3 = fit->points[i_end];
+        chordLengthParameterization(fit, i_start, i_end);
 
-    if (i_end - i_start == 1) {
-        // Only two points
+        for (unsigned level = 0; ; level++) {
+            double c11, c1221, c22, x1, x2;
+            c11 = c1221 = c22 = x1 = x2 = 0;
 
-        double dist = vec2_dist(v0, v3) / 3.0;
-        addToNewPath(fit, vec2_add(v0, vec2_scalarMult(t1, dist)), -1);
-        addToNewPath(fit, vec2_add(v3, vec2_scalarMult(t2, dist)), -1);
-        addToNewPath(fit, v3, i_end);
-        return;
-    }
+            // Fit a bezier to a set of points
+            for (size_t i = i_start; i <= i_end; i++) {
+                double u = fit->params[i];
+                Vec2 d = fit->points[i];
 
-    double c11, c1221, c22, x1, x2;
-    c11 = c1221 = c22 = x1 = x2 = 0;
+                BezierCoeffs *c = &fit->coeffs[i];
 
-    // Fit a bezier to a set of points
-    for (size_t i = i_start; i <= i_end; i++) {
-        double u = fit->params[i];
-        Vec2 d = fit->points[i];
+                double omu = 1-u;
 
-        BezierCoeffs *c = &fit->coeffs[i];
+                // Calculate and cache binomial coefficients
+                c->B0 = omu*omu*omu;
+                double B1 = c->B1 = 3*u * omu*omu;
+                double B2 = c->B2 = 3*u*u * omu;
+                c->B3 = u*u*u;
 
-        double omu = 1-u;
+                Vec2 A1 = vec2_scalarMult(t1, B1);
+                Vec2 A2 = vec2_scalarMult(t1, B2);
 
-        // Calculate and cache binomial coefficients
-        c->B0 = omu*omu*omu;
-        double B1 = c->B1 = 3*u * omu*omu;
-        double B2 = c->B2 = 3*u*u * omu;
-        c->B3 = u*u*u;
+                c11 += vec2_dot(A1, A1);
+                c1221 += vec2_dot(A1, A2);
+                c22 += vec2_dot(A2, A2);
 
-        Vec2 A1 = vec2_scalarMult(t1, B1);
-        Vec2 A2 = vec2_scalarMult(t1, B2);
+                Vec2 bisum = calcBezier(fit, i, v0, v0, v3, v3);
 
-        c11 += vec2_dot(A1, A1);
-        c1221 += vec2_dot(A1, A2);
-        c22 += vec2_dot(A2, A2);
+                Vec2 sub = vec2_sub(d, bisum);
+                x1 += vec2_dot(sub, A1);
+                x2 += vec2_dot(sub, A2);
+            }
 
-        Vec2 bisum = calcBezier(fit, i, v0, v0, v3, v3);
+            double det_c = (c11*c22 - c1221*c1221);
+            double a1 = (det_c == 0) ? 0 : (x1*c22 - c1221*x2) / det_c;
+            double a2 = (det_c == 0) ? 0 : (c11*x2 - x1*c1221) / det_c;
 
-        Vec2 sub = vec2_sub(d, bisum);
-        x1 += vec2_dot(sub, A1);
-        x2 += vec2_dot(sub, A2);
-    }
+            Vec2 v1, v2;
 
-    double det_c = (c11*c22 - c1221*c1221);
-    double a1 = (det_c == 0) ? 0 : (x1*c22 - c1221*x2) / det_c;
-    double a2 = (det_c == 0) ? 0 : (c11*x2 - x1*c1221) / det_c;
+            // Hacky fix for wrong fits. If alpha is zero or negative, just
+            // assume that it is a straight line.
+            // TODO: See if something better is needed. We could split the line
+            // and see if it fits better.
+            double alpha_err = 1.0e-6 * vec2_dist(v0, v3);
+            if (a1 < alpha_err || a2 < alpha_err) {
+                a1 = a2 = vec2_dist(v0, v3) / 3.0;
+            }
 
-    Vec2 v1, v2;
+            v1 = vec2_add(v0, vec2_scalarMult(t1, a1));
+            v2 = vec2_add(v3, vec2_scalarMult(t2, a2));
 
-    // Hacky fix for wrong fits. If alpha is zero or negative, just assume that
-    // it is a straight line.
-    // TODO: See if something better is needed. We could split the line and see
-    // if it fits better.
-    double alpha_err = 1.0e-6 * vec2_dist(v0, v3);
-    if (a1 < alpha_err || a2 < alpha_err) {
-        a1 = a2 = vec2_dist(v0, v3) / 3.0;
-    }
+            // Calculate the error (distance) between the curve and the points
+            double max_err = 0;
+            size_t max_err_i = 0;
+            Vec2 max_err_d = {0, 0};
+            for (size_t i = i_start; i <= i_end; i++) {
+                Vec2 d = fit->points[i];
 
-    v1 = vec2_add(v0, vec2_scalarMult(t1, a1));
-    v2 = vec2_add(v3, vec2_scalarMult(t2, a2));
+                Vec2 p = calcBezier(fit, i, v0, v1, v2, v3);
 
-    // Calculate the error (distance) between the curve and the points
-    double max_err = 0;
-    size_t max_err_i = 0;
-    Vec2 max_err_d = {0, 0};
-    for (size_t i = i_start; i <= i_end; i++) {
-        Vec2 d = fit->points[i];
+                double err = vec2_distSqr(d, p);
+                if (err > max_err) {
+                    max_err = err;
+                    max_err_i = i;
+                    max_err_d = d;
+                }
+            }
 
-        Vec2 p = calcBezier(fit, i, v0, v1, v2, v3);
+            if (max_err < fit->epsilon*fit->epsilon) {
+                // Error is small enough, add curve to list
+                if (fit->debug) {
+                    path_addNode(dbg, max_err_d);
+                    path_addNode(dbg, calcBezier(fit, max_err_i, v0, v1, v2, v3));
+                }
 
-        double err = vec2_distSqr(d, p);
-        if (err > max_err) {
-            max_err = err;
-            max_err_i = i;
-            max_err_d = d;
+                addToNewPath(fit, v1, -1);
+                addToNewPath(fit, v2, -1);
+                addToNewPath(fit, v3, i_end);
+                break;
+            } else if (max_err < fit->psi*fit->psi && level < fit->max_iter) {
+                // The error is fairly small but still too large, try to
+                // improve by reparameterizing.
+                reparameterize(fit, v0, v1, v2, v3, i_start, i_end);
+                continue;
+            }
+
+            // Error is very large, split the span in two and try on these
+            // separately.
+            Vec2 t_split = vec2_norm(
+                    vec2_scalarMult(vec2_add(
+                        vec2_sub(fit->points[max_err_i-1], fit->points[max_err_i]),
+                        vec2_sub(fit->points[max_err_i], fit->points[max_err_i+1])),
+                    0.5));
+
+            pushSpan(fit, vec2_scalarMult(t_split, -1), t2, max_err_i, i_end);
+            pushSpan(fit, t1, t_split, i_start, max_err_i);
+            break;
         }
     }
-    //printf("Level %d; Max distance error is %f at t=%f\n", level, sqrt(max_err), max_err_t);
-
-    if (max_err < fit->epsilon*fit->epsilon) {
-        // Error is small enough, add curve to list and return;
-
-        Vec2 p = vec2_scalarMult(v0, fit->coeffs[max_err_i].B0);
-        p = vec2_add(p, vec2_scalarMult(v1, fit->coeffs[max_err_i].B1));
-        p = vec2_add(p, vec2_scalarMult(v2, fit->coeffs[max_err_i].B2));
-        p = vec2_add(p, vec2_scalarMult(v3, fit->coeffs[max_err_i].B3));
-        path_addNode(dbg, max_err_d);
-        path_addNode(dbg, p);
-
-        addToNewPath(fit, v1, -1);
-        addToNewPath(fit, v2, -1);
-        addToNewPath(fit, v3, i_end);
-        return;
-    } else if (max_err < fit->psi*fit->psi && level < fit->max_iter) {
-        // The error is fairly small but still too large, try to improve by
-        // reparameterizing.
-
-        reparameterize(fit, v0, v1, v2, v3, i_start, i_end);
-        fitBezier(fit, t1, t2, level+1, i_start, i_end);
-        return;
-    }
-
-    // Error is very large, split the curve into multiple paths and try on
-    // these paths separately.
-
-    //printf("Splitting! err=%f, i=%ld\n", sqrt(max_err), max_err_i);
-
-    Vec2 t_split = vec2_norm(
-            vec2_scalarMult(vec2_add(
-                vec2_sub(fit->points[max_err_i-1], fit->points[max_err_i]),
-                vec2_sub(fit->points[max_err_i], fit->points[max_err_i+1])),
-            0.5));
-
-    chordLengthParameterization(fit, i_start, max_err_i);
-    fitBezier(fit, t1, t_split, 0, i_start, max_err_i);
-
-    t_split = vec2_scalarMult(t_split, -1);
-    chordLengthParameterization(fit, max_err_i, i_end);
-    fitBezier(fit, t_split, t2, 0, max_err_i, i_end);
-
 }
 
 void startFit(BezierFitCtx *fit, size_t i_start, size_t i_end) {
     Vec2 t1 = calcTangent(fit, i_start, i_end, FIT_DIR_RIGHT);
     Vec2 t2 = calcTangent(fit, i_start, i_end, FIT_DIR_LEFT);
 
-    chordLengthParameterization(fit, i_start, i_end);
-    fitBezier(fit, t1, t2, 0, i_start, i_end);
+    pushSpan(fit, t1, t2, i_start, i_end);
+    fitBezier(fit);
 }
 
 /**
@@ -0,0 +1,540 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Own static copy of stb_truetype, the one in fontstash allocates from the
+// fontstash scratch buffer
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "nanovg/stb_truetype.h"
+#pragma GCC diagnostic pop
+
+#include "font.h"
+#include "vec.h"
+
+#define FONT_ONEDGE 128         // Distance field value on the glyph outline
+#define FONT_GLYPH_GAP 1        // Empty pixels between glyphs in the atlas
+
+// Tried in order when no font file is given
+static const char *FONT_DEFAULT_FILES[] = {
+    "/usr/share/fonts/TTF/DejaVuSans.ttf",
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/dejavu/DejaVuSans.ttf",
+    "/usr/share/fonts/noto/NotoSans-Regular.ttf",
+    "/usr/share/fonts/truetype/noto/NotoSans-Regular.ttf",
+    "/System/Library/Fonts/Supplemental/Arial.ttf",
+    "C:/Windows/Fonts/arial.ttf",
+};
+
+static uint8_t *readFile(const char *filename) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size <= 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t *buf = malloc(size);
+    assert(buf != NULL);
+    if (fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+
+    return buf;
+}
+
+/**
+ * Loads a TrueType font, or the first of the default fonts that exists if
+ * `filename` is NULL. Returns false if no font could be loaded.
+ */
+bool font_init(FontAtlas *atlas, const char *filename) {
+    memset(atlas, 0, sizeof(FontAtlas));
+
+    if (filename) {
+        atlas->font_data = readFile(filename);
+    } else {
+        size_t cnt = sizeof(FONT_DEFAULT_FILES) / sizeof(FONT_DEFAULT_FILES[0]);
+        for (size_t i = 0; i < cnt && !atlas->font_data; i++) {
+            filename = FONT_DEFAULT_FILES[i];
+            atlas->font_data = readFile(filename);
+        }
+    }
+    if (!atlas->font_data) {
+        printf("Error(Font): Could not read '%s'\n", filename);
+        return false;
+    }
+
+    atlas->font = malloc(sizeof(stbtt_fontinfo));
+    assert(atlas->font != NULL);
+    if (!stbtt_InitFont(atlas->font, atlas->font_data,
+                stbtt_GetFontOffsetForIndex(atlas->font_data, 0))) {
+        printf("Error(Font): '%s' is not a TrueType font\n", filename);
+        font_deinit(atlas);
+        return false;
+    }
+
+    int ascent, descent, line_gap;
+    stbtt_GetFontVMetrics(atlas->font, &ascent, &descent, &line_gap);
+    atlas->scale = stbtt_ScaleForPixelHeight(atlas->font, FONT_SDF_SIZE);
+    atlas->ascent = ascent * atlas->scale;
+    atlas->descent = descent * atlas->scale;
+    atlas->line_height = (ascent - descent + line_gap) * atlas->scale;
+
+    atlas->width = FONT_ATLAS_WIDTH;
+    atlas->height = FONT_ATLAS_WIDTH / 4;
+    atlas->max_height = FONT_ATLAS_MAX_HEIGHT;
+    atlas->pixels = calloc(atlas->width * atlas->height, 1);
+    assert(atlas->pixels != NULL);
+    atlas->resized = true;
+
+    atlas->glyph_capacity = 256;
+    atlas->glyphs = malloc(atlas->glyph_capacity * sizeof(Glyph));
+    assert(atlas->glyphs != NULL);
+    for (unsigned i = 0; i < atlas->glyph_capacity; i++)
+        atlas->glyphs[i].codepoint = -1;
+
+    return true;
+}
+
+void font_deinit(FontAtlas *atlas) {
+    free(atlas->font);
+    free(atlas->font_data);
+    free(atlas->pixels);
+    free(atlas->shelves);
+    free(atlas->glyphs);
+    memset(atlas, 0, sizeof(FontAtlas));
+}
+
+static Glyph *findSlot(Glyph *glyphs, unsigned capacity, int codepoint) {
+    unsigned i = ((unsigned)codepoint * 2654435761u) & (capacity - 1);
+    while (glyphs[i].codepoint != -1 && glyphs[i].codepoint != codepoint)
+        i = (i + 1) & (capacity - 1);
+    return &glyphs[i];
+}
+
+/**
+ * Rebuilds the hash table with `capacity` slots, dropping the glyphs on shelf
+ * `drop` (-1 to keep all).
+ */
+static void rehashGlyphs(FontAtlas *atlas, unsigned capacity, int drop) {
+    Glyph *glyphs = malloc(capacity * sizeof(Glyph));
+    assert(glyphs != NULL);
+    for (unsigned i = 0; i < capacity; i++)
+        glyphs[i].codepoint = -1;
+
+    atlas->glyph_cnt = 0;
+    for (unsigned i = 0; i < atlas->glyph_capacity; i++) {
+        Glyph *g = &atlas->glyphs[i];
+        if (g->codepoint != -1 && (g->shelf != drop || drop == -1)) {
+            *findSlot(glyphs, capacity, g->codepoint) = *g;
+            atlas->glyph_cnt++;
+        }
+    }
+
+    free(atlas->glyphs);
+    atlas->glyphs = glyphs;
+    atlas->glyph_capacity = capacity;
+}
+
+static void markDirty(FontAtlas *atlas, unsigned y0, unsigned y1) {
+    if (atlas->dirty_y1 <= atlas->dirty_y0) {
+        atlas->dirty_y0 = y0;
+        atlas->dirty_y1 = y1;
+    } else {
+        atlas->dirty_y0 = y0 < atlas->dirty_y0 ? y0 : atlas->dirty_y0;
+        atlas->dirty_y1 = y1 > atlas->dirty_y1 ? y1 : atlas->dirty_y1;
+    }
+}
+
+static FontShelf *addShelf(FontAtlas *atlas, unsigned y, unsigned h) {
+    if (atlas->shelf_cnt >= atlas->shelf_capacity) {
+        atlas->shelf_capacity = atlas->shelf_capacity ? atlas->shelf_capacity*2 : 32;
+        atlas->shelves = realloc(atlas->shelves, atlas->shelf_capacity * sizeof(FontShelf));
+        assert(atlas->shelves != NULL);
+    }
+
+    FontShelf *shelf = &atlas->shelves[atlas->shelf_cnt++];
+    memset(shelf, 0, sizeof(FontShelf));
+    shelf->y = y;
+    shelf->h = h;
+    return shelf;
+}
+
+/**
+ * Empties the least recently used shelf that is at least h high and was not
+ * needed this frame. Its glyphs are dropped, notes using them notice the new
+ * generation. Returns NULL if all such shelves are in use.
+ */
+static FontShelf *evictShelf(FontAtlas *atlas, unsigned h) {
+    FontShelf *lru = NULL;
+    for (unsigned i = 0; i < atlas->shelf_cnt; i++) {
+        FontShelf *shelf = &atlas->shelves[i];
+        if (shelf->h >= h && shelf->last_used != atlas->frame
+                && (!lru || shelf->last_used < lru->last_used))
+            lru = shelf;
+    }
+    if (!lru)
+        return NULL;
+
+    rehashGlyphs(atlas, atlas->glyph_capacity, lru - atlas->shelves);
+
+    // Cleared, so the new glyphs do not bleed into stale ones
+    memset(&atlas->pixels[lru->y * atlas->width], 0, lru->h * atlas->width);
+    markDirty(atlas, lru->y, lru->y + lru->h);
+
+    lru->x = 0;
+    lru->generation++;
+    atlas->evictions++;
+    return lru;
+}
+
+/**
+ * Finds space for a w x h bitmap. Uses the tightest shelf with room that is
+ * high enough, then a new shelf, which may grow the atlas, then an evicted
+ * shelf. Returns NULL if there is no space.
+ */
+static FontShelf *allocRect(FontAtlas *atlas, unsigned w, unsigned h, unsigned *x, unsigned *y) {
+    if (w > atlas->width)
+        return NULL;
+
+    FontShelf *best = NULL;
+    for (unsigned i = 0; i < atlas->shelf_cnt; i++) {
+        FontShelf *shelf = &atlas->shelves[i];
+        if (shelf->x + w <= atlas->width && shelf->h >= h && (!best || shelf->h < best->h))
+            best = shelf;
+    }
+
+    // The last shelf can still grow, if the glyph does not waste much of it
+    FontShelf *last = atlas->shelf_cnt ? &atlas->shelves[atlas->shelf_cnt - 1] : NULL;
+    if (!best && last && last->x + w <= atlas->width && h <= last->h * 5/4
+            && last->y + h <= atlas->height) {
+        last->h = h;
+        best = last;
+    }
+
+    if (!best) {
+        unsigned top = last ? last->y + last->h + FONT_GLYPH_GAP : 0;
+        while (top + h > atlas->height && atlas->height * 2 <= atlas->max_height) {
+            atlas->pixels = realloc(atlas->pixels, atlas->width * atlas->height * 2);
+            assert(atlas->pixels != NULL);
+            memset(&atlas->pixels[atlas->width * atlas->height], 0, atlas->width * atlas->height);
+            atlas->height *= 2;
+            atlas->resized = true;
+        }
+        if (top + h <= atlas->height)
+            best = addShelf(atlas, top, h);
+    }
+
+    if (!best)
+        best = evictShelf(atlas, h);
+    if (!best)
+        return NULL;
+
+    *x = best->x;
+    *y = best->y;
+    best->x += w + FONT_GLYPH_GAP;
+    return best;
+}
+
+/**
+ * Returns the glyph of a codepoint, it is rasterized into the atlas on first
+ * use. The pointer is valid until the next call. Returns NULL if there is no
+ * space for the glyph this frame.
+ */
+const Glyph *font_glyph(FontAtlas *atlas, int codepoint) {
+    atlas->lookups++;
+
+    Glyph *glyph = findSlot(atlas->glyphs, atlas->glyph_capacity, codepoint);
+    if (glyph->codepoint == codepoint) {
+        atlas->hits++;
+        if (glyph->shelf >= 0)
+            atlas->shelves[glyph->shelf].last_used = atlas->frame;
+        return glyph;
+    }
+
+    // Every shelf is in use until the next frame, no point rasterizing
+    if (atlas->full && atlas->full_frame == atlas->frame)
+        return NULL;
+
+    int advance, lsb;
+    stbtt_GetCodepointHMetrics(atlas->font, codepoint, &advance, &lsb);
+
+    int w, h, xoff, yoff;
+    uint8_t *sdf = stbtt_GetCodepointSDF(atlas->font, atlas->scale, codepoint,
+            FONT_SDF_PADDING, FONT_ONEDGE, (float)FONT_ONEDGE / FONT_SDF_PADDING,
+            &w, &h, &xoff, &yoff);
+    atlas->rasterized++;
+
+    // Placed first, an eviction rebuilds the hash table
+    FontShelf *shelf = NULL;
+    unsigned x = 0, y = 0;
+    if (sdf) {
+        shelf = allocRect(atlas, w, h, &x, &y);
+        if (!shelf) {
+            // Not cached, it is tried again once shelves are free. Reported
+            // when the atlas becomes full, not for every frame it stays full.
+            if (!atlas->full || atlas->full_frame + 1 < atlas->frame)
+                printf("Error(Font): Glyph atlas is full\n");
+            atlas->full = true;
+            atlas->full_frame = atlas->frame;
+            stbtt_FreeSDF(sdf, NULL);
+            return NULL;
+        }
+    }
+
+    if (2 * (atlas->glyph_cnt + 1) > atlas->glyph_capacity)
+        rehashGlyphs(atlas, atlas->glyph_capacity * 2, -1);
+
+    glyph = findSlot(atlas->glyphs, atlas->glyph_capacity, codepoint);
+    memset(glyph, 0, sizeof(Glyph));
+    glyph->codepoint = codepoint;
+    glyph->shelf = -1;
+    glyph->advance = advance * atlas->scale;
+    atlas->glyph_cnt++;
+
+    if (shelf) {
+        for (int row = 0; row < h; row++)
+            memcpy(&atlas->pixels[(y + row) * atlas->width + x], &sdf[row * w], w);
+        markDirty(atlas, y, y + h);
+
+        shelf->last_used = atlas->frame;
+        glyph->shelf = shelf - atlas->shelves;
+        glyph->x = x;
+        glyph->y = y;
+        glyph->w = w;
+        glyph->h = h;
+        glyph->xoff = xoff;
+        glyph->yoff = yoff;
+    }
+
+    stbtt_FreeSDF(sdf, NULL);
+    return glyph;
+}
+
+static int decodeUtf8(const char **s) {
+    const unsigned char *p = (const unsigned char *)*s;
+    int cp, extra;
+
+    if (p[0] < 0x80)      { cp = p[0];        extra = 0; }
+    else if (p[0] < 0xe0) { cp = p[0] & 0x1f; extra = 1; }
+    else if (p[0] < 0xf0) { cp = p[0] & 0x0f; extra = 2; }
+    else                  { cp = p[0] & 0x07; extra = 3; }
+
+    p++;
+    for (int i = 0; i < extra && (*p & 0xc0) == 0x80; i++)
+        cp = (cp << 6) | (*p++ & 0x3f);
+
+    *s = (const char *)p;
+    return cp;
+}
+
+static void pushQuad(TextNote *note, float x0, float y0, float x1, float y1,
+        float u0, float v0, float u1, float v1) {
+    if (note->vert_cnt + 6 > note->vert_capacity) {
+        note->vert_capacity = note->vert_capacity ? note->vert_capacity * 2 : 96;
+        note->verts = realloc(note->verts, note->vert_capacity * 4*sizeof(float));
+        assert(note->verts != NULL);
+    }
+
+    float quad[6][4] = {
+        { x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x1, y1, u1, v1 },
+        { x0, y0, u0, v0 }, { x1, y1, u1, v1 }, { x0, y1, u0, v1 },
+    };
+    memcpy(&note->verts[4 * note->vert_cnt], quad, sizeof(quad));
+    note->vert_cnt += 6;
+}
+
+static void addShelfRef(FontAtlas *atlas, TextNote *note, int shelf) {
+    for (unsigned i = 0; i < note->shelf_ref_cnt; i++) {
+        if (note->shelf_refs[i].shelf == (unsigned)shelf)
+            return;
+    }
+
+    if (note->shelf_ref_cnt >= note->shelf_ref_capacity) {
+        note->shelf_ref_capacity = note->shelf_ref_capacity ? note->shelf_ref_capacity*2 : 8;
+        note->shelf_refs = realloc(note->shelf_refs, note->shelf_ref_capacity * sizeof(ShelfRef));
+        assert(note->shelf_refs != NULL);
+    }
+    note->shelf_refs[note->shelf_ref_cnt++] = (ShelfRef){
+        .shelf = shelf,
+        .generation = atlas->shelves[shelf].generation,
+    };
+}
+
+/**
+ * Lays out the text of a note as glyph quads in atlas pixels, rasterizing
+ * glyphs that are not in the atlas yet.
+ */
+void font_layout(FontAtlas *atlas, TextNote *note) {
+    note->vert_cnt = 0;
+    note->shelf_ref_cnt = 0;
+    note->missing_glyphs = false;
+    note->bbox_min = (Vec2){ 0, 0 };
+    note->bbox_max = (Vec2){ 0, atlas->line_height };
+
+    Vec2 pen = { 0, atlas->ascent };
+    int prev = 0;
+    const char *s = note->text;
+    const char *end = note->text + note->len;
+    while (s < end) {
+        int cp = decodeUtf8(&s);
+        if (cp == '\n') {
+            pen.x = 0;
+            pen.y += atlas->line_height;
+            note->bbox_max.y = fmax(note->bbox_max.y, pen.y - atlas->descent);
+            prev = 0;
+            continue;
+        }
+
+        if (prev)
+            pen.x += stbtt_GetCodepointKernAdvance(atlas->font, prev, cp) * atlas->scale;
+        prev = cp;
+
+        // Copied, the glyph table may be rehashed by the next lookup
+        const Glyph *glyph = font_glyph(atlas, cp);
+        if (!glyph) {
+            note->missing_glyphs = true;
+            pen.x += 0.5f * atlas->line_height;
+            continue;
+        }
+        Glyph g = *glyph;
+        if (g.w > 0) {
+            addShelfRef(atlas, note, g.shelf);
+            float x0 = pen.x + g.xoff;
+            float y0 = pen.y + g.yoff;
+            pushQuad(note, x0, y0, x0 + g.w, y0 + g.h, g.x, g.y, g.x + g.w, g.y + g.h);
+
+            note->bbox_min.x = fmin(note->bbox_min.x, x0);
+            note->bbox_min.y = fmin(note->bbox_min.y, y0);
+            note->bbox_max.y = fmax(note->bbox_max.y, y0 + g.h);
+        }
+        pen.x += g.advance;
+        note->bbox_max.x = fmax(note->bbox_max.x, pen.x + FONT_SDF_PADDING);
+    }
+
+    note->caret = pen;
+    note->layout_valid = true;
+    note->gpu_valid = false;
+}
+
+/**
+ * Starts a new frame for the LRU eviction: shelves used by notes in this frame
+ * are not evicted.
+ */
+void font_beginFrame(FontAtlas *atlas) {
+    atlas->frame++;
+}
+
+/**
+ * Marks the shelves of a note as used this frame. Returns false if one of them
+ * was evicted since the layout, or glyphs did not fit then, in which case the
+ * note has to be laid out again.
+ */
+bool font_useNote(FontAtlas *atlas, TextNote *note) {
+    if (note->missing_glyphs)
+        note->layout_valid = false;
+    if (!note->layout_valid)
+        return false;
+
+    for (unsigned i = 0; i < note->shelf_ref_cnt; i++) {
+        if (atlas->shelves[note->shelf_refs[i].shelf].generation != note->shelf_refs[i].generation) {
+            note->layout_valid = false;
+            return false;
+        }
+    }
+    for (unsigned i = 0; i < note->shelf_ref_cnt; i++)
+        atlas->shelves[note->shelf_refs[i].shelf].last_used = atlas->frame;
+    return true;
+}
+
+void font_printStats(const FontAtlas *atlas) {
+    printf("Font atlas: %ux%u, %u glyphs on %u shelves, %lu lookups, %.1f%% hits, "
+            "%lu rasterized, %lu shelves evicted\n",
+            atlas->width, atlas->height, atlas->glyph_cnt, atlas->shelf_cnt,
+            atlas->lookups, atlas->lookups ? 100.0 * atlas->hits / atlas->lookups : 0,
+            atlas->rasterized, atlas->evictions);
+}
+
+TextNote *font_noteInit(Vec2 pos, double size) {
+    TextNote *note = calloc(1, sizeof(TextNote));
+    assert(note != NULL);
+
+    note->capacity = 64;
+    note->text = malloc(note->capacity);
+    assert(note->text != NULL);
+    note->text[0] = '\0';
+
+    note->pos = pos;
+    note->size = size;
+    return note;
+}
+
+void font_noteDeinit(TextNote *note) {
+    if (note) {
+        free(note->text);
+        free(note->verts);
+        free(note->shelf_refs);
+        free(note);
+    }
+}
+
+/**
+ * Appends a codepoint to the text, encoded as UTF-8.
+ */
+void font_noteAppend(TextNote *note, int codepoint) {
+    if (note->len + 5 > note->capacity) {
+        note->capacity *= 2;
+        note->text = realloc(note->text, note->capacity);
+        assert(note->text != NULL);
+    }
+
+    char *p = &note->text[note->len];
+    if (codepoint < 0x80) {
+        *p++ = codepoint;
+    } else if (codepoint < 0x800) {
+        *p++ = 0xc0 | (codepoint >> 6);
+        *p++ = 0x80 | (codepoint & 0x3f);
+    } else if (codepoint < 0x10000) {
+        *p++ = 0xe0 | (codepoint >> 12);
+        *p++ = 0x80 | ((codepoint >> 6) & 0x3f);
+        *p++ = 0x80 | (codepoint & 0x3f);
+    } else {
+        *p++ = 0xf0 | (codepoint >> 18);
+        *p++ = 0x80 | ((codepoint >> 12) & 0x3f);
+        *p++ = 0x80 | ((codepoint >> 6) & 0x3f);
+        *p++ = 0x80 | (codepoint & 0x3f);
+    }
+    *p = '\0';
+
+    note->len = p - note->text;
+    note->layout_valid = false;
+}
+
+/**
+ * Removes the last character. Returns false if the text was empty.
+ */
+bool font_noteBackspace(TextNote *note) {
+    if (note->len == 0)
+        return false;
+
+    note->len--;
+    while (note->len > 0 && (note->text[note->len] & 0xc0) == 0x80)
+        note->len--;
+    note->text[note->len] = '\0';
+
+    note->layout_valid = false;
+    return true;
+}
@@ -1,41 +1,237 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <glad/glad.h>
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "gl.h"
 
-GLuint gl_createProgram(Shader shaders[]) {
-    // Inspired by https://github.com/fcaruso/GLSLParametricCurve
-    // TODO: Add some debugging
-    int success;
+#define GL_CACHE_MAGIC 0x4250564e   // "NVPB"
+#define GL_MAX_SHADERS 8
+
+static uint64_t hashStr(uint64_t h, const char *str) {
+    // FNV-1a
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        h ^= *c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/**
+ * Key for the program binary cache. Binaries are only valid for the driver
+ * that created them, so the vendor, renderer and version strings are part of
+ * the key, next to the sources themselves.
+ */
+static uint64_t cacheKey(const char *sources[], int count) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (size_t i = 0; i < sizeof(strings)/sizeof(GLenum); i++) {
+        const char *str = (const char *)glGetString(strings[i]);
+        h = hashStr(h, str ? str : "");
+        h = hashStr(h, "\n");
+    }
+
+    for (int i = 0; i < count; i++) {
+        h = hashStr(h, sources[i] ? sources[i] : "");
+        h = hashStr(h, "\x1f");
+    }
+    return h;
+}
+
+/**
+ * Cache file for `key` in $XDG_CACHE_HOME/vectornotes (or ~/.cache). Returns
+ * false if caching is disabled ($VN_NO_SHADER_CACHE) or no home is set.
+ */
+static bool cachePath(char *buf, size_t size, uint64_t key, bool create_dir) {
+    if (getenv("VN_NO_SHADER_CACHE"))
+        return false;
+
+    char dir[512];
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && *xdg) {
+        snprintf(dir, sizeof(dir), "%s/vectornotes", xdg);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        if (create_dir) mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "%s/.cache/vectornotes", home);
+    } else {
+        return false;
+    }
+
+    if (create_dir)
+        mkdir(dir, 0755);
+
+    snprintf(buf, size, "%s/%016llx.bin", dir, (unsigned long long)key);
+    return true;
+}
+
+/**
+ * Tries to create a program from a cached binary. Returns 0 if there is no
+ * (valid) binary for these sources and this driver.
+ */
+GLuint gl_loadProgramBinary(const char *sources[], int count) {
+    char path[600];
+    if (!cachePath(path, sizeof(path), cacheKey(sources, count), false))
+        return 0;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    uint32_t header[3];     // magic, format, length
+    if (fread(header, sizeof(header), 1, fp) != 1 || header[0] != GL_CACHE_MAGIC) {
+        fclose(fp);
+        return 0;
+    }
+
+    void *data = malloc(header[2]);
+    if (!data || fread(data, 1, header[2], fp) != header[2]) {
+        free(data);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
 
     GLuint program = glCreateProgram();
+    glProgramBinary(program, header[1], data, header[2]);
+    free(data);
 
-    Shader *shader = shaders;
-    while (shader->type != GL_NONE) {
-        shader->id = glCreateShader(shader->type);
+    // The driver may reject the binary (e.g. after an update), just recompile
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
 
-        if (shader->is_path) {
-            FILE *fp = fopen(shader->source, "r");
+    return program;
+}
+
+void gl_storeProgramBinary(const char *sources[], int count, GLuint program) {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0)
+        return;
+
+    char path[600];
+    if (!cachePath(path, sizeof(path), cacheKey(sources, count), true))
+        return;
+
+    GLint len = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0)
+        return;
+
+    void *data = malloc(len);
+    if (!data)
+        return;
+
+    GLenum format;
+    glGetProgramBinary(program, len, &len, &format, data);
+
+    // Write to a temp file first, so a crash never leaves a truncated binary
+    char tmp[620];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        uint32_t header[3] = { GL_CACHE_MAGIC, format, len };
+        bool ok = fwrite(header, sizeof(header), 1, fp) == 1
+            && fwrite(data, 1, len, fp) == (size_t)len;
+        ok = fclose(fp) == 0 && ok;
+        if (ok)
+            rename(tmp, path);
+        else
+            remove(tmp);
+    }
+
+    free(data);
+}
+
+const char *gl_embeddedSource(const char *name) {
+    for (const EmbeddedShader *s = gl_embedded_shaders; s->name; s++) {
+        if (strcmp(s->name, name) == 0)
+            return s->source;
+    }
+    return NULL;
+}
+
+static char *readFile(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    size_t len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
 
-            fseek(fp, 0, SEEK_END);
-            size_t len = ftell(fp);
-            fseek(fp, 0, SEEK_SET);
+    char * const buf = malloc(len + 1);
+    if (buf) {
+        len = fread(buf, 1, len, fp);
+        buf[len] = '\0';
+    }
+    fclose(fp);
 
-            char * const buf = malloc(len + 1);
+    return buf;
+}
 
-            fread(buf, 1, len, fp);
-            fclose(fp);
+/**
+ * Creates a program from the given shaders. For `is_path` shaders the sources
+ * embedded at build time are used, the file is only read when it was not
+ * embedded. Linked programs are cached as binaries, later starts skip the
+ * compile and link steps. Returns 0 on failure.
+ */
+GLuint gl_createProgram(Shader shaders[]) {
+    // Inspired by https://github.com/fcaruso/GLSLParametricCurve
+    int success;
 
-            buf[len] = '\0';
+    // Gather the sources first, they are needed for the cache key
+    const char *sources[GL_MAX_SHADERS*2];
+    char *owned[GL_MAX_SHADERS] = {0};
+    char types[GL_MAX_SHADERS][16];
+    int count = 0;
 
-            glShaderSource(shader->id, 1, (const char *const *)&buf, NULL);
-            free(buf);
-        } else {
-            glShaderSource(shader->id, 1, &shader->source, NULL);
+    GLuint program = 0;
+
+    for (Shader *shader = shaders; shader->type != GL_NONE; shader++, count++) {
+        if (count >= GL_MAX_SHADERS) {
+            printf("Error(GL): Too many shaders in program\n");
+            goto cleanup;
+        }
+
+        const char *src = shader->source;
+        if (shader->is_path) {
+            src = gl_embeddedSource(shader->source);
+            if (!src) {
+                src = owned[count] = readFile(shader->source);
+            }
+            if (!src) {
+                printf("Error(GL): Shader source '%s' not found\n", shader->source);
+                goto cleanup;
+            }
         }
 
+        snprintf(types[count], sizeof(types[count]), "%u", shader->type);
+        sources[2*count] = types[count];
+        sources[2*count + 1] = src;
+    }
+
+    program = gl_loadProgramBinary(sources, 2*count);
+    if (program)
+        goto cleanup;
+
+    program = glCreateProgram();
+    for (int i = 0; i < count; i++) {
+        Shader *shader = &shaders[i];
+        shader->id = glCreateShader(shader->type);
+
+        glShaderSource(shader->id, 1, &sources[2*i + 1], NULL);
         glCompileShader(shader->id);
 
         glGetShaderiv(shader->id, GL_COMPILE_STATUS, &success);
@@ -43,27 +239,35 @@ GLuint gl_createProgram(Shader shaders[]) {
             char info[512];
             glGetShaderInfoLog(shader->id, 512, NULL, info);
             printf("Error(GL): Shader compilation failed;\n%s\n", info);
-            return 0;
+            glDeleteProgram(program);
+            program = 0;
+            goto cleanup;
         }
 
         glAttachShader(program, shader->id);
-        shader++;
     }
 
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program);
     glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
         char info[512];
         glGetProgramInfoLog(program, 512, NULL, info);
         printf("Error(GL): Shader program linking failed;\n%s\n", info);
-        return 0;
+        glDeleteProgram(program);
+        program = 0;
+        goto cleanup;
     }
 
-    shader = shaders;
-    while (shader->type != GL_NONE) {
-        glDeleteShader(shader->id);
-        shader->id = 0;
-        shader++;
+    gl_storeProgramBinary(sources, 2*count, program);
+
+cleanup:
+    for (int i = 0; i < count && i < GL_MAX_SHADERS; i++) {
+        if (shaders[i].id) {
+            glDeleteShader(shaders[i].id);
+            shaders[i].id = 0;
+        }
+        free(owned[i]);
     }
 
     return program;
@@ -0,0 +1,305 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <GLFW/glfw3.h>
+
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The implementation is compiled into nanovg.c. Only the loader thread
+// decodes, stb_image keeps its error state in a global.
+#include "nanovg/stb_image.h"
+
+#include "image.h"
+#include "vec.h"
+
+// Decoded by the file extension, stb_image guesses some formats (TGA) from
+// any data
+static const char *IMAGE_EXTENSIONS[] = {
+    ".png", ".jpg", ".jpeg", ".bmp", ".gif", ".tga", ".psd", ".pnm", ".ppm", ".pgm",
+};
+
+typedef struct image_loader {
+    pthread_t thread;
+    bool started;
+    bool quit;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    Image *head;        // Queued images, oldest first
+    Image *tail;
+} ImageLoader;
+
+ImageLoader g_loader = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static void freeImage(Image *image) {
+    for (unsigned i = 0; i < image->level_cnt; i++) {
+        free(image->levels[i].pixels);
+        free(image->levels[i].tiles);
+    }
+    free(image->filename);
+    free(image);
+}
+
+/**
+ * Next level of the pyramid, 2x2 box filter. The last row and column of odd
+ * sized levels are averaged with themselves.
+ */
+static void downsample(const ImageLevel *src, ImageLevel *dst) {
+    dst->width = (src->width + 1) / 2;
+    dst->height = (src->height + 1) / 2;
+    dst->pixels = malloc((size_t)dst->width * dst->height * 4);
+    assert(dst->pixels != NULL);
+
+    for (unsigned y = 0; y < dst->height; y++) {
+        unsigned y0 = 2*y;
+        unsigned y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        const uint8_t *r0 = src->pixels + (size_t)y0 * src->width * 4;
+        const uint8_t *r1 = src->pixels + (size_t)y1 * src->width * 4;
+        uint8_t *out = dst->pixels + (size_t)y * dst->width * 4;
+
+        for (unsigned x = 0; x < dst->width; x++) {
+            unsigned x0 = 2*x * 4;
+            unsigned x1 = 2*x + 1 < src->width ? x0 + 4 : x0;
+            for (int c = 0; c < 4; c++)
+                out[4*x + c] = (r0[x0+c] + r0[x1+c] + r1[x0+c] + r1[x1+c] + 2) / 4;
+        }
+    }
+}
+
+static void addTiles(ImageLevel *level) {
+    level->tiles_x = (level->width + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+    level->tiles_y = (level->height + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+    level->tiles = calloc((size_t)level->tiles_x * level->tiles_y, sizeof(ImageTile));
+    assert(level->tiles != NULL);
+}
+
+/**
+ * Decodes the image and builds its levels, on the loader thread.
+ */
+static bool decode(Image *image) {
+    int w, h, n;
+    uint8_t *pixels = stbi_load(image->filename, &w, &h, &n, 4);
+    if (!pixels) {
+        printf("Error(Image): Could not decode '%s': %s\n", image->filename, stbi_failure_reason());
+        return false;
+    }
+
+    // stb_image allocates with malloc, so the pixels are kept as level 0
+    ImageLevel *level = &image->levels[0];
+    level->width = w;
+    level->height = h;
+    level->pixels = pixels;
+    addTiles(level);
+    image->level_cnt = 1;
+    image->tiles_pending = level->tiles_x * level->tiles_y;
+
+    while (image->level_cnt < IMAGE_MAX_LEVELS
+            && (level->width > IMAGE_TILE_SIZE || level->height > IMAGE_TILE_SIZE)) {
+        ImageLevel *next = &image->levels[image->level_cnt++];
+        downsample(level, next);
+        addTiles(next);
+        image->tiles_pending += next->tiles_x * next->tiles_y;
+        level = next;
+    }
+    return true;
+}
+
+static void *loaderThread(void *arg) {
+    ImageLoader *loader = arg;
+
+    pthread_mutex_lock(&loader->lock);
+    for (;;) {
+        while (!loader->quit && !loader->head)
+            pthread_cond_wait(&loader->wake, &loader->lock);
+        if (loader->quit)
+            break;
+
+        Image *image = loader->head;
+        loader->head = image->next;
+        if (!loader->head)
+            loader->tail = NULL;
+        image->next = NULL;
+        atomic_store(&image->state, IMAGE_decoding);
+        pthread_mutex_unlock(&loader->lock);
+
+        double t = glfwGetTime();
+        bool ok = decode(image);
+
+        pthread_mutex_lock(&loader->lock);
+        if (atomic_load(&image->cancelled)) {
+            freeImage(image);
+            continue;
+        }
+        if (ok) {
+            printf("Decoded %s, %ux%u, %u levels in %f s\n", image->filename,
+                    image->width, image->height, image->level_cnt, glfwGetTime() - t);
+        }
+        atomic_store(&image->state, ok ? IMAGE_ready : IMAGE_failed);
+    }
+    pthread_mutex_unlock(&loader->lock);
+
+    return NULL;
+}
+
+bool image_isSupported(const char *filename) {
+    const char *ext = strrchr(filename, '.');
+    if (!ext)
+        return false;
+
+    for (size_t i = 0; i < sizeof(IMAGE_EXTENSIONS)/sizeof(*IMAGE_EXTENSIONS); i++) {
+        const char *e = IMAGE_EXTENSIONS[i];
+        size_t j = 0;
+        while (e[j] && ext[j] && tolower((unsigned char)ext[j]) == e[j])
+            j++;
+        if (!e[j] && !ext[j])
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Queues an image for decoding and returns right away, only the header is
+ * read here. The image is drawn once its state is IMAGE_ready.
+ */
+Image *image_load(const char *filename, Vec2 pos, double scale) {
+    ImageLoader *loader = &g_loader;
+
+    int w, h, n;
+    if (!stbi_info(filename, &w, &h, &n)) {
+        printf("Error(Image): Could not read '%s'\n", filename);
+        return NULL;
+    }
+
+    Image *image = calloc(1, sizeof(Image));
+    assert(image != NULL);
+    image->filename = strdup(filename);
+    assert(image->filename != NULL);
+    image->pos = pos;
+    image->scale = scale;
+    image->width = w;
+    image->height = h;
+    atomic_init(&image->state, IMAGE_queued);
+    atomic_init(&image->cancelled, false);
+
+    pthread_mutex_lock(&loader->lock);
+    if (!loader->started) {
+        if (pthread_create(&loader->thread, NULL, loaderThread, loader) != 0) {
+            pthread_mutex_unlock(&loader->lock);
+            printf("Error(Image): Could not start the loader thread\n");
+            freeImage(image);
+            return NULL;
+        }
+        loader->started = true;
+    }
+
+    if (loader->tail)
+        loader->tail->next = image;
+    else
+        loader->head = image;
+    loader->tail = image;
+    pthread_cond_signal(&loader->wake);
+    pthread_mutex_unlock(&loader->lock);
+
+    return image;
+}
+
+/**
+ * Frees the image, the textures of uploaded tiles must be deleted before. An
+ * image still being decoded is freed by the loader when it is done.
+ */
+void image_deinit(Image *image) {
+    ImageLoader *loader = &g_loader;
+
+    pthread_mutex_lock(&loader->lock);
+    int state = atomic_load(&image->state);
+    if (state == IMAGE_decoding) {
+        atomic_store(&image->cancelled, true);
+        pthread_mutex_unlock(&loader->lock);
+        return;
+    }
+
+    if (state == IMAGE_queued) {
+        Image **link = &loader->head;
+        Image *prev = NULL;
+        while (*link != image) {
+            prev = *link;
+            link = &(*link)->next;
+        }
+        *link = image->next;
+        if (loader->tail == image)
+            loader->tail = prev;
+    }
+    pthread_mutex_unlock(&loader->lock);
+
+    freeImage(image);
+}
+
+/**
+ * Copies tile `tx`, `ty` of a level with its border to `dest`, which holds
+ * IMAGE_TILE_TEXELS^2 RGBA pixels. Pixels outside the level repeat the edge,
+ * so the border filters like the neighbouring tile.
+ */
+void image_copyTile(const Image *image, unsigned level, unsigned tx, unsigned ty, uint8_t *dest) {
+    const ImageLevel *l = &image->levels[level];
+    assert(l->pixels != NULL);
+
+    int x0 = (int)(tx * IMAGE_TILE_SIZE) - IMAGE_TILE_BORDER;
+    int y0 = (int)(ty * IMAGE_TILE_SIZE) - IMAGE_TILE_BORDER;
+    for (int y = 0; y < IMAGE_TILE_TEXELS; y++) {
+        int sy = y0 + y;
+        if (sy < 0) sy = 0;
+        if (sy >= (int)l->height) sy = l->height - 1;
+        const uint8_t *row = l->pixels + (size_t)sy * l->width * 4;
+        uint8_t *out = dest + (size_t)y * IMAGE_TILE_TEXELS * 4;
+
+        for (int x = 0; x < IMAGE_TILE_TEXELS; x++) {
+            int sx = x0 + x;
+            if (sx < 0) sx = 0;
+            if (sx >= (int)l->width) sx = l->width - 1;
+            memcpy(out + 4*x, row + 4*sx, 4);
+        }
+    }
+}
+
+/**
+ * Counts an uploaded tile, the pixels are freed after the last one.
+ */
+void image_tileUploaded(Image *image) {
+    assert(image->tiles_pending > 0);
+    if (--image->tiles_pending > 0)
+        return;
+
+    for (unsigned i = 0; i < image->level_cnt; i++) {
+        free(image->levels[i].pixels);
+        image->levels[i].pixels = NULL;
+    }
+}
+
+/**
+ * Stops the loader thread. Images still queued stay queued.
+ */
+void image_loaderDeinit(void) {
+    ImageLoader *loader = &g_loader;
+
+    pthread_mutex_lock(&loader->lock);
+    if (!loader->started) {
+        pthread_mutex_unlock(&loader->lock);
+        return;
+    }
+    loader->quit = true;
+    pthread_cond_broadcast(&loader->wake);
+    pthread_mutex_unlock(&loader->lock);
+
+    pthread_join(loader->thread, NULL);
+    loader->started = false;
+    loader->quit = false;
+}
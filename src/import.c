@@ -0,0 +1,462 @@
+// Bulk import of SVG paths and raw polylines.
+//
+// Every subpath becomes one Path. Subpaths with cubic (or quadratic) segments
+// are taken as-is, subpaths made of straight lines only are treated as raw
+// strokes and fitted with `fitCurve`, in parallel batches. Polyline files use
+// the format printed by the 'P' key: one `{x, y},` per line, with strokes
+// separated by blank lines.
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affine.h"
+#include "import.h"
+#include "path.h"
+#include "vec.h"
+
+typedef struct path_list {
+    Path **items;
+    unsigned cnt;
+    unsigned capacity;
+} PathList;
+
+typedef struct importer {
+    PathList out;       // Result, polylines have a NULL placeholder
+    PathList polys;     // Polylines which still have to be fitted
+    unsigned *poly_slots;   // Index in `out` for every polyline
+    unsigned poly_slots_capacity;
+
+    // Current subpath
+    Path *sub;
+    bool sub_curved;
+    Affine transform;
+} Importer;
+
+static void listPush(PathList *list, Path *path) {
+    if (list->cnt >= list->capacity) {
+        list->capacity = list->capacity ? list->capacity*2 : 64;
+        list->items = realloc(list->items, list->capacity * sizeof(Path*));
+        assert(list->items != NULL);
+    }
+    list->items[list->cnt++] = path;
+}
+
+static void addPolyline(Importer *imp, Path *poly) {
+    if (imp->polys.cnt >= imp->poly_slots_capacity) {
+        imp->poly_slots_capacity = imp->poly_slots_capacity ? imp->poly_slots_capacity*2 : 64;
+        imp->poly_slots = realloc(imp->poly_slots, imp->poly_slots_capacity * sizeof(unsigned));
+        assert(imp->poly_slots != NULL);
+    }
+    imp->poly_slots[imp->polys.cnt] = imp->out.cnt;
+    listPush(&imp->polys, poly);
+    listPush(&imp->out, NULL);
+}
+
+static void beginSubpath(Importer *imp, Vec2 p) {
+    imp->sub = path_init(0);
+    imp->sub_curved = false;
+    path_addNode(imp->sub, p);
+}
+
+/**
+ * Finishes the current subpath. Curved subpaths keep the transform of the
+ * <path> element, polylines are transformed to canvas coordinates first so
+ * they are fitted at the right scale.
+ */
+static void endSubpath(Importer *imp) {
+    Path *sub = imp->sub;
+    imp->sub = NULL;
+    if (!sub)
+        return;
+
+    if (sub->node_cnt < 2) {
+        path_deinit(sub);
+    } else if (imp->sub_curved) {
+        sub->type = PATHTYPE_bezier;
+        sub->transform = imp->transform;
+        path_localize(sub);
+        // Fitted polylines come out exact, this one still has the default capacity
+        path_resize(sub, sub->node_cnt);
+        listPush(&imp->out, sub);
+    } else {
+        if (!affine_isIdentity(imp->transform)) {
+            for (unsigned i = 0; i < sub->node_cnt; i++)
+                sub->nodes[i] = affine_apply(imp->transform, sub->nodes[i]);
+            path_updateBBox(sub);
+        }
+        addPolyline(imp, sub);
+    }
+}
+
+static void addLine(Importer *imp, Vec2 p) {
+    Path *sub = imp->sub;
+    Vec2 *prev = path_getNode(sub, -1);
+
+    if (!imp->sub_curved) {
+        // Duplicate points break the tangent calculations of the fitter
+        if (prev->x != p.x || prev->y != p.y)
+            path_addNode(sub, p);
+        return;
+    }
+
+    // Straight segment inside a curved path, store it as a degenerate cubic
+    Vec2 d = vec2_sub(p, *prev);
+    path_addNode(sub, vec2_add(*prev, vec2_scalarMult(d, 1.0/3)));
+    path_addNode(sub, vec2_add(*prev, vec2_scalarMult(d, 2.0/3)));
+    path_addNode(sub, p);
+}
+
+static void addCubic(Importer *imp, Vec2 c1, Vec2 c2, Vec2 p) {
+    Path *sub = imp->sub;
+
+    if (!imp->sub_curved) {
+        // Convert the lines so far into degenerate cubics
+        Path *lines = sub;
+        imp->sub = path_init(lines->node_cnt*3 + 4);
+        imp->sub_curved = true;
+        path_addNode(imp->sub, lines->nodes[0]);
+        for (unsigned i = 1; i < lines->node_cnt; i++)
+            addLine(imp, lines->nodes[i]);
+        path_deinit(lines);
+        sub = imp->sub;
+    }
+
+    path_addNode(sub, c1);
+    path_addNode(sub, c2);
+    path_addNode(sub, p);
+}
+
+static const char *skipSeparators(const char *s, const char *end) {
+    while (s < end && (*s == ' ' || *s == ',' || *s == '\t' || *s == '\n' || *s == '\r'))
+        s++;
+    return s;
+}
+
+static bool parseNumber(const char **s, const char *end, double *out) {
+    const char *p = skipSeparators(*s, end);
+    if (p >= end)
+        return false;
+
+    char *num_end;
+    *out = strtod(p, &num_end);
+    if (num_end == p || num_end > end)
+        return false;
+
+    *s = num_end;
+    return true;
+}
+
+static bool parsePoint(const char **s, const char *end, Vec2 *out) {
+    return parseNumber(s, end, &out->x) && parseNumber(s, end, &out->y);
+}
+
+static bool isCommand(char c) {
+    return strchr("MmLlHhVvCcSsQqZz", c) != NULL && c != '\0';
+}
+
+/**
+ * Parses SVG path data. Supported: M, L, H, V, C, S, Q and Z, absolute and
+ * relative. Parsing stops at the first unsupported command.
+ */
+static void parsePathData(Importer *imp, const char *s, const char *end) {
+    char cmd = 0;
+    Vec2 cur = {0, 0};
+    Vec2 start = {0, 0};
+    Vec2 last_ctrl = {0, 0};    // For smooth 'S' curves
+
+    for (;;) {
+        s = skipSeparators(s, end);
+        if (s >= end)
+            break;
+
+        if (isCommand(*s)) {
+            cmd = *s++;
+        } else if (!cmd || ((*s < '0' || *s > '9') && *s != '-' && *s != '+' && *s != '.')) {
+            printf("Warning(import): Unsupported path command '%c'\n", *s);
+            break;
+        }
+
+        bool rel = cmd >= 'a' && cmd <= 'z';
+        Vec2 base = rel ? cur : (Vec2){0, 0};
+        Vec2 p, c1, c2;
+
+        switch (cmd) {
+        case 'M': case 'm':
+            if (!parsePoint(&s, end, &p)) goto done;
+            endSubpath(imp);
+            cur = start = vec2_add(base, p);
+            beginSubpath(imp, cur);
+            // Following coordinate pairs are implicit line-to commands
+            cmd = rel ? 'l' : 'L';
+            break;
+
+        case 'L': case 'l':
+            if (!imp->sub || !parsePoint(&s, end, &p)) goto done;
+            cur = vec2_add(base, p);
+            addLine(imp, cur);
+            break;
+
+        case 'H': case 'h':
+            if (!imp->sub || !parseNumber(&s, end, &p.x)) goto done;
+            cur.x = base.x + p.x;
+            addLine(imp, cur);
+            break;
+
+        case 'V': case 'v':
+            if (!imp->sub || !parseNumber(&s, end, &p.y)) goto done;
+            cur.y = base.y + p.y;
+            addLine(imp, cur);
+            break;
+
+        case 'C': case 'c':
+            if (!imp->sub || !parsePoint(&s, end, &c1) || !parsePoint(&s, end, &c2)
+                    || !parsePoint(&s, end, &p)) goto done;
+            c1 = vec2_add(base, c1);
+            c2 = vec2_add(base, c2);
+            cur = vec2_add(base, p);
+            addCubic(imp, c1, c2, cur);
+            last_ctrl = c2;
+            break;
+
+        case 'S': case 's':
+            if (!imp->sub || !parsePoint(&s, end, &c2) || !parsePoint(&s, end, &p)) goto done;
+            c1 = vec2_sub(vec2_scalarMult(cur, 2), last_ctrl);
+            c2 = vec2_add(base, c2);
+            cur = vec2_add(base, p);
+            addCubic(imp, c1, c2, cur);
+            last_ctrl = c2;
+            break;
+
+        case 'Q': case 'q': {
+            Vec2 q;
+            if (!imp->sub || !parsePoint(&s, end, &q) || !parsePoint(&s, end, &p)) goto done;
+            q = vec2_add(base, q);
+            p = vec2_add(base, p);
+            // Degree elevation
+            c1 = vec2_add(cur, vec2_scalarMult(vec2_sub(q, cur), 2.0/3));
+            c2 = vec2_add(p, vec2_scalarMult(vec2_sub(q, p), 2.0/3));
+            addCubic(imp, c1, c2, p);
+            cur = p;
+            last_ctrl = c2;
+        } break;
+
+        case 'Z': case 'z':
+            if (imp->sub) {
+                addLine(imp, start);
+                endSubpath(imp);
+            }
+            cur = start;
+            cmd = 0;
+            break;
+
+        default:
+            goto done;
+        }
+
+        if (cmd != 'C' && cmd != 'c' && cmd != 'S' && cmd != 's')
+            last_ctrl = cur;
+    }
+
+done:
+    endSubpath(imp);
+}
+
+/**
+ * Finds `name="` (or with single quotes) within a tag, returns a pointer to the
+ * value and sets `value_end` to the closing quote.
+ */
+static const char *findAttr(const char *tag, const char *tag_end, const char *name,
+        const char **value_end) {
+    size_t len = strlen(name);
+    for (const char *s = tag; s + len + 2 < tag_end; s++) {
+        bool boundary = s[-1] == ' ' || s[-1] == '\t' || s[-1] == '\n' || s[-1] == '\r';
+        if (!boundary || strncmp(s, name, len) != 0 || s[len] != '=')
+            continue;
+
+        char quote = s[len+1];
+        if (quote != '"' && quote != '\'')
+            continue;
+
+        const char *value = s + len + 2;
+        const char *e = memchr(value, quote, tag_end - value);
+        if (!e)
+            return NULL;
+
+        *value_end = e;
+        return value;
+    }
+    return NULL;
+}
+
+static Affine parseTransform(const char *s, const char *end) {
+    Affine m = affine_identity();
+    if (!s)
+        return m;
+
+    s = skipSeparators(s, end);
+    if (end - s > 7 && strncmp(s, "matrix(", 7) == 0) {
+        s += 7;
+        double v[6];
+        for (int i = 0; i < 6; i++) {
+            if (!parseNumber(&s, end, &v[i]))
+                return affine_identity();
+        }
+        m = (Affine){ v[0], v[1], v[2], v[3], v[4], v[5] };
+    } else if (end - s > 10 && strncmp(s, "translate(", 10) == 0) {
+        s += 10;
+        Vec2 t = {0, 0};
+        if (!parseNumber(&s, end, &t.x))
+            return m;
+        parseNumber(&s, end, &t.y);
+        m = affine_translate(t);
+    } else {
+        printf("Warning(import): Unsupported transform, ignored\n");
+    }
+    return m;
+}
+
+static void parseSvg(Importer *imp, const char *buf, size_t len) {
+    const char *end = buf + len;
+    const char *s = buf;
+
+    while ((s = strstr(s, "<path")) != NULL) {
+        const char *tag = s + 5;
+        const char *tag_end = memchr(tag, '>', end - tag);
+        if (!tag_end)
+            break;
+
+        const char *d_end = NULL;
+        const char *d = findAttr(tag, tag_end, "d", &d_end);
+
+        const char *t_end = NULL;
+        const char *t = findAttr(tag, tag_end, "transform", &t_end);
+        imp->transform = parseTransform(t, t_end);
+
+        if (d)
+            parsePathData(imp, d, d_end);
+
+        s = tag_end;
+    }
+}
+
+static void parsePolylines(Importer *imp, const char *buf, size_t len) {
+    const char *end = buf + len;
+    const char *s = buf;
+
+    imp->transform = affine_identity();
+
+    while (s < end) {
+        const char *line_end = memchr(s, '\n', end - s);
+        if (!line_end)
+            line_end = end;
+
+        const char *p = s;
+        while (p < line_end && (*p == ' ' || *p == '\t' || *p == '{'))
+            p++;
+
+        Vec2 v;
+        if (parsePoint(&p, line_end, &v)) {
+            if (imp->sub)
+                addLine(imp, v);
+            else
+                beginSubpath(imp, v);
+        } else {
+            // Blank or unknown line, ends the current stroke
+            endSubpath(imp);
+        }
+
+        s = line_end + 1;
+    }
+
+    endSubpath(imp);
+}
+
+static char *readFile(const char *filename, size_t *len) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return NULL;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    char *buf = malloc(size + 1);
+    assert(buf != NULL);
+
+    *len = fread(buf, 1, size, fp);
+    buf[*len] = '\0';
+    fclose(fp);
+
+    return buf;
+}
+
+/**
+ * Imports all paths from an SVG or polyline file. Polylines are fitted in
+ * parallel batches at the given scale. Returns a malloc'd array of `count`
+ * paths, or NULL on error.
+ */
+Path **import_file(const char *filename, double scale, unsigned *count) {
+    size_t len;
+    char *buf = readFile(filename, &len);
+    if (!buf) {
+        printf("Error(import): Could not read '%s'\n", filename);
+        return NULL;
+    }
+
+    Importer imp = {0};
+    if (strstr(buf, "<svg") || strstr(buf, "<path"))
+        parseSvg(&imp, buf, len);
+    else
+        parsePolylines(&imp, buf, len);
+
+    free(buf);
+
+    if (imp.polys.cnt > 0) {
+        Path **fitted = path_fitBezierN(imp.polys.items, imp.polys.cnt, scale);
+        for (unsigned i = 0; i < imp.polys.cnt; i++) {
+            imp.out.items[imp.poly_slots[i]] = fitted[i];
+            path_deinit(imp.polys.items[i]);
+        }
+        free(fitted);
+    }
+    free(imp.polys.items);
+    free(imp.poly_slots);
+
+    *count = imp.out.cnt;
+    if (!imp.out.items)
+        imp.out.items = malloc(sizeof(Path*));
+    return imp.out.items;
+}
+
+/**
+ * Reads the raw strokes of a polyline file without fitting them, e.g. as a
+ * corpus for the fit tuner. Returns a malloc'd array of `count` paths, or NULL
+ * on error.
+ */
+Path **import_readPolylines(const char *filename, unsigned *count) {
+    size_t len;
+    char *buf = readFile(filename, &len);
+    if (!buf) {
+        printf("Error(import): Could not read '%s'\n", filename);
+        return NULL;
+    }
+
+    Importer imp = {0};
+    parsePolylines(&imp, buf, len);
+    free(buf);
+
+    free(imp.out.items);
+    free(imp.poly_slots);
+
+    *count = imp.polys.cnt;
+    if (!imp.polys.items)
+        imp.polys.items = malloc(sizeof(Path*));
+    return imp.polys.items;
+}
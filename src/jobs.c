@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "jobs.h"
+
+#define JOBS_MAX_THREADS 64
+
+typedef struct job_pool {
+    pthread_t threads[JOBS_MAX_THREADS];
+    unsigned thread_cnt;    // Worker threads, excluding the caller
+    bool initialized;
+    bool quit;
+
+    pthread_mutex_t run_lock;   // Serializes jobs_parallelFor calls
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned generation;
+    unsigned busy;
+
+    // Current job
+    JobFn fn;
+    void *ctx;
+    size_t count;
+    size_t batch;
+    atomic_size_t next;
+} JobPool;
+
+JobPool g_jobs = {
+    .run_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void runBatches(JobPool *pool) {
+    for (;;) {
+        size_t begin = atomic_fetch_add(&pool->next, pool->batch);
+        if (begin >= pool->count)
+            break;
+
+        size_t end = begin + pool->batch;
+        if (end > pool->count) end = pool->count;
+
+        pool->fn(pool->ctx, begin, end);
+    }
+}
+
+static void *worker(void *arg) {
+    JobPool *pool = arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        runBatches(pool);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->busy -= 1;
+        if (pool->busy == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static void poolInit(JobPool *pool) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *env = getenv("VN_THREADS");
+    if (env && atoi(env) > 0)
+        cores = atoi(env);
+    if (cores < 1) cores = 1;
+    if (cores > JOBS_MAX_THREADS) cores = JOBS_MAX_THREADS;
+
+    pool->thread_cnt = 0;
+    for (long i = 0; i < cores - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker, pool) != 0)
+            break;
+        pool->thread_cnt += 1;
+    }
+    pool->initialized = true;
+}
+
+unsigned jobs_threadCount(void) {
+    JobPool *pool = &g_jobs;
+
+    pthread_mutex_lock(&pool->run_lock);
+    if (!pool->initialized)
+        poolInit(pool);
+    unsigned cnt = pool->thread_cnt + 1;
+    pthread_mutex_unlock(&pool->run_lock);
+
+    return cnt;
+}
+
+/**
+ * Calls `fn` for consecutive ranges of at most `batch` items until all `count`
+ * items are processed, spread over the worker threads. Returns when all items
+ * are done. Must not be called from within a job.
+ */
+void jobs_parallelFor(size_t count, size_t batch, JobFn fn, void *ctx) {
+    JobPool *pool = &g_jobs;
+
+    if (count == 0)
+        return;
+    if (batch == 0)
+        batch = 1;
+
+    pthread_mutex_lock(&pool->run_lock);
+    if (!pool->initialized)
+        poolInit(pool);
+
+    if (pool->thread_cnt == 0 || count <= batch) {
+        pthread_mutex_unlock(&pool->run_lock);
+        fn(ctx, 0, count);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->batch = batch;
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->thread_cnt;
+    pool->generation += 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    runBatches(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->run_lock);
+}
+
+void jobs_deinit(void) {
+    JobPool *pool = &g_jobs;
+
+    pthread_mutex_lock(&pool->run_lock);
+    if (pool->initialized) {
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = true;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (unsigned i = 0; i < pool->thread_cnt; i++)
+            pthread_join(pool->threads[i], NULL);
+
+        pool->thread_cnt = 0;
+        pool->initialized = false;
+        pool->quit = false;
+    }
+    pthread_mutex_unlock(&pool->run_lock);
+}
@@ -19,10 +19,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "bench.h"
+#include "compact.h"
 #include "fit_bezier.h"
 #include "gl.h"
+#include "jobs.h"
+#include "mem.h"
 #include "path.h"
+#include "raster.h"
+#include "record.h"
 #include "tool.h"
+#include "tune.h"
 #include "vec.h"
 #include "vectornotes.h"
 
@@ -37,10 +44,35 @@ static void glfwError(int id, const char* desc) {
     fprintf(stderr, "Error(GLFW): %s\n", desc);
 }
 
-int main(void) {
+int main(int argc, char *argv[]) {
+    // Headless commands
+    if (argc > 1 && strcmp(argv[1], "tune") == 0)
+        return tune_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "fitbench") == 0)
+        return tune_benchMain(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "flattenbench") == 0)
+        return bench_flattenMain(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "pickbench") == 0)
+        return bench_pickMain(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "geombench") == 0)
+        return bench_geomMain(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "render") == 0)
+        return raster_main(argc - 1, argv + 1);
+    if (argc > 1 && strcmp(argv[1], "compact") == 0)
+        return compact_main(argc - 1, argv + 1);
+
     g_path = path_init(0);
     dbg = path_init(0);
 
+    // Replays run the fitter like the window does, with its debug output
+    if (argc > 1 && strcmp(argv[1], "replay") == 0) {
+        int ret = record_replayMain(argc - 1, argv + 1);
+        path_deinit(g_path);
+        path_deinit(dbg);
+        path_freeFitCtx();
+        return ret;
+    }
+
     glfwSetErrorCallback(&glfwError);
     glfwInit();
 
@@ -49,9 +81,25 @@ int main(void) {
         glfwTerminate();
         return -1;
     }
-    vn->tools[TOOLS_pencil] = pencil_init();
-    vn->tool_cnt += 1;
-    vn->active_tool = TOOLS_pencil;
+    // Pencil input filter stages, e.g. --filter euro,rdp, the font of text
+    // notes, a default font if not given, and the fit parameters (see `tune`),
+    // which apply to everything fitted from here on
+    const char *filter_spec = NULL;
+    const char *font_file = NULL;
+    for (int i = 1; i+1 < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0)
+            filter_spec = argv[i+1];
+        if (strcmp(argv[i], "--font") == 0)
+            font_file = argv[i+1];
+        if (strcmp(argv[i], "--fit-profile") == 0) {
+            FitParams params = fit_defaultParams();
+            if (fit_loadParams(argv[i+1], &params))
+                path_setFitParams(&params);
+        }
+    }
+    vn_loadFont(vn, font_file);
+
+    vn_addTools(vn, filter_spec);
 
     Vec2 test[] = {
         //{400.0, 200.0},
@@ -117,8 +165,45 @@ int main(void) {
                 new->nodes[i+3].x, new->nodes[i+3].y);
     }
 
+    // Notebook directory, e.g. --notebook notes --page-budget 512 (MB of
+    // resident pages)
+    const char *notebook_dir = NULL;
+    size_t page_budget = 0;
+    for (int i = 1; i+1 < argc; i++) {
+        if (strcmp(argv[i], "--notebook") == 0)
+            notebook_dir = argv[i+1];
+        if (strcmp(argv[i], "--page-budget") == 0)
+            page_budget = (size_t)(atof(argv[i+1]) * 1024 * 1024);
+    }
+    if (notebook_dir)
+        vn_openNotebook(vn, notebook_dir, page_budget);
+
+    // Files given on the command line are imported into the canvas
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "--filter") == 0 || strcmp(argv[i], "--font") == 0
+                    || strcmp(argv[i], "--fit-profile") == 0
+                    || strcmp(argv[i], "--notebook") == 0 || strcmp(argv[i], "--page-budget") == 0
+                    || strcmp(argv[i], "--record") == 0)
+                && i+1 < argc) {
+            i++;
+            continue;
+        }
+        vn_importFile(vn, argv[i]);
+    }
+
+    // Time since glfwInit, to measure cold start up to the first frame
+    double startup_time = glfwGetTime();
+    bool first_frame = true;
+
     glfwSetTime(0);
 
+    // Input session recording, e.g. --record session.vnr, replayed with
+    // `vectornotes replay session.vnr` on the same files
+    for (int i = 1; i+1 < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0)
+            vn->recorder = record_open(argv[i+1], vn->view_width, vn->view_height, 0);
+    }
+
     //Path *paths[16];
     //size_t path_cnt = 0;
     //NVGcontext *vg = vn->vg;
@@ -200,12 +285,27 @@ int main(void) {
         //        vn->view_scale);
 
         glfwSwapBuffers(vn->window);
+
+        if (first_frame) {
+            printf("First frame after %f s\n", startup_time + glfwGetTime());
+            first_frame = false;
+        }
         glfwWaitEventsTimeout(0.016666);
     }
+    if (vn->recorder)
+        record_close(vn->recorder);
+    vn->recorder = NULL;
+
+    mem_printStats();
+
     path_deinit(g_path);
     path_deinit(dbg);
     path_deinit(new);
 
+    select_deinit(vn->tools[TOOLS_select]);
+    text_deinit(vn->tools[TOOLS_text]);
     vn_deinit(vn);
+    jobs_deinit();
+    path_freeFitCtx();
     return 0;
 }
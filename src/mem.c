@@ -0,0 +1,162 @@
+#include <assert.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mem.h"
+
+// Precedes every block, padded so the block keeps malloc's alignment
+typedef struct mem_header {
+    alignas(max_align_t) size_t size;
+    MemTag tag;
+} MemHeader;
+
+typedef struct mem_counter {
+    _Atomic size_t live;
+    _Atomic size_t peak;
+    _Atomic size_t blocks;
+} MemCounter;
+
+static MemCounter g_counters[MEM_count];
+
+static const char *g_tag_names[MEM_count] = {
+    [MEM_path] = "paths",
+    [MEM_fit] = "fit scratch",
+    [MEM_nvg_commands] = "nvg commands",
+    [MEM_nvg_cache] = "nvg cache",
+    [MEM_nvg_gl] = "nvg gl",
+    [MEM_gl] = "gl buffers",
+};
+
+static void add(MemTag tag, size_t bytes, size_t blocks) {
+    MemCounter *c = &g_counters[tag];
+    size_t live = atomic_fetch_add(&c->live, bytes) + bytes;
+    atomic_fetch_add(&c->blocks, blocks);
+
+    size_t peak = atomic_load(&c->peak);
+    while (live > peak && !atomic_compare_exchange_weak(&c->peak, &peak, live))
+        ;
+}
+
+static void sub(MemTag tag, size_t bytes, size_t blocks) {
+    MemCounter *c = &g_counters[tag];
+    atomic_fetch_sub(&c->live, bytes);
+    atomic_fetch_sub(&c->blocks, blocks);
+}
+
+static MemHeader *header(void *ptr) {
+    return (MemHeader *)ptr - 1;
+}
+
+void *mem_malloc(MemTag tag, size_t size) {
+    assert(tag < MEM_count);
+    if (size > SIZE_MAX - sizeof(MemHeader))
+        return NULL;
+
+    MemHeader *h = malloc(sizeof(MemHeader) + size);
+    if (!h)
+        return NULL;
+    h->size = size;
+    h->tag = tag;
+    add(tag, size, 1);
+    return h + 1;
+}
+
+void *mem_calloc(MemTag tag, size_t count, size_t size) {
+    if (size > 0 && count > (SIZE_MAX - sizeof(MemHeader)) / size)
+        return NULL;
+
+    void *ptr = mem_malloc(tag, count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    return ptr;
+}
+
+/**
+ * Like realloc. The block moves to `tag` if it had another one.
+ */
+void *mem_realloc(MemTag tag, void *ptr, size_t size) {
+    if (!ptr)
+        return mem_malloc(tag, size);
+    if (size > SIZE_MAX - sizeof(MemHeader))
+        return NULL;
+
+    MemHeader *h = header(ptr);
+    size_t old_size = h->size;
+    MemTag old_tag = h->tag;
+
+    h = realloc(h, sizeof(MemHeader) + size);
+    if (!h)
+        return NULL;
+    h->size = size;
+    h->tag = tag;
+
+    sub(old_tag, old_size, 1);
+    add(tag, size, 1);
+    return h + 1;
+}
+
+void mem_free(void *ptr) {
+    if (!ptr)
+        return;
+
+    MemHeader *h = header(ptr);
+    sub(h->tag, h->size, 1);
+    free(h);
+}
+
+/**
+ * Moves a block to another tag, e.g. when a buffer is handed to another
+ * subsystem.
+ */
+void mem_retag(void *ptr, MemTag tag) {
+    MemHeader *h = header(ptr);
+    if (h->tag == tag)
+        return;
+
+    sub(h->tag, h->size, 1);
+    add(tag, h->size, 1);
+    h->tag = tag;
+}
+
+/**
+ * Accounts `bytes` more (or less, if negative) memory allocated outside of
+ * mem_malloc.
+ */
+void mem_track(MemTag tag, ptrdiff_t bytes) {
+    assert(tag < MEM_count);
+    if (bytes >= 0)
+        add(tag, bytes, 0);
+    else
+        sub(tag, -bytes, 0);
+}
+
+MemStats mem_getStats(MemTag tag) {
+    assert(tag < MEM_count);
+    MemCounter *c = &g_counters[tag];
+    return (MemStats){
+        .live = atomic_load(&c->live),
+        .peak = atomic_load(&c->peak),
+        .blocks = atomic_load(&c->blocks),
+    };
+}
+
+size_t mem_totalLive(void) {
+    size_t total = 0;
+    for (unsigned i = 0; i < MEM_count; i++)
+        total += atomic_load(&g_counters[i].live);
+    return total;
+}
+
+void mem_printStats(void) {
+    printf("Memory          live KiB     peak KiB     blocks\n");
+    for (unsigned i = 0; i < MEM_count; i++) {
+        MemStats stats = mem_getStats(i);
+        printf("  %-12s %11.1f  %11.1f  %9zu\n", g_tag_names[i],
+                stats.live / 1024.0, stats.peak / 1024.0, stats.blocks);
+    }
+    printf("  %-12s %11.1f\n", "total", mem_totalLive() / 1024.0);
+}
@@ -17,11 +17,13 @@
 //
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <math.h>
 #include <memory.h>
 
 #include "nanovg.h"
+#include "mem.h"
 #define FONTSTASH_IMPLEMENTATION
 #include "fontstash.h"
 
@@ -123,6 +125,8 @@ struct NVGcontext {
 	NVGpathCache* cache;
 	float tessTol;
 	float distTol;
+	float flattenTol;
+	int curveTess;
 	float fringeWidth;
 	float devicePxRatio;
 	struct FONScontext* fs;
@@ -167,29 +171,29 @@ static float nvg__normalize(float *x, float* y)
 static void nvg__deletePathCache(NVGpathCache* c)
 {
 	if (c == NULL) return;
-	if (c->points != NULL) free(c->points);
-	if (c->paths != NULL) free(c->paths);
-	if (c->verts != NULL) free(c->verts);
-	free(c);
+	if (c->points != NULL) mem_free(c->points);
+	if (c->paths != NULL) mem_free(c->paths);
+	if (c->verts != NULL) mem_free(c->verts);
+	mem_free(c);
 }
 
 static NVGpathCache* nvg__allocPathCache(void)
 {
-	NVGpathCache* c = (NVGpathCache*)malloc(sizeof(NVGpathCache));
+	NVGpathCache* c = (NVGpathCache*)mem_malloc(MEM_nvg_cache, sizeof(NVGpathCache));
 	if (c == NULL) goto error;
 	memset(c, 0, sizeof(NVGpathCache));
 
-	c->points = (NVGpoint*)malloc(sizeof(NVGpoint)*NVG_INIT_POINTS_SIZE);
+	c->points = (NVGpoint*)mem_malloc(MEM_nvg_cache, sizeof(NVGpoint)*NVG_INIT_POINTS_SIZE);
 	if (!c->points) goto error;
 	c->npoints = 0;
 	c->cpoints = NVG_INIT_POINTS_SIZE;
 
-	c->paths = (NVGpath*)malloc(sizeof(NVGpath)*NVG_INIT_PATHS_SIZE);
+	c->paths = (NVGpath*)mem_malloc(MEM_nvg_cache, sizeof(NVGpath)*NVG_INIT_PATHS_SIZE);
 	if (!c->paths) goto error;
 	c->npaths = 0;
 	c->cpaths = NVG_INIT_PATHS_SIZE;
 
-	c->verts = (NVGvertex*)malloc(sizeof(NVGvertex)*NVG_INIT_VERTS_SIZE);
+	c->verts = (NVGvertex*)mem_malloc(MEM_nvg_cache, sizeof(NVGvertex)*NVG_INIT_VERTS_SIZE);
 	if (!c->verts) goto error;
 	c->nverts = 0;
 	c->cverts = NVG_INIT_VERTS_SIZE;
@@ -204,6 +208,7 @@ static void nvg__setDevicePixelRatio(NVGcontext* ctx, float ratio)
 {
 	ctx->tessTol = 0.25f / ratio;
 	ctx->distTol = 0.01f / ratio;
+	ctx->flattenTol = 0.25f / ratio;
 	ctx->fringeWidth = 1.0f / ratio;
 	ctx->devicePxRatio = ratio;
 }
@@ -289,7 +294,7 @@ static NVGstate* nvg__getState(NVGcontext* ctx)
 NVGcontext* nvgCreateInternal(NVGparams* params)
 {
 	FONSparams fontParams;
-	NVGcontext* ctx = (NVGcontext*)malloc(sizeof(NVGcontext));
+	NVGcontext* ctx = (NVGcontext*)mem_malloc(MEM_nvg_commands, sizeof(NVGcontext));
 	int i;
 	if (ctx == NULL) goto error;
 	memset(ctx, 0, sizeof(NVGcontext));
@@ -298,7 +303,7 @@ NVGcontext* nvgCreateInternal(NVGparams* params)
 	for (i = 0; i < NVG_MAX_FONTIMAGES; i++)
 		ctx->fontImages[i] = 0;
 
-	ctx->commands = (float*)malloc(sizeof(float)*NVG_INIT_COMMANDS_SIZE);
+	ctx->commands = (float*)mem_malloc(MEM_nvg_commands, sizeof(float)*NVG_INIT_COMMANDS_SIZE);
 	if (!ctx->commands) goto error;
 	ctx->ncommands = 0;
 	ctx->ccommands = NVG_INIT_COMMANDS_SIZE;
@@ -347,7 +352,7 @@ void nvgDeleteInternal(NVGcontext* ctx)
 {
 	int i;
 	if (ctx == NULL) return;
-	if (ctx->commands != NULL) free(ctx->commands);
+	if (ctx->commands != NULL) mem_free(ctx->commands);
 	if (ctx->cache != NULL) nvg__deletePathCache(ctx->cache);
 
 	if (ctx->fs)
@@ -363,7 +368,294 @@ void nvgDeleteInternal(NVGcontext* ctx)
 	if (ctx->params.renderDelete != NULL)
 		ctx->params.renderDelete(ctx->params.userPtr);
 
-	free(ctx);
+	mem_free(ctx);
+}
+
+// Worker contexts record the tessellated calls instead of rendering them.
+// Vertex pointers of the recorded paths are stored as offsets into the
+// recording's vertex arena, as the arena may move while it grows.
+enum NVGrecordType {
+	NVG_REC_FILL,
+	NVG_REC_STROKE,
+	NVG_REC_TRIANGLES,
+};
+
+struct NVGrecordedCall {
+	int type;
+	NVGpaint paint;
+	NVGcompositeOperationState compositeOperation;
+	NVGscissor scissor;
+	float fringe;
+	float strokeWidth;
+	float bounds[4];
+	int pathOffset;
+	int npaths;
+	int vertOffset;		// Triangles only
+	int nverts;
+};
+typedef struct NVGrecordedCall NVGrecordedCall;
+
+struct NVGrecording {
+	NVGrecordedCall* calls;
+	int ncalls;
+	int ccalls;
+	NVGpath* paths;
+	int npaths;
+	int cpaths;
+	NVGvertex* verts;
+	int nverts;
+	int cverts;
+};
+typedef struct NVGrecording NVGrecording;
+
+static int nvg__recCreate(void* uptr) { return 1; }
+static int nvg__recCreateTexture(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data) { return 0; }
+static int nvg__recDeleteTexture(void* uptr, int image) { return 0; }
+static int nvg__recUpdateTexture(void* uptr, int image, int x, int y, int w, int h, const unsigned char* data) { return 0; }
+static int nvg__recGetTextureSize(void* uptr, int image, int* w, int* h) { return 0; }
+static void nvg__recViewport(void* uptr, float width, float height, float devicePixelRatio) { }
+static void nvg__recFlush(void* uptr) { }
+
+static void nvg__recCancel(void* uptr)
+{
+	NVGrecording* rec = (NVGrecording*)uptr;
+	rec->ncalls = 0;
+	rec->npaths = 0;
+	rec->nverts = 0;
+}
+
+static void nvg__recDelete(void* uptr)
+{
+	NVGrecording* rec = (NVGrecording*)uptr;
+	if (rec == NULL) return;
+	mem_free(rec->calls);
+	mem_free(rec->paths);
+	mem_free(rec->verts);
+	mem_free(rec);
+}
+
+static NVGrecordedCall* nvg__recAllocCall(NVGrecording* rec)
+{
+	if (rec->ncalls+1 > rec->ccalls) {
+		NVGrecordedCall* calls;
+		int ccalls = nvg__maxi(rec->ncalls+1, 128) + rec->ccalls/2;
+		calls = (NVGrecordedCall*)mem_realloc(MEM_nvg_cache, rec->calls, sizeof(NVGrecordedCall)*ccalls);
+		if (calls == NULL) return NULL;
+		rec->calls = calls;
+		rec->ccalls = ccalls;
+	}
+	memset(&rec->calls[rec->ncalls], 0, sizeof(NVGrecordedCall));
+	return &rec->calls[rec->ncalls++];
+}
+
+static int nvg__recAllocPaths(NVGrecording* rec, int n)
+{
+	int ret;
+	if (rec->npaths+n > rec->cpaths) {
+		NVGpath* paths;
+		int cpaths = nvg__maxi(rec->npaths+n, 128) + rec->cpaths/2;
+		paths = (NVGpath*)mem_realloc(MEM_nvg_cache, rec->paths, sizeof(NVGpath)*cpaths);
+		if (paths == NULL) return -1;
+		rec->paths = paths;
+		rec->cpaths = cpaths;
+	}
+	ret = rec->npaths;
+	rec->npaths += n;
+	return ret;
+}
+
+static int nvg__recAllocVerts(NVGrecording* rec, int n)
+{
+	int ret;
+	if (rec->nverts+n > rec->cverts) {
+		NVGvertex* verts;
+		int cverts = nvg__maxi(rec->nverts+n, 4096) + rec->cverts/2;
+		verts = (NVGvertex*)mem_realloc(MEM_nvg_cache, rec->verts, sizeof(NVGvertex)*cverts);
+		if (verts == NULL) return -1;
+		rec->verts = verts;
+		rec->cverts = cverts;
+	}
+	ret = rec->nverts;
+	rec->nverts += n;
+	return ret;
+}
+
+// Copies the vertices of the paths into the arena, returns the offset of the
+// first path or -1.
+static int nvg__recPaths(NVGrecording* rec, const NVGpath* paths, int npaths)
+{
+	int i, offset = nvg__recAllocPaths(rec, npaths);
+	if (offset == -1) return -1;
+
+	for (i = 0; i < npaths; i++) {
+		NVGpath* dst = &rec->paths[offset + i];
+		int fill = nvg__recAllocVerts(rec, paths[i].nfill);
+		int stroke = nvg__recAllocVerts(rec, paths[i].nstroke);
+		if (fill == -1 || stroke == -1) return -1;
+
+		*dst = paths[i];
+		if (paths[i].nfill > 0)
+			memcpy(&rec->verts[fill], paths[i].fill, sizeof(NVGvertex)*paths[i].nfill);
+		if (paths[i].nstroke > 0)
+			memcpy(&rec->verts[stroke], paths[i].stroke, sizeof(NVGvertex)*paths[i].nstroke);
+		dst->fill = (NVGvertex*)(intptr_t)fill;
+		dst->stroke = (NVGvertex*)(intptr_t)stroke;
+	}
+	return offset;
+}
+
+static void nvg__recFill(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+						 const float* bounds, const NVGpath* paths, int npaths)
+{
+	NVGrecording* rec = (NVGrecording*)uptr;
+	int offset = nvg__recPaths(rec, paths, npaths);
+	NVGrecordedCall* call;
+	if (offset == -1) return;
+
+	call = nvg__recAllocCall(rec);
+	if (call == NULL) return;
+	call->type = NVG_REC_FILL;
+	call->paint = *paint;
+	call->compositeOperation = compositeOperation;
+	call->scissor = *scissor;
+	call->fringe = fringe;
+	memcpy(call->bounds, bounds, sizeof(call->bounds));
+	call->pathOffset = offset;
+	call->npaths = npaths;
+}
+
+static void nvg__recStroke(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe,
+						   float strokeWidth, const NVGpath* paths, int npaths)
+{
+	NVGrecording* rec = (NVGrecording*)uptr;
+	int offset = nvg__recPaths(rec, paths, npaths);
+	NVGrecordedCall* call;
+	if (offset == -1) return;
+
+	call = nvg__recAllocCall(rec);
+	if (call == NULL) return;
+	call->type = NVG_REC_STROKE;
+	call->paint = *paint;
+	call->compositeOperation = compositeOperation;
+	call->scissor = *scissor;
+	call->fringe = fringe;
+	call->strokeWidth = strokeWidth;
+	call->pathOffset = offset;
+	call->npaths = npaths;
+}
+
+static void nvg__recTriangles(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor,
+							  const NVGvertex* verts, int nverts, float fringe)
+{
+	NVGrecording* rec = (NVGrecording*)uptr;
+	int offset = nvg__recAllocVerts(rec, nverts);
+	NVGrecordedCall* call;
+	if (offset == -1) return;
+	memcpy(&rec->verts[offset], verts, sizeof(NVGvertex)*nverts);
+
+	call = nvg__recAllocCall(rec);
+	if (call == NULL) return;
+	call->type = NVG_REC_TRIANGLES;
+	call->paint = *paint;
+	call->compositeOperation = compositeOperation;
+	call->scissor = *scissor;
+	call->fringe = fringe;
+	call->vertOffset = offset;
+	call->nverts = nverts;
+}
+
+NVGcontext* nvgCreateWorker(NVGcontext* ctx)
+{
+	NVGrecording* rec;
+	NVGcontext* worker = (NVGcontext*)mem_malloc(MEM_nvg_commands, sizeof(NVGcontext));
+	if (worker == NULL) return NULL;
+	memset(worker, 0, sizeof(NVGcontext));
+
+	rec = (NVGrecording*)mem_malloc(MEM_nvg_cache, sizeof(NVGrecording));
+	if (rec == NULL) goto error;
+	memset(rec, 0, sizeof(NVGrecording));
+
+	worker->params.userPtr = rec;
+	worker->params.edgeAntiAlias = ctx->params.edgeAntiAlias;
+	worker->params.renderCreate = nvg__recCreate;
+	worker->params.renderCreateTexture = nvg__recCreateTexture;
+	worker->params.renderDeleteTexture = nvg__recDeleteTexture;
+	worker->params.renderUpdateTexture = nvg__recUpdateTexture;
+	worker->params.renderGetTextureSize = nvg__recGetTextureSize;
+	worker->params.renderViewport = nvg__recViewport;
+	worker->params.renderCancel = nvg__recCancel;
+	worker->params.renderFlush = nvg__recFlush;
+	worker->params.renderFill = nvg__recFill;
+	worker->params.renderStroke = nvg__recStroke;
+	worker->params.renderTriangles = nvg__recTriangles;
+	worker->params.renderDelete = nvg__recDelete;
+
+	worker->commands = (float*)mem_malloc(MEM_nvg_commands, sizeof(float)*NVG_INIT_COMMANDS_SIZE);
+	if (!worker->commands) goto error;
+	worker->ncommands = 0;
+	worker->ccommands = NVG_INIT_COMMANDS_SIZE;
+
+	worker->cache = nvg__allocPathCache();
+	if (worker->cache == NULL) goto error;
+
+	nvgSave(worker);
+	nvgReset(worker);
+
+	nvg__setDevicePixelRatio(worker, ctx->devicePxRatio);
+	worker->curveTess = ctx->curveTess;
+
+	return worker;
+
+error:
+	nvgDeleteInternal(worker);
+	return NULL;
+}
+
+void nvgSubmitWorker(NVGcontext* ctx, NVGcontext* worker)
+{
+	NVGrecording* rec = (NVGrecording*)worker->params.userPtr;
+	int i, j;
+
+	// The arena is complete, resolve the vertex offsets
+	for (i = 0; i < rec->npaths; i++) {
+		NVGpath* path = &rec->paths[i];
+		path->fill = rec->verts + (intptr_t)path->fill;
+		path->stroke = rec->verts + (intptr_t)path->stroke;
+	}
+
+	for (i = 0; i < rec->ncalls; i++) {
+		NVGrecordedCall* call = &rec->calls[i];
+		const NVGpath* paths = &rec->paths[call->pathOffset];
+		switch (call->type) {
+		case NVG_REC_FILL:
+			ctx->params.renderFill(ctx->params.userPtr, &call->paint, call->compositeOperation, &call->scissor, call->fringe,
+								   call->bounds, paths, call->npaths);
+			ctx->drawCallCount += 2;
+			for (j = 0; j < call->npaths; j++)
+				ctx->fillTriCount += paths[j].nfill-2 + paths[j].nstroke-2;
+			break;
+		case NVG_REC_STROKE:
+			ctx->params.renderStroke(ctx->params.userPtr, &call->paint, call->compositeOperation, &call->scissor, call->fringe,
+									 call->strokeWidth, paths, call->npaths);
+			for (j = 0; j < call->npaths; j++) {
+				ctx->strokeTriCount += paths[j].nstroke-2;
+				ctx->drawCallCount++;
+			}
+			break;
+		case NVG_REC_TRIANGLES:
+			ctx->params.renderTriangles(ctx->params.userPtr, &call->paint, call->compositeOperation, &call->scissor,
+										&rec->verts[call->vertOffset], call->nverts, call->fringe);
+			ctx->drawCallCount++;
+			break;
+		}
+	}
+
+	nvg__recCancel(rec);
+}
+
+void nvgCurveTessellation(NVGcontext* ctx, int mode)
+{
+	ctx->curveTess = mode;
 }
 
 void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float devicePixelRatio)
@@ -1082,7 +1374,7 @@ static void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 	if (ctx->ncommands+nvals > ctx->ccommands) {
 		float* commands;
 		int ccommands = ctx->ncommands+nvals + ctx->ccommands/2;
-		commands = (float*)realloc(ctx->commands, sizeof(float)*ccommands);
+		commands = (float*)mem_realloc(MEM_nvg_commands, ctx->commands, sizeof(float)*ccommands);
 		if (commands == NULL) return;
 		ctx->commands = commands;
 		ctx->ccommands = ccommands;
@@ -1148,7 +1440,7 @@ static void nvg__addPath(NVGcontext* ctx)
 	if (ctx->cache->npaths+1 > ctx->cache->cpaths) {
 		NVGpath* paths;
 		int cpaths = ctx->cache->npaths+1 + ctx->cache->cpaths/2;
-		paths = (NVGpath*)realloc(ctx->cache->paths, sizeof(NVGpath)*cpaths);
+		paths = (NVGpath*)mem_realloc(MEM_nvg_cache, ctx->cache->paths, sizeof(NVGpath)*cpaths);
 		if (paths == NULL) return;
 		ctx->cache->paths = paths;
 		ctx->cache->cpaths = cpaths;
@@ -1185,7 +1477,7 @@ static void nvg__addPoint(NVGcontext* ctx, float x, float y, int flags)
 	if (ctx->cache->npoints+1 > ctx->cache->cpoints) {
 		NVGpoint* points;
 		int cpoints = ctx->cache->npoints+1 + ctx->cache->cpoints/2;
-		points = (NVGpoint*)realloc(ctx->cache->points, sizeof(NVGpoint)*cpoints);
+		points = (NVGpoint*)mem_realloc(MEM_nvg_cache, ctx->cache->points, sizeof(NVGpoint)*cpoints);
 		if (points == NULL) return;
 		ctx->cache->points = points;
 		ctx->cache->cpoints = cpoints;
@@ -1227,7 +1519,7 @@ static NVGvertex* nvg__allocTempVerts(NVGcontext* ctx, int nverts)
 	if (nverts > ctx->cache->cverts) {
 		NVGvertex* verts;
 		int cverts = (nverts + 0xff) & ~0xff; // Round up to prevent allocations when things change just slightly.
-		verts = (NVGvertex*)realloc(ctx->cache->verts, sizeof(NVGvertex)*cverts);
+		verts = (NVGvertex*)mem_realloc(MEM_nvg_cache, ctx->cache->verts, sizeof(NVGvertex)*cverts);
 		if (verts == NULL) return NULL;
 		ctx->cache->verts = verts;
 		ctx->cache->cverts = cverts;
@@ -1323,6 +1615,56 @@ static void nvg__tesselateBezier(NVGcontext* ctx,
 	nvg__tesselateBezier(ctx, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
 }
 
+// Flattens a cubic with a segment count calculated up front. By Wang's formula
+// n = sqrt(3*2/8 * M / tol) segments keep the polyline within tol of the curve,
+// with M the largest second difference of the control points. The points are
+// evaluated by forward differencing, the end point is added exactly.
+static void nvg__tesselateBezierForward(NVGcontext* ctx,
+								 float x1, float y1, float x2, float y2,
+								 float x3, float y3, float x4, float y4,
+								 int type)
+{
+	float ddx1 = x1 - 2*x2 + x3, ddy1 = y1 - 2*y2 + y3;
+	float ddx2 = x2 - 2*x3 + x4, ddy2 = y2 - 2*y3 + y4;
+	float m = nvg__maxf(nvg__sqrtf(ddx1*ddx1 + ddy1*ddy1), nvg__sqrtf(ddx2*ddx2 + ddy2*ddy2));
+	int i, n = (int)ceilf(nvg__sqrtf(0.75f * m / ctx->flattenTol));
+	float h, h2, h3, ax, ay, bx, by, cx, cy;
+	float x, y, dx, dy, d2x, d2y, d3x, d3y;
+
+	n = nvg__clampi(n, 1, 1024);
+	h = 1.0f / n;
+	h2 = h*h;
+	h3 = h2*h;
+
+	// B(t) = a t^3 + b t^2 + c t + p1
+	ax = -x1 + 3*x2 - 3*x3 + x4;
+	ay = -y1 + 3*y2 - 3*y3 + y4;
+	bx = 3*x1 - 6*x2 + 3*x3;
+	by = 3*y1 - 6*y2 + 3*y3;
+	cx = 3*(x2 - x1);
+	cy = 3*(y2 - y1);
+
+	x = x1;
+	y = y1;
+	dx = ax*h3 + bx*h2 + cx*h;
+	dy = ay*h3 + by*h2 + cy*h;
+	d3x = 6*ax*h3;
+	d3y = 6*ay*h3;
+	d2x = d3x + 2*bx*h2;
+	d2y = d3y + 2*by*h2;
+
+	for (i = 1; i < n; i++) {
+		x += dx;
+		y += dy;
+		dx += d2x;
+		dy += d2y;
+		d2x += d3x;
+		d2y += d3y;
+		nvg__addPoint(ctx, x, y, 0);
+	}
+	nvg__addPoint(ctx, x4, y4, type);
+}
+
 static void nvg__flattenPaths(NVGcontext* ctx)
 {
 	NVGpathCache* cache = ctx->cache;
@@ -1363,7 +1705,10 @@ static void nvg__flattenPaths(NVGcontext* ctx)
 				cp1 = &ctx->commands[i+1];
 				cp2 = &ctx->commands[i+3];
 				p = &ctx->commands[i+5];
-				nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], 0, NVG_PT_CORNER);
+				if (ctx->curveTess == NVG_TESS_FORWARD)
+					nvg__tesselateBezierForward(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], NVG_PT_CORNER);
+				else
+					nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], 0, NVG_PT_CORNER);
 			}
 			i += 7;
 			break;
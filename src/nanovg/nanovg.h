@@ -71,6 +71,11 @@ enum NVGlineCap {
 	NVG_MITER,
 };
 
+enum NVGcurveTessellation {
+	NVG_TESS_SUBDIVIDE,		// Default, recursive midpoint subdivision until flat.
+	NVG_TESS_FORWARD,		// Segment count from an error bound, forward differencing.
+};
+
 enum NVGalign {
 	// Horizontal align
 	NVG_ALIGN_LEFT 		= 1<<0,	// Default, align text horizontally to left.
@@ -154,6 +159,12 @@ enum NVGimageFlags {
 // devicePixelRatio to: frameBufferWidth / windowWidth.
 void nvgBeginFrame(NVGcontext* ctx, float windowWidth, float windowHeight, float devicePixelRatio);
 
+// Sets how bezier curves are flattened, one of NVGcurveTessellation. NVG_TESS_FORWARD
+// calculates the number of segments per curve up front (Wang's formula) and
+// evaluates the points by forward differencing, which avoids over-subdividing
+// gentle curves.
+void nvgCurveTessellation(NVGcontext* ctx, int mode);
+
 // Cancels drawing the current frame.
 void nvgCancelFrame(NVGcontext* ctx);
 
@@ -681,6 +692,16 @@ void nvgDeleteInternal(NVGcontext* ctx);
 
 NVGparams* nvgInternalParams(NVGcontext* ctx);
 
+// Worker contexts build and tessellate paths on other threads. A worker takes
+// the same path, state and fill/stroke calls as ctx, but records the
+// tessellated calls into its own vertex arena instead of rendering them.
+// nvgSubmitWorker() passes the recorded calls on to the back-end of ctx in
+// the order they were made, and clears the worker. A worker may only be used
+// by one thread at a time, text is not supported. Delete with
+// nvgDeleteInternal().
+NVGcontext* nvgCreateWorker(NVGcontext* ctx);
+void nvgSubmitWorker(NVGcontext* ctx, NVGcontext* worker);
+
 // Debug function to dump cached path data.
 void nvgDebugDumpPathCache(NVGcontext* ctx);
 
@@ -112,6 +112,7 @@ enum NVGimageFlagsGL {
 #include <string.h>
 #include <math.h>
 #include "nanovg.h"
+#include "mem.h"
 
 enum GLNVGuniformLoc {
 	GLNVG_LOC_VIEWSIZE,
@@ -360,7 +361,7 @@ static GLNVGtexture* glnvg__allocTexture(GLNVGcontext* gl)
 		if (gl->ntextures+1 > gl->ctextures) {
 			GLNVGtexture* textures;
 			int ctextures = glnvg__maxi(gl->ntextures+1, 4) +  gl->ctextures/2; // 1.5x Overallocate
-			textures = (GLNVGtexture*)realloc(gl->textures, sizeof(GLNVGtexture)*ctextures);
+			textures = (GLNVGtexture*)mem_realloc(MEM_nvg_gl, gl->textures, sizeof(GLNVGtexture)*ctextures);
 			if (textures == NULL) return NULL;
 			gl->textures = textures;
 			gl->ctextures = ctextures;
@@ -438,6 +439,18 @@ static int glnvg__createShader(GLNVGshader* shader, const char* name, const char
 
 	memset(shader, 0, sizeof(*shader));
 
+#ifdef NANOVG_GL_PROGRAM_CACHE_LOAD
+	// Optional program binary cache provided by the application:
+	//   GLuint load(const char* sources[], int count);
+	//   void store(const char* sources[], int count, GLuint prog);
+	const char* cache_src[4] = { header, str[1], vshader, fshader };
+	prog = NANOVG_GL_PROGRAM_CACHE_LOAD(cache_src, 4);
+	if (prog != 0) {
+		shader->prog = prog;
+		return 1;
+	}
+#endif
+
 	prog = glCreateProgram();
 	vert = glCreateShader(GL_VERTEX_SHADER);
 	frag = glCreateShader(GL_FRAGMENT_SHADER);
@@ -466,6 +479,10 @@ static int glnvg__createShader(GLNVGshader* shader, const char* name, const char
 	glBindAttribLocation(prog, 0, "vertex");
 	glBindAttribLocation(prog, 1, "tcoord");
 
+#ifdef NANOVG_GL_PROGRAM_CACHE_STORE
+	glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+
 	glLinkProgram(prog);
 	glGetProgramiv(prog, GL_LINK_STATUS, &status);
 	if (status != GL_TRUE) {
@@ -473,6 +490,10 @@ static int glnvg__createShader(GLNVGshader* shader, const char* name, const char
 		return 0;
 	}
 
+#ifdef NANOVG_GL_PROGRAM_CACHE_STORE
+	NANOVG_GL_PROGRAM_CACHE_STORE(cache_src, 4, prog);
+#endif
+
 	shader->prog = prog;
 	shader->vert = vert;
 	shader->frag = frag;
@@ -1282,7 +1303,7 @@ static GLNVGcall* glnvg__allocCall(GLNVGcontext* gl)
 	if (gl->ncalls+1 > gl->ccalls) {
 		GLNVGcall* calls;
 		int ccalls = glnvg__maxi(gl->ncalls+1, 128) + gl->ccalls/2; // 1.5x Overallocate
-		calls = (GLNVGcall*)realloc(gl->calls, sizeof(GLNVGcall) * ccalls);
+		calls = (GLNVGcall*)mem_realloc(MEM_nvg_gl, gl->calls, sizeof(GLNVGcall) * ccalls);
 		if (calls == NULL) return NULL;
 		gl->calls = calls;
 		gl->ccalls = ccalls;
@@ -1298,7 +1319,7 @@ static int glnvg__allocPaths(GLNVGcontext* gl, int n)
 	if (gl->npaths+n > gl->cpaths) {
 		GLNVGpath* paths;
 		int cpaths = glnvg__maxi(gl->npaths + n, 128) + gl->cpaths/2; // 1.5x Overallocate
-		paths = (GLNVGpath*)realloc(gl->paths, sizeof(GLNVGpath) * cpaths);
+		paths = (GLNVGpath*)mem_realloc(MEM_nvg_gl, gl->paths, sizeof(GLNVGpath) * cpaths);
 		if (paths == NULL) return -1;
 		gl->paths = paths;
 		gl->cpaths = cpaths;
@@ -1314,7 +1335,7 @@ static int glnvg__allocVerts(GLNVGcontext* gl, int n)
 	if (gl->nverts+n > gl->cverts) {
 		NVGvertex* verts;
 		int cverts = glnvg__maxi(gl->nverts + n, 4096) + gl->cverts/2; // 1.5x Overallocate
-		verts = (NVGvertex*)realloc(gl->verts, sizeof(NVGvertex) * cverts);
+		verts = (NVGvertex*)mem_realloc(MEM_nvg_gl, gl->verts, sizeof(NVGvertex) * cverts);
 		if (verts == NULL) return -1;
 		gl->verts = verts;
 		gl->cverts = cverts;
@@ -1330,7 +1351,7 @@ static int glnvg__allocFragUniforms(GLNVGcontext* gl, int n)
 	if (gl->nuniforms+n > gl->cuniforms) {
 		unsigned char* uniforms;
 		int cuniforms = glnvg__maxi(gl->nuniforms+n, 128) + gl->cuniforms/2; // 1.5x Overallocate
-		uniforms = (unsigned char*)realloc(gl->uniforms, structSize * cuniforms);
+		uniforms = (unsigned char*)mem_realloc(MEM_nvg_gl, gl->uniforms, structSize * cuniforms);
 		if (uniforms == NULL) return -1;
 		gl->uniforms = uniforms;
 		gl->cuniforms = cuniforms;
@@ -1549,14 +1570,14 @@ static void glnvg__renderDelete(void* uptr)
 		if (gl->textures[i].tex != 0 && (gl->textures[i].flags & NVG_IMAGE_NODELETE) == 0)
 			glDeleteTextures(1, &gl->textures[i].tex);
 	}
-	free(gl->textures);
+	mem_free(gl->textures);
 
-	free(gl->paths);
-	free(gl->verts);
-	free(gl->uniforms);
-	free(gl->calls);
+	mem_free(gl->paths);
+	mem_free(gl->verts);
+	mem_free(gl->uniforms);
+	mem_free(gl->calls);
 
-	free(gl);
+	mem_free(gl);
 }
 
 
@@ -1572,7 +1593,7 @@ NVGcontext* nvgCreateGLES3(int flags)
 {
 	NVGparams params;
 	NVGcontext* ctx = NULL;
-	GLNVGcontext* gl = (GLNVGcontext*)malloc(sizeof(GLNVGcontext));
+	GLNVGcontext* gl = (GLNVGcontext*)mem_malloc(MEM_nvg_gl, sizeof(GLNVGcontext));
 	if (gl == NULL) goto error;
 	memset(gl, 0, sizeof(GLNVGcontext));
 
@@ -0,0 +1,475 @@
+// Notebook pages on disk. A page file is a header followed by the paths with
+// their nodes, transform and raw stroke samples, as native doubles, so pages
+// load without parsing or refitting:
+//
+//   "VNPG" u32 version, u32 path count
+//   per path: u32 type, u32 node count, 6 doubles transform, nodes,
+//             u32 stroke bytes (0 for none), then if any: u32 sample count,
+//             3 doubles view origin and scale, stroke bytes
+//
+// Pages are written to a temporary file first and renamed over the old one.
+// Instances of shared nodes are stored as separate paths, they are found again
+// when the page is loaded.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "affine.h"
+#include "mem.h"
+#include "notebook.h"
+#include "path.h"
+#include "stroke.h"
+#include "vec.h"
+#include "writer.h"
+
+#define PAGE_MAGIC "VNPG"
+#define PAGE_VERSION 1
+#define PAGE_MIN_CAPACITY 8     // Path array, vn_addPaths doubles it
+
+static char *pageFilename(const Notebook *nb, unsigned index, const char *suffix) {
+    size_t len = strlen(nb->dir) + 32;
+    char *name = malloc(len);
+    assert(name != NULL);
+    snprintf(name, len, "%s/page-%04u.vnp%s", nb->dir, index, suffix);
+    return name;
+}
+
+/**
+ * Memory of a path. Shared nodes are split evenly between their instances, so
+ * the bytes of all paths add up to what is allocated.
+ */
+size_t notebook_pathBytes(const Path *path) {
+    size_t nodes = path->capacity * sizeof(Vec2);
+    if (path->shared)
+        nodes = (nodes + sizeof(PathShared)) / path->shared->refs;
+
+    size_t bytes = sizeof(Path) + nodes;
+    if (path->stroke)
+        bytes += sizeof(Stroke) + path->stroke->size;
+    return bytes;
+}
+
+static size_t pageBytes(const Page *page) {
+    size_t bytes = page->path_capacity * sizeof(Path*);
+    for (unsigned i = 0; i < page->path_cnt; i++)
+        bytes += notebook_pathBytes(page->paths[i]);
+    return bytes;
+}
+
+static void setPageBytes(Notebook *nb, Page *page, size_t bytes) {
+    nb->resident_bytes = nb->resident_bytes - page->bytes + bytes;
+    page->bytes = bytes;
+}
+
+static void pushPage(Notebook *nb) {
+    if (nb->page_cnt >= nb->page_capacity) {
+        nb->page_capacity = nb->page_capacity ? nb->page_capacity*2 : 64;
+        nb->pages = realloc(nb->pages, nb->page_capacity * sizeof(Page));
+        assert(nb->pages != NULL);
+    }
+    memset(&nb->pages[nb->page_cnt++], 0, sizeof(Page));
+}
+
+static void putU32(Writer *w, uint32_t v) {
+    writer_write(w, &v, sizeof(v));
+}
+
+static void putDoubles(Writer *w, const double *v, size_t count) {
+    writer_write(w, v, count * sizeof(double));
+}
+
+bool notebook_savePage(Notebook *nb, unsigned index) {
+    Page *page = &nb->pages[index];
+    assert(page->resident);
+
+    char *tmp = pageFilename(nb, index, ".tmp");
+    char *name = pageFilename(nb, index, "");
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        printf("Error(Notebook): Could not open '%s' for writing\n", tmp);
+        free(tmp);
+        free(name);
+        return false;
+    }
+
+    Writer w;
+    writer_init(&w, fp, NULL, 0);
+    writer_write(&w, PAGE_MAGIC, 4);
+    putU32(&w, PAGE_VERSION);
+    putU32(&w, page->path_cnt);
+
+    for (unsigned i = 0; i < page->path_cnt; i++) {
+        const Path *path = page->paths[i];
+        const Affine *m = &path->transform;
+        double transform[6] = { m->a, m->b, m->c, m->d, m->e, m->f };
+
+        putU32(&w, path->type);
+        putU32(&w, path->node_cnt);
+        putDoubles(&w, transform, 6);
+        putDoubles(&w, (const double *)path->nodes, 2 * path->node_cnt);
+
+        const Stroke *stroke = path->stroke;
+        putU32(&w, stroke ? stroke->size : 0);
+        if (stroke) {
+            double view[3] = { stroke->view_origin.x, stroke->view_origin.y, stroke->view_scale };
+            putU32(&w, stroke->sample_cnt);
+            putDoubles(&w, view, 3);
+            writer_write(&w, stroke->data, stroke->size);
+        }
+    }
+
+    size_t size = w.total;
+    bool ok = writer_deinit(&w);
+    if (fclose(fp) != 0)
+        ok = false;
+    if (ok && rename(tmp, name) != 0)
+        ok = false;
+
+    if (ok) {
+        page->dirty = false;
+        page->file_size = size;
+    } else {
+        printf("Error(Notebook): Failed writing '%s'\n", name);
+        remove(tmp);
+    }
+
+    free(tmp);
+    free(name);
+    return ok;
+}
+
+typedef struct reader {
+    const uint8_t *p;
+    const uint8_t *end;
+    bool error;
+} Reader;
+
+static void readBytes(Reader *r, void *dest, size_t len) {
+    if (r->error || (size_t)(r->end - r->p) < len) {
+        r->error = true;
+        memset(dest, 0, len);
+        return;
+    }
+    memcpy(dest, r->p, len);
+    r->p += len;
+}
+
+static uint32_t readU32(Reader *r) {
+    uint32_t v;
+    readBytes(r, &v, sizeof(v));
+    return v;
+}
+
+static Path *readPath(Reader *r) {
+    uint32_t type = readU32(r);
+    uint32_t node_cnt = readU32(r);
+    double transform[6];
+    readBytes(r, transform, sizeof(transform));
+    if (r->error || type > PATHTYPE_bezier
+            || node_cnt > (size_t)(r->end - r->p) / sizeof(Vec2))
+        return NULL;
+
+    Vec2 *nodes = mem_malloc(MEM_path, (node_cnt > 0 ? node_cnt : 1) * sizeof(Vec2));
+    assert(nodes != NULL);
+    readBytes(r, nodes, node_cnt * sizeof(Vec2));
+
+    Path *path = path_adopt(nodes, node_cnt);
+    path->type = type;
+    path->transform = (Affine){ transform[0], transform[1], transform[2],
+                                transform[3], transform[4], transform[5] };
+
+    uint32_t stroke_size = readU32(r);
+    if (stroke_size > 0 && !r->error) {
+        Stroke *stroke = calloc(1, sizeof(Stroke));
+        assert(stroke != NULL);
+        double view[3];
+        stroke->sample_cnt = readU32(r);
+        readBytes(r, view, sizeof(view));
+        stroke->view_origin = (Vec2){ view[0], view[1] };
+        stroke->view_scale = view[2];
+        if (stroke_size <= (size_t)(r->end - r->p)) {
+            stroke->data = malloc(stroke_size);
+            assert(stroke->data != NULL);
+            stroke->size = stroke_size;
+            readBytes(r, stroke->data, stroke_size);
+            // Decoded only on refit, where a corrupt stroke would read past
+            // its data
+            if (!r->error && !stroke_check(stroke))
+                r->error = true;
+        } else {
+            r->error = true;
+        }
+        path->stroke = stroke;
+    }
+
+    if (r->error) {
+        path_deinit(path);
+        return NULL;
+    }
+    return path;
+}
+
+/**
+ * Reads a page from its file. A page that was never saved is empty.
+ */
+static bool loadPage(Notebook *nb, unsigned index) {
+    Page *page = &nb->pages[index];
+    assert(!page->resident);
+
+    page->path_cnt = 0;
+    page->path_capacity = PAGE_MIN_CAPACITY;
+    page->paths = malloc(page->path_capacity * sizeof(Path*));
+    assert(page->paths != NULL);
+
+    if (page->file_size > 0) {
+        char *name = pageFilename(nb, index, "");
+        FILE *fp = fopen(name, "rb");
+        uint8_t *buf = malloc(page->file_size);
+        assert(buf != NULL);
+        size_t len = fp ? fread(buf, 1, page->file_size, fp) : 0;
+        if (fp)
+            fclose(fp);
+
+        Reader r = { buf, buf + len, false };
+        char magic[4];
+        readBytes(&r, magic, 4);
+        uint32_t version = readU32(&r);
+        uint32_t path_cnt = readU32(&r);
+        if (r.error || memcmp(magic, PAGE_MAGIC, 4) != 0 || version != PAGE_VERSION)
+            r.error = true;
+
+        for (uint32_t i = 0; i < path_cnt && !r.error; i++) {
+            Path *path = readPath(&r);
+            if (!path)
+                break;
+            if (page->path_cnt >= page->path_capacity) {
+                page->path_capacity *= 2;
+                page->paths = realloc(page->paths, page->path_capacity * sizeof(Path*));
+                assert(page->paths != NULL);
+            }
+            page->paths[page->path_cnt++] = path;
+        }
+
+        free(buf);
+        if (r.error || page->path_cnt != path_cnt) {
+            printf("Error(Notebook): Could not read '%s'\n", name);
+            for (unsigned i = 0; i < page->path_cnt; i++)
+                path_deinit(page->paths[i]);
+            free(page->paths);
+            page->paths = NULL;
+            page->path_cnt = 0;
+            free(name);
+            return false;
+        }
+        free(name);
+    }
+
+    // Pasted instances are written as full copies, share their nodes again
+    path_shareIdentical(page->paths, page->path_cnt);
+
+    page->resident = true;
+    page->dirty = false;
+    page->last_used = ++nb->clock;
+    setPageBytes(nb, page, pageBytes(page));
+    nb->loads += 1;
+    return true;
+}
+
+/**
+ * Saves the page if it changed and frees its paths.
+ */
+static bool evictPage(Notebook *nb, unsigned index) {
+    Page *page = &nb->pages[index];
+    assert(page->resident);
+
+    if (page->dirty && !notebook_savePage(nb, index))
+        return false;
+
+    for (unsigned i = 0; i < page->path_cnt; i++)
+        path_deinit(page->paths[i]);
+    free(page->paths);
+    page->paths = NULL;
+    page->path_cnt = 0;
+    page->path_capacity = 0;
+    page->resident = false;
+    setPageBytes(nb, page, 0);
+    nb->evictions += 1;
+    return true;
+}
+
+/**
+ * Opens the notebook in directory `dir`, which is created if it does not
+ * exist. Only the sizes of the page files are read, the first page is active.
+ */
+Notebook *notebook_open(const char *dir, size_t budget) {
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        printf("Error(Notebook): Could not create '%s'\n", dir);
+        return NULL;
+    }
+
+    Notebook *nb = calloc(1, sizeof(Notebook));
+    assert(nb != NULL);
+    nb->dir = strdup(dir);
+    assert(nb->dir != NULL);
+    nb->budget = budget > 0 ? budget : NOTEBOOK_DEFAULT_BUDGET;
+
+    // Pages are numbered without gaps
+    for (;;) {
+        char *name = pageFilename(nb, nb->page_cnt, "");
+        struct stat st;
+        bool exists = stat(name, &st) == 0;
+        free(name);
+        if (!exists)
+            break;
+
+        pushPage(nb);
+        nb->pages[nb->page_cnt-1].file_size = st.st_size;
+    }
+
+    if (!notebook_activate(nb, 0)) {
+        notebook_close(nb);
+        return NULL;
+    }
+    return nb;
+}
+
+/**
+ * Saves all changed pages and frees the notebook. The paths of the active
+ * page must be stored back with notebook_storeActive before. Returns false if
+ * a page could not be saved.
+ */
+bool notebook_close(Notebook *nb) {
+    bool ok = true;
+    for (unsigned i = 0; i < nb->page_cnt; i++) {
+        if (nb->pages[i].resident && !evictPage(nb, i))
+            ok = false;
+    }
+
+    // Pages that failed to save are freed anyway
+    for (unsigned i = 0; i < nb->page_cnt; i++) {
+        Page *page = &nb->pages[i];
+        for (unsigned j = 0; page->resident && j < page->path_cnt; j++)
+            path_deinit(page->paths[j]);
+        free(page->paths);
+    }
+    free(nb->pages);
+    free(nb->dir);
+    free(nb);
+    return ok;
+}
+
+/**
+ * Makes page `index` the active page, loading it if needed. An index one past
+ * the last page appends an empty page. Returns NULL if the page could not be
+ * loaded.
+ */
+Page *notebook_activate(Notebook *nb, unsigned index) {
+    assert(index <= nb->page_cnt);
+
+    bool added = index == nb->page_cnt;
+    if (added)
+        pushPage(nb);
+
+    Page *page = &nb->pages[index];
+    if (!page->resident && !loadPage(nb, index))
+        return NULL;
+
+    // Saved even if it stays empty, the pages are numbered without gaps
+    if (added)
+        page->dirty = true;
+
+    nb->active = index;
+    page->last_used = ++nb->clock;
+    return page;
+}
+
+/**
+ * Makes page `index` resident without activating it, for reading its paths.
+ * Returns NULL if the page could not be loaded.
+ */
+Page *notebook_load(Notebook *nb, unsigned index) {
+    assert(index < nb->page_cnt);
+
+    Page *page = &nb->pages[index];
+    if (!page->resident && !loadPage(nb, index))
+        return NULL;
+
+    page->last_used = ++nb->clock;
+    return page;
+}
+
+/**
+ * Hands the path array of the active page back to the notebook, which may
+ * have been moved by adding paths. Changes to the paths are reported with
+ * notebook_markDirty.
+ */
+void notebook_storeActive(Notebook *nb, Path **paths, unsigned path_cnt, unsigned path_capacity) {
+    Page *page = &nb->pages[nb->active];
+    page->paths = paths;
+    page->path_cnt = path_cnt;
+    page->path_capacity = path_capacity;
+    page->last_used = ++nb->clock;
+}
+
+/**
+ * The paths of the active page changed since the last call, it is saved when
+ * evicted and its memory is counted again. Call after notebook_storeActive.
+ */
+void notebook_markDirty(Notebook *nb) {
+    Page *page = &nb->pages[nb->active];
+    page->dirty = true;
+    setPageBytes(nb, page, pageBytes(page));
+}
+
+/**
+ * Loads at most one neighbour of the active page, if it fits into the budget.
+ * Meant to be called once per frame, so flipping to a neighbour is instant.
+ */
+void notebook_prefetch(Notebook *nb) {
+    unsigned neighbours[2] = { nb->active - 1, nb->active + 1 };
+    for (int i = 0; i < 2; i++) {
+        unsigned n = neighbours[i];
+        if (n >= nb->page_cnt || nb->pages[n].resident)
+            continue;
+        // Loaded paths take a bit more than their file size
+        if (nb->resident_bytes + 2 * nb->pages[n].file_size > nb->budget)
+            continue;
+
+        loadPage(nb, n);
+        return;
+    }
+}
+
+/**
+ * Evicts the least recently used pages until the resident pages fit into the
+ * budget. The active page always stays, its neighbours only go last.
+ */
+void notebook_evict(Notebook *nb) {
+    while (nb->resident_bytes > nb->budget) {
+        unsigned victim = nb->page_cnt;
+        bool victim_near = true;
+        for (unsigned i = 0; i < nb->page_cnt; i++) {
+            const Page *page = &nb->pages[i];
+            if (!page->resident || i == nb->active)
+                continue;
+
+            bool near = i + 1 == nb->active || i == nb->active + 1;
+            if (victim == nb->page_cnt || (victim_near && !near)
+                    || (near == victim_near && page->last_used < nb->pages[victim].last_used)) {
+                victim = i;
+                victim_near = near;
+            }
+        }
+
+        if (victim == nb->page_cnt || !evictPage(nb, victim))
+            return;
+    }
+}
@@ -1,79 +1,884 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 #include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "affine.h"
 #include "fit_bezier.h"
+#include "jobs.h"
+#include "mem.h"
 #include "path.h"
+#include "stroke.h"
 #include "vec.h"
 
+#define PATH_LENGTH_DEPTH 16        // Max halvings of the arc length quadrature
+#define PATH_LENGTH_EPSILON 1e-8    // Relative arc length tolerance
+#define PATH_LENGTH_ITERATIONS 32
+
 const double PI = 3.1415926535897932384626433832795;
 
+// Fit profile used for all new paths, fit_defaultParams() until set
+static FitParams g_fit_params;
+static bool g_fit_params_set = false;
+
 Path* path_init(unsigned count) {
-    Path *path = calloc(1, sizeof(Path));
+    Path *path = mem_calloc(MEM_path, 1, sizeof(Path));
     assert(path != NULL);
 
     unsigned capacity = count > 0 ? count : PATH_DEFAULT_CAPACITY;
-    path->nodes = malloc(sizeof(Vec2) * capacity);
+    path->nodes = mem_malloc(MEM_path, sizeof(Vec2) * capacity);
     path->capacity = capacity;
+    path->transform = affine_identity();
+    path_clear(path);
 
     assert(path->nodes != NULL);
 
     return path;
 }
 
+/**
+ * Drops the reference of the path to its nodes, freeing them if no other
+ * instance uses them.
+ */
+static void releaseNodes(Path *path) {
+    if (path->shared) {
+        if (--path->shared->refs == 0) {
+            mem_free(path->shared);
+            mem_free(path->nodes);
+        }
+    } else {
+        mem_free(path->nodes);
+    }
+    path->shared = NULL;
+    path->nodes = NULL;
+}
+
 void path_deinit(Path *path) {
     if(path) {
-        if (path->nodes) free(path->nodes);
+        releaseNodes(path);
+        stroke_deinit(path->stroke);
+
+        mem_free(path);
+    }
+}
+
+/**
+ * Adds a reference to the nodes of `path`, which become shared if they were
+ * not yet.
+ */
+static PathShared *acquireNodes(Path *path) {
+    if (!path->shared) {
+        path->shared = mem_calloc(MEM_path, 1, sizeof(PathShared));
+        assert(path->shared != NULL);
+        path->shared->refs = 1;
+    }
+    path->shared->refs++;
+    return path->shared;
+}
+
+/**
+ * New path with the same geometry and transform, which shares the nodes of
+ * `path` instead of copying them. Changing the nodes of either one later
+ * gives it its own copy first (path_unshare). Raw samples are not shared, the
+ * instance has none.
+ */
+Path* path_instance(Path *path) {
+    acquireNodes(path);
+
+    Path *instance = mem_malloc(MEM_path, sizeof(Path));
+    assert(instance != NULL);
+
+    *instance = *path;
+    instance->gpu_valid = false;
+    instance->flat_cnt = 0;
+    instance->flat_empty = false;
+    instance->stroke = NULL;
+
+    return instance;
+}
 
-        free(path);
+/**
+ * Copy on write: gives the path its own copy of the nodes if they are shared
+ * with other instances.
+ */
+void path_unshare(Path *path) {
+    PathShared *shared = path->shared;
+    if (!shared)
+        return;
+
+    // The only reference left, no other instance can touch it any more
+    if (shared->refs == 1) {
+        mem_free(shared);
+        path->shared = NULL;
+        return;
     }
+
+    Vec2 *nodes = mem_malloc(MEM_path, sizeof(Vec2) * (path->capacity > 0 ? path->capacity : 1));
+    assert(nodes != NULL);
+    memcpy(nodes, path->nodes, path->node_cnt * sizeof(Vec2));
+
+    releaseNodes(path);
+    path->nodes = nodes;
+    path->gpu_valid = false;
+}
+
+typedef struct geometry_key {
+    uint64_t hash;
+    unsigned index;
+} GeometryKey;
+
+static int compareGeometryKeys(const void *a, const void *b) {
+    const GeometryKey *ka = a;
+    const GeometryKey *kb = b;
+    if (ka->hash != kb->hash)
+        return ka->hash < kb->hash ? -1 : 1;
+    return (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+static bool sameGeometry(const Path *a, const Path *b) {
+    return a->nodes == b->nodes
+        || (a->type == b->type && a->node_cnt == b->node_cnt
+            && memcmp(a->nodes, b->nodes, a->node_cnt * sizeof(Vec2)) == 0);
+}
+
+/**
+ * Turns paths with identical nodes into instances of the first of them, e.g.
+ * copies that were pasted before a page was saved and loaded again. Returns
+ * the number of paths that gave up their own nodes.
+ */
+unsigned path_shareIdentical(Path **paths, unsigned count) {
+    if (count < 2)
+        return 0;
+
+    GeometryKey *keys = mem_malloc(MEM_path, count * sizeof(GeometryKey));
+    assert(keys != NULL);
+
+    for (unsigned i = 0; i < count; i++) {
+        // FNV-1a over the type and nodes
+        const Path *path = paths[i];
+        const unsigned char *p = (const unsigned char *)path->nodes;
+        size_t len = path->node_cnt * sizeof(Vec2);
+        uint64_t hash = 0xcbf29ce484222325ULL ^ path->type;
+        for (size_t k = 0; k < len; k++) {
+            hash ^= p[k];
+            hash *= 0x100000001b3ULL;
+        }
+        keys[i] = (GeometryKey){ hash, i };
+    }
+    qsort(keys, count, sizeof(GeometryKey), compareGeometryKeys);
+
+    unsigned shared = 0;
+    for (unsigned first = 0; first < count; ) {
+        unsigned end = first + 1;
+        while (end < count && keys[end].hash == keys[first].hash)
+            end++;
+
+        // Every path joins the first one of its run with equal nodes
+        for (unsigned i = first + 1; i < end; i++) {
+            Path *path = paths[keys[i].index];
+            for (unsigned j = first; j < i; j++) {
+                Path *source = paths[keys[j].index];
+                if (path->node_cnt == 0 || !sameGeometry(path, source))
+                    continue;
+                if (path->nodes != source->nodes) {
+                    releaseNodes(path);
+                    path->shared = acquireNodes(source);
+                    path->nodes = source->nodes;
+                    path->capacity = source->capacity;
+                    path->gpu_valid = false;
+                    shared++;
+                }
+                break;
+            }
+        }
+        first = end;
+    }
+
+    mem_free(keys);
+    return shared;
 }
 
 void path_resize(Path *path, unsigned new_capacity) {
-    path->nodes = realloc(path->nodes, sizeof(Vec2) * new_capacity);
+    path_unshare(path);
+    path->nodes = mem_realloc(MEM_path, path->nodes, sizeof(Vec2) * new_capacity);
     path->capacity = new_capacity;
 
     assert(path->nodes != NULL);
 }
 
 void path_addNode(Path *path, Vec2 node) {
+    path_unshare(path);
     if (path->node_cnt >= path->capacity) {
         path_resize(path, path->capacity * 2);
     }
 
     path->nodes[path->node_cnt] = node;
     path->node_cnt += 1;
+
+    path->bbox_min.x = fmin(path->bbox_min.x, node.x);
+    path->bbox_min.y = fmin(path->bbox_min.y, node.y);
+    path->bbox_max.x = fmax(path->bbox_max.x, node.x);
+    path->bbox_max.y = fmax(path->bbox_max.y, node.y);
+}
+
+/**
+ * Removes all nodes but keeps the allocated memory.
+ */
+void path_clear(Path *path) {
+    path->node_cnt = 0;
+    path->bbox_min = (Vec2){ DBL_MAX, DBL_MAX };
+    path->bbox_max = (Vec2){ -DBL_MAX, -DBL_MAX };
+}
+
+/**
+ * Recalculates the bounding box, needed after writing to `nodes` directly.
+ */
+void path_updateBBox(Path *path) {
+    unsigned cnt = path->node_cnt;
+    path_clear(path);
+    for (unsigned i = 0; i < cnt; i++) {
+        Vec2 n = path->nodes[i];
+        path->bbox_min.x = fmin(path->bbox_min.x, n.x);
+        path->bbox_min.y = fmin(path->bbox_min.y, n.y);
+        path->bbox_max.x = fmax(path->bbox_max.x, n.x);
+        path->bbox_max.y = fmax(path->bbox_max.y, n.y);
+    }
+    path->node_cnt = cnt;
+}
+
+/**
+ * Bounding box of the path in canvas coordinates, so with `transform` applied.
+ */
+void path_getBounds(Path *path, Vec2 *min, Vec2 *max) {
+    Vec2 corners[4] = {
+        path->bbox_min,
+        { path->bbox_max.x, path->bbox_min.y },
+        path->bbox_max,
+        { path->bbox_min.x, path->bbox_max.y },
+    };
+
+    *min = (Vec2){ DBL_MAX, DBL_MAX };
+    *max = (Vec2){ -DBL_MAX, -DBL_MAX };
+    for (int i = 0; i < 4; i++) {
+        Vec2 c = affine_apply(path->transform, corners[i]);
+        min->x = fmin(min->x, c.x);
+        min->y = fmin(min->y, c.y);
+        max->x = fmax(max->x, c.x);
+        max->y = fmax(max->y, c.y);
+    }
 }
 
 Vec2* path_getNode(Path *path, int index) {
     int pos = (index < 0) ? (int)path->node_cnt + index : index;
-    if (pos < (int)path->node_cnt) {
+    if (pos >= 0 && pos < (int)path->node_cnt) {
         return &path->nodes[pos];
     }
     return NULL;
 }
 
-Path* path_fitBezier(Path *path, double scale) {
+/**
+ * Moves the origin of the nodes to the first node and folds the offset into
+ * `transform`. The nodes then stay small relative to the path size, which
+ * keeps them exact when converted to float32 for the GPU, at any zoom level.
+ */
+void path_localize(Path *path) {
+    if (path->node_cnt == 0)
+        return;
+
+    Vec2 origin = path->nodes[0];
+    if (origin.x == 0.0 && origin.y == 0.0)
+        return;
+
+    path_unshare(path);
+    for (unsigned i = 0; i < path->node_cnt; i++) {
+        path->nodes[i] = vec2_sub(path->nodes[i], origin);
+    }
+    path->bbox_min = vec2_sub(path->bbox_min, origin);
+    path->bbox_max = vec2_sub(path->bbox_max, origin);
+
+    path->transform = affine_mult(path->transform, affine_translate(origin));
+    path->gpu_valid = false;
+    path->flat_cnt = 0;
+    path->flat_empty = false;
+}
+
+// Geometry operations. A position on a path is `segment + t`, from 0 at the
+// first node to path_segmentCount at the last one. Beziers have a segment per
+// three nodes, lines one per node. Lengths are in node coordinates, times
+// affine_scaleFactor(transform) in canvas units.
+//
+// The operations change the nodes in place and only grow the node buffer when
+// it is too small. Changed paths lose their raw samples, a refit would undo
+// the edit.
+
+static unsigned nodeStride(const Path *path) {
+    return path->type == PATHTYPE_bezier ? 3 : 1;
+}
+
+unsigned path_segmentCount(const Path *path) {
+    if (path->node_cnt < 2)
+        return 0;
+    return (path->node_cnt - 1) / nodeStride(path);
+}
+
+/**
+ * Splits a position into segment and curve parameter. A position on a node
+ * is the end of the previous segment if `at_end`, else the start of the next.
+ */
+static unsigned locate(const Path *path, double u, bool at_end, double *t) {
+    unsigned cnt = path_segmentCount(path);
+    assert(cnt > 0);
+
+    u = fmin(fmax(u, 0.0), cnt);
+    double s = floor(u);
+    if ((at_end && s > 0 && s == u) || s >= cnt)
+        s -= 1;
+    *t = u - s;
+    return (unsigned)s;
+}
+
+/**
+ * de Casteljau subdivision of the cubic `c` at `t`. `left` and `right` may
+ * overlap `c`, they share the split point.
+ */
+static void splitCubic(const Vec2 c[4], double t, Vec2 left[4], Vec2 right[4]) {
+    Vec2 p01 = vec2_lerp(c[0], c[1], t);
+    Vec2 p12 = vec2_lerp(c[1], c[2], t);
+    Vec2 p23 = vec2_lerp(c[2], c[3], t);
+    Vec2 p012 = vec2_lerp(p01, p12, t);
+    Vec2 p123 = vec2_lerp(p12, p23, t);
+    Vec2 mid = vec2_lerp(p012, p123, t);
+    Vec2 first = c[0];
+    Vec2 last = c[3];
+
+    left[0] = first;
+    left[1] = p01;
+    left[2] = p012;
+    left[3] = mid;
+    right[0] = mid;
+    right[1] = p123;
+    right[2] = p23;
+    right[3] = last;
+}
+
+static Vec2 cubicPoint(const Vec2 c[4], double t) {
+    double mt = 1 - t;
+    Vec2 p = vec2_scalarMult(c[0], mt*mt*mt);
+    p = vec2_add(p, vec2_scalarMult(c[1], 3*mt*mt*t));
+    p = vec2_add(p, vec2_scalarMult(c[2], 3*mt*t*t));
+    return vec2_add(p, vec2_scalarMult(c[3], t*t*t));
+}
+
+static double cubicSpeed(const Vec2 c[4], double t) {
+    double mt = 1 - t;
+    Vec2 d = vec2_scalarMult(vec2_sub(c[1], c[0]), 3*mt*mt);
+    d = vec2_add(d, vec2_scalarMult(vec2_sub(c[2], c[1]), 6*mt*t));
+    d = vec2_add(d, vec2_scalarMult(vec2_sub(c[3], c[2]), 3*t*t));
+    return vec2_len(d);
+}
+
+/**
+ * Point at position `u`, in node coordinates.
+ */
+Vec2 path_pointAt(const Path *path, double u) {
+    if (path->node_cnt < 2)
+        return path->node_cnt ? path->nodes[0] : (Vec2){ 0, 0 };
+
+    double t;
+    unsigned s = locate(path, u, false, &t);
+    if (path->type == PATHTYPE_bezier)
+        return cubicPoint(&path->nodes[3*s], t);
+    return vec2_lerp(path->nodes[s], path->nodes[s+1], t);
+}
+
+static void invalidateGeometry(Path *path) {
+    path_updateBBox(path);
+    path->gpu_valid = false;
+    path->flat_cnt = 0;
+    path->flat_empty = false;
+    stroke_deinit(path->stroke);
+    path->stroke = NULL;
+}
+
+/**
+ * Inserts a node at position `u` without changing the shape. For beziers
+ * the segment is split exactly with de Casteljau's algorithm.
+ */
+void path_subdivide(Path *path, double u) {
+    if (path_segmentCount(path) == 0)
+        return;
+
+    double t;
+    unsigned s = locate(path, u, false, &t);
+    if (t <= 0.0 || t >= 1.0)
+        return;
+
+    path_unshare(path);
+    unsigned stride = nodeStride(path);
+    if (path->node_cnt + stride > path->capacity)
+        path_resize(path, 2 * path->capacity > path->node_cnt + stride
+                ? 2 * path->capacity : path->node_cnt + stride);
+
+    Vec2 *c = &path->nodes[stride * s];
+    unsigned tail = path->node_cnt - stride * s - 1;
+    memmove(c + 1 + stride, c + 1, tail * sizeof(Vec2));
+    if (path->type == PATHTYPE_bezier) {
+        Vec2 seg[4] = { c[0], c[1+3], c[2+3], c[3+3] };
+        splitCubic(seg, t, c, c + 3);
+    } else {
+        c[1] = vec2_lerp(c[0], c[2], t);
+    }
+    path->node_cnt += stride;
+    invalidateGeometry(path);
+}
+
+/**
+ * Cuts the path down to the positions [u0, u1], in place.
+ */
+void path_trim(Path *path, double u0, double u1) {
+    if (path_segmentCount(path) == 0 || u1 <= u0)
+        return;
+
+    path_unshare(path);
+    double t0, t1;
+    unsigned s0 = locate(path, u0, false, &t0);
+    unsigned s1 = locate(path, u1, true, &t1);
+    unsigned stride = nodeStride(path);
+    Vec2 *nodes = path->nodes;
+
+    // Last segment first, the first one may be the same
+    if (path->type == PATHTYPE_bezier) {
+        Vec2 *c = &nodes[3*s1];
+        Vec2 right[4];
+        if (t1 < 1.0)
+            splitCubic(c, t1, c, right);
+        if (s0 == s1)
+            t0 = t1 > 0 ? t0 / t1 : 0;
+        c = &nodes[3*s0];
+        Vec2 left[4];
+        if (t0 > 0.0)
+            splitCubic(c, t0, left, c);
+    } else {
+        Vec2 end = vec2_lerp(nodes[s1], nodes[s1+1], t1);
+        Vec2 start = vec2_lerp(nodes[s0], nodes[s0+1], t0);
+        nodes[s1+1] = end;
+        nodes[s0] = start;
+    }
+
+    unsigned cnt = stride * (s1 - s0 + 1) + 1;
+    memmove(nodes, nodes + stride * s0, cnt * sizeof(Vec2));
+    path->node_cnt = cnt;
+    invalidateGeometry(path);
+}
+
+/**
+ * Cuts the path in two at position `u`. The path keeps the part before it,
+ * the rest is returned as a new path with the same type and transform, NULL
+ * if `u` is at either end.
+ */
+Path* path_split(Path *path, double u) {
+    unsigned cnt = path_segmentCount(path);
+    if (cnt == 0 || u <= 0.0 || u >= cnt)
+        return NULL;
+
+    double t;
+    unsigned s = locate(path, u, false, &t);
+    unsigned stride = nodeStride(path);
+
+    unsigned tail_cnt = path->node_cnt - stride * s;
+    Path *tail = path_init(tail_cnt);
+    memcpy(tail->nodes, &path->nodes[stride * s], tail_cnt * sizeof(Vec2));
+    tail->node_cnt = tail_cnt;
+    tail->type = path->type;
+    tail->transform = path->transform;
+    path_trim(tail, t, cnt - s);
+
+    path_trim(path, 0, u);
+    return tail;
+}
+
+static double gaussLength(const Vec2 c[4], double a, double b) {
+    // 5 point Gauss-Legendre quadrature
+    static const double X[5] = {
+        0.0, -0.5384693101056831, 0.5384693101056831,
+        -0.9061798459386640, 0.9061798459386640,
+    };
+    static const double W[5] = {
+        0.5688888888888889, 0.4786286704993665, 0.4786286704993665,
+        0.2369268850561891, 0.2369268850561891,
+    };
+
+    double h = 0.5 * (b - a);
+    double sum = 0;
+    for (int i = 0; i < 5; i++)
+        sum += W[i] * cubicSpeed(c, a + h * (X[i] + 1));
+    return h * sum;
+}
+
+/**
+ * Arc length of the cubic from `a` to `b`. Halves the interval until the
+ * quadrature agrees with the sum over both halves.
+ */
+static double cubicLength(const Vec2 c[4], double a, double b, double whole, int depth) {
+    double m = 0.5 * (a + b);
+    double l = gaussLength(c, a, m);
+    double r = gaussLength(c, m, b);
+    if (depth >= PATH_LENGTH_DEPTH || fabs(l + r - whole) <= PATH_LENGTH_EPSILON * (l + r))
+        return l + r;
+    return cubicLength(c, a, m, l, depth + 1) + cubicLength(c, m, b, r, depth + 1);
+}
+
+static double segmentLength(const Path *path, unsigned s, double t) {
+    if (path->type != PATHTYPE_bezier)
+        return t * vec2_dist(path->nodes[s], path->nodes[s+1]);
+    const Vec2 *c = &path->nodes[3*s];
+    return cubicLength(c, 0, t, gaussLength(c, 0, t), 0);
+}
+
+/**
+ * Arc length from the start of the path to position `u`.
+ */
+double path_length(const Path *path, double u) {
+    if (path_segmentCount(path) == 0 || u <= 0.0)
+        return 0.0;
+
+    double t;
+    unsigned s = locate(path, u, true, &t);
+    double length = 0;
+    for (unsigned i = 0; i < s; i++)
+        length += segmentLength(path, i, 1.0);
+    return length + segmentLength(path, s, t);
+}
+
+/**
+ * Position at arc length `length` from the start of the path, clamped to the
+ * ends. Newton steps on the length of the segment, kept in bracket by
+ * bisection.
+ */
+double path_positionAt(const Path *path, double length) {
+    unsigned cnt = path_segmentCount(path);
+    if (cnt == 0 || length <= 0.0)
+        return 0.0;
+
+    unsigned s = 0;
+    double seg_len = segmentLength(path, 0, 1.0);
+    while (length > seg_len && s + 1 < cnt) {
+        length -= seg_len;
+        s += 1;
+        seg_len = segmentLength(path, s, 1.0);
+    }
+    if (length >= seg_len)
+        return s + 1;
+    if (path->type != PATHTYPE_bezier)
+        return s + length / seg_len;
+
+    const Vec2 *c = &path->nodes[3*s];
+    double a = 0, b = 1;
+    double t = length / seg_len;
+    for (int i = 0; i < PATH_LENGTH_ITERATIONS; i++) {
+        double f = segmentLength(path, s, t) - length;
+        if (fabs(f) <= PATH_LENGTH_EPSILON * seg_len)
+            break;
+        if (f < 0)
+            a = t;
+        else
+            b = t;
+
+        double speed = cubicSpeed(c, t);
+        double next = speed > 0 ? t - f / speed : 0.5 * (a + b);
+        if (!(next > a && next < b))
+            next = 0.5 * (a + b);
+        t = next;
+    }
+    return s + t;
+}
+
+/**
+ * Appends `other` to the path. Its nodes are mapped into the node space of
+ * the path. If the ends are at most `max_gap` (canvas units) apart they are
+ * joined at their middle, and handles that are less than PATH_G1_ANGLE apart
+ * are aligned so the curve stays smooth. Otherwise a straight segment bridges
+ * the gap. Returns false if the path types differ.
+ */
+bool path_concat(Path *path, const Path *other, double max_gap) {
+    if (other->node_cnt == 0)
+        return true;
+    if (path->node_cnt == 0) {
+        path->type = other->type;
+        path->transform = other->transform;
+    }
+    if (path->type != other->type)
+        return false;
+
+    path_unshare(path);
+    unsigned stride = nodeStride(path);
+    unsigned needed = path->node_cnt + other->node_cnt + stride;
+    if (needed > path->capacity)
+        path_resize(path, needed);
+
+    Affine m = affine_mult(affine_inverse(path->transform), other->transform);
+    Vec2 *dst = &path->nodes[path->node_cnt];
+    for (unsigned i = 0; i < other->node_cnt; i++)
+        dst[i] = affine_apply(m, other->nodes[i]);
+
+    if (path->node_cnt == 0) {
+        path->node_cnt = other->node_cnt;
+        invalidateGeometry(path);
+        return true;
+    }
+
+    Vec2 *end = &path->nodes[path->node_cnt - 1];
+    double scale = affine_scaleFactor(path->transform);
+    double gap = vec2_dist(*end, dst[0]) * scale;
+
+    if (gap > max_gap) {
+        // Bridge, for beziers a straight cubic
+        if (path->type == PATHTYPE_bezier) {
+            Vec2 start = *end;
+            memmove(dst + 2, dst, other->node_cnt * sizeof(Vec2));
+            dst[0] = vec2_lerp(start, dst[2], 1.0 / 3);
+            dst[1] = vec2_lerp(start, dst[2], 2.0 / 3);
+            path->node_cnt += 2;
+        }
+        path->node_cnt += other->node_cnt;
+        invalidateGeometry(path);
+        return true;
+    }
+
+    Vec2 joint = vec2_lerp(*end, dst[0], 0.5);
+    if (path->type == PATHTYPE_bezier && path->node_cnt >= 4 && other->node_cnt >= 4) {
+        // Handles around the joint, moved along with their node
+        Vec2 in = vec2_sub(end[-1], *end);
+        Vec2 out = vec2_sub(dst[1], dst[0]);
+        double in_len = vec2_len(in);
+        double out_len = vec2_len(out);
+        if (in_len > 0 && out_len > 0) {
+            double cos_angle = -vec2_dot(in, out) / (in_len * out_len);
+            if (cos_angle >= cos(PATH_G1_ANGLE * PI / 180)) {
+                Vec2 dir = vec2_norm(vec2_sub(vec2_scalarMult(out, 1 / out_len),
+                        vec2_scalarMult(in, 1 / in_len)));
+                in = vec2_scalarMult(dir, -in_len);
+                out = vec2_scalarMult(dir, out_len);
+            }
+        }
+        end[-1] = vec2_add(joint, in);
+        dst[1] = vec2_add(joint, out);
+    }
+    *end = joint;
+
+    memmove(dst, dst + 1, (other->node_cnt - 1) * sizeof(Vec2));
+    path->node_cnt += other->node_cnt - 1;
+    invalidateGeometry(path);
+    return true;
+}
+
+/**
+ * Sets the fit profile for all paths fitted from now on. Not thread safe with
+ * respect to fits running at the same time.
+ */
+void path_setFitParams(const FitParams *params) {
+    g_fit_params = *params;
+    g_fit_params_set = true;
+}
+
+FitParams path_getFitParams(void) {
+    return g_fit_params_set ? g_fit_params : fit_defaultParams();
+}
+
+// Fit context per thread, reused for every stroke that thread fits. Freed
+// when the thread exits, the main thread's by path_freeFitCtx.
+static pthread_key_t g_fit_key;
+static pthread_once_t g_fit_once = PTHREAD_ONCE_INIT;
+
+static void destroyFitCtx(void *fit) {
+    fit_deinit(fit);
+}
+
+static void createFitKey(void) {
+    pthread_key_create(&g_fit_key, destroyFitCtx);
+}
+
+static BezierFitCtx *threadFitCtx(Vec2 *points, size_t count) {
+    pthread_once(&g_fit_once, createFitKey);
+
+    BezierFitCtx *fit = pthread_getspecific(g_fit_key);
+    if (!fit) {
+        fit = fit_init(points, count);
+        pthread_setspecific(g_fit_key, fit);
+    } else {
+        fit_reset(fit, points, count);
+    }
+    return fit;
+}
+
+/**
+ * Frees the fit context of the calling thread, if it has one. Thread exit does
+ * this for the workers, but not for the main thread returning from main.
+ */
+void path_freeFitCtx(void) {
+    pthread_once(&g_fit_once, createFitKey);
+
+    BezierFitCtx *fit = pthread_getspecific(g_fit_key);
+    if (fit) {
+        fit_deinit(fit);
+        pthread_setspecific(g_fit_key, NULL);
+    }
+}
+
+/**
+ * Wraps an existing node buffer of `count` nodes in a new path, which takes
+ * ownership of it. The buffer has to come from mem_malloc, it is accounted to
+ * the paths from now on.
+ */
+Path* path_adopt(Vec2 *nodes, unsigned count) {
+    Path *path = mem_calloc(MEM_path, 1, sizeof(Path));
+    assert(path != NULL);
+
+    mem_retag(nodes, MEM_path);
+    path->nodes = nodes;
+    path->node_cnt = count;
+    path->capacity = count;
+    path->transform = affine_identity();
+    path_updateBBox(path);
+
+    return path;
+}
+
+static Path* fitPath(Path *path, double scale, bool debug) {
     assert(path->node_cnt > 1);
 
-    BezierFitCtx *fit = fit_init(path->nodes, path->node_cnt);
+    BezierFitCtx *fit = threadFitCtx(path->nodes, path->node_cnt);
     //fit->timestamps = path->timestamps;
-    fit->corner_thresh = PI / 6;
-    fit->tangent_range = 20.0 / scale;
-    fit->epsilon = 10.0 / scale;
-    fit->psi = 80.0 / scale;
-    fit->max_iter = 4;
+    FitParams params = path_getFitParams();
+    fit_setParams(fit, &params, scale);
+    fit->debug = debug;
 
     fitCurve(fit);
 
-    Path *new = path_init(fit->new_cnt);
-    memcpy(new->nodes, fit->new, fit->new_cnt * sizeof(Vec2));
-    new->node_cnt = fit->new_cnt;
-    new->capacity = fit->new_cnt;
+    // The output buffer becomes the nodes of the new path, no copy. Still
+    // allocated per fit: the Path, the shrink of the output and the next
+    // fit's output buffer. Cheap next to the fit itself, so not pooled.
+    size_t cnt;
+    Vec2 *nodes = fit_takeOutput(fit, &cnt);
+
+    Path *new = path_adopt(nodes, cnt);
+    new->type = PATHTYPE_bezier;
+    new->transform = path->transform;
+    path_localize(new);
 
-    fit_deinit(fit);
     return new;
 }
+
+Path* path_fitBezier(Path *path, double scale) {
+    return fitPath(path, scale, true);
+}
+
+typedef struct fit_batch {
+    Path **in;
+    Path **out;
+    double scale;
+} FitBatch;
+
+static void fitBatchJob(void *ctx, size_t begin, size_t end) {
+    FitBatch *batch = ctx;
+    for (size_t i = begin; i < end; i++) {
+        batch->out[i] = fitPath(batch->in[i], batch->scale, false);
+    }
+}
+
+/**
+ * Fits all paths in parallel batches. Returns a malloc'd array with `count`
+ * new paths, in the same order as the input.
+ */
+Path** path_fitBezierN(Path **paths, unsigned count, double scale) {
+    FitBatch batch = {
+        .in = paths,
+        .out = malloc(sizeof(Path*) * (count > 0 ? count : 1)),
+        .scale = scale,
+    };
+    assert(batch.out != NULL);
+
+    jobs_parallelFor(count, 16, fitBatchJob, &batch);
+
+    return batch.out;
+}
+
+/**
+ * Fits the path again from its raw samples, e.g. at a different view scale or
+ * with a new fit profile. The nodes are replaced in place, so the Path pointer
+ * and its transform stay valid. Returns false if the path has no samples.
+ */
+bool path_refit(Path *path, double scale) {
+    if (!path->stroke || path->stroke->sample_cnt < 2)
+        return false;
+
+    Path *raw = stroke_decode(path->stroke);
+
+    // The fitted path was localized at its first node, which is the first
+    // sample. Undo that offset so the refit ends up at the same place.
+    raw->transform = affine_mult(path->transform,
+            affine_translate(vec2_scalarMult(raw->nodes[0], -1)));
+
+    Path *fitted = fitPath(raw, scale, false);
+    path_deinit(raw);
+
+    // The old nodes go with `fitted`, instances keep them
+    Vec2 *nodes = path->nodes;
+    PathShared *shared = path->shared;
+    path->type = fitted->type;
+    path->nodes = fitted->nodes;
+    path->shared = NULL;
+    path->node_cnt = fitted->node_cnt;
+    path->capacity = fitted->capacity;
+    path->bbox_min = fitted->bbox_min;
+    path->bbox_max = fitted->bbox_max;
+    path->transform = fitted->transform;
+    path->gpu_valid = false;
+    path->flat_cnt = 0;
+    path->flat_empty = false;
+
+    fitted->nodes = nodes;
+    fitted->shared = shared;
+    path_deinit(fitted);
+
+    return true;
+}
+
+typedef struct refit_batch {
+    Path **paths;
+    double scale;
+    _Atomic unsigned refit_cnt;
+} RefitBatch;
+
+static void refitBatchJob(void *ctx, size_t begin, size_t end) {
+    RefitBatch *batch = ctx;
+    unsigned cnt = 0;
+    for (size_t i = begin; i < end; i++) {
+        cnt += path_refit(batch->paths[i], batch->scale);
+    }
+    batch->refit_cnt += cnt;
+}
+
+/**
+ * Refits all paths that have raw samples, in parallel batches. Returns the
+ * number of refitted paths.
+ */
+unsigned path_refitN(Path **paths, unsigned count, double scale) {
+    RefitBatch batch = {
+        .paths = paths,
+        .scale = scale,
+        .refit_cnt = 0,
+    };
+
+    jobs_parallelFor(count, 16, refitBatchJob, &batch);
+
+    return batch.refit_cnt;
+}
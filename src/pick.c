@@ -0,0 +1,490 @@
+// Nearest path queries. The hierarchy is built top down, every node is split
+// at the median of the segment centers along its longest axis. Queries walk
+// it depth first, nearer child first, and skip nodes farther away than the
+// best segment so far.
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affine.h"
+#include "path.h"
+#include "pick.h"
+#include "vec.h"
+
+#define PICK_ROOT_DEPTH 16          // Subdivisions before a root is taken as isolated
+#define PICK_NEWTON_ITERATIONS 16
+#define PICK_T_EPSILON 1e-12
+
+PickIndex *pick_init(void) {
+    PickIndex *index = calloc(1, sizeof(PickIndex));
+    assert(index != NULL);
+    return index;
+}
+
+void pick_deinit(PickIndex *index) {
+    if (!index)
+        return;
+    free(index->items);
+    free(index->nodes);
+    free(index->keys);
+    free(index);
+}
+
+static unsigned segmentCount(const Path *path) {
+    if (path->node_cnt < 2)
+        return path->node_cnt;
+    if (path->type == PATHTYPE_bezier)
+        return path->node_cnt >= 4 ? (path->node_cnt - 1) / 3 : 1;
+    return path->node_cnt - 1;
+}
+
+/**
+ * Control points of a segment in canvas coordinates. Lines and short paths
+ * are cubics with their control points on the line, so all segments go through
+ * the same solver.
+ */
+static void segmentPoints(const Path *path, unsigned segment, Vec2 c[4]) {
+    const Affine m = path->transform;
+    if (path->type == PATHTYPE_bezier && path->node_cnt >= 4) {
+        for (int i = 0; i < 4; i++)
+            c[i] = affine_apply(m, path->nodes[3*segment + i]);
+        return;
+    }
+
+    unsigned last = path->node_cnt - 1;
+    Vec2 a = affine_apply(m, path->nodes[segment < last ? segment : last]);
+    Vec2 b = affine_apply(m, path->nodes[segment + 1 < last ? segment + 1 : last]);
+    for (int i = 0; i < 4; i++) {
+        double s = i / 3.0;
+        c[i] = (Vec2){ a.x + (b.x - a.x) * s, a.y + (b.y - a.y) * s };
+    }
+}
+
+static void itemBounds(PickItem *item, const Path *path) {
+    Vec2 c[4];
+    segmentPoints(path, item->segment, c);
+    item->min = item->max = c[0];
+    for (int i = 1; i < 4; i++) {
+        item->min.x = fmin(item->min.x, c[i].x);
+        item->min.y = fmin(item->min.y, c[i].y);
+        item->max.x = fmax(item->max.x, c[i].x);
+        item->max.y = fmax(item->max.y, c[i].y);
+    }
+}
+
+static double boxDistSqr(Vec2 min, Vec2 max, Vec2 p) {
+    double dx = fmax(fmax(min.x - p.x, p.x - max.x), 0.0);
+    double dy = fmax(fmax(min.y - p.y, p.y - max.y), 0.0);
+    return dx*dx + dy*dy;
+}
+
+static double center(const PickItem *item, int axis) {
+    return axis == 0 ? item->min.x + item->max.x : item->min.y + item->max.y;
+}
+
+/**
+ * Partially sorts items [begin, end) so item `nth` has the center it would
+ * have in sorted order, smaller ones before it, larger ones after.
+ */
+static void selectNth(PickItem *items, unsigned begin, unsigned end, unsigned nth, int axis) {
+    while (end - begin > 1) {
+        double pivot = center(&items[(begin + end) / 2], axis);
+        unsigned i = begin;
+        unsigned j = end - 1;
+        while (i <= j) {
+            while (center(&items[i], axis) < pivot)
+                i++;
+            while (center(&items[j], axis) > pivot)
+                j--;
+            if (i <= j) {
+                PickItem tmp = items[i];
+                items[i] = items[j];
+                items[j] = tmp;
+                i++;
+                if (j == 0)
+                    break;
+                j--;
+            }
+        }
+        if (nth <= j)
+            end = j + 1;
+        else if (nth >= i)
+            begin = i;
+        else
+            return;
+    }
+}
+
+static void leafBounds(PickIndex *index, PickNode *node) {
+    node->min = (Vec2){ DBL_MAX, DBL_MAX };
+    node->max = (Vec2){ -DBL_MAX, -DBL_MAX };
+    for (unsigned i = node->start; i < node->start + node->count; i++) {
+        const PickItem *item = &index->items[i];
+        node->min.x = fmin(node->min.x, item->min.x);
+        node->min.y = fmin(node->min.y, item->min.y);
+        node->max.x = fmax(node->max.x, item->max.x);
+        node->max.y = fmax(node->max.y, item->max.y);
+    }
+}
+
+static unsigned buildNode(PickIndex *index, unsigned begin, unsigned end, unsigned depth) {
+    assert(index->node_cnt < index->node_capacity);
+    unsigned n = index->node_cnt++;
+    PickNode *node = &index->nodes[n];
+    node->start = begin;
+    node->count = end - begin;
+    leafBounds(index, node);
+
+    if (end - begin <= PICK_LEAF_SIZE || depth + 1 >= PICK_MAX_DEPTH)
+        return n;
+
+    Vec2 cmin = { DBL_MAX, DBL_MAX };
+    Vec2 cmax = { -DBL_MAX, -DBL_MAX };
+    for (unsigned i = begin; i < end; i++) {
+        double x = center(&index->items[i], 0);
+        double y = center(&index->items[i], 1);
+        cmin.x = fmin(cmin.x, x);
+        cmin.y = fmin(cmin.y, y);
+        cmax.x = fmax(cmax.x, x);
+        cmax.y = fmax(cmax.y, y);
+    }
+    int axis = cmax.x - cmin.x >= cmax.y - cmin.y ? 0 : 1;
+
+    unsigned mid = begin + (end - begin) / 2;
+    selectNth(index->items, begin, end, mid, axis);
+
+    buildNode(index, begin, mid, depth + 1);
+    unsigned right = buildNode(index, mid, end, depth + 1);
+
+    // The node array does not move, its capacity was reserved up front
+    node->start = right;
+    node->count = 0;
+    return n;
+}
+
+static void storeKeys(PickIndex *index, Path **paths, unsigned count) {
+    if (count > index->key_capacity) {
+        index->key_capacity = count;
+        index->keys = realloc(index->keys, count * sizeof(PickKey));
+        assert(index->keys != NULL);
+    }
+    for (unsigned i = 0; i < count; i++) {
+        const Path *path = paths[i];
+        index->keys[i] = (PickKey){ path, path->nodes, path->node_cnt, path->transform };
+    }
+    index->key_cnt = count;
+}
+
+/**
+ * Builds the index over all segments of `paths`. Hits refer to the paths by
+ * their position in this array.
+ */
+void pick_build(PickIndex *index, Path **paths, unsigned count) {
+    unsigned item_cnt = 0;
+    for (unsigned i = 0; i < count; i++)
+        item_cnt += segmentCount(paths[i]);
+
+    if (item_cnt > index->item_capacity) {
+        index->item_capacity = item_cnt;
+        index->items = realloc(index->items, item_cnt * sizeof(PickItem));
+        assert(index->items != NULL);
+    }
+    index->item_cnt = 0;
+    for (unsigned i = 0; i < count; i++) {
+        unsigned segments = segmentCount(paths[i]);
+        for (unsigned s = 0; s < segments; s++) {
+            PickItem *item = &index->items[index->item_cnt++];
+            item->path = i;
+            item->segment = s;
+            itemBounds(item, paths[i]);
+        }
+    }
+
+    // A median split tree with leaves of at least one item has fewer than
+    // twice as many nodes as items
+    unsigned node_capacity = 2 * item_cnt + 1;
+    if (node_capacity > index->node_capacity) {
+        index->node_capacity = node_capacity;
+        index->nodes = realloc(index->nodes, node_capacity * sizeof(PickNode));
+        assert(index->nodes != NULL);
+    }
+    index->node_cnt = 0;
+    if (item_cnt > 0)
+        buildNode(index, 0, item_cnt, 0);
+
+    storeKeys(index, paths, count);
+    index->builds += 1;
+}
+
+/**
+ * Recomputes the bounds of all nodes from their items, children come after
+ * their parents.
+ */
+static void refitNodes(PickIndex *index) {
+    for (unsigned i = index->node_cnt; i-- > 0;) {
+        PickNode *node = &index->nodes[i];
+        if (node->count > 0) {
+            leafBounds(index, node);
+            continue;
+        }
+        const PickNode *l = &index->nodes[i + 1];
+        const PickNode *r = &index->nodes[node->start];
+        node->min = (Vec2){ fmin(l->min.x, r->min.x), fmin(l->min.y, r->min.y) };
+        node->max = (Vec2){ fmax(l->max.x, r->max.x), fmax(l->max.y, r->max.y) };
+    }
+}
+
+static bool sameTransform(Affine m0, Affine m1) {
+    return m0.a == m1.a && m0.b == m1.b && m0.c == m1.c
+        && m0.d == m1.d && m0.e == m1.e && m0.f == m1.f;
+}
+
+/**
+ * Brings the index up to date with `paths`. Changed paths rebuild it, moved or
+ * scaled paths only update the bounds, which keeps the tree but is much
+ * cheaper. Costs a comparison per path when nothing changed.
+ */
+void pick_update(PickIndex *index, Path **paths, unsigned count) {
+    if (count != index->key_cnt) {
+        pick_build(index, paths, count);
+        return;
+    }
+
+    bool moved = false;
+    for (unsigned i = 0; i < count; i++) {
+        const PickKey *key = &index->keys[i];
+        const Path *path = paths[i];
+        if (key->path != path || key->nodes != path->nodes || key->node_cnt != path->node_cnt) {
+            pick_build(index, paths, count);
+            return;
+        }
+        if (!sameTransform(key->transform, path->transform))
+            moved = true;
+    }
+    if (!moved)
+        return;
+
+    for (unsigned i = 0; i < index->item_cnt; i++) {
+        PickItem *item = &index->items[i];
+        const Path *path = paths[item->path];
+        if (!sameTransform(index->keys[item->path].transform, path->transform))
+            itemBounds(item, path);
+    }
+    refitNodes(index);
+    storeKeys(index, paths, count);
+    index->refits += 1;
+}
+
+static Vec2 cubicPoint(const Vec2 c[4], double t) {
+    double mt = 1 - t;
+    double b0 = mt*mt*mt, b1 = 3*mt*mt*t, b2 = 3*mt*t*t, b3 = t*t*t;
+    return (Vec2){
+        b0*c[0].x + b1*c[1].x + b2*c[2].x + b3*c[3].x,
+        b0*c[0].y + b1*c[1].y + b2*c[2].y + b3*c[3].y,
+    };
+}
+
+/**
+ * Refines the root of (B(t) - p) . B'(t) in [a, b], where it goes from
+ * negative to positive. Newton steps that leave the bracket are replaced by
+ * bisection.
+ */
+static double refineRoot(const Vec2 c[4], Vec2 p, double a, double b) {
+    double t = 0.5 * (a + b);
+    for (int i = 0; i < PICK_NEWTON_ITERATIONS; i++) {
+        double mt = 1 - t;
+        Vec2 q = cubicPoint(c, t);
+        q.x -= p.x;
+        q.y -= p.y;
+
+        Vec2 d0 = { c[1].x - c[0].x, c[1].y - c[0].y };
+        Vec2 d1 = { c[2].x - c[1].x, c[2].y - c[1].y };
+        Vec2 d2 = { c[3].x - c[2].x, c[3].y - c[2].y };
+        Vec2 dq = {
+            3 * (mt*mt*d0.x + 2*mt*t*d1.x + t*t*d2.x),
+            3 * (mt*mt*d0.y + 2*mt*t*d1.y + t*t*d2.y),
+        };
+        Vec2 ddq = {
+            6 * (mt*(d1.x - d0.x) + t*(d2.x - d1.x)),
+            6 * (mt*(d1.y - d0.y) + t*(d2.y - d1.y)),
+        };
+
+        double f = q.x*dq.x + q.y*dq.y;
+        double df = dq.x*dq.x + dq.y*dq.y + q.x*ddq.x + q.y*ddq.y;
+        if (f < 0)
+            a = t;
+        else
+            b = t;
+
+        double next = df > 0 ? t - f / df : 0.5 * (a + b);
+        if (!(next > a && next < b))
+            next = 0.5 * (a + b);
+        if (fabs(next - t) < PICK_T_EPSILON)
+            return next;
+        t = next;
+    }
+    return t;
+}
+
+/**
+ * Finds the minima of the squared distance in [a, b]. `w` are the Bernstein
+ * coefficients of (B(t) - p) . B'(t) over [a, b]: with no sign change there
+ * is no root, with one there is exactly one.
+ */
+static void isolateMinima(const Vec2 c[4], Vec2 p, const double w[6], double a, double b,
+        int depth, double *best, double *best_t) {
+    int changes = 0;
+    for (int k = 0; k < 5; k++)
+        changes += (w[k] < 0) != (w[k+1] < 0);
+    if (changes == 0)
+        return;
+
+    if (changes == 1 || depth >= PICK_ROOT_DEPTH) {
+        // Maxima of the distance go from positive to negative
+        if (!(w[0] < 0 && w[5] >= 0) && changes == 1)
+            return;
+        double t = refineRoot(c, p, a, b);
+        Vec2 q = cubicPoint(c, t);
+        double d = (q.x - p.x)*(q.x - p.x) + (q.y - p.y)*(q.y - p.y);
+        if (d < *best) {
+            *best = d;
+            *best_t = t;
+        }
+        return;
+    }
+
+    // de Casteljau split at the middle
+    double l[6], r[6], tmp[6];
+    memcpy(tmp, w, sizeof(tmp));
+    for (int k = 0; k < 6; k++) {
+        l[k] = tmp[0];
+        r[5 - k] = tmp[5 - k];
+        for (int j = 0; j < 5 - k; j++)
+            tmp[j] = 0.5 * (tmp[j] + tmp[j+1]);
+    }
+    double m = 0.5 * (a + b);
+    isolateMinima(c, p, l, a, m, depth + 1, best, best_t);
+    isolateMinima(c, p, r, m, b, depth + 1, best, best_t);
+}
+
+static double cubicDistSqr(const Vec2 c[4], Vec2 p, double *t) {
+    static const double BINOM3[4] = { 1, 3, 3, 1 };
+    static const double BINOM2[3] = { 1, 2, 1 };
+    static const double BINOM5[6] = { 1, 5, 10, 10, 5, 1 };
+
+    // Product of B(t) - p (degree 3) and B'(t) (degree 2) in Bernstein form
+    double w[6] = { 0 };
+    for (int i = 0; i < 4; i++) {
+        Vec2 q = { c[i].x - p.x, c[i].y - p.y };
+        for (int j = 0; j < 3; j++) {
+            Vec2 d = { 3 * (c[j+1].x - c[j].x), 3 * (c[j+1].y - c[j].y) };
+            w[i+j] += BINOM3[i] * BINOM2[j] * (q.x*d.x + q.y*d.y);
+        }
+    }
+    for (int k = 0; k < 6; k++)
+        w[k] /= BINOM5[k];
+
+    double d0 = (c[0].x - p.x)*(c[0].x - p.x) + (c[0].y - p.y)*(c[0].y - p.y);
+    double d3 = (c[3].x - p.x)*(c[3].x - p.x) + (c[3].y - p.y)*(c[3].y - p.y);
+    double best = d0 <= d3 ? d0 : d3;
+    double best_t = d0 <= d3 ? 0.0 : 1.0;
+
+    isolateMinima(c, p, w, 0.0, 1.0, 0, &best, &best_t);
+    *t = best_t;
+    return best;
+}
+
+/**
+ * Distance of `p` to the cubic with control points `c`, and the curve
+ * parameter of the nearest point.
+ */
+double pick_cubicDistance(const Vec2 c[4], Vec2 p, double *t) {
+    return sqrt(cubicDistSqr(c, p, t));
+}
+
+double pick_lineDistance(Vec2 a, Vec2 b, Vec2 p, double *t) {
+    Vec2 ab = { b.x - a.x, b.y - a.y };
+    double len_sqr = ab.x*ab.x + ab.y*ab.y;
+    double s = len_sqr > 0 ? ((p.x - a.x)*ab.x + (p.y - a.y)*ab.y) / len_sqr : 0.0;
+    s = fmin(fmax(s, 0.0), 1.0);
+    *t = s;
+    return hypot(a.x + ab.x*s - p.x, a.y + ab.y*s - p.y);
+}
+
+static double segmentDistSqr(const Path *path, unsigned segment, Vec2 p, double *t) {
+    Vec2 c[4];
+    segmentPoints(path, segment, c);
+    if (path->type == PATHTYPE_bezier && path->node_cnt >= 4)
+        return cubicDistSqr(c, p, t);
+
+    double d = pick_lineDistance(c[0], c[3], p, t);
+    return d*d;
+}
+
+/**
+ * Finds the segment nearest to `p` within `max_dist` (canvas units, INFINITY
+ * for any distance). `paths` must be the paths the index was last built or
+ * updated with. Returns false if there is none.
+ */
+bool pick_nearest(const PickIndex *index, Path **paths, Vec2 p, double max_dist, PickHit *hit) {
+    if (index->node_cnt == 0)
+        return false;
+
+    double best = max_dist * max_dist;
+    bool found = false;
+
+    unsigned stack[PICK_MAX_DEPTH + 1];
+    unsigned sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        unsigned n = stack[--sp];
+        const PickNode *node = &index->nodes[n];
+
+        if (node->count > 0) {
+            for (unsigned i = node->start; i < node->start + node->count; i++) {
+                const PickItem *item = &index->items[i];
+                if (boxDistSqr(item->min, item->max, p) > best)
+                    continue;
+
+                double t;
+                double d = segmentDistSqr(paths[item->path], item->segment, p, &t);
+                if (d <= best) {
+                    best = d;
+                    found = true;
+                    hit->path = item->path;
+                    hit->segment = item->segment;
+                    hit->t = t;
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top of the stack
+        unsigned l = n + 1;
+        unsigned r = node->start;
+        double dl = boxDistSqr(index->nodes[l].min, index->nodes[l].max, p);
+        double dr = boxDistSqr(index->nodes[r].min, index->nodes[r].max, p);
+        if (dl > dr) {
+            unsigned tmp = l; l = r; r = tmp;
+            double dtmp = dl; dl = dr; dr = dtmp;
+        }
+        if (dr <= best)
+            stack[sp++] = r;
+        if (dl <= best)
+            stack[sp++] = l;
+    }
+
+    if (!found)
+        return false;
+
+    Vec2 c[4];
+    const Path *path = paths[hit->path];
+    segmentPoints(path, hit->segment, c);
+    hit->point = cubicPoint(c, hit->t);
+    hit->dist = sqrt(best);
+    return true;
+}
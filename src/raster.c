@@ -0,0 +1,707 @@
+// CPU rasterizer. Every path is flattened and turned into stroke outline
+// polygons: a quad per segment, a miter (or bevel) wedge per join and a disc
+// per cap. All polygons are oriented the same way, and their edges are
+// accumulated as signed area per pixel (like font-rs). The running sum along a
+// row, clamped to 1, is the coverage of the union of all strokes.
+//
+// The edges are binned into the tiles they cross. The rows of tiles are
+// rendered in parallel, the tiles of a row from left to right: every tile
+// accumulates its own edges in a small buffer, and the running sums at its
+// right border carry over into the next tile.
+//
+//   vectornotes render FILE... [-o OUT.ppm] [--size WxH] [--stroke-width PX]
+//                              [--repeat N]
+//
+// renders the paths of the files (as imported by the drop handler), fitted
+// into the image, and prints the render time.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "affine.h"
+#include "import.h"
+#include "jobs.h"
+#include "path.h"
+#include "raster.h"
+#include "vec.h"
+
+// Same as the nanovg defaults, see nvgCreateInternal and nvg__tesselateBezier
+#define RASTER_TESS_TOL 0.25
+#define RASTER_DIST_TOL 0.01
+#define RASTER_MAX_LEVEL 10
+#define RASTER_PI 3.14159265358979323846
+
+#define RASTER_ROW_STRIDE (RASTER_TILE_SIZE + 2)
+
+typedef struct edge {
+    float x0, y0, x1, y1;
+} Edge;
+
+typedef struct raster_ctx {
+    Raster *raster;
+    const RasterStyle *style;
+    unsigned tiles_x, tiles_y;
+
+    Edge *edges;
+    unsigned edge_cnt;
+    unsigned edge_capacity;
+
+    // Flattened polyline of the current path
+    Vec2 *points;
+    unsigned point_cnt;
+    unsigned point_capacity;
+
+    // Edges crossing every tile, row major. `tile_start` has one entry more
+    // than there are tiles.
+    unsigned *tile_start;
+    unsigned *tile_edges;
+} RasterCtx;
+
+Raster *raster_init(unsigned width, unsigned height) {
+    Raster *raster = malloc(sizeof(Raster));
+    assert(raster != NULL);
+    raster->width = width;
+    raster->height = height;
+    raster->pixels = calloc((size_t)width * height, 4);
+    assert(raster->pixels != NULL);
+    return raster;
+}
+
+void raster_deinit(Raster *raster) {
+    if (!raster)
+        return;
+    free(raster->pixels);
+    free(raster);
+}
+
+void raster_clear(Raster *raster, const uint8_t color[4]) {
+    size_t cnt = (size_t)raster->width * raster->height;
+    for (size_t i = 0; i < cnt; i++)
+        memcpy(&raster->pixels[4*i], color, 4);
+}
+
+/**
+ * The stroke of vn_update: 2 px wide, same color as the nanovg renderer.
+ */
+RasterStyle raster_defaultStyle(void) {
+    RasterStyle style = {
+        .stroke_width = 2.0,
+        .miter_limit = 10.0,
+        .color = { 230, 20, 15, 255 },
+    };
+    return style;
+}
+
+static void addEdge(RasterCtx *ctx, Vec2 a, Vec2 b) {
+    if (a.y == b.y)
+        return;
+
+    if (ctx->edge_cnt >= ctx->edge_capacity) {
+        ctx->edge_capacity = ctx->edge_capacity ? ctx->edge_capacity*2 : 1024;
+        ctx->edges = realloc(ctx->edges, ctx->edge_capacity * sizeof(Edge));
+        assert(ctx->edges != NULL);
+    }
+    ctx->edges[ctx->edge_cnt++] = (Edge){ a.x, a.y, b.x, b.y };
+}
+
+/**
+ * Adds a closed polygon, reversed if needed so all polygons have the same
+ * orientation and their coverage adds up.
+ */
+static void addPolygon(RasterCtx *ctx, const Vec2 *pts, unsigned cnt) {
+    double area = 0;
+    for (unsigned i = 0; i < cnt; i++) {
+        Vec2 a = pts[i];
+        Vec2 b = pts[(i + 1) % cnt];
+        area += a.x*b.y - b.x*a.y;
+    }
+
+    for (unsigned i = 0; i < cnt; i++) {
+        Vec2 a = pts[i];
+        Vec2 b = pts[(i + 1) % cnt];
+        if (area >= 0)
+            addEdge(ctx, a, b);
+        else
+            addEdge(ctx, b, a);
+    }
+}
+
+/**
+ * Round cap, a full disc with the nanovg number of divisions.
+ */
+static void addDisc(RasterCtx *ctx, Vec2 center, double r) {
+    Vec2 pts[256];
+    double da = acos(r / (r + RASTER_TESS_TOL)) * 2;
+    unsigned divs = (unsigned)ceil(2*RASTER_PI / da);
+    if (divs < 8) divs = 8;
+    if (divs > 256) divs = 256;
+
+    for (unsigned i = 0; i < divs; i++) {
+        double a = 2*RASTER_PI * i / divs;
+        pts[i] = (Vec2){ center.x + cos(a)*r, center.y + sin(a)*r };
+    }
+    addPolygon(ctx, pts, divs);
+}
+
+static void addPoint(RasterCtx *ctx, Vec2 p) {
+    if (ctx->point_cnt > 0) {
+        Vec2 last = ctx->points[ctx->point_cnt-1];
+        if (fabs(p.x - last.x) < RASTER_DIST_TOL && fabs(p.y - last.y) < RASTER_DIST_TOL)
+            return;
+    }
+
+    if (ctx->point_cnt >= ctx->point_capacity) {
+        ctx->point_capacity = ctx->point_capacity ? ctx->point_capacity*2 : 256;
+        ctx->points = realloc(ctx->points, ctx->point_capacity * sizeof(Vec2));
+        assert(ctx->points != NULL);
+    }
+    ctx->points[ctx->point_cnt++] = p;
+}
+
+/**
+ * Recursive subdivision with the nanovg flatness test.
+ */
+static void flattenBezier(RasterCtx *ctx, Vec2 p1, Vec2 p2, Vec2 p3, Vec2 p4, int level) {
+    if (level > RASTER_MAX_LEVEL)
+        return;
+
+    double dx = p4.x - p1.x;
+    double dy = p4.y - p1.y;
+    double d2 = fabs((p2.x - p4.x)*dy - (p2.y - p4.y)*dx);
+    double d3 = fabs((p3.x - p4.x)*dy - (p3.y - p4.y)*dx);
+    if ((d2 + d3)*(d2 + d3) < RASTER_TESS_TOL * (dx*dx + dy*dy)) {
+        addPoint(ctx, p4);
+        return;
+    }
+
+    Vec2 p12 = vec2_scalarMult(vec2_add(p1, p2), 0.5);
+    Vec2 p23 = vec2_scalarMult(vec2_add(p2, p3), 0.5);
+    Vec2 p34 = vec2_scalarMult(vec2_add(p3, p4), 0.5);
+    Vec2 p123 = vec2_scalarMult(vec2_add(p12, p23), 0.5);
+    Vec2 p234 = vec2_scalarMult(vec2_add(p23, p34), 0.5);
+    Vec2 p1234 = vec2_scalarMult(vec2_add(p123, p234), 0.5);
+
+    flattenBezier(ctx, p1, p12, p123, p1234, level + 1);
+    flattenBezier(ctx, p1234, p234, p34, p4, level + 1);
+}
+
+static Vec2 leftNormal(Vec2 a, Vec2 b) {
+    Vec2 d = vec2_sub(b, a);
+    double len = sqrt(d.x*d.x + d.y*d.y);
+    return (Vec2){ -d.y / len, d.x / len };
+}
+
+/**
+ * Stroke outline of the flattened points: segment quads, joins and caps.
+ */
+static void strokePoints(RasterCtx *ctx) {
+    const Vec2 *p = ctx->points;
+    unsigned cnt = ctx->point_cnt;
+    double hw = 0.5 * ctx->style->stroke_width;
+    double limit = ctx->style->miter_limit;
+
+    if (cnt == 0)
+        return;
+    addDisc(ctx, p[0], hw);
+    if (cnt == 1)
+        return;
+    addDisc(ctx, p[cnt-1], hw);
+
+    for (unsigned i = 0; i + 1 < cnt; i++) {
+        Vec2 n = vec2_scalarMult(leftNormal(p[i], p[i+1]), hw);
+        Vec2 quad[4] = {
+            vec2_add(p[i], n),
+            vec2_add(p[i+1], n),
+            vec2_sub(p[i+1], n),
+            vec2_sub(p[i], n),
+        };
+        addPolygon(ctx, quad, 4);
+    }
+
+    for (unsigned i = 1; i + 1 < cnt; i++) {
+        Vec2 n0 = leftNormal(p[i-1], p[i]);
+        Vec2 n1 = leftNormal(p[i], p[i+1]);
+        double cross = n0.x*n1.y - n0.y*n1.x;
+        if (fabs(cross) < 1e-6)
+            continue;
+
+        // The wedge is on the outer side of the turn
+        double s = cross > 0 ? -hw : hw;
+        Vec2 a = vec2_add(p[i], vec2_scalarMult(n0, s));
+        Vec2 b = vec2_add(p[i], vec2_scalarMult(n1, s));
+
+        Vec2 dm = vec2_scalarMult(vec2_add(n0, n1), 0.5);
+        double dmr2 = dm.x*dm.x + dm.y*dm.y;
+        if (dmr2 * limit*limit >= 1.0) {
+            Vec2 miter = vec2_add(p[i], vec2_scalarMult(dm, s / dmr2));
+            Vec2 wedge[4] = { p[i], a, miter, b };
+            addPolygon(ctx, wedge, 4);
+        } else {
+            Vec2 bevel[3] = { p[i], a, b };
+            addPolygon(ctx, bevel, 3);
+        }
+    }
+}
+
+static void strokePath(RasterCtx *ctx, Path *path, Affine m) {
+    if (path->node_cnt == 0)
+        return;
+
+    ctx->point_cnt = 0;
+    addPoint(ctx, affine_apply(m, path->nodes[0]));
+    if (path->type == PATHTYPE_bezier) {
+        for (unsigned j = 1; j + 2 < path->node_cnt; j += 3) {
+            flattenBezier(ctx, ctx->points[ctx->point_cnt-1],
+                    affine_apply(m, path->nodes[j]),
+                    affine_apply(m, path->nodes[j+1]),
+                    affine_apply(m, path->nodes[j+2]), 0);
+        }
+    } else {
+        for (unsigned j = 1; j < path->node_cnt; j++)
+            addPoint(ctx, affine_apply(m, path->nodes[j]));
+    }
+    strokePoints(ctx);
+}
+
+/**
+ * Accumulates the signed area of a line left of the pixel centers, for a
+ * line within 0 <= x <= w and 0 <= y <= h of the tile.
+ */
+static void accumulateLine(float *acc, double x0, double y0, double x1, double y1) {
+    if (y0 == y1)
+        return;
+
+    double dir = 1.0;
+    if (y0 > y1) {
+        double t;
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+        dir = -1.0;
+    }
+
+    double dxdy = (x1 - x0) / (y1 - y0);
+    double x = x0;
+    for (int y = (int)y0; y < (int)ceil(y1); y++) {
+        float *row = acc + y * RASTER_ROW_STRIDE;
+        double dy = fmin(y + 1, y1) - fmax(y, y0);
+        // Rounding may carry x past the ends of the edge, off the tile
+        double xnext = fmin(fmax(x + dxdy * dy, fmin(x0, x1)), fmax(x0, x1));
+        double d = dy * dir;
+
+        double xl = fmin(x, xnext);
+        double xr = fmax(x, xnext);
+        double xl_floor = floor(xl);
+        int xl_i = (int)xl_floor;
+        int xr_i = (int)ceil(xr);
+
+        if (xr_i <= xl_i + 1) {
+            // Within one pixel
+            double xm = 0.5 * (x + xnext) - xl_floor;
+            row[xl_i] += d - d * xm;
+            row[xl_i + 1] += d * xm;
+        } else {
+            double s = 1.0 / (xr - xl);
+            double xl_f = xl - xl_floor;
+            double a0 = 0.5 * s * (1 - xl_f) * (1 - xl_f);
+            double xr_f = xr - xr_i + 1;
+            double am = 0.5 * s * xr_f * xr_f;
+
+            row[xl_i] += d * a0;
+            if (xr_i == xl_i + 2) {
+                row[xl_i + 1] += d * (1 - a0 - am);
+            } else {
+                double a1 = s * (1.5 - xl_f);
+                row[xl_i + 1] += d * (a1 - a0);
+                for (int xi = xl_i + 2; xi < xr_i - 1; xi++)
+                    row[xi] += d * s;
+                double a2 = a1 + (xr_i - xl_i - 3) * s;
+                row[xr_i - 1] += d * (1 - a2 - am);
+            }
+            row[xr_i] += d * am;
+        }
+        x = xnext;
+    }
+}
+
+/**
+ * Clips an edge (in tile coordinates) to the tile, split where it crosses the
+ * left and right border. The parts left and right of the tile belong to the
+ * neighbours, except left of the first tile of a row: those are projected
+ * onto the border, where they cover whole rows.
+ */
+static void accumulateEdge(float *acc, unsigned w, unsigned h, Edge e, bool first) {
+    double x0 = e.x0, y0 = e.y0, x1 = e.x1, y1 = e.y1;
+
+    if (fmax(y0, y1) <= 0 || fmin(y0, y1) >= h)
+        return;
+
+    double ta = 0, tb = 1;
+    double dy = y1 - y0;
+    if (y0 < 0) ta = (0 - y0) / dy;
+    if (y0 > h) ta = (h - y0) / dy;
+    if (y1 < 0) tb = (0 - y0) / dy;
+    if (y1 > h) tb = (h - y0) / dy;
+
+    double ax = x0 + ta * (x1 - x0), ay = y0 + ta * dy;
+    double bx = x0 + tb * (x1 - x0), by = y0 + tb * dy;
+    ay = fmin(fmax(ay, 0), h);
+    by = fmin(fmax(by, 0), h);
+
+    // Split at the borders, at most two crossings
+    double ts[4] = { 0, 1, 1, 1 };
+    unsigned cnt = 1;
+    double dx = bx - ax;
+    if (dx != 0) {
+        double t0 = (0 - ax) / dx;
+        double tw = (w - ax) / dx;
+        if (t0 > 0 && t0 < 1) ts[cnt++] = t0;
+        if (tw > 0 && tw < 1) ts[cnt++] = tw;
+    }
+    ts[cnt++] = 1;
+    if (cnt == 4 && ts[1] > ts[2]) {
+        double t = ts[1]; ts[1] = ts[2]; ts[2] = t;
+    }
+
+    for (unsigned i = 0; i + 1 < cnt; i++) {
+        double px0 = ax + ts[i] * dx;
+        double py0 = ay + ts[i] * (by - ay);
+        double px1 = ax + ts[i+1] * dx;
+        double py1 = ay + ts[i+1] * (by - ay);
+
+        // Each part goes to exactly one tile
+        double mid = 0.5 * (px0 + px1);
+        if (mid >= w || (mid < 0 && !first))
+            continue;
+        accumulateLine(acc,
+                fmin(fmax(px0, 0), w), py0,
+                fmin(fmax(px1, 0), w), py1);
+    }
+}
+
+/**
+ * Coverage of a row from the accumulated area, the running sum clamped to
+ * [0, 1]. `cov` holds RASTER_TILE_SIZE values. Returns the running sum at the
+ * end of the row.
+ */
+static float coverageRow(const float *acc, float *cov) {
+#ifdef __SSE2__
+    __m128 offset = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    for (unsigned x = 0; x < RASTER_TILE_SIZE; x += 4) {
+        __m128 v = _mm_loadu_ps(acc + x);
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+        v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+        v = _mm_add_ps(v, offset);
+        offset = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+        _mm_storeu_ps(cov + x, _mm_min_ps(_mm_andnot_ps(sign, v), one));
+    }
+    return _mm_cvtss_f32(offset);
+#else
+    float sum = 0;
+    for (unsigned x = 0; x < RASTER_TILE_SIZE; x++) {
+        sum += acc[x];
+        cov[x] = fminf(fabsf(sum), 1.0f);
+    }
+    return sum;
+#endif
+}
+
+/**
+ * Renders rows of tiles, each from left to right.
+ */
+static void tileRowJob(void *arg, size_t begin, size_t end) {
+    RasterCtx *ctx = arg;
+    Raster *raster = ctx->raster;
+    const uint8_t *color = ctx->style->color;
+    float alpha = color[3] / 255.0f;
+
+    float acc[RASTER_TILE_SIZE * RASTER_ROW_STRIDE];
+    float cov[RASTER_TILE_SIZE];
+    float carry[RASTER_TILE_SIZE][2];   // Area right of the previous tile
+
+    for (size_t ty = begin; ty < end; ty++) {
+        unsigned y0 = ty * RASTER_TILE_SIZE;
+        unsigned h = raster->height - y0 < RASTER_TILE_SIZE ? raster->height - y0 : RASTER_TILE_SIZE;
+        bool carried = false;
+        memset(carry, 0, sizeof(carry));
+
+        for (unsigned tx = 0; tx < ctx->tiles_x; tx++) {
+            unsigned x0 = tx * RASTER_TILE_SIZE;
+            unsigned w = raster->width - x0 < RASTER_TILE_SIZE ? raster->width - x0 : RASTER_TILE_SIZE;
+            unsigned t = ty * ctx->tiles_x + tx;
+            if (!carried && ctx->tile_start[t] == ctx->tile_start[t+1])
+                continue;
+
+            memset(acc, 0, sizeof(float) * RASTER_ROW_STRIDE * h);
+            for (unsigned y = 0; y < h; y++) {
+                acc[y * RASTER_ROW_STRIDE] = carry[y][0];
+                acc[y * RASTER_ROW_STRIDE + 1] = carry[y][1];
+            }
+            for (unsigned i = ctx->tile_start[t]; i < ctx->tile_start[t+1]; i++) {
+                Edge e = ctx->edges[ctx->tile_edges[i]];
+                e.x0 -= x0; e.x1 -= x0;
+                e.y0 -= y0; e.y1 -= y0;
+                accumulateEdge(acc, w, h, e, tx == 0);
+            }
+
+            carried = false;
+            for (unsigned y = 0; y < h; y++) {
+                float *row = acc + y * RASTER_ROW_STRIDE;
+                float sum = coverageRow(row, cov);
+                carry[y][0] = sum + row[w];
+                carry[y][1] = row[w + 1];
+                if (carry[y][0] != 0 || carry[y][1] != 0)
+                    carried = true;
+
+                uint8_t *px = raster->pixels + ((size_t)(y0 + y) * raster->width + x0) * 4;
+                for (unsigned x = 0; x < w; x++, px += 4) {
+                    float k = cov[x] * alpha;
+                    if (k <= 0)
+                        continue;
+                    // Exact for opaque backgrounds
+                    for (int c = 0; c < 3; c++)
+                        px[c] = (uint8_t)(px[c] + (color[c] - px[c]) * k + 0.5f);
+                    px[3] = (uint8_t)(px[3] + (255 - px[3]) * k + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Sorts the edges into the tiles they cross. Edges left of the raster go to
+ * the first tile of their rows, edges above, below or right of it are
+ * dropped.
+ */
+static void binEdges(RasterCtx *ctx) {
+    unsigned tile_cnt = ctx->tiles_x * ctx->tiles_y;
+    float width = ctx->raster->width;
+    float height = ctx->raster->height;
+    ctx->tile_start = calloc(tile_cnt + 1, sizeof(unsigned));
+    assert(ctx->tile_start != NULL);
+
+    unsigned *fill = NULL;
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            // Counts to offsets
+            unsigned sum = 0;
+            for (unsigned t = 0; t <= tile_cnt; t++) {
+                unsigned c = ctx->tile_start[t];
+                ctx->tile_start[t] = sum;
+                sum += c;
+            }
+            ctx->tile_edges = malloc((sum > 0 ? sum : 1) * sizeof(unsigned));
+            assert(ctx->tile_edges != NULL);
+            fill = calloc(tile_cnt, sizeof(unsigned));
+            assert(fill != NULL);
+        }
+
+        for (unsigned i = 0; i < ctx->edge_cnt; i++) {
+            const Edge *e = &ctx->edges[i];
+            float ymin = fminf(e->y0, e->y1);
+            float ymax = fmaxf(e->y0, e->y1);
+            float xmin = fminf(e->x0, e->x1);
+            float xmax = fmaxf(e->x0, e->x1);
+            if (ymax <= 0 || ymin >= height || xmin >= width)
+                continue;
+
+            unsigned y0 = ymin > 0 ? (unsigned)(ymin / RASTER_TILE_SIZE) : 0;
+            unsigned y1 = (unsigned)(fminf(ymax, height - 1) / RASTER_TILE_SIZE);
+            unsigned x0 = xmin > 0 ? (unsigned)(xmin / RASTER_TILE_SIZE) : 0;
+            unsigned x1 = xmax > 0 ? (unsigned)(fminf(xmax, width - 1) / RASTER_TILE_SIZE) : 0;
+            for (unsigned ty = y0; ty <= y1; ty++) {
+                for (unsigned tx = x0; tx <= x1; tx++) {
+                    unsigned t = ty * ctx->tiles_x + tx;
+                    if (pass == 0)
+                        ctx->tile_start[t] += 1;
+                    else
+                        ctx->tile_edges[ctx->tile_start[t] + fill[t]++] = i;
+                }
+            }
+        }
+    }
+    free(fill);
+}
+
+/**
+ * Strokes the paths into the raster. `view` maps canvas coordinates to
+ * raster pixels, the stroke width is in pixels like on screen.
+ */
+void raster_strokePaths(Raster *raster, Path **paths, unsigned count, Affine view,
+        const RasterStyle *style) {
+    RasterStyle defaults = raster_defaultStyle();
+    if (!style)
+        style = &defaults;
+    if (raster->width == 0 || raster->height == 0)
+        return;
+
+    RasterCtx ctx = {
+        .raster = raster,
+        .style = style,
+        .tiles_x = (raster->width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE,
+        .tiles_y = (raster->height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE,
+    };
+
+    double margin = style->stroke_width;
+    for (unsigned i = 0; i < count; i++) {
+        Path *path = paths[i];
+        Affine m = affine_mult(view, path->transform);
+
+        // Off-raster paths, by the corners of their box
+        Vec2 corners[4] = {
+            path->bbox_min,
+            { path->bbox_max.x, path->bbox_min.y },
+            path->bbox_max,
+            { path->bbox_min.x, path->bbox_max.y },
+        };
+        Vec2 min = { DBL_MAX, DBL_MAX };
+        Vec2 max = { -DBL_MAX, -DBL_MAX };
+        for (int j = 0; j < 4; j++) {
+            Vec2 c = affine_apply(m, corners[j]);
+            min.x = fmin(min.x, c.x);
+            min.y = fmin(min.y, c.y);
+            max.x = fmax(max.x, c.x);
+            max.y = fmax(max.y, c.y);
+        }
+        if (max.x < -margin || max.y < -margin
+                || min.x > raster->width + margin || min.y > raster->height + margin)
+            continue;
+
+        strokePath(&ctx, path, m);
+    }
+
+    binEdges(&ctx);
+    jobs_parallelFor(ctx.tiles_y, 1, tileRowJob, &ctx);
+
+    free(ctx.edges);
+    free(ctx.points);
+    free(ctx.tile_start);
+    free(ctx.tile_edges);
+}
+
+/**
+ * Writes the color channels as binary PPM.
+ */
+bool raster_writePpm(const Raster *raster, const char *filename) {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        printf("Error(Raster): Could not open '%s' for writing\n", filename);
+        return false;
+    }
+
+    fprintf(fp, "P6\n%u %u\n255\n", raster->width, raster->height);
+    uint8_t *row = malloc((size_t)raster->width * 3);
+    assert(row != NULL);
+    bool ok = true;
+    for (unsigned y = 0; y < raster->height && ok; y++) {
+        const uint8_t *px = raster->pixels + (size_t)y * raster->width * 4;
+        for (unsigned x = 0; x < raster->width; x++)
+            memcpy(&row[3*x], &px[4*x], 3);
+        ok = fwrite(row, 3, raster->width, fp) == raster->width;
+    }
+    free(row);
+    if (fclose(fp) != 0)
+        ok = false;
+
+    if (!ok)
+        printf("Error(Raster): Failed writing '%s'\n", filename);
+    return ok;
+}
+
+static double wallTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int raster_main(int argc, char *argv[]) {
+    const char *out = "render.ppm";
+    unsigned width = 1024, height = 768;
+    int repeat = 1;
+    RasterStyle style = raster_defaultStyle();
+
+    Path **paths = NULL;
+    unsigned path_cnt = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+            out = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i+1 < argc) {
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2 || width == 0 || height == 0) {
+                printf("Error(Raster): Invalid size '%s', expected WxH\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stroke-width") == 0 && i+1 < argc) {
+            style.stroke_width = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && i+1 < argc) {
+            repeat = atoi(argv[++i]);
+            if (repeat < 1) repeat = 1;
+        } else {
+            unsigned cnt = 0;
+            Path **imported = import_file(argv[i], 1.0, &cnt);
+            if (!imported)
+                return 1;
+            paths = realloc(paths, (path_cnt + cnt + 1) * sizeof(Path*));
+            assert(paths != NULL);
+            memcpy(&paths[path_cnt], imported, cnt * sizeof(Path*));
+            path_cnt += cnt;
+            free(imported);
+        }
+    }
+    if (path_cnt == 0) {
+        printf("Usage: vectornotes render FILE... [-o OUT.ppm] [--size WxH] "
+               "[--stroke-width PX] [--repeat N]\n");
+        free(paths);
+        return 1;
+    }
+
+    // Fit all paths into the image with a small margin
+    Vec2 min = { DBL_MAX, DBL_MAX };
+    Vec2 max = { -DBL_MAX, -DBL_MAX };
+    for (unsigned i = 0; i < path_cnt; i++) {
+        if (paths[i]->node_cnt == 0) continue;
+        Vec2 pmin, pmax;
+        path_getBounds(paths[i], &pmin, &pmax);
+        min.x = fmin(min.x, pmin.x);
+        min.y = fmin(min.y, pmin.y);
+        max.x = fmax(max.x, pmax.x);
+        max.y = fmax(max.y, pmax.y);
+    }
+    double scale = 0.95 * fmin(width / fmax(max.x - min.x, 1e-9), height / fmax(max.y - min.y, 1e-9));
+    Vec2 center = vec2_scalarMult(vec2_add(min, max), 0.5);
+    Affine view = affine_mult(
+            affine_translate((Vec2){ 0.5 * width, 0.5 * height }),
+            affine_mult(affine_scale(scale), affine_translate(vec2_scalarMult(center, -1))));
+
+    Raster *raster = raster_init(width, height);
+    const uint8_t white[4] = { 255, 255, 255, 255 };
+    double best = DBL_MAX;
+    for (int r = 0; r < repeat; r++) {
+        raster_clear(raster, white);
+        double t = wallTime();
+        raster_strokePaths(raster, paths, path_cnt, view, &style);
+        best = fmin(best, wallTime() - t);
+    }
+
+    printf("Rendered %u paths at %ux%u in %.3f ms (best of %d, %u threads)\n",
+            path_cnt, width, height, best * 1e3, repeat, jobs_threadCount());
+
+    bool ok = raster_writePpm(raster, out);
+    raster_deinit(raster);
+    for (unsigned i = 0; i < path_cnt; i++)
+        path_deinit(paths[i]);
+    free(paths);
+    return ok ? 0 : 1;
+}
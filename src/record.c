@@ -0,0 +1,513 @@
+// Input session recordings. A recording is a header followed by the events:
+//
+//   "VNRC" u32 version, u32 width, u32 height, u64 start time (us)
+//   per event: u8 type, varint microseconds since the previous event, then
+//     key:    zigzag varint key, zigzag varint scancode, u8 action, u8 mods
+//     char:   varint codepoint
+//     cursor, scroll: two f32, or two f64 with RECORD_WIDE set in the type
+//     button: u8 button, u8 action, u8 mods
+//     resize: varint width, varint height
+//     drop:   varint count, per file varint length and the bytes
+//
+// Cursor positions and scroll offsets are whole numbers on most platforms, so
+// they are stored as f32 whenever that is exact.
+//
+//   vectornotes replay SESSION [FILE...] [--fast] [--frames OUT.csv]
+//                              [-o OUT.ppm] [--filter SPEC] [--notebook DIR]
+//
+// replays a recording on the files (and notebook) the session started with,
+// as the recorded input would not make sense on another canvas. With a
+// notebook, replay on a copy, the pages are saved at the end.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "affine.h"
+#include "jobs.h"
+#include "mem.h"
+#include "raster.h"
+#include "record.h"
+#include "thumb.h"
+#include "tool.h"
+#include "vec.h"
+#include "vectornotes.h"
+#include "writer.h"
+
+#define RECORD_MAGIC "VNRC"
+#define RECORD_VERSION 1
+#define RECORD_WIDE 0x80
+
+static const uint8_t REPLAY_BACKGROUND[4] = { 255, 255, 255, 255 };
+
+static void putU8(Writer *w, uint8_t v) {
+    writer_write(w, &v, 1);
+}
+
+static void putVarint(Writer *w, uint64_t v) {
+    uint8_t buf[10];
+    size_t len = 0;
+    while (v >= 0x80) {
+        buf[len++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    buf[len++] = (uint8_t)v;
+    writer_write(w, buf, len);
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * Starts a recording, `start_us` is the event time the session starts at.
+ * Returns NULL if the file could not be opened.
+ */
+Recorder *record_open(const char *filename, unsigned width, unsigned height, uint64_t start_us) {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        printf("Error(Record): Could not open '%s' for writing\n", filename);
+        return NULL;
+    }
+
+    Recorder *rec = calloc(1, sizeof(Recorder));
+    assert(rec != NULL);
+    rec->fp = fp;
+    rec->prev_us = start_us;
+    writer_init(&rec->w, fp, NULL, 0);
+
+    uint32_t header[3] = { RECORD_VERSION, width, height };
+    writer_write(&rec->w, RECORD_MAGIC, 4);
+    writer_write(&rec->w, header, sizeof(header));
+    writer_write(&rec->w, &start_us, sizeof(start_us));
+    return rec;
+}
+
+/**
+ * Ends the recording. Returns false if it could not be written completely.
+ */
+bool record_close(Recorder *rec) {
+    bool ok = writer_deinit(&rec->w);
+    if (fclose(rec->fp) != 0)
+        ok = false;
+    if (ok)
+        printf("Recorded %lu events, %lu frames\n", rec->events, rec->frames);
+    else
+        printf("Error(Record): Failed writing the recording\n");
+    free(rec);
+    return ok;
+}
+
+static bool isWide(double x, double y) {
+    return (double)(float)x != x || (double)(float)y != y;
+}
+
+void record_event(Recorder *rec, const RecordEvent *ev) {
+    Writer *w = &rec->w;
+
+    uint64_t delta = ev->time_us >= rec->prev_us ? ev->time_us - rec->prev_us : 0;
+    bool pair = ev->type == RECORD_cursor || ev->type == RECORD_scroll;
+    bool wide = pair && isWide(ev->x, ev->y);
+    rec->prev_us += delta;
+    rec->events += 1;
+
+    putU8(w, ev->type | (wide ? RECORD_WIDE : 0));
+    putVarint(w, delta);
+
+    switch (ev->type) {
+    case RECORD_frame:
+        rec->frames += 1;
+        break;
+    case RECORD_key:
+        putVarint(w, zigzag(ev->key));
+        putVarint(w, zigzag(ev->scancode));
+        putU8(w, ev->action);
+        putU8(w, ev->mods);
+        break;
+    case RECORD_char:
+        putVarint(w, ev->codepoint);
+        break;
+    case RECORD_cursor:
+    case RECORD_scroll:
+        if (wide) {
+            double v[2] = { ev->x, ev->y };
+            writer_write(w, v, sizeof(v));
+        } else {
+            float v[2] = { (float)ev->x, (float)ev->y };
+            writer_write(w, v, sizeof(v));
+        }
+        break;
+    case RECORD_button:
+        putU8(w, ev->key);
+        putU8(w, ev->action);
+        putU8(w, ev->mods);
+        break;
+    case RECORD_resize:
+        putVarint(w, (uint64_t)ev->x);
+        putVarint(w, (uint64_t)ev->y);
+        break;
+    case RECORD_drop:
+        putVarint(w, ev->path_cnt);
+        for (int i = 0; i < ev->path_cnt; i++) {
+            size_t len = strlen(ev->paths[i]);
+            putVarint(w, len);
+            writer_write(w, ev->paths[i], len);
+        }
+        break;
+    default:
+        assert(false && "Unknown record event");
+    }
+}
+
+typedef struct replay {
+    uint8_t *buf;
+    const uint8_t *p;
+    const uint8_t *end;
+    bool error;
+
+    unsigned width, height;
+    uint64_t time_us;
+
+    // Files of the last drop event
+    char **drop_paths;
+    int drop_cnt;
+} Replay;
+
+static void readBytes(Replay *r, void *dest, size_t len) {
+    if (r->error || (size_t)(r->end - r->p) < len) {
+        r->error = true;
+        memset(dest, 0, len);
+        return;
+    }
+    memcpy(dest, r->p, len);
+    r->p += len;
+}
+
+static uint8_t getU8(Replay *r) {
+    uint8_t v;
+    readBytes(r, &v, 1);
+    return v;
+}
+
+static uint64_t getVarint(Replay *r) {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t b = getU8(r);
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    r->error = true;
+    return 0;
+}
+
+static void freeDrop(Replay *r) {
+    for (int i = 0; i < r->drop_cnt; i++)
+        free(r->drop_paths[i]);
+    free(r->drop_paths);
+    r->drop_paths = NULL;
+    r->drop_cnt = 0;
+}
+
+static bool openReplay(Replay *r, const char *filename) {
+    memset(r, 0, sizeof(*r));
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        printf("Error(Record): Could not open '%s'\n", filename);
+        return false;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    r->buf = malloc(size > 0 ? size : 1);
+    assert(r->buf != NULL);
+    size_t len = size > 0 ? fread(r->buf, 1, size, fp) : 0;
+    fclose(fp);
+    r->p = r->buf;
+    r->end = r->buf + len;
+
+    char magic[4];
+    uint32_t header[3];
+    readBytes(r, magic, 4);
+    readBytes(r, header, sizeof(header));
+    readBytes(r, &r->time_us, sizeof(r->time_us));
+    if (r->error || memcmp(magic, RECORD_MAGIC, 4) != 0 || header[0] != RECORD_VERSION) {
+        printf("Error(Record): '%s' is not a recording\n", filename);
+        free(r->buf);
+        return false;
+    }
+    r->width = header[1];
+    r->height = header[2];
+    return true;
+}
+
+/**
+ * Reads the next event, false at the end of the recording or on an error.
+ */
+static bool nextEvent(Replay *r, RecordEvent *ev) {
+    if (r->p == r->end || r->error)
+        return false;
+
+    memset(ev, 0, sizeof(*ev));
+    uint8_t type = getU8(r);
+    bool wide = type & RECORD_WIDE;
+    ev->type = type & ~RECORD_WIDE;
+    r->time_us += getVarint(r);
+    ev->time_us = r->time_us;
+
+    switch (ev->type) {
+    case RECORD_frame:
+        break;
+    case RECORD_key:
+        ev->key = unzigzag(getVarint(r));
+        ev->scancode = unzigzag(getVarint(r));
+        ev->action = getU8(r);
+        ev->mods = getU8(r);
+        break;
+    case RECORD_char:
+        ev->codepoint = getVarint(r);
+        break;
+    case RECORD_cursor:
+    case RECORD_scroll:
+        if (wide) {
+            double v[2];
+            readBytes(r, v, sizeof(v));
+            ev->x = v[0];
+            ev->y = v[1];
+        } else {
+            float v[2];
+            readBytes(r, v, sizeof(v));
+            ev->x = v[0];
+            ev->y = v[1];
+        }
+        break;
+    case RECORD_button:
+        ev->key = getU8(r);
+        ev->action = getU8(r);
+        ev->mods = getU8(r);
+        break;
+    case RECORD_resize:
+        ev->x = getVarint(r);
+        ev->y = getVarint(r);
+        break;
+    case RECORD_drop: {
+        freeDrop(r);
+        uint64_t cnt = getVarint(r);
+        if (cnt > (size_t)(r->end - r->p)) {
+            r->error = true;
+            break;
+        }
+        r->drop_paths = calloc(cnt > 0 ? cnt : 1, sizeof(char*));
+        assert(r->drop_paths != NULL);
+        for (uint64_t i = 0; i < cnt && !r->error; i++) {
+            uint64_t len = getVarint(r);
+            if (len > (size_t)(r->end - r->p)) {
+                r->error = true;
+                break;
+            }
+            char *path = malloc(len + 1);
+            assert(path != NULL);
+            readBytes(r, path, len);
+            path[len] = '\0';
+            r->drop_paths[r->drop_cnt++] = path;
+        }
+        ev->path_cnt = r->drop_cnt;
+        ev->paths = (const char **)r->drop_paths;
+    } break;
+    default:
+        r->error = true;
+        break;
+    }
+
+    if (r->error) {
+        printf("Error(Record): The recording is corrupt\n");
+        return false;
+    }
+    return true;
+}
+
+static double wallTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleepUntil(double t) {
+    double dt = t - wallTime();
+    if (dt <= 0)
+        return;
+    struct timespec ts = { (time_t)dt, (long)((dt - (time_t)dt) * 1e9) };
+    nanosleep(&ts, NULL);
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Renders the view like vn_update: the paths and the path being drawn, 2 px
+ * wide.
+ */
+static void renderFrame(VnCtx *vn, Raster *raster) {
+    Affine view = affine_mult(affine_scale(vn->view_scale),
+            affine_translate(vec2_scalarMult(vn->view_origin, -1)));
+
+    raster_clear(raster, REPLAY_BACKGROUND);
+    raster_strokePaths(raster, vn->paths, vn->path_cnt, view, NULL);
+
+    Tool *tool = vn->tools[vn->active_tool];
+    if (tool->tmp_path && tool->tmp_path->node_cnt >= 2)
+        raster_strokePaths(raster, &tool->tmp_path, 1, view, NULL);
+}
+
+int record_replayMain(int argc, char *argv[]) {
+    const char *session = NULL;
+    const char *frames_file = NULL;
+    const char *out_file = NULL;
+    const char *filter_spec = NULL;
+    const char *notebook_dir = NULL;
+    bool fast = false;
+
+    const char **files = malloc(argc * sizeof(char*));
+    assert(files != NULL);
+    int file_cnt = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0)
+            fast = true;
+        else if (strcmp(argv[i], "--frames") == 0 && i+1 < argc)
+            frames_file = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+            out_file = argv[++i];
+        else if (strcmp(argv[i], "--filter") == 0 && i+1 < argc)
+            filter_spec = argv[++i];
+        else if (strcmp(argv[i], "--notebook") == 0 && i+1 < argc)
+            notebook_dir = argv[++i];
+        else if (!session)
+            session = argv[i];
+        else
+            files[file_cnt++] = argv[i];
+    }
+
+    Replay r;
+    if (!session) {
+        printf("Usage: vectornotes replay SESSION [FILE...] [--fast] [--frames OUT.csv]\n"
+               "                          [-o OUT.ppm] [--filter SPEC] [--notebook DIR]\n");
+        free(files);
+        return 1;
+    }
+    if (!openReplay(&r, session)) {
+        free(files);
+        return 1;
+    }
+
+    VnCtx *vn = vn_initHeadless(r.width, r.height);
+    vn_loadFont(vn, NULL);
+    vn_addTools(vn, filter_spec);
+    if (notebook_dir)
+        vn_openNotebook(vn, notebook_dir, 0);
+    for (int i = 0; i < file_cnt; i++)
+        vn_importFile(vn, files[i]);
+    free(files);
+
+    Raster *raster = raster_init(r.width, r.height);
+    double *frame_times = NULL;
+    unsigned frame_cnt = 0;
+    unsigned frame_capacity = 0;
+    unsigned long event_cnt = 0;
+    uint64_t start_us = r.time_us;
+
+    double start = wallTime();
+    double busy = 0;
+    RecordEvent ev;
+    while (nextEvent(&r, &ev)) {
+        if (!fast)
+            sleepUntil(start + (ev.time_us - start_us) * 1e-6);
+
+        double t = wallTime();
+        vn->event_us = ev.time_us;
+        event_cnt += 1;
+
+        if (ev.type != RECORD_frame) {
+            vn_handleEvent(vn, &ev);
+            busy += wallTime() - t;
+            continue;
+        }
+
+        if (raster->width != vn->view_width || raster->height != vn->view_height) {
+            raster_deinit(raster);
+            raster = raster_init(vn->view_width, vn->view_height);
+        }
+        if (!vn->page_grid) {
+            vn_step(vn);
+            renderFrame(vn, raster);
+        }
+
+        // Input handled since the previous frame counts towards this one
+        busy += wallTime() - t;
+        if (frame_cnt >= frame_capacity) {
+            frame_capacity = frame_capacity ? frame_capacity*2 : 1024;
+            frame_times = realloc(frame_times, frame_capacity * sizeof(double));
+            assert(frame_times != NULL);
+        }
+        frame_times[frame_cnt++] = busy;
+        busy = 0;
+    }
+    double total = wallTime() - start;
+    bool ok = !r.error;
+
+    if (frames_file) {
+        FILE *fp = fopen(frames_file, "w");
+        if (fp) {
+            fprintf(fp, "frame,ms\n");
+            for (unsigned i = 0; i < frame_cnt; i++)
+                fprintf(fp, "%u,%.4f\n", i, frame_times[i] * 1e3);
+            fclose(fp);
+        } else {
+            printf("Error(Record): Could not open '%s' for writing\n", frames_file);
+        }
+    }
+    if (out_file)
+        raster_writePpm(raster, out_file);
+
+    printf("Replayed %lu events, %u frames in %f s (recorded %f s)\n",
+            event_cnt, frame_cnt, total, (r.time_us - start_us) * 1e-6);
+    if (frame_cnt > 0) {
+        double sum = 0;
+        for (unsigned i = 0; i < frame_cnt; i++)
+            sum += frame_times[i];
+        qsort(frame_times, frame_cnt, sizeof(double), compareDoubles);
+        printf("Frame ms: mean %.3f, median %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+                sum / frame_cnt * 1e3,
+                frame_times[frame_cnt / 2] * 1e3,
+                frame_times[(unsigned)(frame_cnt * 0.95)] * 1e3,
+                frame_times[(unsigned)(frame_cnt * 0.99)] * 1e3,
+                frame_times[frame_cnt - 1] * 1e3);
+    }
+    // Equal for every replay of the same recording on the same files
+    printf("Canvas: %u paths, hash %016llx\n", vn->path_cnt,
+            (unsigned long long)thumb_hashPaths(THUMB_HASH_SEED, vn->paths, vn->path_cnt));
+    mem_printStats();
+
+    freeDrop(&r);
+    free(r.buf);
+    free(frame_times);
+    raster_deinit(raster);
+    select_deinit(vn->tools[TOOLS_select]);
+    text_deinit(vn->tools[TOOLS_text]);
+    vn_deinit(vn);
+    jobs_deinit();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "path.h"
+#include "stroke.h"
+#include "vec.h"
+
+// Max bytes per sample: a 10 byte varint per axis, or the escape byte and two
+// raw doubles
+#define STROKE_MAX_SAMPLE_SIZE 20
+#define STROKE_ESCAPE 1
+
+// Grid steps beyond this are not exact in double anymore
+#define STROKE_MAX_STEP 4.0e15
+
+/**
+ * Maps a grid position back to the canvas, the same way screenToCanvas does.
+ */
+static double gridToCanvas(int64_t q, double origin, double scale) {
+    return (double)q * (1/scale) + origin;
+}
+
+static bool canvasToGrid(double v, double origin, double scale, int64_t *q) {
+    double g = nearbyint((v - origin) * scale);
+    if (!(fabs(g) <= STROKE_MAX_STEP))
+        return false;
+
+    *q = (int64_t)g;
+    return gridToCanvas(*q, origin, scale) == v;
+}
+
+static uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t *putVarint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *getVarint(const uint8_t *p, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+    return p;
+}
+
+/**
+ * getVarint that stops at `end`, NULL if the varint runs past it.
+ */
+static const uint8_t *getVarintBounded(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end)
+            return NULL;
+        uint8_t b = *p++;
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            break;
+    }
+    return p;
+}
+
+/**
+ * Checks that `data` holds exactly `sample_cnt` samples, so stroke_decode
+ * stays within it. For strokes read from a file.
+ */
+bool stroke_check(const Stroke *stroke) {
+    // Every sample takes at least two bytes
+    if (stroke->sample_cnt > stroke->size / 2)
+        return false;
+
+    const uint8_t *p = stroke->data;
+    const uint8_t *end = p + stroke->size;
+    for (unsigned i = 0; i < stroke->sample_cnt; i++) {
+        // Same steps as stroke_decode
+        uint64_t v;
+        p = getVarintBounded(p, end, &v);
+        if (!p)
+            return false;
+
+        if (v == STROKE_ESCAPE) {
+            if ((size_t)(end - p) < sizeof(Vec2))
+                return false;
+            p += sizeof(Vec2);
+        } else {
+            p = getVarintBounded(p, end, &v);
+            if (!p)
+                return false;
+        }
+    }
+    return p == end;
+}
+
+/**
+ * Compresses `count` canvas samples captured with the given view. The samples
+ * are copied, the returned stroke owns its data.
+ */
+Stroke *stroke_encode(const Vec2 *samples, unsigned count, Vec2 view_origin, double view_scale) {
+    Stroke *stroke = calloc(1, sizeof(Stroke));
+    assert(stroke != NULL);
+
+    stroke->sample_cnt = count;
+    stroke->view_origin = view_origin;
+    stroke->view_scale = view_scale;
+
+    // Worst case first, shrunk to the actual size at the end
+    uint8_t *data = malloc((size_t)count * STROKE_MAX_SAMPLE_SIZE + 1);
+    assert(data != NULL);
+
+    uint8_t *p = data;
+    int64_t prev_x = 0, prev_y = 0;
+    for (unsigned i = 0; i < count; i++) {
+        Vec2 s = samples[i];
+        int64_t qx, qy;
+
+        if (canvasToGrid(s.x, view_origin.x, view_scale, &qx)
+                && canvasToGrid(s.y, view_origin.y, view_scale, &qy)) {
+            // The low bit of the first varint flags an escaped sample
+            p = putVarint(p, zigzag(qx - prev_x) << 1);
+            p = putVarint(p, zigzag(qy - prev_y));
+            prev_x = qx;
+            prev_y = qy;
+        } else {
+            *p++ = STROKE_ESCAPE;
+            memcpy(p, &s, sizeof(Vec2));
+            p += sizeof(Vec2);
+        }
+    }
+
+    stroke->size = p - data;
+    stroke->data = realloc(data, stroke->size > 0 ? stroke->size : 1);
+    assert(stroke->data != NULL);
+
+    return stroke;
+}
+
+void stroke_deinit(Stroke *stroke) {
+    if (stroke) {
+        free(stroke->data);
+        free(stroke);
+    }
+}
+
+/**
+ * Decodes the samples into a new line path in canvas coordinates. Strokes are
+ * only decoded when needed, e.g. to refit them.
+ */
+Path *stroke_decode(const Stroke *stroke) {
+    Path *path = path_init(stroke->sample_cnt);
+
+    const uint8_t *p = stroke->data;
+    int64_t qx = 0, qy = 0;
+    for (unsigned i = 0; i < stroke->sample_cnt; i++) {
+        uint64_t v;
+        p = getVarint(p, &v);
+
+        Vec2 s;
+        if (v == STROKE_ESCAPE) {
+            memcpy(&s, p, sizeof(Vec2));
+            p += sizeof(Vec2);
+        } else {
+            qx += unzigzag(v >> 1);
+            p = getVarint(p, &v);
+            qy += unzigzag(v);
+
+            s.x = gridToCanvas(qx, stroke->view_origin.x, stroke->view_scale);
+            s.y = gridToCanvas(qy, stroke->view_origin.y, stroke->view_scale);
+        }
+        path_addNode(path, s);
+    }
+    assert((size_t)(p - stroke->data) == stroke->size);
+
+    return path;
+}
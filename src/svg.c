@@ -0,0 +1,149 @@
+// SVG export. The document is streamed through a fixed size Writer buffer, one
+// <path> element per Path, so memory use is independent of the document size.
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "affine.h"
+#include "path.h"
+#include "svg.h"
+#include "vec.h"
+#include "writer.h"
+
+SvgOptions svg_defaultOptions(void) {
+    SvgOptions opts = {
+        .precision = SVG_DEFAULT_PRECISION,
+        .stroke_width = 2.0,
+        .stroke_color = "#e6140f",
+    };
+    return opts;
+}
+
+static void putPoint(Writer *w, Vec2 p, unsigned precision) {
+    writer_putDouble(w, p.x, precision);
+    writer_putc(w, ' ');
+    writer_putDouble(w, p.y, precision);
+}
+
+/**
+ * Writes the 'd' attribute data, offset by `t`. Bezier paths are stored as
+ * node triples (ctrl, ctrl, end) after the first node, which maps directly onto
+ * a single 'C' command with implicit repeats.
+ */
+static void putPathData(Writer *w, Path *path, Vec2 t, unsigned precision) {
+    writer_putc(w, 'M');
+    putPoint(w, vec2_add(path->nodes[0], t), precision);
+
+    if (path->type == PATHTYPE_bezier) {
+        writer_putc(w, 'C');
+        for (unsigned i = 1; i + 2 < path->node_cnt; i += 3) {
+            if (i > 1) writer_putc(w, ' ');
+            putPoint(w, vec2_add(path->nodes[i], t), precision);
+            writer_putc(w, ' ');
+            putPoint(w, vec2_add(path->nodes[i+1], t), precision);
+            writer_putc(w, ' ');
+            putPoint(w, vec2_add(path->nodes[i+2], t), precision);
+        }
+    } else {
+        writer_putc(w, 'L');
+        for (unsigned i = 1; i < path->node_cnt; i++) {
+            if (i > 1) writer_putc(w, ' ');
+            putPoint(w, vec2_add(path->nodes[i], t), precision);
+        }
+    }
+}
+
+static void putTransform(Writer *w, Affine m, unsigned precision) {
+    // Keep some more precision for the linear part, it multiplies all nodes
+    const unsigned mp = precision + 3;
+
+    writer_puts(w, " transform=\"matrix(");
+    writer_putDouble(w, m.a, mp); writer_putc(w, ' ');
+    writer_putDouble(w, m.b, mp); writer_putc(w, ' ');
+    writer_putDouble(w, m.c, mp); writer_putc(w, ' ');
+    writer_putDouble(w, m.d, mp); writer_putc(w, ' ');
+    writer_putDouble(w, m.e, precision); writer_putc(w, ' ');
+    writer_putDouble(w, m.f, precision);
+    writer_puts(w, ")\" vector-effect=\"non-scaling-stroke\"");
+}
+
+/**
+ * Exports all paths to an SVG file. The viewBox is fit to the bounds of the
+ * paths. Returns false if the file could not be written.
+ */
+bool svg_export(const char *filename, Path **paths, unsigned path_cnt, const SvgOptions *opts) {
+    SvgOptions defaults = svg_defaultOptions();
+    if (!opts)
+        opts = &defaults;
+
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        printf("Error(SVG): Could not open '%s' for writing\n", filename);
+        return false;
+    }
+
+    Vec2 min = { DBL_MAX, DBL_MAX };
+    Vec2 max = { -DBL_MAX, -DBL_MAX };
+    for (unsigned i = 0; i < path_cnt; i++) {
+        if (paths[i]->node_cnt == 0) continue;
+
+        Vec2 pmin, pmax;
+        path_getBounds(paths[i], &pmin, &pmax);
+        min.x = fmin(min.x, pmin.x);
+        min.y = fmin(min.y, pmin.y);
+        max.x = fmax(max.x, pmax.x);
+        max.y = fmax(max.y, pmax.y);
+    }
+    if (min.x > max.x) {
+        min = (Vec2){ 0, 0 };
+        max = (Vec2){ 0, 0 };
+    }
+
+    double margin = opts->stroke_width;
+    min = vec2_sub(min, (Vec2){ margin, margin });
+    max = vec2_add(max, (Vec2){ margin, margin });
+
+    Writer w;
+    writer_init(&w, fp, NULL, 0);
+
+    writer_puts(&w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    writer_puts(&w, "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"");
+    putPoint(&w, min, opts->precision);
+    writer_putc(&w, ' ');
+    putPoint(&w, vec2_sub(max, min), opts->precision);
+    writer_puts(&w, "\">\n<g fill=\"none\" stroke=\"");
+    writer_puts(&w, opts->stroke_color);
+    writer_puts(&w, "\" stroke-width=\"");
+    writer_putDouble(&w, opts->stroke_width, opts->precision + 3);
+    writer_puts(&w, "\" stroke-linecap=\"round\" stroke-linejoin=\"miter\">\n");
+
+    for (unsigned i = 0; i < path_cnt; i++) {
+        Path *path = paths[i];
+        if (path->node_cnt == 0) continue;
+
+        // Paths store their nodes relative to their origin, a pure
+        // translation is folded back into the coordinates.
+        Vec2 t = {0, 0};
+        writer_puts(&w, "<path");
+        if (affine_isTranslation(path->transform))
+            t = (Vec2){ path->transform.e, path->transform.f };
+        else
+            putTransform(&w, path->transform, opts->precision);
+        writer_puts(&w, " d=\"");
+        putPathData(&w, path, t, opts->precision);
+        writer_puts(&w, "\"/>\n");
+    }
+
+    writer_puts(&w, "</g>\n</svg>\n");
+
+    bool ok = writer_deinit(&w);
+    if (fclose(fp) != 0)
+        ok = false;
+
+    if (!ok)
+        printf("Error(SVG): Failed writing '%s'\n", filename);
+
+    return ok;
+}
@@ -0,0 +1,354 @@
+// Page thumbnails. The cache file holds the thumbnails of all pages:
+//
+//   "VNTC" u32 version, u32 width, u32 height, u32 levels, u32 count
+//   per thumbnail: u32 page, u64 page file size, u64 content hash,
+//                  RGBA pixels of all levels
+//
+// The content hash is FNV-1a over the type, transform and nodes of the paths
+// in canvas order, so adding paths continues the hash of the page.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affine.h"
+#include "notebook.h"
+#include "path.h"
+#include "raster.h"
+#include "thumb.h"
+#include "vec.h"
+#include "writer.h"
+
+#define THUMB_MAGIC "VNTC"
+#define THUMB_VERSION 1
+#define THUMB_FILENAME "thumbs.vnc"
+#define THUMB_FNV_PRIME 0x100000001b3ull
+
+static const uint8_t THUMB_BACKGROUND[4] = { 255, 255, 255, 255 };
+
+static size_t levelOffset(unsigned level) {
+    size_t offset = 0;
+    for (unsigned l = 0; l < level; l++)
+        offset += (size_t)(THUMB_WIDTH >> l) * (THUMB_HEIGHT >> l) * 4;
+    return offset;
+}
+
+static size_t thumbBytes(void) {
+    return levelOffset(THUMB_LEVELS);
+}
+
+uint8_t *thumb_level(const Thumb *thumb, unsigned level) {
+    assert(thumb->pixels != NULL && level < THUMB_LEVELS);
+    return thumb->pixels + levelOffset(level);
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t len) {
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= THUMB_FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t thumb_hashPaths(uint64_t hash, Path **paths, unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        const Path *path = paths[i];
+        uint32_t header[2] = { path->type, path->node_cnt };
+        hash = hashBytes(hash, header, sizeof(header));
+        hash = hashBytes(hash, &path->transform, sizeof(Affine));
+        hash = hashBytes(hash, path->nodes, path->node_cnt * sizeof(Vec2));
+    }
+    return hash;
+}
+
+/**
+ * Returns the thumbnail of `page`, the cache grows with the notebook.
+ */
+Thumb *thumb_get(ThumbCache *cache, unsigned page) {
+    if (page >= cache->thumb_capacity) {
+        unsigned capacity = cache->thumb_capacity ? cache->thumb_capacity : 64;
+        while (page >= capacity)
+            capacity *= 2;
+        cache->thumbs = realloc(cache->thumbs, capacity * sizeof(Thumb));
+        assert(cache->thumbs != NULL);
+        memset(&cache->thumbs[cache->thumb_capacity], 0,
+                (capacity - cache->thumb_capacity) * sizeof(Thumb));
+        cache->thumb_capacity = capacity;
+    }
+    if (page >= cache->thumb_cnt)
+        cache->thumb_cnt = page + 1;
+    return &cache->thumbs[page];
+}
+
+static bool readU32(FILE *fp, uint32_t *v) {
+    return fread(v, sizeof(*v), 1, fp) == 1;
+}
+
+static bool readU64(FILE *fp, uint64_t *v) {
+    return fread(v, sizeof(*v), 1, fp) == 1;
+}
+
+/**
+ * Reads the cached thumbnails of the pages of `nb`. Thumbnails whose page file
+ * changed size are dropped, a missing or outdated cache file gives an empty
+ * cache.
+ */
+ThumbCache *thumb_open(const Notebook *nb) {
+    ThumbCache *cache = calloc(1, sizeof(ThumbCache));
+    assert(cache != NULL);
+    size_t len = strlen(nb->dir) + sizeof(THUMB_FILENAME) + 1;
+    cache->filename = malloc(len);
+    assert(cache->filename != NULL);
+    snprintf(cache->filename, len, "%s/%s", nb->dir, THUMB_FILENAME);
+
+    FILE *fp = fopen(cache->filename, "rb");
+    if (!fp)
+        return cache;
+
+    char magic[4];
+    uint32_t version, width, height, levels, count;
+    if (fread(magic, 4, 1, fp) != 1 || memcmp(magic, THUMB_MAGIC, 4) != 0
+            || !readU32(fp, &version) || version != THUMB_VERSION
+            || !readU32(fp, &width) || width != THUMB_WIDTH
+            || !readU32(fp, &height) || height != THUMB_HEIGHT
+            || !readU32(fp, &levels) || levels != THUMB_LEVELS
+            || !readU32(fp, &count)) {
+        fclose(fp);
+        return cache;
+    }
+
+    size_t bytes = thumbBytes();
+    uint8_t *pixels = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t page;
+        uint64_t file_size, hash;
+        if (!pixels) {
+            pixels = malloc(bytes);
+            assert(pixels != NULL);
+        }
+        if (!readU32(fp, &page) || !readU64(fp, &file_size) || !readU64(fp, &hash)
+                || fread(pixels, bytes, 1, fp) != 1) {
+            printf("Error(Thumb): '%s' is truncated\n", cache->filename);
+            break;
+        }
+        if (page >= nb->page_cnt || nb->pages[page].file_size != file_size)
+            continue;
+
+        Thumb *thumb = thumb_get(cache, page);
+        free(thumb->pixels);
+        thumb->pixels = pixels;
+        thumb->hash = hash;
+        thumb->file_size = file_size;
+        thumb->stale = THUMB_ALL_TILES;
+        pixels = NULL;
+        cache->loaded += 1;
+    }
+    free(pixels);
+    fclose(fp);
+    return cache;
+}
+
+/**
+ * Writes the complete thumbnails to the cache file. The pages must be saved
+ * before, the file sizes are taken from `nb`.
+ */
+bool thumb_save(const ThumbCache *cache, const Notebook *nb) {
+    size_t len = strlen(cache->filename) + 5;
+    char *tmp = malloc(len);
+    assert(tmp != NULL);
+    snprintf(tmp, len, "%s.tmp", cache->filename);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        printf("Error(Thumb): Could not open '%s' for writing\n", tmp);
+        free(tmp);
+        return false;
+    }
+
+    uint32_t count = 0;
+    for (unsigned i = 0; i < cache->thumb_cnt && i < nb->page_cnt; i++) {
+        const Thumb *thumb = &cache->thumbs[i];
+        count += thumb->pixels && !thumb->dirty;
+    }
+
+    Writer w;
+    writer_init(&w, fp, NULL, 0);
+    uint32_t header[5] = { THUMB_VERSION, THUMB_WIDTH, THUMB_HEIGHT, THUMB_LEVELS, count };
+    writer_write(&w, THUMB_MAGIC, 4);
+    writer_write(&w, header, sizeof(header));
+
+    size_t bytes = thumbBytes();
+    for (unsigned i = 0; i < cache->thumb_cnt && i < nb->page_cnt; i++) {
+        const Thumb *thumb = &cache->thumbs[i];
+        if (!thumb->pixels || thumb->dirty)
+            continue;
+
+        // Verified thumbnails show the page as it was just saved
+        uint32_t page = i;
+        uint64_t file_size = thumb->verified ? nb->pages[i].file_size : thumb->file_size;
+        writer_write(&w, &page, sizeof(page));
+        writer_write(&w, &file_size, sizeof(file_size));
+        writer_write(&w, &thumb->hash, sizeof(thumb->hash));
+        writer_write(&w, thumb->pixels, bytes);
+    }
+
+    bool ok = writer_deinit(&w);
+    if (fclose(fp) != 0)
+        ok = false;
+    if (ok && rename(tmp, cache->filename) != 0)
+        ok = false;
+    if (!ok) {
+        printf("Error(Thumb): Failed writing '%s'\n", cache->filename);
+        remove(tmp);
+    }
+
+    free(tmp);
+    return ok;
+}
+
+/**
+ * Frees the cache, the textures of the thumbnails must be deleted before.
+ */
+void thumb_close(ThumbCache *cache) {
+    for (unsigned i = 0; i < cache->thumb_cnt; i++)
+        free(cache->thumbs[i].pixels);
+    free(cache->thumbs);
+    free(cache->filename);
+    free(cache);
+}
+
+/**
+ * Compares the thumbnail with the paths of its page. If they differ, or there
+ * is no thumbnail yet, all tiles are rendered again by the next thumb_render.
+ */
+void thumb_check(ThumbCache *cache, unsigned page, Path **paths, unsigned count) {
+    Thumb *thumb = thumb_get(cache, page);
+    uint64_t hash = thumb_hashPaths(THUMB_HASH_SEED, paths, count);
+
+    if (!thumb->pixels) {
+        thumb->pixels = malloc(thumbBytes());
+        assert(thumb->pixels != NULL);
+        thumb->dirty = THUMB_ALL_TILES;
+    } else if (hash != thumb->hash) {
+        thumb->dirty = THUMB_ALL_TILES;
+    }
+    thumb->hash = hash;
+    thumb->verified = true;
+}
+
+/**
+ * Marks the tiles under paths appended to the page. Only continues a verified
+ * thumbnail, others are compared in full by thumb_check anyway.
+ */
+void thumb_addPaths(ThumbCache *cache, unsigned page, Path **paths, unsigned count) {
+    Thumb *thumb = thumb_get(cache, page);
+    if (!thumb->verified)
+        return;
+
+    thumb->hash = thumb_hashPaths(thumb->hash, paths, count);
+
+    double s = THUMB_WIDTH / THUMB_PAGE_WIDTH;
+    double margin = THUMB_STROKE_WIDTH;
+    for (unsigned i = 0; i < count; i++) {
+        Vec2 min, max;
+        path_getBounds(paths[i], &min, &max);
+
+        double x0 = min.x * s - margin;
+        double y0 = min.y * s - margin;
+        double x1 = max.x * s + margin;
+        double y1 = max.y * s + margin;
+        if (x1 < 0 || y1 < 0 || x0 >= THUMB_WIDTH || y0 >= THUMB_HEIGHT)
+            continue;
+
+        int tx0 = x0 > 0 ? (int)(x0 / THUMB_TILE_SIZE) : 0;
+        int ty0 = y0 > 0 ? (int)(y0 / THUMB_TILE_SIZE) : 0;
+        int tx1 = x1 < THUMB_WIDTH ? (int)(x1 / THUMB_TILE_SIZE) : THUMB_TILES_X - 1;
+        int ty1 = y1 < THUMB_HEIGHT ? (int)(y1 / THUMB_TILE_SIZE) : THUMB_TILES_Y - 1;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++)
+                thumb->dirty |= 1u << (ty * THUMB_TILES_X + tx);
+        }
+    }
+}
+
+/**
+ * Rebuilds the area of level 0 tile `tx`, `ty` in the smaller levels, 2x2 box
+ * filter.
+ */
+static void downsampleTile(Thumb *thumb, unsigned tx, unsigned ty) {
+    for (unsigned l = 1; l < THUMB_LEVELS; l++) {
+        const uint8_t *src = thumb_level(thumb, l - 1);
+        uint8_t *dst = thumb_level(thumb, l);
+        unsigned src_w = THUMB_WIDTH >> (l - 1);
+        unsigned dst_w = THUMB_WIDTH >> l;
+        unsigned size = THUMB_TILE_SIZE >> l;
+
+        for (unsigned y = ty * size; y < (ty + 1) * size; y++) {
+            const uint8_t *r0 = src + (size_t)(2*y) * src_w * 4;
+            const uint8_t *r1 = r0 + (size_t)src_w * 4;
+            uint8_t *out = dst + (size_t)y * dst_w * 4;
+            for (unsigned x = tx * size; x < (tx + 1) * size; x++) {
+                for (int c = 0; c < 4; c++) {
+                    out[4*x + c] = (r0[8*x + c] + r0[8*x + 4 + c]
+                            + r1[8*x + c] + r1[8*x + 4 + c] + 2) / 4;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Renders the dirty tiles of the thumbnail from the paths of its page, a
+ * thumbnail with all tiles dirty in one go. Returns false if there was
+ * nothing to render.
+ */
+bool thumb_render(ThumbCache *cache, unsigned page, Path **paths, unsigned count) {
+    Thumb *thumb = thumb_get(cache, page);
+    if (!thumb->pixels || !thumb->dirty)
+        return false;
+
+    RasterStyle style = raster_defaultStyle();
+    style.stroke_width = THUMB_STROKE_WIDTH;
+    Affine frame = affine_scale(THUMB_WIDTH / THUMB_PAGE_WIDTH);
+    uint8_t *level0 = thumb_level(thumb, 0);
+
+    if (thumb->dirty == THUMB_ALL_TILES) {
+        Raster raster = { level0, THUMB_WIDTH, THUMB_HEIGHT };
+        raster_clear(&raster, THUMB_BACKGROUND);
+        raster_strokePaths(&raster, paths, count, frame, &style);
+    } else {
+        Raster *tile = raster_init(THUMB_TILE_SIZE, THUMB_TILE_SIZE);
+        for (unsigned t = 0; t < THUMB_TILES_X * THUMB_TILES_Y; t++) {
+            if (!(thumb->dirty & (1u << t)))
+                continue;
+
+            unsigned x0 = (t % THUMB_TILES_X) * THUMB_TILE_SIZE;
+            unsigned y0 = (t / THUMB_TILES_X) * THUMB_TILE_SIZE;
+            Affine view = affine_mult(affine_translate((Vec2){ -(double)x0, -(double)y0 }), frame);
+            raster_clear(tile, THUMB_BACKGROUND);
+            raster_strokePaths(tile, paths, count, view, &style);
+
+            for (unsigned y = 0; y < THUMB_TILE_SIZE; y++) {
+                memcpy(level0 + ((size_t)(y0 + y) * THUMB_WIDTH + x0) * 4,
+                        tile->pixels + (size_t)y * THUMB_TILE_SIZE * 4, THUMB_TILE_SIZE * 4);
+            }
+        }
+        raster_deinit(tile);
+    }
+
+    for (unsigned t = 0; t < THUMB_TILES_X * THUMB_TILES_Y; t++) {
+        if (!(thumb->dirty & (1u << t)))
+            continue;
+        downsampleTile(thumb, t % THUMB_TILES_X, t / THUMB_TILES_X);
+        cache->tiles_rendered += 1;
+    }
+
+    thumb->stale |= thumb->dirty;
+    thumb->dirty = 0;
+    return true;
+}
@@ -0,0 +1,491 @@
+// Lasso selection tool. Paths inside the lasso can be moved by dragging the
+// selection, or scaled by dragging the handle in the bottom-right corner.
+//
+// Moving and scaling only changes `Path.transform`, the nodes themselves are
+// never touched. Mouse events only update the total drag transform, which is
+// applied to the selected paths once per frame in `update()`.
+//
+// Without a drag the path under the cursor is highlighted, and a click that
+// does not draw a lasso selects it. Both use a segment index of the canvas
+// (pick.h) that is updated lazily when the cursor moves.
+//
+// Ctrl+C copies the selection, Ctrl+V pastes it at the cursor. Copies are
+// instances (vn_instancePath) that share the nodes of the copied paths, so
+// repeated stamps only cost a Path each until one of them is edited.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "affine.h"
+#include "path.h"
+#include "pick.h"
+#include "tool.h"
+#include "vec.h"
+#include "vectornotes.h"
+
+#define SELECT_HANDLE_SIZE 8.0      // Size of the scale handle in pixels
+#define SELECT_LASSO_MIN_DIST 3.0   // Min distance between lasso points in pixels
+#define SELECT_LASSO_MAX_STEPS 64   // Max samples per segment tested against the lasso
+#define SELECT_MIN_SCALE 0.01       // Prevents flipping/collapsing the selection
+#define SELECT_PICK_RADIUS 8.0      // Max distance for hover and click in pixels
+
+typedef enum select_mode {
+    SELECT_MODE_idle,
+    SELECT_MODE_lasso,
+    SELECT_MODE_move,
+    SELECT_MODE_scale,
+} SelectMode;
+
+typedef struct select_tool {
+    Tool tool;      // Must be the first member, the callbacks cast Tool * back
+
+    VnCtx *vn;
+    SelectMode mode;
+
+    Path **selected;
+    unsigned selected_cnt;
+    unsigned selected_capacity;
+
+    // Bounds of the selection in canvas coordinates
+    Vec2 sel_min;
+    Vec2 sel_max;
+
+    // Drag state, all in canvas coordinates
+    Vec2 drag_start;
+    Vec2 scale_anchor;
+    Affine drag;            // Total transform since the start of the drag
+    Affine drag_applied;    // Part of `drag` already applied to the paths
+
+    // Path under the cursor, only valid while it is still at index
+    // `hover_hit.path` of the canvas paths
+    PickIndex *pick;
+    Path *hover;
+    PickHit hover_hit;
+
+    // Instances of the copied paths, they keep the nodes alive when the
+    // originals are changed or their page is evicted
+    Path **clipboard;
+    unsigned clipboard_cnt;
+    unsigned clipboard_capacity;
+    Vec2 clipboard_min;     // Top left of the copied paths in canvas coordinates
+} SelectTool;
+
+// TODO: Get rid of global..?
+SelectTool g_select = {0};
+
+/**
+ * Even-odd rule point in polygon test. The polygon is implicitly closed.
+ */
+static bool pointInPolygon(Vec2 p, Vec2 *poly, unsigned cnt) {
+    bool inside = false;
+    for (unsigned i = 0, j = cnt-1; i < cnt; j = i++) {
+        Vec2 a = poly[i];
+        Vec2 b = poly[j];
+        if ((a.y > p.y) != (b.y > p.y)
+                && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+static bool boxesOverlap(Vec2 min0, Vec2 max0, Vec2 min1, Vec2 max1) {
+    return min0.x <= max1.x && max0.x >= min1.x
+        && min0.y <= max1.y && max0.y >= min1.y;
+}
+
+static void addSelected(SelectTool *sel, Path *path) {
+    if (sel->selected_cnt >= sel->selected_capacity) {
+        sel->selected_capacity = sel->selected_capacity ? sel->selected_capacity*2 : 64;
+        sel->selected = realloc(sel->selected, sel->selected_capacity * sizeof(Path*));
+        assert(sel->selected != NULL);
+    }
+    sel->selected[sel->selected_cnt++] = path;
+
+    Vec2 min, max;
+    path_getBounds(path, &min, &max);
+    sel->sel_min.x = fmin(sel->sel_min.x, min.x);
+    sel->sel_min.y = fmin(sel->sel_min.y, min.y);
+    sel->sel_max.x = fmax(sel->sel_max.x, max.x);
+    sel->sel_max.y = fmax(sel->sel_max.y, max.y);
+}
+
+void select_clear(Tool *tool) {
+    SelectTool *sel = (SelectTool *)tool;
+    sel->selected_cnt = 0;
+    sel->sel_min = (Vec2){ DBL_MAX, DBL_MAX };
+    sel->sel_max = (Vec2){ -DBL_MAX, -DBL_MAX };
+    sel->hover = NULL;
+}
+
+/**
+ * Finds the path nearest to `mouse_pos` within SELECT_PICK_RADIUS pixels.
+ */
+static Path *pickPath(SelectTool *sel, Vec2 mouse_pos, PickHit *hit) {
+    VnCtx *vn = sel->vn;
+
+    Vec2 p = screenToCanvas(mouse_pos);
+    Vec2 edge = screenToCanvas(vec2_add(mouse_pos, (Vec2){ SELECT_PICK_RADIUS, 0 }));
+    double radius = vec2_dist(p, edge);
+
+    pick_update(sel->pick, vn->paths, vn->path_cnt);
+    if (!pick_nearest(sel->pick, vn->paths, p, radius, hit))
+        return NULL;
+    return vn->paths[hit->path];
+}
+
+static Path *hoveredPath(SelectTool *sel) {
+    VnCtx *vn = sel->vn;
+    if (!sel->hover || sel->hover_hit.path >= vn->path_cnt
+            || vn->paths[sel->hover_hit.path] != sel->hover)
+        return NULL;
+    return sel->hover;
+}
+
+/**
+ * Whether the curve of the path lies inside the lasso. Bezier segments are
+ * sampled every SELECT_LASSO_MIN_DIST screen pixels along their control
+ * polygon, so parts that bulge out between the nodes are caught too.
+ */
+static bool pathInLasso(SelectTool *sel, Path *path, Path *lasso) {
+    unsigned cnt = path_segmentCount(path);
+    if (cnt == 0)
+        return pointInPolygon(affine_apply(path->transform, path->nodes[0]),
+                lasso->nodes, lasso->node_cnt);
+
+    double scale = affine_scaleFactor(vn_pathToScreen(sel->vn, path));
+    for (unsigned s = 0; s < cnt; s++) {
+        unsigned steps = 1;
+        if (path->type == PATHTYPE_bezier && path->node_cnt >= 4) {
+            Vec2 *c = &path->nodes[3*s];
+            double len = (vec2_dist(c[0], c[1]) + vec2_dist(c[1], c[2])
+                    + vec2_dist(c[2], c[3])) * scale;
+            steps = (unsigned)fmin(ceil(len / SELECT_LASSO_MIN_DIST), SELECT_LASSO_MAX_STEPS);
+            steps = steps > 0 ? steps : 1;
+        }
+
+        // The end of a segment is the start of the next, tested there
+        bool last = s + 1 == cnt;
+        for (unsigned k = 0; k < steps + last; k++) {
+            Vec2 p = affine_apply(path->transform, path_pointAt(path, s + (double)k / steps));
+            if (!pointInPolygon(p, lasso->nodes, lasso->node_cnt))
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * A path is selected when its curve lies inside the lasso. Paths whose bounds
+ * do not overlap the lasso bounds are rejected up front.
+ */
+static void selectInLasso(SelectTool *sel) {
+    Path *lasso = sel->tool.tmp_path;
+    VnCtx *vn = sel->vn;
+
+    select_clear(&sel->tool);
+    if (lasso->node_cnt < 3)
+        return;
+
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+
+        Vec2 min, max;
+        path_getBounds(path, &min, &max);
+        if (!boxesOverlap(min, max, lasso->bbox_min, lasso->bbox_max))
+            continue;
+
+        if (path->node_cnt > 0 && pathInLasso(sel, path, lasso))
+            addSelected(sel, path);
+    }
+
+    printf("Selected %u paths\n", sel->selected_cnt);
+}
+
+static bool onHandle(SelectTool *sel, Vec2 mouse_pos) {
+    Vec2 h = canvasToScreen(sel->sel_max);
+    return fabs(mouse_pos.x - h.x) <= SELECT_HANDLE_SIZE
+        && fabs(mouse_pos.y - h.y) <= SELECT_HANDLE_SIZE;
+}
+
+static bool onSelection(SelectTool *sel, Vec2 mouse_pos) {
+    Vec2 p = screenToCanvas(mouse_pos);
+    return p.x >= sel->sel_min.x && p.x <= sel->sel_max.x
+        && p.y >= sel->sel_min.y && p.y <= sel->sel_max.y;
+}
+
+static void mousePosCb(Tool *tool, Vec2 *mouse_pos, int mouse_states[]) {
+    SelectTool *sel = (SelectTool *)tool;
+
+    if (mouse_states[GLFW_MOUSE_BUTTON_LEFT] != GLFW_PRESS) {
+        sel->hover = pickPath(sel, *mouse_pos, &sel->hover_hit);
+        return;
+    }
+
+    Vec2 p = screenToCanvas(*mouse_pos);
+
+    switch (sel->mode) {
+    case SELECT_MODE_lasso: {
+        Vec2 *prev = path_getNode(tool->tmp_path, -1);
+        if (vec2_dist(canvasToScreen(*prev), *mouse_pos) > SELECT_LASSO_MIN_DIST)
+            path_addNode(tool->tmp_path, p);
+    } break;
+
+    case SELECT_MODE_move:
+        sel->drag = affine_translate(vec2_sub(p, sel->drag_start));
+        break;
+
+    case SELECT_MODE_scale: {
+        // Project the cursor on the anchor-handle diagonal for uniform scaling
+        Vec2 r0 = vec2_sub(sel->drag_start, sel->scale_anchor);
+        Vec2 r1 = vec2_sub(p, sel->scale_anchor);
+        double len_sqr = vec2_dot(r0, r0);
+        double s = len_sqr > 0 ? vec2_dot(r0, r1) / len_sqr : 1.0;
+        sel->drag = affine_scaleAround(sel->scale_anchor, fmax(s, SELECT_MIN_SCALE));
+    } break;
+
+    default: break;
+    }
+}
+
+static void mouseBtnCb(Tool *tool, Vec2 *mouse_pos, int button, int action) {
+    SelectTool *sel = (SelectTool *)tool;
+
+    if (button != GLFW_MOUSE_BUTTON_LEFT)
+        return;
+
+    if (action == GLFW_PRESS) {
+        Vec2 p = screenToCanvas(*mouse_pos);
+
+        sel->drag = affine_identity();
+        sel->drag_applied = affine_identity();
+        sel->drag_start = p;
+        sel->hover = NULL;
+
+        if (sel->selected_cnt > 0 && onHandle(sel, *mouse_pos)) {
+            sel->mode = SELECT_MODE_scale;
+            sel->scale_anchor = sel->sel_min;
+        } else if (sel->selected_cnt > 0 && onSelection(sel, *mouse_pos)) {
+            sel->mode = SELECT_MODE_move;
+        } else {
+            sel->mode = SELECT_MODE_lasso;
+            select_clear(tool);
+            path_clear(tool->tmp_path);
+            path_addNode(tool->tmp_path, p);
+        }
+    } else {
+        if (sel->mode == SELECT_MODE_lasso && tool->tmp_path->node_cnt < 3) {
+            // A click, selects the path under the cursor
+            PickHit hit;
+            select_clear(tool);
+            Path *path = pickPath(sel, *mouse_pos, &hit);
+            if (path)
+                addSelected(sel, path);
+            path_clear(tool->tmp_path);
+        } else if (sel->mode == SELECT_MODE_lasso) {
+            selectInLasso(sel);
+            path_clear(tool->tmp_path);
+        }
+        // A pending move/scale is flushed by the next update
+        sel->mode = SELECT_MODE_idle;
+    }
+}
+
+/**
+ * Applies the part of the drag transform that was not yet applied. This costs
+ * one matrix multiplication per selected path per frame, independent of the
+ * node count.
+ */
+static Path *update(Tool *tool, double scale) {
+    SelectTool *sel = (SelectTool *)tool;
+
+    Affine delta = affine_mult(sel->drag, affine_inverse(sel->drag_applied));
+    if (affine_isIdentity(delta))
+        return NULL;
+
+    for (unsigned i = 0; i < sel->selected_cnt; i++) {
+        Path *path = sel->selected[i];
+        path->transform = affine_mult(delta, path->transform);
+    }
+    vn_pageEdited(sel->vn);
+
+    // Only translation and uniform scaling, the bounds stay axis aligned
+    sel->sel_min = affine_apply(delta, sel->sel_min);
+    sel->sel_max = affine_apply(delta, sel->sel_max);
+    sel->drag_applied = sel->drag;
+
+    return NULL;
+}
+
+static void clearClipboard(SelectTool *sel) {
+    for (unsigned i = 0; i < sel->clipboard_cnt; i++)
+        path_deinit(sel->clipboard[i]);
+    sel->clipboard_cnt = 0;
+}
+
+static void copySelection(SelectTool *sel) {
+    if (sel->selected_cnt == 0)
+        return;
+
+    clearClipboard(sel);
+    if (sel->selected_cnt > sel->clipboard_capacity) {
+        sel->clipboard_capacity = sel->selected_cnt;
+        sel->clipboard = realloc(sel->clipboard, sel->clipboard_capacity * sizeof(Path*));
+        assert(sel->clipboard != NULL);
+    }
+
+    for (unsigned i = 0; i < sel->selected_cnt; i++)
+        sel->clipboard[sel->clipboard_cnt++] = vn_instancePath(sel->vn, sel->selected[i]);
+    sel->clipboard_min = sel->sel_min;
+
+    printf("Copied %u paths\n", sel->clipboard_cnt);
+}
+
+/**
+ * Adds instances of the copied paths with their top left at the cursor, they
+ * become the selection.
+ */
+static void paste(SelectTool *sel) {
+    VnCtx *vn = sel->vn;
+    if (sel->clipboard_cnt == 0)
+        return;
+
+    Vec2 offset = vec2_sub(screenToCanvas(vn->mouse_pos), sel->clipboard_min);
+    Affine move = affine_translate(offset);
+
+    Path **pasted = malloc(sel->clipboard_cnt * sizeof(Path*));
+    assert(pasted != NULL);
+    for (unsigned i = 0; i < sel->clipboard_cnt; i++) {
+        pasted[i] = path_instance(sel->clipboard[i]);
+        pasted[i]->transform = affine_mult(move, pasted[i]->transform);
+    }
+    vn_addPaths(vn, pasted, sel->clipboard_cnt);
+
+    select_clear(&sel->tool);
+    for (unsigned i = 0; i < sel->clipboard_cnt; i++)
+        addSelected(sel, pasted[i]);
+    free(pasted);
+
+    printf("Pasted %u paths\n", sel->clipboard_cnt);
+}
+
+static bool keyCb(Tool *tool, int key, int action, int mods) {
+    SelectTool *sel = (SelectTool *)tool;
+
+    if (!(mods & GLFW_MOD_CONTROL) || (key != GLFW_KEY_C && key != GLFW_KEY_V))
+        return false;
+    if (action != GLFW_PRESS || sel->mode != SELECT_MODE_idle)
+        return true;
+
+    if (key == GLFW_KEY_C)
+        copySelection(sel);
+    else
+        paste(sel);
+    return true;
+}
+
+static void drawHover(SelectTool *sel, NVGcontext *vg, Path *path) {
+    Affine m = vn_pathToScreen(sel->vn, path);
+
+    nvgBeginPath(vg);
+    Vec2 p = affine_apply(m, path->nodes[0]);
+    nvgMoveTo(vg, p.x, p.y);
+    if (path->type == PATHTYPE_bezier) {
+        for (unsigned j = 1; j + 2 < path->node_cnt; j += 3) {
+            Vec2 p0 = affine_apply(m, path->nodes[j]);
+            Vec2 p1 = affine_apply(m, path->nodes[j+1]);
+            Vec2 p2 = affine_apply(m, path->nodes[j+2]);
+            nvgBezierTo(vg, p0.x, p0.y, p1.x, p1.y, p2.x, p2.y);
+        }
+    } else {
+        for (unsigned j = 1; j < path->node_cnt; j++) {
+            p = affine_apply(m, path->nodes[j]);
+            nvgLineTo(vg, p.x, p.y);
+        }
+    }
+    nvgStrokeWidth(vg, 4.0f);
+    nvgStrokeColor(vg, nvgRGBA(82, 144, 242, 120));
+    nvgStroke(vg);
+
+    Vec2 c = canvasToScreen(sel->hover_hit.point);
+    nvgBeginPath(vg);
+    nvgCircle(vg, c.x, c.y, 3.0f);
+    nvgFillColor(vg, nvgRGBA(82, 144, 242, 255));
+    nvgFill(vg);
+}
+
+static void draw(Tool *tool, NVGcontext *vg) {
+    SelectTool *sel = (SelectTool *)tool;
+
+    Path *hover = hoveredPath(sel);
+    if (hover && sel->mode == SELECT_MODE_idle)
+        drawHover(sel, vg, hover);
+
+    if (sel->selected_cnt == 0)
+        return;
+
+    Vec2 min = canvasToScreen(sel->sel_min);
+    Vec2 max = canvasToScreen(sel->sel_max);
+
+    nvgBeginPath(vg);
+    nvgRect(vg, min.x, min.y, max.x - min.x, max.y - min.y);
+    nvgStrokeWidth(vg, 1.0f);
+    nvgStrokeColor(vg, nvgRGBA(82, 144, 242, 160));
+    nvgStroke(vg);
+
+    nvgBeginPath(vg);
+    nvgRect(vg, max.x - SELECT_HANDLE_SIZE/2, max.y - SELECT_HANDLE_SIZE/2,
+            SELECT_HANDLE_SIZE, SELECT_HANDLE_SIZE);
+    nvgFillColor(vg, nvgRGBA(82, 144, 242, 255));
+    nvgFill(vg);
+}
+
+Tool *select_init(VnCtx *vn) {
+    SelectTool *sel = &g_select;
+    Tool *tool = &sel->tool;
+
+    tool->mousePosCb = mousePosCb;
+    tool->mouseBtnCb = mouseBtnCb;
+    tool->update = update;
+    tool->draw = draw;
+    tool->keyCb = keyCb;
+
+    tool->tmp_path = path_init(0);
+    tool->tmp_path_ready = false;
+
+    sel->vn = vn;
+    sel->mode = SELECT_MODE_idle;
+    sel->drag = affine_identity();
+    sel->drag_applied = affine_identity();
+    sel->pick = pick_init();
+    select_clear(tool);
+
+    return tool;
+}
+
+void select_deinit(Tool *tool) {
+    SelectTool *sel = (SelectTool *)tool;
+
+    if (tool->tmp_path)
+        path_deinit(tool->tmp_path);
+    tool->tmp_path = NULL;
+
+    free(sel->selected);
+    sel->selected = NULL;
+    sel->selected_cnt = 0;
+    sel->selected_capacity = 0;
+
+    pick_deinit(sel->pick);
+    sel->pick = NULL;
+    sel->hover = NULL;
+
+    clearClipboard(sel);
+    free(sel->clipboard);
+    sel->clipboard = NULL;
+    sel->clipboard_capacity = 0;
+}
@@ -0,0 +1,141 @@
+// Text tool. Clicking places a new text note, typed characters are appended
+// to it until Escape is pressed or another note is placed. Notes are created
+// at a fixed on-screen size, like strokes keep their on-screen width.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+
+#include "affine.h"
+#include "font.h"
+#include "tool.h"
+#include "vec.h"
+#include "vectornotes.h"
+
+#define TEXT_DEFAULT_SIZE 24.0      // Line height of new notes, in pixels
+
+typedef struct text_tool {
+    Tool tool;      // Must be the first member, the callbacks cast Tool * back
+
+    VnCtx *vn;
+    TextNote *note;     // Note being edited, NULL if none
+} TextTool;
+
+TextTool g_text = {0};
+
+/**
+ * Stops editing the current note, an empty note is removed again.
+ */
+static void finishNote(TextTool *text) {
+    if (!text->note)
+        return;
+
+    if (text->note->len == 0) {
+        vn_removeNote(text->vn, text->note);
+        font_noteDeinit(text->note);
+    }
+    text->note = NULL;
+}
+
+static void mouseBtnCb(Tool *tool, Vec2 *mouse_pos, int button, int action) {
+    TextTool *text = (TextTool *)tool;
+    VnCtx *vn = text->vn;
+
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS)
+        return;
+
+    finishNote(text);
+    if (!vn->font_ready) {
+        printf("Error(Text): No font loaded, see --font\n");
+        return;
+    }
+
+    text->note = font_noteInit(screenToCanvas(*mouse_pos), TEXT_DEFAULT_SIZE / vn->view_scale);
+    vn_addNote(vn, text->note);
+}
+
+static bool keyCb(Tool *tool, int key, int action, int mods) {
+    TextTool *text = (TextTool *)tool;
+
+    if (!text->note)
+        return false;
+    if (action != GLFW_PRESS && action != GLFW_REPEAT)
+        return true;
+
+    switch (key) {
+    case GLFW_KEY_BACKSPACE:
+        font_noteBackspace(text->note);
+        break;
+    case GLFW_KEY_ENTER:
+    case GLFW_KEY_KP_ENTER:
+        font_noteAppend(text->note, '\n');
+        break;
+    case GLFW_KEY_ESCAPE:
+        finishNote(text);
+        break;
+    default: break;
+    }
+
+    // Printable keys arrive as characters in charCb
+    return true;
+}
+
+static void charCb(Tool *tool, unsigned codepoint) {
+    TextTool *text = (TextTool *)tool;
+
+    if (text->note)
+        font_noteAppend(text->note, codepoint);
+}
+
+static Path *update(Tool *tool, double scale) {
+    return NULL;
+}
+
+/**
+ * Draws the caret after the last character of the edited note.
+ */
+static void draw(Tool *tool, NVGcontext *vg) {
+    TextTool *text = (TextTool *)tool;
+    VnCtx *vn = text->vn;
+
+    if (!text->note)
+        return;
+    if (!text->note->layout_valid)
+        font_layout(&vn->font, text->note);
+
+    Affine m = vn_noteToScreen(vn, text->note);
+    Vec2 caret = text->note->caret;
+    Vec2 top = affine_apply(m, (Vec2){ caret.x, caret.y - vn->font.ascent });
+    Vec2 bottom = affine_apply(m, (Vec2){ caret.x, caret.y - vn->font.descent });
+
+    nvgBeginPath(vg);
+    nvgMoveTo(vg, top.x, top.y);
+    nvgLineTo(vg, bottom.x, bottom.y);
+    nvgStrokeWidth(vg, 1.0f);
+    nvgStrokeColor(vg, nvgRGBA(82, 144, 242, 255));
+    nvgStroke(vg);
+}
+
+Tool *text_init(VnCtx *vn) {
+    TextTool *text = &g_text;
+    Tool *tool = &text->tool;
+
+    tool->mouseBtnCb = mouseBtnCb;
+    tool->update = update;
+    tool->draw = draw;
+    tool->keyCb = keyCb;
+    tool->charCb = charCb;
+
+    text->vn = vn;
+    text->note = NULL;
+
+    return tool;
+}
+
+void text_deinit(Tool *tool) {
+    TextTool *text = (TextTool *)tool;
+
+    // The notes belong to the canvas
+    text->note = NULL;
+}
@@ -0,0 +1,398 @@
+// Fit parameter tuning and benchmarking, run from the command line:
+//
+//   vectornotes tune CORPUS [--scale S] [--max-error PX] [-o PROFILE]
+//   vectornotes fitbench CORPUS [--scale S] [--profile PROFILE] [--filter STAGES]
+//
+// CORPUS is a polyline file (as printed by the 'P' key) with raw strokes.
+// `tune` runs the corpus through fitCurve for every point of a parameter grid
+// and reports the Pareto front of output node count, max and mean deviation
+// and fit time. `-o` writes the profile with the fewest nodes that stays
+// within --max-error (default: the epsilon of the default profile). Profiles
+// are loaded at startup with `--fit-profile PROFILE`. `fitbench --filter`
+// also fits the corpus after the pencil input filters (see filter.h).
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "filter.h"
+#include "fit_bezier.h"
+#include "import.h"
+#include "jobs.h"
+#include "path.h"
+#include "pick.h"
+#include "tune.h"
+#include "vec.h"
+
+#define TUNE_SAMPLE_DT (1.0 / 120)  // The corpus has no timestamps
+
+typedef struct fit_stats {
+    FitParams params;
+    unsigned long nodes;
+    double max_dev;     // In pixels
+    double mean_dev;
+    double time;        // CPU time of the fits, in seconds
+    bool pareto;
+} FitStats;
+
+typedef struct tune_ctx {
+    Path **strokes;
+    Path **reference;   // Deviation is measured against these if set
+    unsigned stroke_cnt;
+    double scale;
+    FitStats *stats;
+} TuneCtx;
+
+static double cpuTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Distance of every raw point to the fitted curve, over all its segments. A
+ * segment is skipped if the bounds of its control points are farther than the
+ * best so far, which starts at the segment nearest to the previous point.
+ */
+static void strokeDeviation(Path *stroke, Vec2 *curve, size_t curve_cnt,
+        double *max_sqr, double *sum) {
+    size_t hint = 0;
+    for (unsigned i = 0; i < stroke->node_cnt; i++) {
+        Vec2 p = stroke->nodes[i];
+        double t;
+        double best = curve_cnt < 4 ? sqrt(vec2_distSqr(p, curve[0]))
+            : pick_cubicDistance(&curve[hint], p, &t);
+        for (size_t k = 0; k + 3 < curve_cnt; k += 3) {
+            const Vec2 *c = &curve[k];
+            double dx = fmax(fmin(fmin(c[0].x, c[1].x), fmin(c[2].x, c[3].x)) - p.x,
+                    p.x - fmax(fmax(c[0].x, c[1].x), fmax(c[2].x, c[3].x)));
+            double dy = fmax(fmin(fmin(c[0].y, c[1].y), fmin(c[2].y, c[3].y)) - p.y,
+                    p.y - fmax(fmax(c[0].y, c[1].y), fmax(c[2].y, c[3].y)));
+            if (dx >= best || dy >= best || k == hint)
+                continue;
+
+            double d = pick_cubicDistance(c, p, &t);
+            if (d < best) {
+                best = d;
+                hint = k;
+            }
+        }
+
+        *max_sqr = fmax(*max_sqr, best*best);
+        *sum += best;
+    }
+}
+
+static void evalParams(TuneCtx *ctx, FitStats *stats) {
+    double max_sqr = 0;
+    double sum = 0;
+    unsigned long points = 0;
+
+    stats->nodes = 0;
+    stats->time = 0;
+
+    // One context for all strokes, like the pencil does
+    BezierFitCtx *fit = fit_init(NULL, 0);
+    fit_setParams(fit, &stats->params, ctx->scale);
+
+    for (unsigned i = 0; i < ctx->stroke_cnt; i++) {
+        Path *stroke = ctx->strokes[i];
+
+        double t = cpuTime();
+        fit_reset(fit, stroke->nodes, stroke->node_cnt);
+        fitCurve(fit);
+        stats->time += cpuTime() - t;
+
+        stats->nodes += fit->new_cnt;
+        Path *ref = ctx->reference ? ctx->reference[i] : stroke;
+        strokeDeviation(ref, fit->new, fit->new_cnt, &max_sqr, &sum);
+        points += ref->node_cnt;
+    }
+    fit_deinit(fit);
+
+    stats->max_dev = sqrt(max_sqr) * ctx->scale;
+    stats->mean_dev = points ? sum / points * ctx->scale : 0;
+}
+
+static void evalJob(void *ctx, size_t begin, size_t end) {
+    TuneCtx *tune = ctx;
+    for (size_t i = begin; i < end; i++)
+        evalParams(tune, &tune->stats[i]);
+}
+
+static bool dominates(FitStats *a, FitStats *b) {
+    bool no_worse = a->nodes <= b->nodes && a->max_dev <= b->max_dev
+        && a->mean_dev <= b->mean_dev && a->time <= b->time;
+    bool better = a->nodes < b->nodes || a->max_dev < b->max_dev
+        || a->mean_dev < b->mean_dev || a->time < b->time;
+    return no_worse && better;
+}
+
+static int compareNodes(const void *a, const void *b) {
+    const FitStats *sa = a, *sb = b;
+    if (sa->nodes != sb->nodes)
+        return sa->nodes < sb->nodes ? -1 : 1;
+    return (sa->max_dev > sb->max_dev) - (sa->max_dev < sb->max_dev);
+}
+
+static void printHeader(void) {
+    printf("%9s %9s %9s %9s | %7s %7s %7s %7s %4s\n",
+            "nodes", "max_dev", "mean_dev", "time_ms",
+            "corner", "tangent", "epsilon", "psi", "iter");
+}
+
+static void printStats(FitStats *s) {
+    printf("%9lu %9.3f %9.3f %9.2f | %7.3f %7.1f %7.1f %7.1f %4u\n",
+            s->nodes, s->max_dev, s->mean_dev, s->time * 1000,
+            s->params.corner_thresh, s->params.tangent_range,
+            s->params.epsilon, s->params.psi, s->params.max_iter);
+}
+
+static Path **loadCorpus(const char *filename, unsigned *count, unsigned long *points) {
+    Path **strokes = import_readPolylines(filename, count);
+    if (!strokes)
+        return NULL;
+
+    *points = 0;
+    for (unsigned i = 0; i < *count; i++)
+        *points += strokes[i]->node_cnt;
+
+    printf("Corpus: %u strokes, %lu points\n", *count, *points);
+    return strokes;
+}
+
+static void freeCorpus(Path **strokes, unsigned count) {
+    for (unsigned i = 0; i < count; i++)
+        path_deinit(strokes[i]);
+    free(strokes);
+}
+
+int tune_main(int argc, char *argv[]) {
+    const char *corpus = NULL;
+    const char *out = NULL;
+    double scale = 1.0;
+    double max_error = fit_defaultParams().epsilon;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scale") == 0 && i+1 < argc)
+            scale = atof(argv[++i]);
+        else if (strcmp(argv[i], "--max-error") == 0 && i+1 < argc)
+            max_error = atof(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i+1 < argc)
+            out = argv[++i];
+        else
+            corpus = argv[i];
+    }
+    if (!corpus || scale <= 0) {
+        printf("Usage: vectornotes tune CORPUS [--scale S] [--max-error PX] [-o PROFILE]\n");
+        return 1;
+    }
+
+    unsigned long points;
+    TuneCtx ctx = { .scale = scale };
+    ctx.strokes = loadCorpus(corpus, &ctx.stroke_cnt, &points);
+    if (!ctx.strokes)
+        return 1;
+
+    const double corners[] = { 0.3927, 0.5236, 0.7854, 1.0472 };   // 22.5-60 deg
+    const double tangents[] = { 10, 20, 30 };
+    const double epsilons[] = { 1, 2, 4, 6, 10, 14 };
+    const double psi_factors[] = { 2, 4, 8 };
+    const unsigned iters[] = { 2, 4, 6 };
+
+#define COUNT(a) (sizeof(a)/sizeof((a)[0]))
+    size_t total = COUNT(corners) * COUNT(tangents) * COUNT(epsilons)
+        * COUNT(psi_factors) * COUNT(iters);
+    ctx.stats = calloc(total, sizeof(FitStats));
+
+    size_t n = 0;
+    for (size_t a = 0; a < COUNT(corners); a++)
+    for (size_t b = 0; b < COUNT(tangents); b++)
+    for (size_t c = 0; c < COUNT(epsilons); c++)
+    for (size_t d = 0; d < COUNT(psi_factors); d++)
+    for (size_t e = 0; e < COUNT(iters); e++) {
+        FitParams *p = &ctx.stats[n++].params;
+        p->corner_thresh = corners[a];
+        p->tangent_range = tangents[b];
+        p->epsilon = epsilons[c];
+        p->psi = epsilons[c] * psi_factors[d];
+        p->max_iter = iters[e];
+    }
+#undef COUNT
+
+    printf("Evaluating %zu parameter sets on %u threads\n", total, jobs_threadCount());
+    jobs_parallelFor(total, 1, evalJob, &ctx);
+
+    FitStats defaults = { .params = fit_defaultParams() };
+    evalParams(&ctx, &defaults);
+
+    size_t front = 0;
+    for (size_t i = 0; i < total; i++) {
+        ctx.stats[i].pareto = true;
+        for (size_t j = 0; j < total; j++) {
+            if (dominates(&ctx.stats[j], &ctx.stats[i])) {
+                ctx.stats[i].pareto = false;
+                break;
+            }
+        }
+        if (ctx.stats[i].pareto)
+            ctx.stats[front++] = ctx.stats[i];
+    }
+    qsort(ctx.stats, front, sizeof(FitStats), compareNodes);
+
+    printf("\nDefault profile:\n");
+    printHeader();
+    printStats(&defaults);
+
+    printf("\nPareto front (%zu of %zu):\n", front, total);
+    printHeader();
+    for (size_t i = 0; i < front; i++)
+        printStats(&ctx.stats[i]);
+
+    int ret = 0;
+    if (out) {
+        // Fewest nodes within the error bound, otherwise the most accurate
+        FitStats *pick = NULL;
+        for (size_t i = 0; i < front; i++) {
+            FitStats *s = &ctx.stats[i];
+            if (s->max_dev <= max_error) {
+                if (!pick || s->nodes < pick->nodes
+                        || (s->nodes == pick->nodes && s->time < pick->time))
+                    pick = s;
+            }
+        }
+        for (size_t i = 0; !pick && i < front; i++) {
+            if (i == 0 || ctx.stats[i].max_dev < pick->max_dev)
+                pick = &ctx.stats[i];
+        }
+
+        if (pick && fit_saveParams(out, &pick->params)) {
+            printf("\nWrote profile to %s:\n", out);
+            printHeader();
+            printStats(pick);
+        } else {
+            ret = 1;
+        }
+    }
+
+    free(ctx.stats);
+    freeCorpus(ctx.strokes, ctx.stroke_cnt);
+    return ret;
+}
+
+static void corpusSink(void *ctx, Vec2 pos) {
+    Path *path = ctx;
+    path_addNode(path, pos);
+}
+
+/**
+ * Runs every stroke through the filter chain, in screen space at `scale`.
+ * Returns the filtered strokes in canvas space.
+ */
+static Path **filterCorpus(FilterChain *chain, Path **strokes, unsigned count,
+        double scale, double *time) {
+    Path **out = malloc(count * sizeof(Path*));
+    assert(out != NULL);
+
+    double t = cpuTime();
+    for (unsigned i = 0; i < count; i++) {
+        Path *screen = path_init(strokes[i]->node_cnt);
+        chain->sink_ctx = screen;
+
+        filter_begin(chain);
+        for (unsigned j = 0; j < strokes[i]->node_cnt; j++) {
+            Vec2 p = vec2_scalarMult(strokes[i]->nodes[j], scale);
+            filter_push(chain, p, j * TUNE_SAMPLE_DT);
+        }
+        filter_end(chain);
+
+        for (unsigned j = 0; j < screen->node_cnt; j++)
+            screen->nodes[j] = vec2_scalarMult(screen->nodes[j], 1/scale);
+        path_updateBBox(screen);
+        out[i] = screen;
+    }
+    *time = cpuTime() - t;
+
+    return out;
+}
+
+int tune_benchMain(int argc, char *argv[]) {
+    const char *corpus = NULL;
+    double scale = 1.0;
+    FitParams params = fit_defaultParams();
+    const char *filter_spec = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scale") == 0 && i+1 < argc) {
+            scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i+1 < argc) {
+            filter_spec = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0 && i+1 < argc) {
+            if (!fit_loadParams(argv[++i], &params))
+                return 1;
+        } else {
+            corpus = argv[i];
+        }
+    }
+    if (!corpus || scale <= 0) {
+        printf("Usage: vectornotes fitbench CORPUS [--scale S] [--profile PROFILE] [--filter STAGES]\n");
+        return 1;
+    }
+
+    unsigned long points;
+    TuneCtx ctx = { .scale = scale };
+    ctx.strokes = loadCorpus(corpus, &ctx.stroke_cnt, &points);
+    if (!ctx.strokes)
+        return 1;
+
+    FitStats stats = { .params = params };
+    evalParams(&ctx, &stats);
+
+    printHeader();
+    printStats(&stats);
+    printf("%.0f points/s, %.1f input points per output node\n",
+            stats.time > 0 ? points / stats.time : 0,
+            stats.nodes ? (double)points / stats.nodes : 0);
+
+    int ret = 0;
+    if (filter_spec) {
+        // Same corpus through the input filters first, the deviation is still
+        // measured against the unfiltered strokes
+        FilterChain chain;
+        filter_init(&chain, corpusSink, NULL);
+        if (filter_parse(&chain, filter_spec)) {
+            double filter_time;
+            Path **raw = ctx.strokes;
+            ctx.reference = raw;
+            ctx.strokes = filterCorpus(&chain, raw, ctx.stroke_cnt, scale, &filter_time);
+
+            FitStats filtered = { .params = params };
+            evalParams(&ctx, &filtered);
+
+            printf("\nFiltered (%s): %lu -> %lu points (%.1f%%) in %.2f ms\n",
+                    filter_spec, chain.in_cnt, chain.out_cnt,
+                    chain.in_cnt ? 100.0 * chain.out_cnt / chain.in_cnt : 0,
+                    filter_time * 1000);
+            printHeader();
+            printStats(&filtered);
+            printf("Nodes %+.1f%%, fit time %+.1f%%, with filtering %+.1f%%\n",
+                    stats.nodes ? 100.0 * ((double)filtered.nodes / stats.nodes - 1) : 0,
+                    stats.time > 0 ? 100.0 * (filtered.time / stats.time - 1) : 0,
+                    stats.time > 0 ? 100.0 * ((filtered.time + filter_time) / stats.time - 1) : 0);
+
+            freeCorpus(ctx.strokes, ctx.stroke_cnt);
+            ctx.strokes = raw;
+        } else {
+            ret = 1;
+        }
+    }
+
+    freeCorpus(ctx.strokes, ctx.stroke_cnt);
+    return ret;
+}
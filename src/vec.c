@@ -68,3 +68,11 @@ Vec2 vec2_norm(Vec2 v) {
 Vec2 vec2_tangent(Vec2 v1, Vec2 v2) {
     return vec2_norm(vec2_sub(v2, v1));
 }
+
+Vec2 vec2_lerp(Vec2 v1, Vec2 v2, double t) {
+    Vec2 out = {
+        .x = v1.x + (v2.x - v1.x) * t,
+        .y = v1.y + (v2.y - v1.y) * t,
+    };
+    return out;
+}
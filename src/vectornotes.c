@@ -1,22 +1,59 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "nanovg/nanovg.h"
+#include "gl.h"
 #define NANOVG_GL3_IMPLEMENTATION
+#define NANOVG_GL_PROGRAM_CACHE_LOAD gl_loadProgramBinary
+#define NANOVG_GL_PROGRAM_CACHE_STORE gl_storeProgramBinary
 #include "nanovg/nanovg_gl.h"
 
 #include <assert.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "affine.h"
+#include "compact.h"
 #include "gl.h"
+#include "image.h"
+#include "import.h"
+#include "jobs.h"
+#include "mem.h"
+#include "notebook.h"
 #include "path.h"
+#include "svg.h"
+#include "thumb.h"
 #include "tool.h"
 #include "vec.h"
 #include "vectornotes.h"
 
+// Segment length of flattened paths for RENDERER_stroke, in pixels
+#define FLATTEN_TOL 2.0
+
+// Fewer visible paths than this are tessellated on the render thread
+#define VG_PARALLEL_MIN_PATHS 32
+
+// Image tile bytes uploaded per frame at most
+#define IMAGE_TILE_BYTES (IMAGE_TILE_TEXELS * IMAGE_TILE_TEXELS * 4)
+#define IMAGE_UPLOAD_BUDGET (8 * IMAGE_TILE_BYTES)
+
+// Page grid layout, thumbnails per row can be changed with +/-
+#define GRID_DEFAULT_COLUMNS 5
+#define GRID_MIN_COLUMNS 2
+#define GRID_MAX_COLUMNS 16
+#define GRID_MARGIN 8.0f
+
+// Thumbnails loaded or rendered per frame at most, the grid stays responsive
+// while the thumbnails of a large notebook are built
+#define GRID_RENDER_BUDGET 4
+
 VnCtx g_vn = {0};
 
+static void deleteImage(VnCtx *vn, Image *image);
+static void closeThumbs(VnCtx *vn);
+static void storeActivePage(VnCtx *vn);
+
 // TODO: Think of a better solution than using a global instance of vn.
 // Possibly having the 'canvas' as a separate ui module
 Vec2 canvasToScreen(Vec2 point) {
@@ -39,12 +76,34 @@ Vec2 screenToCanvas(Vec2 point) {
             vn->view_origin);
 }
 
-static void setViewport(VnCtx *vn, unsigned width, unsigned height) {
-    glViewport(0, 0, width, height);
+double vn_eventTime(void) {
+    VnCtx *vn = &g_vn;
+    return vn->event_us * 1e-6;
+}
 
+/**
+ * Stamps an input event (or frame) with the event time and logs it while
+ * recording. In a replay there is no window, the replay sets the time.
+ */
+static void logEvent(VnCtx *vn, RecordEvent ev) {
+    if (vn->window)
+        vn->event_us = (uint64_t)(glfwGetTime() * 1e6);
+    if (vn->recorder) {
+        ev.time_us = vn->event_us;
+        record_event(vn->recorder, &ev);
+    }
+}
+
+static void setViewport(VnCtx *vn, unsigned width, unsigned height) {
     vn->view_width = width;
     vn->view_height = height;
 
+    // Headless, see vn_initHeadless
+    if (!vn->window)
+        return;
+
+    glViewport(0, 0, width, height);
+
     for (size_t i = 0; i < sizeof(vn->shaders)/sizeof(GLuint); i++) {
         glProgramUniform2f(
                 vn->shaders[i],
@@ -53,16 +112,85 @@ static void setViewport(VnCtx *vn, unsigned width, unsigned height) {
     }
 }
 
+/**
+ * Size of a page grid cell, a thumbnail with its margin.
+ */
+static void gridCellSize(VnCtx *vn, float *w, float *h) {
+    *w = (float)vn->view_width / vn->grid_columns;
+    *h = (*w - 2*GRID_MARGIN) * THUMB_HEIGHT / THUMB_WIDTH + 2*GRID_MARGIN;
+}
+
+static void scrollGrid(VnCtx *vn, double yoffset) {
+    float cell_w, cell_h;
+    gridCellSize(vn, &cell_w, &cell_h);
+    unsigned rows = (vn->notebook->page_cnt + vn->grid_columns - 1) / vn->grid_columns;
+    double max = fmax(0.0, rows * cell_h - vn->view_height);
+    vn->grid_scroll = fmin(fmax(vn->grid_scroll - yoffset * cell_h / 2, 0.0), max);
+}
+
+/**
+ * Flips to the page under the mouse and closes the grid.
+ */
+static void pickGridPage(VnCtx *vn) {
+    float cell_w, cell_h;
+    gridCellSize(vn, &cell_w, &cell_h);
+    if (vn->mouse_pos.x < 0 || vn->mouse_pos.y < 0)
+        return;
+
+    unsigned col = vn->mouse_pos.x / cell_w;
+    unsigned row = (vn->mouse_pos.y + vn->grid_scroll) / cell_h;
+    unsigned index = row * vn->grid_columns + col;
+    if (col >= vn->grid_columns || index >= vn->notebook->page_cnt)
+        return;
+
+    vn->page_grid = false;
+    vn_setPage(vn, index);
+}
+
+static void pageGridKey(VnCtx *vn, int key) {
+    switch (key) {
+        case GLFW_KEY_G:
+        case GLFW_KEY_ESCAPE:
+            vn->page_grid = false;
+            break;
+        case GLFW_KEY_EQUAL:
+            if (vn->grid_columns > GRID_MIN_COLUMNS)
+                vn->grid_columns--;
+            break;
+        case GLFW_KEY_MINUS:
+            if (vn->grid_columns < GRID_MAX_COLUMNS)
+                vn->grid_columns++;
+            break;
+        default:
+            break;
+    }
+}
+
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_key, .key = key, .scancode = scancode,
+            .action = action, .mods = mods });
+
+    if (vn->page_grid) {
+        if (action == GLFW_PRESS)
+            pageGridKey(vn, key);
+        return;
+    }
+
+    Tool *tool = vn->tools[vn->active_tool];
+    if (tool && tool->keyCb && tool->keyCb(tool, key, action, mods))
+        return;
 
     if (action == GLFW_PRESS) {
         switch (key) {
             case GLFW_KEY_ESCAPE:
             case GLFW_KEY_Q:
-                glfwSetWindowShouldClose(window, true);
+                if (window)
+                    glfwSetWindowShouldClose(window, true);
                 break;
             case GLFW_KEY_M: {
+                if (!window)
+                    break;
                 static int mode = 0;
                 printf("%d\n", mode);
                 glPolygonMode(GL_FRONT_AND_BACK, GL_POINT + mode);
@@ -71,11 +199,66 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
             case GLFW_KEY_D:
                 vn->debug = !vn->debug;
                 break;
+            case GLFW_KEY_R:
+                vn->renderer = (vn->renderer + 1) % RENDERER_count;
+                printf("Renderer %d\n", vn->renderer);
+                break;
+            case GLFW_KEY_E: {
+                // Export with the current on-screen stroke width
+                SvgOptions opts = svg_defaultOptions();
+                opts.stroke_width = 2.0 / vn->view_scale;
+
+                double t = glfwGetTime();
+                if (svg_export("vectornotes.svg", vn->paths, vn->path_cnt, &opts)) {
+                    printf("Exported %u paths to vectornotes.svg in %f s\n",
+                            vn->path_cnt, glfwGetTime() - t);
+                }
+            } break;
+            case GLFW_KEY_F: {
+                // Refit the drawn strokes from their raw samples at this zoom
+                double t = glfwGetTime();
+                unsigned cnt = path_refitN(vn->paths, vn->path_cnt, vn->view_scale);
+                if (cnt > 0)
+                    vn_pageEdited(vn);
+                printf("Refitted %u paths in %f s\n", cnt, glfwGetTime() - t);
+            } break;
+            case GLFW_KEY_C:
+                vn_compact(vn);
+                break;
+            case GLFW_KEY_1:
+            case GLFW_KEY_2:
+            case GLFW_KEY_3: {
+                size_t t = key - GLFW_KEY_1;
+                if (t < TOOLS_count && vn->tools[t])
+                    vn->active_tool = t;
+            } break;
+            case GLFW_KEY_I:
+                if (vn->font_ready)
+                    font_printStats(&vn->font);
+                break;
+            case GLFW_KEY_PAGE_UP:
+                if (vn->notebook && vn->notebook->active > 0)
+                    vn_setPage(vn, vn->notebook->active - 1);
+                break;
+            case GLFW_KEY_PAGE_DOWN:
+                // Past the last page a new page is added
+                if (vn->notebook)
+                    vn_setPage(vn, vn->notebook->active + 1);
+                break;
+            case GLFW_KEY_G:
+                if (vn->notebook) {
+                    // Catches edits other than new paths, e.g. moved paths
+                    thumb_check(vn->thumbs, vn->notebook->active, vn->paths, vn->path_cnt);
+                    vn->page_grid = true;
+                }
+                break;
             case GLFW_KEY_P: {
                 if (vn->path_cnt == 0) break;
                 Path *p = vn->paths[vn->path_cnt-1];
+                // In canvas coordinates, the nodes are relative to the path origin
                 for (size_t i = 0; i < p->node_cnt; i++) {
-                    printf("{%f, %f},\n", p->nodes[i].x, p->nodes[i].y);
+                    Vec2 n = affine_apply(p->transform, p->nodes[i]);
+                    printf("{%f, %f},\n", n.x, n.y);
                 }
             } break;
 
@@ -85,11 +268,25 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
     }
 }
 
+static void charCallback(GLFWwindow* window, unsigned codepoint) {
+    VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_char, .codepoint = codepoint });
+    if (vn->page_grid)
+        return;
+
+    Tool *tool = vn->tools[vn->active_tool];
+    if (tool && tool->charCb)
+        tool->charCb(tool, codepoint);
+}
+
 static void mousePositionCallback(GLFWwindow* window, double xpos, double ypos) {
     VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_cursor, .x = xpos, .y = ypos });
 
     vn->mouse_pos.x = xpos;
     vn->mouse_pos.y = ypos;
+    if (vn->page_grid)
+        return;
 
     // Handle right mouse button for panning
     if (vn->mouse_states[GLFW_MOUSE_BUTTON_RIGHT] == GLFW_PRESS) {
@@ -106,9 +303,17 @@ static void mousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 
 static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
     VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_button, .key = button, .action = action,
+            .mods = mods });
 
     vn->mouse_states[button] = action;
 
+    if (vn->page_grid) {
+        if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+            pickGridPage(vn);
+        return;
+    }
+
     // Needed for panning
     if (button == GLFW_MOUSE_BUTTON_RIGHT) {
         if (action == GLFW_PRESS) {
@@ -123,6 +328,12 @@ static void mouseButtonCallback(GLFWwindow* window, int button, int action, int
 
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
     VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_scroll, .x = xoffset, .y = yoffset });
+
+    if (vn->page_grid) {
+        scrollGrid(vn, yoffset);
+        return;
+    }
 
     // Zoom by changing the scale parameter, and correcting the view_offset to
     // scale around the mouse position.
@@ -146,15 +357,59 @@ void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
     }
 }
 
+static void dropCallback(GLFWwindow* window, int count, const char *paths[]) {
+    VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_drop, .path_cnt = count, .paths = paths });
+
+    for (int i = 0; i < count; i++) {
+        vn_importFile(vn, paths[i]);
+    }
+}
+
 static void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
     VnCtx *vn = &g_vn;
+    logEvent(vn, (RecordEvent){ .type = RECORD_resize, .x = width, .y = height });
     setViewport(vn, width, height);
 }
 
+/**
+ * Feeds a recorded input event to the callbacks it was recorded from.
+ */
+void vn_handleEvent(VnCtx *vn, const RecordEvent *ev) {
+    switch (ev->type) {
+    case RECORD_key:
+        keyCallback(vn->window, ev->key, ev->scancode, ev->action, ev->mods);
+        break;
+    case RECORD_char:
+        charCallback(vn->window, ev->codepoint);
+        break;
+    case RECORD_cursor:
+        mousePositionCallback(vn->window, ev->x, ev->y);
+        break;
+    case RECORD_button:
+        if (ev->key >= NUM_MOUSE_STATES)
+            break;
+        mouseButtonCallback(vn->window, ev->key, ev->action, ev->mods);
+        break;
+    case RECORD_scroll:
+        scrollCallback(vn->window, ev->x, ev->y);
+        break;
+    case RECORD_resize:
+        framebufferSizeCallback(vn->window, ev->x, ev->y);
+        break;
+    case RECORD_drop:
+        dropCallback(vn->window, ev->path_cnt, ev->paths);
+        break;
+    default:
+        break;
+    }
+}
+
 VnCtx *vn_init(unsigned width, unsigned height) {
     //VnCtx *vn = malloc(sizeof(VnCtx));
     VnCtx *vn = &g_vn;
     vn->view_scale = 1.0;
+    vn->grid_columns = GRID_DEFAULT_COLUMNS;
 
     { // Setup window
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -179,17 +434,19 @@ VnCtx *vn_init(unsigned width, unsigned height) {
 
         glfwSetFramebufferSizeCallback(vn->window, framebufferSizeCallback);
         glfwSetKeyCallback(vn->window, keyCallback);
+        glfwSetCharCallback(vn->window, charCallback);
         glfwSetMouseButtonCallback(vn->window, mouseButtonCallback);
         glfwSetCursorPosCallback(vn->window, mousePositionCallback);
         glfwSetScrollCallback(vn->window, scrollCallback);
+        glfwSetDropCallback(vn->window, dropCallback);
     }
 
     glGenVertexArrays(VAO_count, vn->vaos);
     glGenBuffers(VBO_count, vn->vbos);
     for (int i = 0; i < VAO_count; i++) {
-        assert(i < VBO_count);
         glBindVertexArray(vn->vaos[i]);
-        glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[i]);
+        // VAOs past VBO_count read from the buffers of the others
+        glBindBuffer(GL_ARRAY_BUFFER, i < VBO_count ? vn->vbos[i] : 0);
 
         switch (i) {
         case VAO_spline:
@@ -200,12 +457,49 @@ VnCtx *vn_init(unsigned width, unsigned height) {
             glVertexAttribPointer(0, 2, GL_DOUBLE, GL_FALSE, 0, 0);
             glEnableVertexAttribArray(0);
             break;
+        case VAO_geometry:
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(0);
+
+            glGenBuffers(1, &vn->geom_ebo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vn->geom_ebo);
+            vn->geom_generation = 1;    // 0 marks shared nodes never uploaded
+            break;
+        case VAO_stroke:
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+            glEnableVertexAttribArray(0);
+            break;
+        case VAO_text:
+            glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), 0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float),
+                    (void *)(2*sizeof(float)));
+            glEnableVertexAttribArray(1);
+            break;
+        case VAO_sdf:
+            // Four consecutive nodes per instance, advancing by one segment
+            // (three nodes). The buffer is bound per path at its offset.
+            for (int j = 0; j < 4; j++) {
+                glVertexAttribFormat(j, 2, GL_FLOAT, GL_FALSE, j * 2*sizeof(float));
+                glVertexAttribBinding(j, 0);
+                glEnableVertexAttribArray(j);
+            }
+            glVertexBindingDivisor(0, 1);
+            break;
 
         default: break;
         }
     }
     glBindVertexArray(0);
 
+    glGenBuffers(VN_IMAGE_PBO_COUNT, vn->image_pbos);
+    for (int i = 0; i < VN_IMAGE_PBO_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, vn->image_pbos[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, IMAGE_TILE_BYTES, NULL, GL_STREAM_DRAW);
+        mem_track(MEM_gl, IMAGE_TILE_BYTES);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
     // TODO: Check if createProgram was successful. Also, this could be done
     // programmatically
     {
@@ -238,10 +532,55 @@ VnCtx *vn_init(unsigned width, unsigned height) {
         };
         vn->shaders[SHADER_debug] = gl_createProgram(shaders);
     }
+    {
+        Shader shaders[] = { // SHADER_path
+            { GL_VERTEX_SHADER, true, "glsl/path.vs" },
+            { GL_TESS_CONTROL_SHADER, true, "glsl/bezier.tcs" },
+            { GL_TESS_EVALUATION_SHADER, true, "glsl/bezier.tes" },
+            { GL_FRAGMENT_SHADER, true, "glsl/simple.fs" },
+            { GL_NONE },
+        };
+        vn->shaders[SHADER_path] = gl_createProgram(shaders);
+    }
+    {
+        Shader shaders[] = { // SHADER_stroke
+            { GL_VERTEX_SHADER, true, "glsl/path.vs" },
+            { GL_GEOMETRY_SHADER, true, "glsl/stroke.gs" },
+            { GL_FRAGMENT_SHADER, true, "glsl/stroke.fs" },
+            { GL_NONE },
+        };
+        vn->shaders[SHADER_stroke] = gl_createProgram(shaders);
+    }
+    {
+        Shader shaders[] = { // SHADER_sdf
+            { GL_VERTEX_SHADER, true, "glsl/sdf.vs" },
+            { GL_FRAGMENT_SHADER, true, "glsl/sdf.fs" },
+            { GL_NONE },
+        };
+        vn->shaders[SHADER_sdf] = gl_createProgram(shaders);
+    }
+    {
+        Shader shaders[] = { // SHADER_text
+            { GL_VERTEX_SHADER, true, "glsl/text.vs" },
+            { GL_FRAGMENT_SHADER, true, "glsl/text.fs" },
+            { GL_NONE },
+        };
+        vn->shaders[SHADER_text] = gl_createProgram(shaders);
+    }
 
     vn->vg = nvgCreateGL3(NVG_ANTIALIAS | NVG_STENCIL_STROKES | NVG_DEBUG);
     if (!vn->vg)
         return NULL;
+    // Fewer points at the same error bound, see `vectornotes flattenbench`
+    nvgCurveTessellation(vn->vg, NVG_TESS_FORWARD);
+
+    vn->vg_worker_cnt = jobs_threadCount();
+    if (vn->vg_worker_cnt > VN_MAX_VG_WORKERS)
+        vn->vg_worker_cnt = VN_MAX_VG_WORKERS;
+    for (unsigned i = 0; i < vn->vg_worker_cnt; i++) {
+        vn->vg_workers[i] = nvgCreateWorker(vn->vg);
+        assert(vn->vg_workers[i] != NULL);
+    }
 
     vn->paths = malloc(DEFAULT_PATH_CAPACITY * sizeof(Path*));
     vn->path_capacity = DEFAULT_PATH_CAPACITY;
@@ -251,13 +590,64 @@ VnCtx *vn_init(unsigned width, unsigned height) {
     return vn;
 }
 
+/**
+ * Sets up a canvas without a window or GL context, for replaying input on the
+ * CPU. Only input, vn_step and the functions that do not draw may be used.
+ */
+VnCtx *vn_initHeadless(unsigned width, unsigned height) {
+    VnCtx *vn = &g_vn;
+    vn->view_scale = 1.0;
+    vn->grid_columns = GRID_DEFAULT_COLUMNS;
+    vn->view_width = width;
+    vn->view_height = height;
+
+    vn->paths = malloc(DEFAULT_PATH_CAPACITY * sizeof(Path*));
+    vn->path_capacity = DEFAULT_PATH_CAPACITY;
+    assert(vn->paths != NULL);
+
+    return vn;
+}
+
+/**
+ * Adds the tools, the pencil is active. `filter_spec` are the pencil input
+ * filter stages, e.g. "euro,rdp", NULL for FILTER_DEFAULT_SPEC.
+ */
+void vn_addTools(VnCtx *vn, const char *filter_spec) {
+    vn->tools[TOOLS_pencil] = pencil_init(filter_spec);
+    vn->tool_cnt += 1;
+    vn->tools[TOOLS_select] = select_init(vn);
+    vn->tool_cnt += 1;
+    vn->tools[TOOLS_text] = text_init(vn);
+    vn->tool_cnt += 1;
+    vn->active_tool = TOOLS_pencil;
+}
+
 void vn_deinit(VnCtx *vn) {
-    for (size_t i = 0; i < sizeof(vn->shaders)/sizeof(GLuint); i++) {
-        glDeleteProgram(vn->shaders[i]);
-    }
-    glDeleteBuffers(sizeof(vn->vbos)/sizeof(GLuint), vn->vbos);
-    glDeleteVertexArrays(sizeof(vn->vaos)/sizeof(GLuint), vn->vaos);
+    // A headless canvas has no GL objects
+    bool gl = vn->window != NULL;
 
+    if (gl) {
+        for (size_t i = 0; i < sizeof(vn->shaders)/sizeof(GLuint); i++) {
+            glDeleteProgram(vn->shaders[i]);
+        }
+        glDeleteBuffers(sizeof(vn->vbos)/sizeof(GLuint), vn->vbos);
+        glDeleteBuffers(1, &vn->geom_ebo);
+        mem_track(MEM_gl, -(ptrdiff_t)(vn->geom_capacity * 2*sizeof(float)
+                + vn->geom_segments * 4*sizeof(GLuint)
+                + vn->flat_capacity * 2*sizeof(float)
+                + vn->text_capacity * 4*sizeof(float)));
+        glDeleteVertexArrays(sizeof(vn->vaos)/sizeof(GLuint), vn->vaos);
+    }
+    free(vn->geom_scratch);
+
+    if (vn->notebook) {
+        Notebook *nb = vn->notebook;
+        storeActivePage(vn);
+        closeThumbs(vn);
+        notebook_close(nb);
+        vn->paths = NULL;
+        vn->path_cnt = 0;
+    }
     if (vn->paths) {
         for (size_t i = 0; i < vn->path_cnt; i++) {
             assert(vn->paths[i]);
@@ -265,11 +655,41 @@ void vn_deinit(VnCtx *vn) {
         }
     }
 
+    for (unsigned i = 0; i < vn->vg_worker_cnt; i++)
+        nvgDeleteInternal(vn->vg_workers[i]);
+    free(vn->visible);
+
+    for (unsigned i = 0; i < vn->note_cnt; i++)
+        font_noteDeinit(vn->notes[i]);
+    free(vn->notes);
+    if (vn->font_ready) {
+        if (gl)
+            glDeleteTextures(1, &vn->font_texture);
+        mem_track(MEM_gl, -(ptrdiff_t)vn->font_texture_bytes);
+        vn->font_texture_bytes = 0;
+        font_deinit(&vn->font);
+    }
+
+    for (unsigned i = 0; i < vn->image_cnt; i++)
+        deleteImage(vn, vn->images[i]);
+    free(vn->images);
+    if (gl) {
+        for (int i = 0; i < VN_IMAGE_PBO_COUNT; i++) {
+            if (vn->image_fences[i])
+                glDeleteSync(vn->image_fences[i]);
+        }
+        glDeleteBuffers(VN_IMAGE_PBO_COUNT, vn->image_pbos);
+        mem_track(MEM_gl, -(ptrdiff_t)IMAGE_TILE_BYTES * VN_IMAGE_PBO_COUNT);
+    }
+    image_loaderDeinit();
+
     if (vn->vg)
         nvgDeleteGL3(vn->vg);
 
-    glfwDestroyWindow(vn->window);
-    glfwTerminate();
+    if (gl) {
+        glfwDestroyWindow(vn->window);
+        glfwTerminate();
+    }
 
     //free(vn);
 }
@@ -277,25 +697,38 @@ void vn_deinit(VnCtx *vn) {
 // TODO: tmp
 extern Path *dbg;
 
-void vn_update(VnCtx *vn) {
+/**
+ * Advances the canvas by a frame without drawing: the path finished by the
+ * active tool is added, and the notebook pages are loaded and evicted.
+ */
+void vn_step(VnCtx *vn) {
     Tool *tool = vn->tools[vn->active_tool];
     Path *path = tool->update(tool, vn->view_scale);
 
     if (path) {
-        if (vn->path_cnt >= vn->path_capacity) {
-            // Path array is full, increase its capacity
-            vn->path_capacity *= 2;
-            vn->paths = realloc(vn->paths, vn->path_capacity * sizeof(Path*));
-            assert(vn->paths != NULL);
-        }
+        vn_addPaths(vn, &path, 1);
+        printf("New path finished, %d nodes, total %d paths\n", path->node_cnt, vn->path_cnt);
+    }
 
-        vn->paths[vn->path_cnt] = path;
+    if (vn->notebook) {
+        Notebook *nb = vn->notebook;
+        storeActivePage(vn);
+        notebook_prefetch(nb);
+        notebook_evict(nb);
+    }
+}
 
-        printf("New path finished, %d nodes, total %d paths\n", vn->paths[vn->path_cnt]->node_cnt, vn->path_cnt);
+void vn_update(VnCtx *vn) {
+    logEvent(vn, (RecordEvent){ .type = RECORD_frame });
 
-        vn->path_cnt += 1;
+    if (vn->page_grid) {
+        vn_drawPageGrid(vn);
+        return;
     }
 
+    vn_step(vn);
+
+    Tool *tool = vn->tools[vn->active_tool];
     NVGcontext *vg = vn->vg;
 
     nvgBeginFrame(vg, vn->view_width, vn->view_height, 1.0);
@@ -306,20 +739,39 @@ void vn_update(VnCtx *vn) {
         nvgStrokeWidth(vg, 2.0f);
         nvgStrokeColor(vg, nvgRGBA(82, 144, 242, 255));
 
+        vn_drawImages(vn);
+
         if (tool->tmp_path && tool->tmp_path->node_cnt >= 2) {
             vn_drawLines(vn, tool->tmp_path);
         }
 
-        for (size_t i = 0; i < vn->path_cnt; i++) {
-            vn_drawPath(vn, vn->paths[i]);
-        }
+        if (vn->renderer == RENDERER_nanovg)
+            vn_drawPathsNanovg(vn);
+
+        if (tool->draw)
+            tool->draw(tool, vg);
     }
     nvgRestore(vg);
     nvgEndFrame(vg);
 
+    if (vn->renderer == RENDERER_gpu)
+        vn_drawPathsGpu(vn);
+    else if (vn->renderer == RENDERER_stroke)
+        vn_drawPathsStroke(vn);
+    else if (vn->renderer == RENDERER_sdf)
+        vn_drawPathsSdf(vn);
+
+    vn_drawNotes(vn);
+
     if (vn->debug) {
         //vn_drawCtrlPoints(vn, new);
 
+        double now = glfwGetTime();
+        if (now - vn->mem_print_time >= VN_MEM_PRINT_INTERVAL) {
+            mem_printStats();
+            vn->mem_print_time = now;
+        }
+
         for (size_t i = 0; i < vn->path_cnt; i++) {
             vn_drawCtrlPoints(vn, vn->paths[i]);
         }
@@ -331,25 +783,1353 @@ void vn_update(VnCtx *vn) {
     }
 }
 
-void vn_drawPath(VnCtx *vn, Path *path) {
-    assert(vn->vg != NULL);
+/**
+ * path_instance of a path on the canvas. If `path` is uploaded to the
+ * geometry buffer, the instances draw from that upload instead of making
+ * their own.
+ */
+Path *vn_instancePath(VnCtx *vn, Path *path) {
+    Path *instance = path_instance(path);
+
+    PathShared *shared = path->shared;
+    if (path->gpu_valid && shared->gpu_generation != vn->geom_generation) {
+        shared->gpu_offset = path->gpu_offset;
+        shared->gpu_generation = vn->geom_generation;
+    }
+    return instance;
+}
 
-    nvgBeginPath(vn->vg);
-    nvgStrokeColor(vn->vg, nvgRGBA(230, 20, 15, 255));
+/**
+ * Appends paths to the canvas, growing the path array at most once.
+ */
+void vn_addPaths(VnCtx *vn, Path **paths, unsigned count) {
+    if (count == 0)
+        return;
 
-    Vec2 p = canvasToScreen(path->nodes[0]);
-    nvgMoveTo(vn->vg, p.x, p.y);
+    if (vn->path_cnt + count > vn->path_capacity) {
+        // Path array is full, increase its capacity
+        while (vn->path_cnt + count > vn->path_capacity)
+            vn->path_capacity *= 2;
+        vn->paths = realloc(vn->paths, vn->path_capacity * sizeof(Path*));
+        assert(vn->paths != NULL);
+    }
+
+    memcpy(&vn->paths[vn->path_cnt], paths, count * sizeof(Path*));
+    vn->path_cnt += count;
+    vn_pageEdited(vn);
+
+    if (vn->thumbs)
+        thumb_addPaths(vn->thumbs, vn->notebook->active, paths, count);
+}
+
+/**
+ * Joins and refits the strokes of the canvas so they look the same at the
+ * current zoom, see compact.h.
+ */
+void vn_compact(VnCtx *vn) {
+    CompactOptions opts = compact_defaultOptions();
+    opts.scale = vn->view_scale;
+
+    double t = glfwGetTime();
+    CompactStats stats;
+    vn->path_cnt = compact_paths(vn->paths, vn->path_cnt, &opts, &stats);
+    vn_pageEdited(vn);
+    printf("Compacted the canvas in %f s\n", glfwGetTime() - t);
+    compact_printStats(&stats);
+
+    // Merged strokes were freed
+    if (vn->tools[TOOLS_select])
+        select_clear(vn->tools[TOOLS_select]);
+    if (vn->thumbs)
+        thumb_check(vn->thumbs, vn->notebook->active, vn->paths, vn->path_cnt);
+}
+
+/**
+ * Reports an edit of the paths on the canvas, e.g. moved paths. The notebook
+ * saves the page and counts its memory again the next time it gets the paths.
+ */
+void vn_pageEdited(VnCtx *vn) {
+    vn->page_edited = true;
+}
+
+/**
+ * Imports an SVG or polyline file into the canvas. Polylines are fitted at the
+ * current view scale. Images are placed at the mouse position and decoded in
+ * the background, they count as no paths. Returns the number of imported
+ * paths.
+ */
+unsigned vn_importFile(VnCtx *vn, const char *filename) {
+    if (image_isSupported(filename)) {
+        vn_addImage(vn, filename, screenToCanvas(vn->mouse_pos));
+        return 0;
+    }
+
+    double t = glfwGetTime();
+
+    unsigned count = 0;
+    Path **paths = import_file(filename, vn->view_scale, &count);
+    if (!paths)
+        return 0;
+
+    vn_addPaths(vn, paths, count);
+    free(paths);
+
+    printf("Imported %u paths from %s in %f s, total %u paths\n",
+            count, filename, glfwGetTime() - t, vn->path_cnt);
+    return count;
+}
+
+/**
+ * Hands the paths back to the active notebook page, with the edits since the
+ * last time.
+ */
+static void storeActivePage(VnCtx *vn) {
+    Notebook *nb = vn->notebook;
+    notebook_storeActive(nb, vn->paths, vn->path_cnt, vn->path_capacity);
+    if (vn->page_edited)
+        notebook_markDirty(nb);
+    vn->page_edited = false;
+}
+
+/**
+ * Takes the paths of the active notebook page. The GPU buffers only hold the
+ * paths of one page, so all of them are uploaded again.
+ */
+static void takeActivePage(VnCtx *vn) {
+    Page *page = &vn->notebook->pages[vn->notebook->active];
+    vn->paths = page->paths;
+    vn->path_cnt = page->path_cnt;
+    vn->path_capacity = page->path_capacity;
+
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        vn->paths[i]->gpu_valid = false;
+        vn->paths[i]->flat_cnt = 0;
+    }
+    vn->geom_used = 0;
+    vn->geom_generation++;
+    vn->flat_used = 0;
+
+    thumb_check(vn->thumbs, vn->notebook->active, vn->paths, vn->path_cnt);
+
+    // The selection refers to paths of the previous page
+    if (vn->tools[TOOLS_select])
+        select_clear(vn->tools[TOOLS_select]);
+}
+
+/**
+ * Opens a notebook, the canvas shows its first page from then on. Paths
+ * already on the canvas are added to that page. `budget` is the memory for
+ * resident pages in bytes, 0 for the default.
+ */
+bool vn_openNotebook(VnCtx *vn, const char *dir, size_t budget) {
+    if (vn->notebook) {
+        printf("Error(Notebook): A notebook is open already\n");
+        return false;
+    }
+
+    Notebook *nb = notebook_open(dir, budget);
+    if (!nb)
+        return false;
+
+    Path **paths = vn->paths;
+    unsigned path_cnt = vn->path_cnt;
+    vn->notebook = nb;
+    vn->thumbs = thumb_open(nb);
+    takeActivePage(vn);
+    vn_addPaths(vn, paths, path_cnt);
+    free(paths);
+
+    printf("Opened notebook %s, %u pages, %lu cached thumbnails\n",
+            dir, nb->page_cnt, vn->thumbs->loaded);
+    return true;
+}
+
+/**
+ * Flips to notebook page `index`, one past the last page adds a page.
+ */
+bool vn_setPage(VnCtx *vn, unsigned index) {
+    Notebook *nb = vn->notebook;
+    if (!nb || index > nb->page_cnt)
+        return false;
+
+    double t = glfwGetTime();
+    unsigned prev = nb->active;
+    thumb_check(vn->thumbs, prev, vn->paths, vn->path_cnt);
+    storeActivePage(vn);
+    if (!notebook_activate(nb, index)) {
+        notebook_activate(nb, prev);
+        return false;
+    }
+    takeActivePage(vn);
+    notebook_evict(nb);
+
+    unsigned resident = 0;
+    for (unsigned i = 0; i < nb->page_cnt; i++)
+        resident += nb->pages[i].resident;
+    printf("Page %u/%u, %u paths in %f s, %u pages resident (%.1f MB)\n",
+            index + 1, nb->page_cnt, vn->path_cnt, glfwGetTime() - t,
+            resident, nb->resident_bytes / (1024.0 * 1024.0));
+    return true;
+}
+
+/**
+ * Brings the thumbnail of a page up to date, loading the page if needed.
+ * Cached thumbnails of pages that are not resident are shown as they are.
+ * Returns false if there was nothing to do.
+ */
+static bool updateThumb(VnCtx *vn, unsigned index) {
+    Notebook *nb = vn->notebook;
+    Thumb *thumb = thumb_get(vn->thumbs, index);
+    if (thumb->pixels && !thumb->dirty && (thumb->verified || !nb->pages[index].resident))
+        return false;
+
+    Page *page = notebook_load(nb, index);
+    if (!page)
+        return true;
+    if (!thumb->verified)
+        thumb_check(vn->thumbs, index, page->paths, page->path_cnt);
+    thumb_render(vn->thumbs, index, page->paths, page->path_cnt);
+    return true;
+}
+
+/**
+ * GPU memory of an RGBA8 texture with `levels` mip levels, for mem_track.
+ */
+static size_t textureBytes(unsigned width, unsigned height, unsigned levels) {
+    size_t bytes = 0;
+    for (unsigned l = 0; l < levels; l++) {
+        bytes += (size_t)width * height * 4;
+        width = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    return bytes;
+}
+
+/**
+ * GPU memory of an image tile texture, with its full mip chain.
+ */
+static size_t tileTextureBytes(void) {
+    return textureBytes(IMAGE_TILE_TEXELS, IMAGE_TILE_TEXELS,
+            (unsigned)floor(log2(IMAGE_TILE_TEXELS)) + 1);
+}
+
+/**
+ * Uploads the tiles of all levels that changed since the last upload. The
+ * levels of the thumbnail are the mipmaps of its texture.
+ */
+static void uploadThumb(VnCtx *vn, Thumb *thumb) {
+    if (!thumb->stale)
+        return;
+
+    if (!thumb->texture) {
+        glGenTextures(1, &thumb->texture);
+        glBindTexture(GL_TEXTURE_2D, thumb->texture);
+        glTexStorage2D(GL_TEXTURE_2D, THUMB_LEVELS, GL_RGBA8, THUMB_WIDTH, THUMB_HEIGHT);
+        mem_track(MEM_gl, textureBytes(THUMB_WIDTH, THUMB_HEIGHT, THUMB_LEVELS));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, THUMB_LEVELS - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        thumb->vg_image = nvglCreateImageFromHandleGL3(vn->vg, thumb->texture,
+                THUMB_WIDTH, THUMB_HEIGHT, NVG_IMAGE_NODELETE);
+        thumb->stale = THUMB_ALL_TILES;
+    } else {
+        glBindTexture(GL_TEXTURE_2D, thumb->texture);
+    }
+
+    for (unsigned l = 0; l < THUMB_LEVELS; l++) {
+        const uint8_t *pixels = thumb_level(thumb, l);
+        unsigned width = THUMB_WIDTH >> l;
+        unsigned size = THUMB_TILE_SIZE >> l;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+
+        for (unsigned t = 0; t < THUMB_TILES_X * THUMB_TILES_Y; t++) {
+            if (!(thumb->stale & (1u << t)))
+                continue;
+            unsigned x = (t % THUMB_TILES_X) * size;
+            unsigned y = (t / THUMB_TILES_X) * size;
+            glTexSubImage2D(GL_TEXTURE_2D, l, x, y, size, size, GL_RGBA, GL_UNSIGNED_BYTE,
+                    pixels + ((size_t)y * width + x) * 4);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    thumb->stale = 0;
+}
+
+/**
+ * Draws the thumbnails of the notebook pages in a grid, the active page
+ * highlighted. Only the visible thumbnails are built, a few per frame.
+ */
+void vn_drawPageGrid(VnCtx *vn) {
+    Notebook *nb = vn->notebook;
+    NVGcontext *vg = vn->vg;
+
+    storeActivePage(vn);
+    scrollGrid(vn, 0);
+
+    float cell_w, cell_h;
+    gridCellSize(vn, &cell_w, &cell_h);
+    unsigned first = (unsigned)(vn->grid_scroll / cell_h) * vn->grid_columns;
+    unsigned last = (unsigned)ceil((vn->grid_scroll + vn->view_height) / cell_h) * vn->grid_columns;
+    if (last > nb->page_cnt)
+        last = nb->page_cnt;
+
+    unsigned budget = GRID_RENDER_BUDGET;
+    nvgBeginFrame(vg, vn->view_width, vn->view_height, 1.0);
+    for (unsigned i = first; i < last; i++) {
+        if (budget > 0 && updateThumb(vn, i))
+            budget--;
+        Thumb *thumb = thumb_get(vn->thumbs, i);
+        uploadThumb(vn, thumb);
+
+        float x = (i % vn->grid_columns) * cell_w + GRID_MARGIN;
+        float y = (i / vn->grid_columns) * cell_h + GRID_MARGIN - vn->grid_scroll;
+        float w = cell_w - 2*GRID_MARGIN;
+        float h = cell_h - 2*GRID_MARGIN;
+
+        nvgBeginPath(vg);
+        nvgRect(vg, x, y, w, h);
+        if (thumb->texture)
+            nvgFillPaint(vg, nvgImagePattern(vg, x, y, w, h, 0, thumb->vg_image, 1.0f));
+        else
+            nvgFillColor(vg, nvgRGBA(128, 128, 128, 48));
+        nvgFill(vg);
+
+        bool active = i == nb->active;
+        nvgStrokeWidth(vg, active ? 3.0f : 1.0f);
+        nvgStrokeColor(vg, active ? nvgRGBA(82, 144, 242, 255) : nvgRGBA(160, 160, 160, 255));
+        nvgStroke(vg);
+    }
+    nvgEndFrame(vg);
+
+    notebook_evict(nb);
+}
+
+/**
+ * Stores the thumbnails of the notebook before it is closed. Thumbnails of
+ * resident pages are completed, then the pages are saved, so the cached
+ * thumbnails are stored with the sizes of the saved page files.
+ */
+static void closeThumbs(VnCtx *vn) {
+    Notebook *nb = vn->notebook;
+    ThumbCache *cache = vn->thumbs;
+
+    thumb_check(cache, nb->active, vn->paths, vn->path_cnt);
+    for (unsigned i = 0; i < nb->page_cnt; i++) {
+        Page *page = &nb->pages[i];
+        if (!page->resident)
+            continue;
+        thumb_render(cache, i, page->paths, page->path_cnt);
+        if (page->dirty)
+            notebook_savePage(nb, i);
+    }
+    thumb_save(cache, nb);
+
+    for (unsigned i = 0; i < cache->thumb_cnt; i++) {
+        Thumb *thumb = &cache->thumbs[i];
+        if (!thumb->texture)
+            continue;
+        nvgDeleteImage(vn->vg, thumb->vg_image);
+        glDeleteTextures(1, &thumb->texture);
+        mem_track(MEM_gl, -(ptrdiff_t)textureBytes(THUMB_WIDTH, THUMB_HEIGHT, THUMB_LEVELS));
+    }
+    thumb_close(cache);
+    vn->thumbs = NULL;
+}
+
+/**
+ * Loads the font for text notes, or a default font if `filename` is NULL.
+ */
+bool vn_loadFont(VnCtx *vn, const char *filename) {
+    if (vn->font_ready) {
+        if (vn->window)
+            glDeleteTextures(1, &vn->font_texture);
+        mem_track(MEM_gl, -(ptrdiff_t)vn->font_texture_bytes);
+        vn->font_texture_bytes = 0;
+        font_deinit(&vn->font);
+        for (unsigned i = 0; i < vn->note_cnt; i++)
+            vn->notes[i]->layout_valid = false;
+    }
+
+    vn->font_ready = font_init(&vn->font, filename);
+    if (!vn->font_ready)
+        return false;
+    if (!vn->window)
+        return true;
+
+    // Distance fields interpolate well, so linear filtering
+    glGenTextures(1, &vn->font_texture);
+    glBindTexture(GL_TEXTURE_2D, vn->font_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
+}
+
+void vn_addNote(VnCtx *vn, TextNote *note) {
+    if (vn->note_cnt >= vn->note_capacity) {
+        vn->note_capacity = vn->note_capacity ? vn->note_capacity*2 : 16;
+        vn->notes = realloc(vn->notes, vn->note_capacity * sizeof(TextNote*));
+        assert(vn->notes != NULL);
+    }
+    vn->notes[vn->note_cnt++] = note;
+}
+
+/**
+ * Removes a note from the canvas, without freeing it.
+ */
+void vn_removeNote(VnCtx *vn, TextNote *note) {
+    for (unsigned i = 0; i < vn->note_cnt; i++) {
+        if (vn->notes[i] == note) {
+            memmove(&vn->notes[i], &vn->notes[i+1], (vn->note_cnt - i - 1) * sizeof(TextNote*));
+            vn->note_cnt--;
+            return;
+        }
+    }
+}
+
+/**
+ * Adds an image with its top-left corner at `pos`, at its pixel size on screen.
+ * Returns NULL if the file is no image.
+ */
+Image *vn_addImage(VnCtx *vn, const char *filename, Vec2 pos) {
+    Image *image = image_load(filename, pos, 1.0 / vn->view_scale);
+    if (!image)
+        return NULL;
+
+    if (vn->image_cnt >= vn->image_capacity) {
+        vn->image_capacity = vn->image_capacity ? vn->image_capacity*2 : 4;
+        vn->images = realloc(vn->images, vn->image_capacity * sizeof(Image*));
+        assert(vn->images != NULL);
+    }
+    vn->images[vn->image_cnt++] = image;
+    return image;
+}
+
+static void deleteImage(VnCtx *vn, Image *image) {
+    if (atomic_load(&image->state) == IMAGE_ready) {
+        for (unsigned l = 0; l < image->level_cnt; l++) {
+            ImageLevel *level = &image->levels[l];
+            for (unsigned i = 0; i < level->tiles_x * level->tiles_y; i++) {
+                ImageTile *tile = &level->tiles[i];
+                if (!tile->texture)
+                    continue;
+                nvgDeleteImage(vn->vg, tile->vg_image);
+                glDeleteTextures(1, &tile->texture);
+                mem_track(MEM_gl, -(ptrdiff_t)tileTextureBytes());
+            }
+        }
+    }
+    image_deinit(image);
+}
+
+/**
+ * Composes the path transform with the view transform. The path translation
+ * and the view origin are subtracted before scaling, so the result stays
+ * accurate when both are large (deep zoom, far from the canvas origin).
+ */
+Affine vn_pathToScreen(VnCtx *vn, Path *path) {
+    Affine m = path->transform;
+    double s = vn->view_scale;
+
+    m.a *= s;
+    m.b *= s;
+    m.c *= s;
+    m.d *= s;
+    m.e = (m.e - vn->view_origin.x) * s;
+    m.f = (m.f - vn->view_origin.y) * s;
+    return m;
+}
+
+/**
+ * Note layout (atlas pixels) to screen, like vn_pathToScreen.
+ */
+Affine vn_noteToScreen(VnCtx *vn, TextNote *note) {
+    double s = vn->view_scale;
+
+    Affine m = affine_scale(note->size / FONT_SDF_SIZE * s);
+    m.e = (note->pos.x - vn->view_origin.x) * s;
+    m.f = (note->pos.y - vn->view_origin.y) * s;
+    return m;
+}
+
+static void strokePath(NVGcontext *vg, Affine m, Path *path) {
+    nvgBeginPath(vg);
+    nvgStrokeColor(vg, nvgRGBA(230, 20, 15, 255));
+
+    Vec2 p = affine_apply(m, path->nodes[0]);
+    nvgMoveTo(vg, p.x, p.y);
     for (size_t j = 1; j < path->node_cnt; j+=3) {
-        Vec2 p0 = canvasToScreen(path->nodes[j]);
-        Vec2 p1 = canvasToScreen(path->nodes[j+1]);
-        Vec2 p2 = canvasToScreen(path->nodes[j+2]);
+        Vec2 p0 = affine_apply(m, path->nodes[j]);
+        Vec2 p1 = affine_apply(m, path->nodes[j+1]);
+        Vec2 p2 = affine_apply(m, path->nodes[j+2]);
 
-        nvgBezierTo(vn->vg,
+        nvgBezierTo(vg,
                 p0.x, p0.y,
                 p1.x, p1.y,
                 p2.x, p2.y);
     }
-    nvgStroke(vn->vg);
+    nvgStroke(vg);
+}
+
+void vn_drawPath(VnCtx *vn, Path *path) {
+    assert(vn->vg != NULL);
+    strokePath(vn->vg, vn_pathToScreen(vn, path), path);
+}
+
+/**
+ * Makes sure the geometry buffer can hold `count` more vertices. When it has
+ * to grow, all live paths are uploaded again, which also drops the space of
+ * removed paths.
+ */
+static void reserveGeometry(VnCtx *vn, unsigned count) {
+    if (vn->geom_used + count <= vn->geom_capacity)
+        return;
+
+    unsigned live = count;
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        // Shared nodes count for the first instance
+        if (!path->shared || path->shared->gpu_generation == vn->geom_generation) {
+            live += path->node_cnt;
+            if (path->shared)
+                path->shared->gpu_generation = 0;
+        }
+        path->gpu_valid = false;
+    }
+    vn->geom_generation++;
+
+    unsigned capacity = vn->geom_capacity ? vn->geom_capacity : 4096;
+    while (capacity < 2*live)
+        capacity *= 2;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[VBO_geometry]);
+    glBufferData(GL_ARRAY_BUFFER, capacity * 2*sizeof(float), NULL, GL_STATIC_DRAW);
+    mem_track(MEM_gl, (ptrdiff_t)(capacity - vn->geom_capacity) * 2*sizeof(float));
+    vn->geom_capacity = capacity;
+    vn->geom_used = 0;
+}
+
+/**
+ * Makes sure the shared patch index buffer covers `segments` segments. Segment
+ * k uses nodes 3k..3k+3, drawn with the path offset as base vertex.
+ */
+static void reserveIndices(VnCtx *vn, unsigned segments) {
+    if (segments <= vn->geom_segments)
+        return;
+
+    unsigned cnt = vn->geom_segments ? vn->geom_segments : 256;
+    while (cnt < segments)
+        cnt *= 2;
+
+    GLuint *indices = malloc(cnt * 4 * sizeof(GLuint));
+    assert(indices != NULL);
+    for (unsigned k = 0; k < cnt; k++) {
+        for (unsigned j = 0; j < 4; j++)
+            indices[4*k + j] = 3*k + j;
+    }
+
+    glBindVertexArray(vn->vaos[VAO_geometry]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vn->geom_ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, cnt * 4 * sizeof(GLuint), indices, GL_STATIC_DRAW);
+    mem_track(MEM_gl, (ptrdiff_t)(cnt - vn->geom_segments) * 4 * sizeof(GLuint));
+    free(indices);
+
+    vn->geom_segments = cnt;
+}
+
+/**
+ * Uploads the nodes of a path as float32. As the nodes are relative to the
+ * path origin (see path_localize), this conversion keeps them exact. An
+ * instance of shared nodes that are already uploaded just draws from there.
+ */
+static void uploadPath(VnCtx *vn, Path *path) {
+    if (path->shared && path->shared->gpu_generation == vn->geom_generation) {
+        path->gpu_offset = path->shared->gpu_offset;
+        path->gpu_valid = true;
+        return;
+    }
+
+    if (path->node_cnt > vn->geom_scratch_capacity) {
+        vn->geom_scratch_capacity = path->node_cnt;
+        vn->geom_scratch = realloc(vn->geom_scratch, vn->geom_scratch_capacity * 2*sizeof(float));
+        assert(vn->geom_scratch != NULL);
+    }
+
+    for (unsigned i = 0; i < path->node_cnt; i++) {
+        vn->geom_scratch[2*i] = path->nodes[i].x;
+        vn->geom_scratch[2*i + 1] = path->nodes[i].y;
+    }
+
+    // May invalidate all paths, so done before taking the offset
+    reserveGeometry(vn, path->node_cnt);
+
+    path->gpu_offset = vn->geom_used;
+    path->gpu_valid = true;
+    vn->geom_used += path->node_cnt;
+    if (path->shared) {
+        path->shared->gpu_offset = path->gpu_offset;
+        path->shared->gpu_generation = vn->geom_generation;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[VBO_geometry]);
+    glBufferSubData(GL_ARRAY_BUFFER, path->gpu_offset * 2*sizeof(float),
+            path->node_cnt * 2*sizeof(float), vn->geom_scratch);
+}
+
+static bool boxOnScreen(VnCtx *vn, Affine m, Vec2 bbox_min, Vec2 bbox_max) {
+    Vec2 corners[4] = {
+        bbox_min,
+        { bbox_max.x, bbox_min.y },
+        bbox_max,
+        { bbox_min.x, bbox_max.y },
+    };
+
+    Vec2 min = { INFINITY, INFINITY };
+    Vec2 max = { -INFINITY, -INFINITY };
+    for (int i = 0; i < 4; i++) {
+        Vec2 c = affine_apply(m, corners[i]);
+        min.x = fmin(min.x, c.x);
+        min.y = fmin(min.y, c.y);
+        max.x = fmax(max.x, c.x);
+        max.y = fmax(max.y, c.y);
+    }
+
+    return max.x >= 0 && max.y >= 0
+        && min.x <= vn->view_width && min.y <= vn->view_height;
+}
+
+static bool pathOnScreen(VnCtx *vn, Affine m, Path *path) {
+    return boxOnScreen(vn, m, path->bbox_min, path->bbox_max);
+}
+
+typedef struct vg_batch {
+    VnCtx *vn;
+    unsigned bounds[VN_MAX_VG_WORKERS + 1]; // Visible path range per worker
+} VgBatch;
+
+static void tessellateJob(void *ctx, size_t begin, size_t end) {
+    VgBatch *batch = ctx;
+    VnCtx *vn = batch->vn;
+
+    for (size_t w = begin; w < end; w++) {
+        NVGcontext *vg = vn->vg_workers[w];
+
+        // Same state as set up by vn_update for the main context
+        nvgBeginFrame(vg, vn->view_width, vn->view_height, 1.0);
+        nvgLineCap(vg, NVG_ROUND);
+        nvgLineJoin(vg, NVG_MITER);
+        nvgStrokeWidth(vg, 2.0f);
+
+        for (unsigned i = batch->bounds[w]; i < batch->bounds[w+1]; i++) {
+            Path *path = vn->visible[i];
+            strokePath(vg, vn_pathToScreen(vn, path), path);
+        }
+    }
+}
+
+/**
+ * Draws the visible paths with nanovg. On dense pages the paths are split into
+ * one contiguous range per worker context, with about the same number of
+ * nodes each. The workers flatten and expand their range in parallel, then the
+ * recorded calls are submitted in range order, so the result is the same as
+ * drawing them one by one.
+ */
+void vn_drawPathsNanovg(VnCtx *vn) {
+    if (vn->path_cnt > vn->visible_capacity) {
+        vn->visible_capacity = vn->path_cnt * 2;
+        vn->visible = realloc(vn->visible, vn->visible_capacity * sizeof(Path*));
+        assert(vn->visible != NULL);
+    }
+
+    unsigned visible_cnt = 0;
+    unsigned long nodes = 0;
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        if (path->node_cnt < 1 || !pathOnScreen(vn, vn_pathToScreen(vn, path), path))
+            continue;
+
+        vn->visible[visible_cnt++] = path;
+        nodes += path->node_cnt;
+    }
+
+    if (vn->vg_worker_cnt < 2 || visible_cnt < VG_PARALLEL_MIN_PATHS) {
+        for (unsigned i = 0; i < visible_cnt; i++)
+            vn_drawPath(vn, vn->visible[i]);
+        return;
+    }
+
+    VgBatch batch = { .vn = vn };
+    unsigned long acc = 0;
+    unsigned w = 1;
+    for (unsigned i = 0; i < visible_cnt && w < vn->vg_worker_cnt; i++) {
+        acc += vn->visible[i]->node_cnt;
+        while (w < vn->vg_worker_cnt && acc * vn->vg_worker_cnt >= nodes * w)
+            batch.bounds[w++] = i + 1;
+    }
+    while (w <= vn->vg_worker_cnt)
+        batch.bounds[w++] = visible_cnt;
+
+    jobs_parallelFor(vn->vg_worker_cnt, 1, tessellateJob, &batch);
+
+    for (unsigned i = 0; i < vn->vg_worker_cnt; i++)
+        nvgSubmitWorker(vn->vg, vn->vg_workers[i]);
+}
+
+/**
+ * Uploads all bezier paths that are not in the geometry buffer yet.
+ */
+static void uploadPaths(VnCtx *vn) {
+    // Upload new and changed paths first, this may reallocate the buffer
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        if (!path->gpu_valid && path->type == PATHTYPE_bezier && path->node_cnt >= 4)
+            uploadPath(vn, path);
+    }
+    // A reallocation during the uploads invalidates the paths before it
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        if (!path->gpu_valid && path->type == PATHTYPE_bezier && path->node_cnt >= 4)
+            uploadPath(vn, path);
+    }
+}
+
+/**
+ * Draws all bezier paths from the resident GPU geometry. Per path only the
+ * composed transform is uploaded: the linear part and the (small) screen
+ * offset of the path origin, both calculated in double.
+ */
+void vn_drawPathsGpu(VnCtx *vn) {
+    GLuint program = vn->shaders[SHADER_path];
+
+    uploadPaths(vn);
+
+    glUseProgram(program);
+    glBindVertexArray(vn->vaos[VAO_geometry]);
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+
+    GLint linear_loc = glGetUniformLocation(program, "linear");
+    GLint offset_loc = glGetUniformLocation(program, "offset");
+    GLint color_loc = glGetUniformLocation(program, "color");
+    glUniform4f(color_loc, 230.0f/255, 20.0f/255, 15.0f/255, 1.0f);
+
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        if (!path->gpu_valid)
+            continue;
+
+        Affine m = vn_pathToScreen(vn, path);
+        if (!pathOnScreen(vn, m, path))
+            continue;
+
+        unsigned segments = (path->node_cnt - 1) / 3;
+        reserveIndices(vn, segments);
+
+        glUniform4f(linear_loc, m.a, m.b, m.c, m.d);
+        glUniform2f(offset_loc, m.e, m.f);
+        glDrawElementsBaseVertex(GL_PATCHES, segments * 4, GL_UNSIGNED_INT,
+                NULL, path->gpu_offset);
+    }
+
+    glBindVertexArray(0);
+}
+
+/**
+ * Like reserveGeometry, for the stroke buffer.
+ */
+static void reserveFlat(VnCtx *vn, unsigned count) {
+    if (vn->flat_used + count <= vn->flat_capacity)
+        return;
+
+    unsigned live = count;
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        live += vn->paths[i]->flat_cnt;
+        vn->paths[i]->flat_cnt = 0;
+    }
+
+    unsigned capacity = vn->flat_capacity ? vn->flat_capacity : 16384;
+    while (capacity < 2*live)
+        capacity *= 2;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[VBO_stroke]);
+    glBufferData(GL_ARRAY_BUFFER, capacity * 2*sizeof(float), NULL, GL_STATIC_DRAW);
+    mem_track(MEM_gl, (ptrdiff_t)(capacity - vn->flat_capacity) * 2*sizeof(float));
+    vn->flat_capacity = capacity;
+    vn->flat_used = 0;
+}
+
+static unsigned flattenSteps(Vec2 *v, double scale) {
+    // Control polygon length bounds the curve length, like bezier.tcs
+    double len = (vec2_dist(v[0], v[1]) + vec2_dist(v[1], v[2])
+            + vec2_dist(v[2], v[3])) * scale;
+    return fmin(fmax(ceil(len / FLATTEN_TOL), 1.0), 64.0);
+}
+
+/**
+ * Appends a point to the scratch buffer, unless it is equal to the previous
+ * one in float32. Zero length segments have no direction to stroke.
+ */
+static void flatPoint(VnCtx *vn, unsigned *cnt, Vec2 p) {
+    float x = p.x, y = p.y;
+    float *prev = &vn->geom_scratch[2*(*cnt - 1)];
+    if (prev[0] == x && prev[1] == y)
+        return;
+
+    vn->geom_scratch[2*(*cnt)] = x;
+    vn->geom_scratch[2*(*cnt) + 1] = y;
+    (*cnt)++;
+}
+
+/**
+ * Flattens a bezier path into line segments of about FLATTEN_TOL pixels at the
+ * current scale and uploads it as a line strip with adjacency: the first and
+ * last point are repeated, which the geometry shader draws as caps. Points are
+ * relative to the path origin, as for the geometry buffer.
+ */
+static void flattenPath(VnCtx *vn, Path *path, double scale) {
+    unsigned segments = (path->node_cnt - 1) / 3;
+
+    unsigned max_cnt = 3;
+    for (unsigned k = 0; k < segments; k++)
+        max_cnt += flattenSteps(&path->nodes[3*k], scale);
+
+    if (max_cnt > vn->geom_scratch_capacity) {
+        vn->geom_scratch_capacity = max_cnt;
+        vn->geom_scratch = realloc(vn->geom_scratch, vn->geom_scratch_capacity * 2*sizeof(float));
+        assert(vn->geom_scratch != NULL);
+    }
+
+    // Index 0 is the leading adjacency point, copied from index 1 at the end
+    vn->geom_scratch[2] = path->nodes[0].x;
+    vn->geom_scratch[3] = path->nodes[0].y;
+    unsigned cnt = 2;
+
+    for (unsigned k = 0; k < segments; k++) {
+        Vec2 *v = &path->nodes[3*k];
+        unsigned steps = flattenSteps(v, scale);
+        for (unsigned i = 1; i <= steps; i++) {
+            double u = (double)i / steps;
+            double omu = 1 - u;
+            Vec2 p = vec2_scalarMult(v[0], omu*omu*omu);
+            p = vec2_add(p, vec2_scalarMult(v[1], 3*u*omu*omu));
+            p = vec2_add(p, vec2_scalarMult(v[2], 3*u*u*omu));
+            p = vec2_add(p, vec2_scalarMult(v[3], u*u*u));
+            flatPoint(vn, &cnt, p);
+        }
+    }
+
+    path->flat_scale = scale;
+    path->flat_empty = cnt < 3;
+    if (path->flat_empty) {
+        // All points are the same, nothing to stroke until zoomed in
+        path->flat_cnt = 0;
+        return;
+    }
+
+    vn->geom_scratch[0] = vn->geom_scratch[2];
+    vn->geom_scratch[1] = vn->geom_scratch[3];
+    vn->geom_scratch[2*cnt] = vn->geom_scratch[2*(cnt-1)];
+    vn->geom_scratch[2*cnt + 1] = vn->geom_scratch[2*(cnt-1) + 1];
+    cnt++;
+
+    // May drop the flattened data of all paths, so done before the offset
+    reserveFlat(vn, cnt);
+
+    path->flat_offset = vn->flat_used;
+    path->flat_cnt = cnt;
+    vn->flat_used += cnt;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[VBO_stroke]);
+    glBufferSubData(GL_ARRAY_BUFFER, path->flat_offset * 2*sizeof(float),
+            cnt * 2*sizeof(float), vn->geom_scratch);
+}
+
+/**
+ * Draws all bezier paths as strokes expanded by the geometry shader. Paths are
+ * only flattened again when the zoom changed a lot since the last time, so in
+ * most frames the CPU only sets two uniforms per path.
+ */
+void vn_drawPathsStroke(VnCtx *vn) {
+    GLuint program = vn->shaders[SHADER_stroke];
+
+    // Flatten new and zoomed paths first, this may reallocate the buffer,
+    // which drops the paths before it. Off-screen paths wait until visible.
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < vn->path_cnt; i++) {
+            Path *path = vn->paths[i];
+            if (path->type != PATHTYPE_bezier || path->node_cnt < 4)
+                continue;
+
+            Affine m = vn_pathToScreen(vn, path);
+            double scale = affine_scaleFactor(m);
+            double ratio = scale / path->flat_scale;
+            bool flattened = path->flat_cnt > 0 || path->flat_empty;
+            if ((!flattened || ratio > 2.0 || ratio < 0.25)
+                    && pathOnScreen(vn, m, path))
+                flattenPath(vn, path, scale);
+        }
+    }
+
+    glUseProgram(program);
+    glBindVertexArray(vn->vaos[VAO_stroke]);
+    glVertexAttrib1f(1, 1.0f);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+
+    GLint linear_loc = glGetUniformLocation(program, "linear");
+    GLint offset_loc = glGetUniformLocation(program, "offset");
+    GLint color_loc = glGetUniformLocation(program, "color");
+    GLint width_loc = glGetUniformLocation(program, "strokeWidth");
+    glUniform4f(color_loc, 230.0f/255, 20.0f/255, 15.0f/255, 1.0f);
+    glUniform1f(width_loc, 2.0f);
+
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        if (path->flat_cnt == 0)
+            continue;
+
+        Affine m = vn_pathToScreen(vn, path);
+        if (!pathOnScreen(vn, m, path))
+            continue;
+
+        glUniform4f(linear_loc, m.a, m.b, m.c, m.d);
+        glUniform2f(offset_loc, m.e, m.f);
+        glDrawArrays(GL_LINE_STRIP_ADJACENCY, path->flat_offset, path->flat_cnt);
+    }
+
+    glBindVertexArray(0);
+}
+
+/**
+ * Draws all bezier paths from the geometry buffer as one instanced quad per
+ * segment, the fragment shader computes the distance to the curve. A single
+ * pass without any tessellation, so the quality does not depend on the zoom.
+ */
+void vn_drawPathsSdf(VnCtx *vn) {
+    GLuint program = vn->shaders[SHADER_sdf];
+
+    uploadPaths(vn);
+
+    glUseProgram(program);
+    glBindVertexArray(vn->vaos[VAO_sdf]);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+
+    GLint linear_loc = glGetUniformLocation(program, "linear");
+    GLint offset_loc = glGetUniformLocation(program, "offset");
+    GLint count_loc = glGetUniformLocation(program, "segmentCount");
+    GLint color_loc = glGetUniformLocation(program, "color");
+    GLint width_loc = glGetUniformLocation(program, "strokeWidth");
+    glUniform4f(color_loc, 230.0f/255, 20.0f/255, 15.0f/255, 1.0f);
+    glUniform1f(width_loc, 2.0f);
+
+    for (unsigned i = 0; i < vn->path_cnt; i++) {
+        Path *path = vn->paths[i];
+        if (!path->gpu_valid)
+            continue;
+
+        Affine m = vn_pathToScreen(vn, path);
+        if (!pathOnScreen(vn, m, path))
+            continue;
+
+        unsigned segments = (path->node_cnt - 1) / 3;
+        glBindVertexBuffer(0, vn->vbos[VBO_geometry],
+                path->gpu_offset * 2*sizeof(float), 3 * 2*sizeof(float));
+
+        glUniform4f(linear_loc, m.a, m.b, m.c, m.d);
+        glUniform2f(offset_loc, m.e, m.f);
+        glUniform1i(count_loc, segments);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, segments);
+    }
+
+    glBindVertexArray(0);
+}
+
+/**
+ * Like reserveGeometry, for the text buffer.
+ */
+static void reserveText(VnCtx *vn, unsigned count) {
+    if (vn->text_used + count <= vn->text_capacity)
+        return;
+
+    unsigned live = count;
+    for (unsigned i = 0; i < vn->note_cnt; i++) {
+        live += vn->notes[i]->vert_cnt;
+        vn->notes[i]->gpu_valid = false;
+    }
+
+    unsigned capacity = vn->text_capacity ? vn->text_capacity : 6 * 1024;
+    while (capacity < 2*live)
+        capacity *= 2;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[VBO_text]);
+    glBufferData(GL_ARRAY_BUFFER, capacity * 4*sizeof(float), NULL, GL_STATIC_DRAW);
+    mem_track(MEM_gl, (ptrdiff_t)(capacity - vn->text_capacity) * 4*sizeof(float));
+    vn->text_capacity = capacity;
+    vn->text_used = 0;
+}
+
+static void uploadNote(VnCtx *vn, TextNote *note) {
+    // May invalidate all notes, so done before taking the offset
+    reserveText(vn, note->vert_cnt);
+
+    note->gpu_offset = vn->text_used;
+    note->gpu_valid = true;
+    vn->text_used += note->vert_cnt;
+
+    glBindBuffer(GL_ARRAY_BUFFER, vn->vbos[VBO_text]);
+    glBufferSubData(GL_ARRAY_BUFFER, note->gpu_offset * 4*sizeof(float),
+            note->vert_cnt * 4*sizeof(float), note->verts);
+}
+
+/**
+ * Uploads the atlas rows that got new glyphs, or all of it after it grew.
+ */
+static void uploadAtlas(VnCtx *vn) {
+    FontAtlas *font = &vn->font;
+
+    glBindTexture(GL_TEXTURE_2D, vn->font_texture);
+    if (font->resized) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, font->width, font->height, 0,
+                GL_RED, GL_UNSIGNED_BYTE, font->pixels);
+        size_t bytes = (size_t)font->width * font->height;
+        mem_track(MEM_gl, (ptrdiff_t)bytes - (ptrdiff_t)vn->font_texture_bytes);
+        vn->font_texture_bytes = bytes;
+    } else if (font->dirty_y1 > font->dirty_y0) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, font->dirty_y0, font->width,
+                font->dirty_y1 - font->dirty_y0, GL_RED, GL_UNSIGNED_BYTE,
+                &font->pixels[font->dirty_y0 * font->width]);
+    }
+    font->resized = false;
+    font->dirty_y0 = font->dirty_y1 = 0;
+}
+
+/**
+ * Draws all text notes from the glyph atlas. Only edited notes and notes that
+ * lost glyphs to an atlas eviction are laid out and uploaded again, zooming
+ * and panning just change the note transforms.
+ */
+void vn_drawNotes(VnCtx *vn) {
+    if (!vn->font_ready || vn->note_cnt == 0)
+        return;
+
+    GLuint program = vn->shaders[SHADER_text];
+
+    // Visible notes keep their glyphs first, then the invisible ones can give
+    // up theirs to the notes that are laid out. Off-screen notes wait with
+    // the layout until they are visible, new notes have an empty box at
+    // their position.
+    font_beginFrame(&vn->font);
+    for (unsigned i = 0; i < vn->note_cnt; i++) {
+        TextNote *note = vn->notes[i];
+        if (boxOnScreen(vn, vn_noteToScreen(vn, note), note->bbox_min, note->bbox_max))
+            font_useNote(&vn->font, note);
+    }
+    for (unsigned i = 0; i < vn->note_cnt; i++) {
+        TextNote *note = vn->notes[i];
+        if (!note->layout_valid
+                && boxOnScreen(vn, vn_noteToScreen(vn, note), note->bbox_min, note->bbox_max))
+            font_layout(&vn->font, note);
+    }
+    uploadAtlas(vn);
+
+    // A reallocation during the uploads invalidates the notes before it
+    for (int pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < vn->note_cnt; i++) {
+            TextNote *note = vn->notes[i];
+            if (note->layout_valid && !note->gpu_valid && note->vert_cnt > 0)
+                uploadNote(vn, note);
+        }
+    }
+
+    glUseProgram(program);
+    glBindVertexArray(vn->vaos[VAO_text]);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, vn->font_texture);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+
+    GLint linear_loc = glGetUniformLocation(program, "linear");
+    GLint offset_loc = glGetUniformLocation(program, "offset");
+    GLint color_loc = glGetUniformLocation(program, "color");
+    glUniform1i(glGetUniformLocation(program, "atlas"), 0);
+    glUniform4f(color_loc, 20.0f/255, 20.0f/255, 20.0f/255, 1.0f);
+
+    for (unsigned i = 0; i < vn->note_cnt; i++) {
+        TextNote *note = vn->notes[i];
+        if (!note->layout_valid || !note->gpu_valid || note->vert_cnt == 0)
+            continue;
+
+        Affine m = vn_noteToScreen(vn, note);
+        if (!boxOnScreen(vn, m, note->bbox_min, note->bbox_max))
+            continue;
+
+        glUniform4f(linear_loc, m.a, m.b, m.c, m.d);
+        glUniform2f(offset_loc, m.e, m.f);
+        glDrawArrays(GL_TRIANGLES, note->gpu_offset, note->vert_cnt);
+    }
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Level of the pyramid drawn at the current zoom, the finest level with at
+ * most one level pixel per screen pixel. The tile mipmaps cover the rest.
+ */
+static unsigned imageLevel(VnCtx *vn, Image *image) {
+    double pixel_scale = image->scale * vn->view_scale;
+    int level = pixel_scale >= 1.0 ? 0 : (int)floor(-log2(pixel_scale));
+    return level < (int)image->level_cnt ? (unsigned)level : image->level_cnt - 1;
+}
+
+/**
+ * Range of tiles of a level on screen, `x1` and `y1` exclusive. Returns false
+ * if the image is off-screen.
+ */
+static bool visibleTiles(VnCtx *vn, Image *image, unsigned level,
+        unsigned *x0, unsigned *y0, unsigned *x1, unsigned *y1) {
+    const ImageLevel *l = &image->levels[level];
+
+    // Screen corners in level pixels
+    double s = image->scale * ldexp(1.0, level);
+    Vec2 min = screenToCanvas((Vec2){ 0, 0 });
+    Vec2 max = screenToCanvas((Vec2){ vn->view_width, vn->view_height });
+    double lx0 = (min.x - image->pos.x) / s;
+    double ly0 = (min.y - image->pos.y) / s;
+    double lx1 = (max.x - image->pos.x) / s;
+    double ly1 = (max.y - image->pos.y) / s;
+
+    if (lx1 < 0 || ly1 < 0 || lx0 >= l->width || ly0 >= l->height)
+        return false;
+
+    *x0 = lx0 > 0 ? (unsigned)(lx0 / IMAGE_TILE_SIZE) : 0;
+    *y0 = ly0 > 0 ? (unsigned)(ly0 / IMAGE_TILE_SIZE) : 0;
+    *x1 = lx1 < l->width ? (unsigned)(lx1 / IMAGE_TILE_SIZE) + 1 : l->tiles_x;
+    *y1 = ly1 < l->height ? (unsigned)(ly1 / IMAGE_TILE_SIZE) + 1 : l->tiles_y;
+    return true;
+}
+
+static bool findPendingTile(Image *image, unsigned level,
+        unsigned x0, unsigned y0, unsigned x1, unsigned y1, unsigned *tx, unsigned *ty) {
+    const ImageLevel *l = &image->levels[level];
+    for (unsigned y = y0; y < y1; y++) {
+        for (unsigned x = x0; x < x1; x++) {
+            if (!l->tiles[y*l->tiles_x + x].texture) {
+                *tx = x;
+                *ty = y;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * Picks the tile to upload next: the visible tiles from the coarsest level
+ * down to the drawn one first, so something is on screen right away, then
+ * all others.
+ */
+static Image *nextImageTile(VnCtx *vn, unsigned *level, unsigned *tx, unsigned *ty) {
+    for (unsigned i = 0; i < vn->image_cnt; i++) {
+        Image *image = vn->images[i];
+        if (atomic_load(&image->state) != IMAGE_ready || image->tiles_pending == 0)
+            continue;
+
+        unsigned drawn = imageLevel(vn, image);
+        for (unsigned l = image->level_cnt; l-- > drawn;) {
+            unsigned x0, y0, x1, y1;
+            if (visibleTiles(vn, image, l, &x0, &y0, &x1, &y1)
+                    && findPendingTile(image, l, x0, y0, x1, y1, tx, ty)) {
+                *level = l;
+                return image;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < vn->image_cnt; i++) {
+        Image *image = vn->images[i];
+        if (atomic_load(&image->state) != IMAGE_ready || image->tiles_pending == 0)
+            continue;
+
+        for (unsigned l = image->level_cnt; l-- > 0;) {
+            const ImageLevel *lv = &image->levels[l];
+            if (findPendingTile(image, l, 0, 0, lv->tiles_x, lv->tiles_y, tx, ty)) {
+                *level = l;
+                return image;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Uploads image tiles up to the per-frame budget. Each tile is copied into the
+ * next pixel buffer of the ring and transferred from there, so the driver
+ * copies it to the texture asynchronously. A buffer still in use by the GPU
+ * ends the uploads of this frame.
+ */
+static void uploadImageTiles(VnCtx *vn) {
+    size_t budget = IMAGE_UPLOAD_BUDGET;
+
+    while (budget >= IMAGE_TILE_BYTES) {
+        unsigned level, tx, ty;
+        Image *image = nextImageTile(vn, &level, &tx, &ty);
+        if (!image)
+            break;
+
+        unsigned slot = vn->image_pbo_next;
+        if (vn->image_fences[slot]) {
+            GLenum status = glClientWaitSync(vn->image_fences[slot], 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+                break;
+            glDeleteSync(vn->image_fences[slot]);
+            vn->image_fences[slot] = 0;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, vn->image_pbos[slot]);
+        uint8_t *dest = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, IMAGE_TILE_BYTES,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!dest) {
+            printf("Error(Image): Could not map the upload buffer\n");
+            break;
+        }
+        image_copyTile(image, level, tx, ty, dest);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // Mipmaps within the tile filter zoom levels between the pyramid levels
+        GLuint texture;
+        int mip_cnt = (int)floor(log2(IMAGE_TILE_TEXELS)) + 1;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, mip_cnt, GL_RGBA8, IMAGE_TILE_TEXELS, IMAGE_TILE_TEXELS);
+        mem_track(MEM_gl, tileTextureBytes());
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, IMAGE_TILE_TEXELS, IMAGE_TILE_TEXELS,
+                GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        vn->image_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        vn->image_pbo_next = (slot + 1) % VN_IMAGE_PBO_COUNT;
+
+        ImageLevel *l = &image->levels[level];
+        ImageTile *tile = &l->tiles[ty*l->tiles_x + tx];
+        tile->texture = texture;
+        tile->vg_image = nvglCreateImageFromHandleGL3(vn->vg, texture,
+                IMAGE_TILE_TEXELS, IMAGE_TILE_TEXELS, NVG_IMAGE_NODELETE);
+        image_tileUploaded(image);
+
+        budget -= IMAGE_TILE_BYTES;
+    }
+
+    // Later texture uploads read from client memory again
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+/**
+ * Draws the area of tile `tx`, `ty` of `level` from the finest uploaded tile
+ * covering it, nothing if there is none yet. The transform is in image pixels.
+ */
+static void drawImageTile(NVGcontext *vg, Image *image, unsigned level, unsigned tx, unsigned ty) {
+    const ImageLevel *l = &image->levels[level];
+    double s = ldexp(1.0, level);
+    float x = tx * IMAGE_TILE_SIZE * s;
+    float y = ty * IMAGE_TILE_SIZE * s;
+    float w = fmin((tx + 1) * IMAGE_TILE_SIZE, l->width) * s - x;
+    float h = fmin((ty + 1) * IMAGE_TILE_SIZE, l->height) * s - y;
+    w = fminf(w, image->width - x);
+    h = fminf(h, image->height - y);
+
+    // Tiles of coarser levels cover the tiles of finer ones
+    for (unsigned c = level; c < image->level_cnt; c++) {
+        const ImageLevel *lc = &image->levels[c];
+        unsigned cx = tx >> (c - level);
+        unsigned cy = ty >> (c - level);
+        const ImageTile *tile = &lc->tiles[cy*lc->tiles_x + cx];
+        if (!tile->texture)
+            continue;
+
+        double cs = ldexp(1.0, c);
+        NVGpaint paint = nvgImagePattern(vg,
+                ((double)cx * IMAGE_TILE_SIZE - IMAGE_TILE_BORDER) * cs,
+                ((double)cy * IMAGE_TILE_SIZE - IMAGE_TILE_BORDER) * cs,
+                IMAGE_TILE_TEXELS * cs, IMAGE_TILE_TEXELS * cs, 0, tile->vg_image, 1.0f);
+        nvgBeginPath(vg);
+        nvgRect(vg, x, y, w, h);
+        nvgFillPaint(vg, paint);
+        nvgFill(vg);
+        return;
+    }
+}
+
+/**
+ * Draws the reference images with nanovg, below everything else. Images being
+ * decoded are drawn as a placeholder of their size.
+ */
+void vn_drawImages(VnCtx *vn) {
+    NVGcontext *vg = vn->vg;
+
+    for (unsigned i = 0; i < vn->image_cnt;) {
+        if (atomic_load(&vn->images[i]->state) == IMAGE_failed) {
+            deleteImage(vn, vn->images[i]);
+            memmove(&vn->images[i], &vn->images[i+1], (vn->image_cnt - i - 1) * sizeof(Image*));
+            vn->image_cnt--;
+        } else {
+            i++;
+        }
+    }
+    uploadImageTiles(vn);
+
+    for (unsigned i = 0; i < vn->image_cnt; i++) {
+        Image *image = vn->images[i];
+        Vec2 origin = canvasToScreen(image->pos);
+        double s = image->scale * vn->view_scale;
+
+        nvgSave(vg);
+        nvgTranslate(vg, origin.x, origin.y);
+        nvgScale(vg, s, s);
+
+        if (atomic_load(&image->state) != IMAGE_ready) {
+            nvgBeginPath(vg);
+            nvgRect(vg, 0, 0, image->width, image->height);
+            nvgFillColor(vg, nvgRGBA(128, 128, 128, 48));
+            nvgFill(vg);
+            nvgRestore(vg);
+            continue;
+        }
+
+        // Antialiased edges would show the seams between tiles
+        nvgShapeAntiAlias(vg, 0);
+
+        unsigned level = imageLevel(vn, image);
+        unsigned x0, y0, x1, y1;
+        if (visibleTiles(vn, image, level, &x0, &y0, &x1, &y1)) {
+            for (unsigned ty = y0; ty < y1; ty++) {
+                for (unsigned tx = x0; tx < x1; tx++)
+                    drawImageTile(vg, image, level, tx, ty);
+            }
+        }
+        nvgRestore(vg);
+    }
 }
 
 void vn_drawLines(VnCtx *vn, Path *path) {
@@ -369,7 +2149,9 @@ void vn_drawCtrlPoints(VnCtx *vn, Path *path) {
     GLuint color_loc;
 
     Vec2 *nodes = malloc(sizeof(Vec2) * path->node_cnt);
-    canvasToScreenN(nodes, path->nodes, path->node_cnt);
+    for (size_t i = 0; i < path->node_cnt; i++) {
+        nodes[i] = canvasToScreen(affine_apply(path->transform, path->nodes[i]));
+    }
 
     glBindVertexArray(vn->vaos[VAO_spline]);
 
@@ -0,0 +1,145 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "writer.h"
+
+static const double POW10[WRITER_MAX_PRECISION+1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7,
+    1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+};
+
+// Largest value we format as a scaled integer, beyond this snprintf is used
+#define WRITER_MAX_FIXED 9.0e18
+
+/**
+ * Initialize the writer. If `buf` is NULL a buffer of `capacity` bytes (or
+ * WRITER_DEFAULT_CAPACITY if zero) is allocated.
+ */
+void writer_init(Writer *w, FILE *fp, char *buf, size_t capacity) {
+    w->fp = fp;
+    w->capacity = capacity > 0 ? capacity : WRITER_DEFAULT_CAPACITY;
+    w->owns_buf = buf == NULL;
+    w->buf = buf ? buf : malloc(w->capacity);
+    w->len = 0;
+    w->error = false;
+    w->total = 0;
+
+    assert(w->buf != NULL);
+    assert(w->capacity >= 64);
+}
+
+/**
+ * Flushes the remaining data and frees the buffer if it was allocated by
+ * `writer_init`. Returns false if any write failed. Does not close `fp`.
+ */
+bool writer_deinit(Writer *w) {
+    writer_flush(w);
+    if (w->owns_buf)
+        free(w->buf);
+    w->buf = NULL;
+    return !w->error;
+}
+
+bool writer_flush(Writer *w) {
+    if (w->len > 0 && !w->error) {
+        if (fwrite(w->buf, 1, w->len, w->fp) != w->len)
+            w->error = true;
+    }
+    w->len = 0;
+    return !w->error;
+}
+
+void writer_write(Writer *w, const void *data, size_t len) {
+    const char *src = data;
+    w->total += len;
+
+    while (len > 0) {
+        if (w->len == w->capacity)
+            writer_flush(w);
+
+        size_t n = w->capacity - w->len;
+        if (n > len) n = len;
+
+        memcpy(w->buf + w->len, src, n);
+        w->len += n;
+        src += n;
+        len -= n;
+    }
+}
+
+void writer_puts(Writer *w, const char *str) {
+    writer_write(w, str, strlen(str));
+}
+
+void writer_putc(Writer *w, char c) {
+    if (w->len == w->capacity)
+        writer_flush(w);
+    w->buf[w->len++] = c;
+    w->total += 1;
+}
+
+void writer_putUint(Writer *w, uint64_t v) {
+    char tmp[24];
+    int pos = sizeof(tmp);
+    do {
+        tmp[--pos] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    writer_write(w, tmp + pos, sizeof(tmp) - pos);
+}
+
+/**
+ * Writes `v` with at most `precision` decimals, trailing zeros are dropped.
+ * This does not depend on the locale (always a '.' separator) and does not go
+ * through printf for regular values.
+ */
+void writer_putDouble(Writer *w, double v, unsigned precision) {
+    if (precision > WRITER_MAX_PRECISION)
+        precision = WRITER_MAX_PRECISION;
+
+    if (!isfinite(v)) {
+        writer_putc(w, '0');
+        return;
+    }
+
+    double scaled = fabs(v) * POW10[precision];
+    if (scaled >= WRITER_MAX_FIXED) {
+        // Too large for the integer path, rare enough to not care about speed
+        char tmp[40];
+        int n = snprintf(tmp, sizeof(tmp), "%.*e", (int)precision, v);
+        for (int i = 0; i < n; i++) {
+            if (tmp[i] == ',') tmp[i] = '.';
+        }
+        writer_write(w, tmp, n);
+        return;
+    }
+
+    uint64_t n = (uint64_t)(scaled + 0.5);
+    unsigned frac = precision;
+    while (frac > 0 && n % 10 == 0) {
+        n /= 10;
+        frac--;
+    }
+
+    char tmp[40];
+    int pos = sizeof(tmp);
+    for (unsigned i = 0; i < frac; i++) {
+        tmp[--pos] = '0' + n % 10;
+        n /= 10;
+    }
+    if (frac > 0)
+        tmp[--pos] = '.';
+    do {
+        tmp[--pos] = '0' + n % 10;
+        n /= 10;
+    } while (n);
+
+    // Avoid writing "-0"
+    if (v < 0 && !(pos == (int)sizeof(tmp)-1 && tmp[pos] == '0'))
+        tmp[--pos] = '-';
+
+    writer_write(w, tmp + pos, sizeof(tmp) - pos);
+}